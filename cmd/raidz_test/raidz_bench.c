@@ -171,8 +171,8 @@ run_rec_bench_impl(const char *impl)
 			iter_cnt /= zio_bench.io_size;
 
 			/* calculate how many bad columns there are */
-			nbad = MIN(3, raidz_ncols(rm_bench) -
-			    raidz_parity(rm_bench));
+			nbad = MIN(3, raidz_ncols(rm_bench->rm_row[0]) -
+			    raidz_parity(rm_bench->rm_row[0]));
 
 			start = gethrtime();
 			for (iter = 0; iter < iter_cnt; iter++)
@@ -179,22 +179,23 @@ static void process_options(int argc, char **argv)
 	}
 }
 
-#define	DATA_COL(rm, i) ((rm)->rm_col[raidz_parity(rm) + (i)].rc_abd)
-#define	DATA_COL_SIZE(rm, i) ((rm)->rm_col[raidz_parity(rm) + (i)].rc_size)
+#define	DATA_COL(rr, i) ((rr)->rr_col[raidz_parity(rr) + (i)].rc_abd)
+#define	DATA_COL_SIZE(rr, i) ((rr)->rr_col[raidz_parity(rr) + (i)].rc_size)
 
-#define	CODE_COL(rm, i) ((rm)->rm_col[(i)].rc_abd)
-#define	CODE_COL_SIZE(rm, i) ((rm)->rm_col[(i)].rc_size)
+#define	CODE_COL(rr, i) ((rr)->rr_col[(i)].rc_abd)
+#define	CODE_COL_SIZE(rr, i) ((rr)->rr_col[(i)].rc_size)
 
 static int
 cmp_code(raidz_test_opts_t *opts, const raidz_map_t *rm, const int parity)
 {
+	const raidz_row_t *rr = rm->rm_row[0];
+	const raidz_row_t *rrg = opts->rm_golden->rm_row[0];
 	int i, ret = 0;
 
 	VERIFY(parity >= 1 && parity <= 3);
 
 	for (i = 0; i < parity; i++) {
-		if (abd_cmp(CODE_COL(rm, i), CODE_COL(opts->rm_golden, i))
-		    != 0) {
+		if (abd_cmp(CODE_COL(rr, i), CODE_COL(rrg, i)) != 0) {
 			ret++;
 			LOG_OPT(D_DEBUG, opts,
 			    "\nParity block [%d] different!\n", i);
@@ -206,12 +207,13 @@ cmp_code(raidz_test_opts_t *opts, const raidz_map_t *rm, const int parity)
 static int
 cmp_data(raidz_test_opts_t *opts, raidz_map_t *rm)
 {
+	raidz_row_t *rr = rm->rm_row[0];
+	raidz_row_t *rrg = opts->rm_golden->rm_row[0];
 	int i, ret = 0;
-	int dcols = opts->rm_golden->rm_cols - raidz_parity(opts->rm_golden);
+	int dcols = raidz_ncols(rrg) - raidz_parity(rrg);
 
 	for (i = 0; i < dcols; i++) {
-		if (abd_cmp(DATA_COL(opts->rm_golden, i), DATA_COL(rm, i))
-		    != 0) {
+		if (abd_cmp(DATA_COL(rrg, i), DATA_COL(rr, i)) != 0) {
 			ret++;
 
 			LOG_OPT(D_DEBUG, opts,
@@ -240,7 +242,7 @@ corrupt_colums(raidz_map_t *rm, const int *tgts, const int cnt)
 	raidz_col_t *col;
 
 	for (i = 0; i < cnt; i++) {
-		col = &rm->rm_col[tgts[i]];
+		col = &rm->rm_row[0]->rr_col[tgts[i]];
 		abd_iterate_func(col->rc_abd, 0, col->rc_size, init_rand, NULL);
 	}
 }
@@ -402,6 +404,7 @@ run_gen_check(raidz_test_opts_t *opts)
 static int
 run_rec_check_impl(raidz_test_opts_t *opts, raidz_map_t *rm, const int fn)
 {
+	raidz_row_t *rr = rm->rm_row[0];
 	int x0, x1, x2;
 	int tgtidx[3];
 	int err = 0;
@@ -420,7 +423,7 @@ run_rec_check_impl(raidz_test_opts_t *opts, raidz_map_t *rm, const int fn)
 	if (fn < RAIDZ_REC_PQ) {
 		/* can reconstruct 1 failed data disk */
 		for (x0 = 0; x0 < opts->rto_dcols; x0++) {
-			if (x0 >= rm->rm_cols - raidz_parity(rm))
+			if (x0 >= raidz_ncols(rr) - raidz_parity(rr))
 				continue;
 
 			/* Check if should stop */
@@ -429,7 +432,7 @@ run_rec_check_impl(raidz_test_opts_t *opts, raidz_map_t *rm, const int fn)
 
 			LOG(D_DEBUG, "[%d] ", x0);
 
-			tgtidx[2] = x0 + raidz_parity(rm);
+			tgtidx[2] = x0 + raidz_parity(rr);
 
 			corrupt_colums(rm, tgtidx+2, 1);
 
@@ -445,10 +448,10 @@ run_rec_check_impl(raidz_test_opts_t *opts, raidz_map_t *rm, const int fn)
 	} else if (fn < RAIDZ_REC_PQR) {
 		/* can reconstruct 2 failed data disk */
 		for (x0 = 0; x0 < opts->rto_dcols; x0++) {
-			if (x0 >= rm->rm_cols - raidz_parity(rm))
+			if (x0 >= raidz_ncols(rr) - raidz_parity(rr))
 				continue;
 			for (x1 = x0 + 1; x1 < opts->rto_dcols; x1++) {
-				if (x1 >= rm->rm_cols - raidz_parity(rm))
+				if (x1 >= raidz_ncols(rr) - raidz_parity(rr))
 					continue;
 
 				/* Check if should stop */
@@ -457,8 +460,8 @@ run_rec_check_impl(raidz_test_opts_t *opts, raidz_map_t *rm, const int fn)
 
 				LOG(D_DEBUG, "[%d %d] ", x0, x1);
 
-				tgtidx[1] = x0 + raidz_parity(rm);
-				tgtidx[2] = x1 + raidz_parity(rm);
+				tgtidx[1] = x0 + raidz_parity(rr);
+				tgtidx[2] = x1 + raidz_parity(rr);
 
 				corrupt_colums(rm, tgtidx+1, 2);
 
@@ -475,14 +478,14 @@ run_rec_check_impl(raidz_test_opts_t *opts, raidz_map_t *rm, const int fn)
 	} else {
 		/* can reconstruct 3 failed data disk */
 		for (x0 = 0; x0 < opts->rto_dcols; x0++) {
-			if (x0 >= rm->rm_cols - raidz_parity(rm))
+			if (x0 >= raidz_ncols(rr) - raidz_parity(rr))
 				continue;
 			for (x1 = x0 + 1; x1 < opts->rto_dcols; x1++) {
-				if (x1 >= rm->rm_cols - raidz_parity(rm))
+				if (x1 >= raidz_ncols(rr) - raidz_parity(rr))
 					continue;
 				for (x2 = x1 + 1; x2 < opts->rto_dcols; x2++) {
 					if (x2 >=
-					    rm->rm_cols - raidz_parity(rm))
+					    raidz_ncols(rr) - raidz_parity(rr))
 						continue;
 
 					/* Check if should stop */
@@ -491,9 +494,9 @@ run_rec_check_impl(raidz_test_opts_t *opts, raidz_map_t *rm, const int fn)
 
 					LOG(D_DEBUG, "[%d %d %d]", x0, x1, x2);
 
-					tgtidx[0] = x0 + raidz_parity(rm);
-					tgtidx[1] = x1 + raidz_parity(rm);
-					tgtidx[2] = x2 + raidz_parity(rm);
+					tgtidx[0] = x0 + raidz_parity(rr);
+					tgtidx[1] = x1 + raidz_parity(rr);
+					tgtidx[2] = x2 + raidz_parity(rr);
 
 					corrupt_colums(rm, tgtidx, 3);
 
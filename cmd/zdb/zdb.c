@@ -943,7 +943,7 @@ dump_metaslab_stats(metaslab_t *msp)
 {
 	char maxbuf[32];
 	range_tree_t *rt = msp->ms_allocatable;
-	avl_tree_t *t = &msp->ms_allocatable_by_size;
+	zfs_btree_t *t = &msp->ms_allocatable_by_size;
 	int free_pct = range_tree_space(rt) * 100 / msp->ms_size;
 
 	/* max sure nicenum has enough space */
@@ -952,7 +952,7 @@ dump_metaslab_stats(metaslab_t *msp)
 	zdb_nicenum(metaslab_block_maxsize(msp), maxbuf, sizeof (maxbuf));
 
 	(void) printf("\t %25s %10lu   %7s  %6s   %4s %4d%%\n",
-	    "segments", avl_numnodes(t), "maxsize", maxbuf,
+	    "segments", zfs_btree_numnodes(t), "maxsize", maxbuf,
 	    "freepct", free_pct);
 	(void) printf("\tIn-memory histogram:\n");
 	dump_histogram(rt->rt_histogram, RANGE_TREE_HISTOGRAM_SIZE, 0);
@@ -1318,6 +1318,21 @@ dump_ddt(ddt_t *ddt, enum ddt_type type, enum ddt_class class)
 	(void) printf("\n");
 }
 
+static void
+dump_ddt_log(ddt_t *ddt)
+{
+	char name[DDT_NAMELEN];
+
+	if (ddt->ddt_log_object == 0 || ddt->ddt_log_count == 0)
+		return;
+
+	ddt_log_name(ddt, name);
+
+	(void) printf("%s: %llu records, %llu entries\n", name,
+	    (u_longlong_t)ddt->ddt_log_count,
+	    (u_longlong_t)avl_numnodes(&ddt->ddt_log_tree));
+}
+
 static void
 dump_all_ddts(spa_t *spa)
 {
@@ -1335,6 +1350,7 @@ dump_all_ddts(spa_t *spa)
 				dump_ddt(ddt, type, class);
 			}
 		}
+		dump_ddt_log(ddt);
 	}
 
 	ddt_get_dedup_stats(spa, &dds_total);
@@ -3678,8 +3694,17 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 			refcnt = 0;
 		} else {
 			ddt_phys_t *ddp = ddt_phys_select(dde, bp);
-			ddt_phys_decref(ddp);
-			refcnt = ddp->ddp_refcnt;
+
+			/*
+			 * If the entry of this block was pruned, the key may
+			 * have been reused by a newer block.
+			 */
+			if (ddp == NULL) {
+				refcnt = 0;
+			} else {
+				ddt_phys_decref(ddp);
+				refcnt = ddp->ddp_refcnt;
+			}
 			if (ddt_phys_total_refcnt(dde) == 0)
 				ddt_remove(ddt, dde);
 		}
@@ -3960,7 +3985,8 @@ zdb_claim_removing(spa_t *spa, zdb_cb_t *zcb)
 
 	ASSERT0(range_tree_space(svr->svr_allocd_segs));
 
-	range_tree_t *allocs = range_tree_create(NULL, NULL);
+	range_tree_t *allocs = range_tree_create(NULL, RANGE_SEG64, NULL,
+	    0, 0);
 	for (uint64_t msi = 0; msi < vd->vdev_ms_count; msi++) {
 		metaslab_t *msp = vd->vdev_ms[msi];
 
@@ -5673,6 +5699,7 @@ dump_mos_leaks(spa_t *spa)
 	mos_obj_refd(spa->spa_pool_props_object);
 	mos_obj_refd(spa->spa_config_object);
 	mos_obj_refd(spa->spa_ddt_stat_object);
+	mos_obj_refd(spa->spa_ddt_txg_times_object);
 	mos_obj_refd(spa->spa_feat_desc_obj);
 	mos_obj_refd(spa->spa_feat_enabled_txg_obj);
 	mos_obj_refd(spa->spa_feat_for_read_obj);
@@ -5739,6 +5766,8 @@ dump_mos_leaks(spa_t *spa)
 			}
 		}
 	}
+	for (uint64_t cksum = 0; cksum < ZIO_CHECKSUM_FUNCTIONS; cksum++)
+		mos_obj_refd(spa->spa_ddt[cksum]->ddt_log_object);
 
 	/*
 	 * Visit all allocated objects and make sure they are referenced.
@@ -5884,7 +5913,8 @@ dump_zpool(spa_t *spa)
 
 	if (dump_opt['d'] || dump_opt['i']) {
 		spa_feature_t f;
-		mos_refd_objs = range_tree_create(NULL, NULL);
+		mos_refd_objs = range_tree_create(NULL, RANGE_SEG64, NULL,
+		    0, 0);
 		dump_dir(dp->dp_meta_objset);
 
 		if (dump_opt['d'] >= 3) {
@@ -92,6 +92,7 @@ static int zpool_do_clear(int, char **);
 static int zpool_do_reopen(int, char **);
 
 static int zpool_do_reguid(int, char **);
+static int zpool_do_ddt_prune(int, char **);
 
 static int zpool_do_attach(int, char **);
 static int zpool_do_detach(int, char **);
@@ -167,6 +168,7 @@ typedef enum {
 	HELP_SPLIT,
 	HELP_SYNC,
 	HELP_REGUID,
+	HELP_DDT_PRUNE,
 	HELP_REOPEN,
 	HELP_VERSION
 } zpool_help_t;
@@ -302,6 +304,7 @@ static zpool_command_t command_table[] = {
 	{ "export",	zpool_do_export,	HELP_EXPORT		},
 	{ "upgrade",	zpool_do_upgrade,	HELP_UPGRADE		},
 	{ "reguid",	zpool_do_reguid,	HELP_REGUID		},
+	{ "ddtprune",	zpool_do_ddt_prune,	HELP_DDT_PRUNE		},
 	{ NULL },
 	{ "history",	zpool_do_history,	HELP_HISTORY		},
 	{ "events",	zpool_do_events,	HELP_EVENTS		},
@@ -328,7 +331,7 @@ get_usage(zpool_help_t idx)
 		return (gettext("\tadd [-fgLnP] [-o property=value] "
 		    "<pool> <vdev> ...\n"));
 	case HELP_ATTACH:
-		return (gettext("\tattach [-f] [-o property=value] "
+		return (gettext("\tattach [-fs] [-o property=value] "
 		    "<pool> <device> <new-device>\n"));
 	case HELP_CLEAR:
 		return (gettext("\tclear [-nF] <pool> [device]\n"));
@@ -371,7 +374,7 @@ get_usage(zpool_help_t idx)
 	case HELP_ONLINE:
 		return (gettext("\tonline [-e] <pool> <device> ...\n"));
 	case HELP_REPLACE:
-		return (gettext("\treplace [-f] [-o property=value] "
+		return (gettext("\treplace [-fs] [-o property=value] "
 		    "<pool> <device> [new-device]\n"));
 	case HELP_REMOVE:
 		return (gettext("\tremove [-nps] <pool> <device> ...\n"));
@@ -381,7 +384,7 @@ get_usage(zpool_help_t idx)
 		return (gettext("\tinitialize [-c | -s] <pool> "
 		    "[<device> ...]\n"));
 	case HELP_SCRUB:
-		return (gettext("\tscrub [-s | -p] <pool> ...\n"));
+		return (gettext("\tscrub [-s | -p | -i] <pool> ...\n"));
 	case HELP_RESILVER:
 		return (gettext("\tresilver <pool> ...\n"));
 	case HELP_TRIM:
@@ -408,6 +411,9 @@ get_usage(zpool_help_t idx)
 		    "[<device> ...]\n"));
 	case HELP_REGUID:
 		return (gettext("\treguid <pool>\n"));
+	case HELP_DDT_PRUNE:
+		return (gettext("\tddtprune -d <days> | -p <percentage> "
+		    "<pool>\n"));
 	case HELP_SYNC:
 		return (gettext("\tsync [pool] ...\n"));
 	case HELP_VERSION:
@@ -2168,6 +2174,10 @@ print_status_config(zpool_handle_t *zhp, status_cbdata_t *cb, const char *name,
 		}
 	}
 
+	/* Leaves being populated by a sequential rebuild */
+	if (children == 0 && vs->vs_rebuild_processed != 0)
+		(void) printf(gettext("  (rebuilding)"));
+
 	if (cb->vcdl != NULL) {
 		if (nvlist_lookup_string(nv, ZPOOL_CONFIG_PATH, &path) == 0) {
 			printf("  ");
@@ -5943,6 +5953,7 @@ static int
 zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 {
 	boolean_t force = B_FALSE;
+	boolean_t rebuild = B_FALSE;
 	int c;
 	nvlist_t *nvroot;
 	char *poolname, *old_disk, *new_disk;
@@ -5952,7 +5963,7 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 	int ret;
 
 	/* check options */
-	while ((c = getopt(argc, argv, "fo:")) != -1) {
+	while ((c = getopt(argc, argv, "fo:s")) != -1) {
 		switch (c) {
 		case 'f':
 			force = B_TRUE;
@@ -5970,6 +5981,9 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 			    (add_prop_list(optarg, propval, &props, B_TRUE)))
 				usage(B_FALSE);
 			break;
+		case 's':
+			rebuild = B_TRUE;
+			break;
 		case '?':
 			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
 			    optopt);
@@ -6051,7 +6065,8 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 		return (1);
 	}
 
-	ret = zpool_vdev_attach(zhp, old_disk, new_disk, nvroot, replacing);
+	ret = zpool_vdev_attach(zhp, old_disk, new_disk, nvroot, replacing,
+	    rebuild);
 
 	nvlist_free(props);
 	nvlist_free(nvroot);
@@ -6061,9 +6076,10 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 }
 
 /*
- * zpool replace [-f] <pool> <device> <new_device>
+ * zpool replace [-fs] <pool> <device> <new_device>
  *
  *	-f	Force attach, even if <new_device> appears to be in use.
+ *	-s	Use a sequential rebuild instead of a resilver (mirrors only).
  *
  * Replace <device> with <new_device>.
  */
@@ -6075,10 +6091,11 @@ zpool_do_replace(int argc, char **argv)
 }
 
 /*
- * zpool attach [-f] [-o property=value] <pool> <device> <new_device>
+ * zpool attach [-fs] [-o property=value] <pool> <device> <new_device>
  *
  *	-f	Force attach, even if <new_device> appears to be in use.
  *	-o	Set property=value.
+ *	-s	Use a sequential rebuild instead of a resilver (mirrors only).
  *
  * Attach <new_device> to the mirror containing <device>.  If <device> is not
  * part of a mirror, then <device> will be transformed into a mirror of
@@ -6607,6 +6624,82 @@ zpool_do_reguid(int argc, char **argv)
 	return (ret);
 }
 
+/*
+ * zpool ddtprune -d <days> | -p <percentage> <pool>
+ *
+ *	-d	Prune the unique entries older than the given number of days.
+ *	-p	Prune the given percentage of the oldest unique entries.
+ *
+ * Removes old unique entries from the dedup table, so that their blocks are
+ * no longer dedup candidates.
+ */
+int
+zpool_do_ddt_prune(int argc, char **argv)
+{
+	zpool_ddt_prune_unit_t unit = ZPOOL_DDT_PRUNE_NONE;
+	uint64_t amount = 0;
+	char *poolname, *endptr;
+	zpool_handle_t *zhp;
+	int c, ret;
+
+	/* check options */
+	while ((c = getopt(argc, argv, "d:p:")) != -1) {
+		switch (c) {
+		case 'd':
+		case 'p':
+			if (unit != ZPOOL_DDT_PRUNE_NONE) {
+				(void) fprintf(stderr, gettext("-d and -p "
+				    "are mutually exclusive\n"));
+				usage(B_FALSE);
+			}
+			errno = 0;
+			amount = strtoull(optarg, &endptr, 10);
+			if (errno != 0 || *endptr != '\0' ||
+			    (c == 'p' && (amount == 0 || amount > 100))) {
+				(void) fprintf(stderr,
+				    gettext("invalid %s value '%s'\n"),
+				    c == 'd' ? "days" : "percentage", optarg);
+				usage(B_FALSE);
+			}
+			unit = (c == 'd') ? ZPOOL_DDT_PRUNE_AGE :
+			    ZPOOL_DDT_PRUNE_PERCENTAGE;
+			break;
+		case '?':
+			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
+			    optopt);
+			usage(B_FALSE);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (unit == ZPOOL_DDT_PRUNE_NONE) {
+		(void) fprintf(stderr, gettext("missing -d or -p option\n"));
+		usage(B_FALSE);
+	}
+
+	/* get pool name and check number of arguments */
+	if (argc < 1) {
+		(void) fprintf(stderr, gettext("missing pool name\n"));
+		usage(B_FALSE);
+	}
+
+	if (argc > 1) {
+		(void) fprintf(stderr, gettext("too many arguments\n"));
+		usage(B_FALSE);
+	}
+
+	poolname = argv[0];
+	if ((zhp = zpool_open(g_zfs, poolname)) == NULL)
+		return (1);
+
+	ret = zpool_ddt_prune(zhp, unit, amount);
+
+	zpool_close(zhp);
+	return (ret);
+}
+
 
 /*
  * zpool reopen <pool>
@@ -6704,22 +6797,24 @@ scrub_callback(zpool_handle_t *zhp, void *data)
 }
 
 /*
- * zpool scrub [-s | -p] <pool> ...
+ * zpool scrub [-s | -p | -i] <pool> ...
  *
  *	-s	Stop.  Stops any in-progress scrub.
  *	-p	Pause. Pause in-progress scrub.
+ *	-i	Incremental. Only scrub blocks born since the last scrub.
  */
 int
 zpool_do_scrub(int argc, char **argv)
 {
 	int c;
 	scrub_cbdata_t cb;
+	boolean_t incremental = B_FALSE;
 
 	cb.cb_type = POOL_SCAN_SCRUB;
 	cb.cb_scrub_cmd = POOL_SCRUB_NORMAL;
 
 	/* check options */
-	while ((c = getopt(argc, argv, "sp")) != -1) {
+	while ((c = getopt(argc, argv, "spi")) != -1) {
 		switch (c) {
 		case 's':
 			cb.cb_type = POOL_SCAN_NONE;
@@ -6727,6 +6822,9 @@ zpool_do_scrub(int argc, char **argv)
 		case 'p':
 			cb.cb_scrub_cmd = POOL_SCRUB_PAUSE;
 			break;
+		case 'i':
+			incremental = B_TRUE;
+			break;
 		case '?':
 			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
 			    optopt);
@@ -6741,6 +6839,17 @@ zpool_do_scrub(int argc, char **argv)
 		usage(B_FALSE);
 	}
 
+	if (incremental) {
+		if (cb.cb_type == POOL_SCAN_NONE ||
+		    cb.cb_scrub_cmd == POOL_SCRUB_PAUSE) {
+			(void) fprintf(stderr, gettext("invalid option "
+			    "combination: -i can only be used to start a "
+			    "scrub\n"));
+			usage(B_FALSE);
+		}
+		cb.cb_scrub_cmd = POOL_SCRUB_INCREMENTAL;
+	}
+
 	cb.cb_argc = argc;
 	cb.cb_argv = argv;
 	argc -= optind;
@@ -7202,6 +7311,101 @@ print_removal_status(zpool_handle_t *zhp, pool_removal_stat_t *prs)
 	}
 }
 
+/*
+ * Print out detailed raidz expansion status.
+ */
+static void
+print_raidz_expand_status(zpool_handle_t *zhp, pool_raidz_expand_stat_t *pres)
+{
+	char copied_buf[7], total_buf[7], rate_buf[7];
+	time_t start, end;
+	nvlist_t *config, *nvroot;
+	nvlist_t **child;
+	uint_t children;
+	char *vdev_name;
+
+	if (pres == NULL || pres->pres_state == DSS_NONE)
+		return;
+
+	/*
+	 * Determine name of vdev.
+	 */
+	config = zpool_get_config(zhp, NULL);
+	nvroot = fnvlist_lookup_nvlist(config, ZPOOL_CONFIG_VDEV_TREE);
+	verify(nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children) == 0);
+	assert(pres->pres_expanding_vdev < children);
+	vdev_name = zpool_vdev_name(g_zfs, zhp,
+	    child[pres->pres_expanding_vdev], VDEV_NAME_TYPE_ID);
+
+	(void) printf(gettext("expand: "));
+
+	start = pres->pres_start_time;
+	end = pres->pres_end_time;
+	zfs_nicenum(pres->pres_reflowed, copied_buf, sizeof (copied_buf));
+
+	/*
+	 * Expansion is finished.
+	 */
+	if (pres->pres_state == DSS_FINISHED) {
+		uint64_t minutes_taken = (end - start) / 60;
+
+		(void) printf(gettext("expanded %s copied %s in "
+		    "%lluh%um, on %s"), vdev_name, copied_buf,
+		    (u_longlong_t)(minutes_taken / 60),
+		    (uint_t)(minutes_taken % 60), ctime((time_t *)&end));
+	} else {
+		uint64_t copied, total, elapsed, mins_left, hours_left;
+		double fraction_done;
+		uint_t rate;
+
+		assert(pres->pres_state == DSS_SCANNING);
+
+		/*
+		 * Expansion is in progress.
+		 */
+		(void) printf(gettext(
+		    "expansion of %s in progress since %s"),
+		    vdev_name, ctime(&start));
+
+		copied = pres->pres_reflowed > 0 ? pres->pres_reflowed : 1;
+		total = pres->pres_to_reflow;
+		fraction_done = (double)copied / total;
+
+		/* elapsed time for this pass */
+		elapsed = time(NULL) - pres->pres_start_time;
+		elapsed = elapsed > 0 ? elapsed : 1;
+		rate = copied / elapsed;
+		rate = rate > 0 ? rate : 1;
+		mins_left = ((total - copied) / rate) / 60;
+		hours_left = mins_left / 60;
+
+		zfs_nicenum(copied, copied_buf, sizeof (copied_buf));
+		zfs_nicenum(total, total_buf, sizeof (total_buf));
+		zfs_nicenum(rate, rate_buf, sizeof (rate_buf));
+
+		/*
+		 * do not print estimated time if hours_left is more than
+		 * 30 days
+		 */
+		(void) printf(gettext("\t%s / %s copied at %s/s, "
+		    "%.2f%% done"),
+		    copied_buf, total_buf, rate_buf, 100 * fraction_done);
+		if (pres->pres_waiting_for_resilver) {
+			(void) printf(gettext(", paused for resilver or "
+			    "clear\n"));
+		} else if (hours_left < (30 * 24)) {
+			(void) printf(gettext(", %lluh%um to go\n"),
+			    (u_longlong_t)hours_left, (uint_t)(mins_left % 60));
+		} else {
+			(void) printf(gettext(
+			    ", (copy is slow, no estimated time)\n"));
+		}
+	}
+
+	free(vdev_name);
+}
+
 static void
 print_checkpoint_status(pool_checkpoint_stat_t *pcs)
 {
@@ -7308,13 +7512,15 @@ print_l2cache(zpool_handle_t *zhp, status_cbdata_t *cb, nvlist_t **l2cache,
 }
 
 static void
-print_dedup_stats(nvlist_t *config)
+print_dedup_stats(zpool_handle_t *zhp, nvlist_t *config)
 {
 	ddt_histogram_t *ddh;
 	ddt_stat_t *dds;
 	ddt_object_t *ddo;
 	uint_t c;
 	char dspace[6], mspace[6];
+	char tsize[32], quota[32], arcsize[6], reserve[6];
+	uint64_t arc_ddt_size = 0, arc_ddt_reserve = 0;
 
 	/*
 	 * If the pool was faulted then we may not have been able to
@@ -7339,6 +7545,20 @@ print_dedup_stats(nvlist_t *config)
 	    dspace,
 	    mspace);
 
+	(void) zpool_get_prop(zhp, ZPOOL_PROP_DEDUP_TABLE_SIZE, tsize,
+	    sizeof (tsize), NULL, B_FALSE);
+	(void) zpool_get_prop(zhp, ZPOOL_PROP_DEDUP_TABLE_QUOTA, quota,
+	    sizeof (quota), NULL, B_FALSE);
+	(void) nvlist_lookup_uint64(config, ZPOOL_CONFIG_DDT_ARC_SIZE,
+	    &arc_ddt_size);
+	(void) nvlist_lookup_uint64(config, ZPOOL_CONFIG_DDT_ARC_RESERVE,
+	    &arc_ddt_reserve);
+	zfs_nicebytes(arc_ddt_size, arcsize, sizeof (arcsize));
+	zfs_nicebytes(arc_ddt_reserve, reserve, sizeof (reserve));
+	(void) printf(gettext("        DDT size %s, quota %s; "
+	    "%s of DDT blocks cached in ARC, %s reserved\n"),
+	    tsize, quota, arcsize, reserve);
+
 	verify(nvlist_lookup_uint64_array(config, ZPOOL_CONFIG_DDT_STATS,
 	    (uint64_t **)&dds, &c) == 0);
 	verify(nvlist_lookup_uint64_array(config, ZPOOL_CONFIG_DDT_HISTOGRAM,
@@ -7678,6 +7898,7 @@ status_callback(zpool_handle_t *zhp, void *data)
 		pool_checkpoint_stat_t *pcs = NULL;
 		pool_scan_stat_t *ps = NULL;
 		pool_removal_stat_t *prs = NULL;
+		pool_raidz_expand_stat_t *pres = NULL;
 
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_CHECKPOINT_STATS, (uint64_t **)&pcs, &c);
@@ -7685,11 +7906,14 @@ status_callback(zpool_handle_t *zhp, void *data)
 		    ZPOOL_CONFIG_SCAN_STATS, (uint64_t **)&ps, &c);
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_REMOVAL_STATS, (uint64_t **)&prs, &c);
+		(void) nvlist_lookup_uint64_array(nvroot,
+		    ZPOOL_CONFIG_RAIDZ_EXPAND_STATS, (uint64_t **)&pres, &c);
 
 		print_scan_status(ps);
 		print_checkpoint_scan_warning(ps, pcs);
 		print_removal_status(zhp, prs);
 		print_checkpoint_status(pcs);
+		print_raidz_expand_status(zhp, pres);
 
 		cbp->cb_namewidth = max_width(zhp, nvroot, 0, 0,
 		    cbp->cb_name_flags | VDEV_NAME_TYPE_ID);
@@ -7760,7 +7984,7 @@ status_callback(zpool_handle_t *zhp, void *data)
 		}
 
 		if (cbp->cb_dedup_stats)
-			print_dedup_stats(config);
+			print_dedup_stats(zhp, config);
 	} else {
 		(void) printf(gettext("config: The configuration cannot be "
 		    "determined.\n"));
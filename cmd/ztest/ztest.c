@@ -120,6 +120,7 @@
 #include <sys/zfeature.h>
 #include <sys/dsl_userhold.h>
 #include <sys/abd.h>
+#include <sys/ddt.h>
 #include <stdio.h>
 #include <stdio_ext.h>
 #include <stdlib.h>
@@ -133,6 +134,7 @@
 #include <libnvpair.h>
 #include <libzutil.h>
 #include <sys/crypto/icp.h>
+#include <sys/blake3.h>
 #ifdef __GLIBC__
 #include <execinfo.h> /* for backtrace() */
 #endif
@@ -214,6 +216,9 @@ extern unsigned long zfs_deadman_synctime_ms;
 extern int metaslab_preload_limit;
 extern boolean_t zfs_compressed_arc_enabled;
 extern int zfs_abd_scatter_enabled;
+extern int zfs_dedup_log_enabled;
+extern unsigned long zfs_dedup_log_flush_records;
+extern unsigned long zfs_arc_ddt_min;
 extern int dmu_object_alloc_chunk_shift;
 extern boolean_t zfs_force_some_double_word_sm_entries;
 extern unsigned long zio_decompress_fail_fraction;
@@ -268,9 +273,9 @@ typedef struct bufwad {
  * still need to map from object ID to rangelock_t.
  */
 typedef enum {
-	RL_READER,
-	RL_WRITER,
-	RL_APPEND
+	ZTRL_READER,
+	ZTRL_WRITER,
+	ZTRL_APPEND
 } rl_type_t;
 
 typedef struct rll {
@@ -371,6 +376,7 @@ ztest_func_t ztest_vdev_class_add;
 ztest_func_t ztest_vdev_aux_add_remove;
 ztest_func_t ztest_split_pool;
 ztest_func_t ztest_reguid;
+ztest_func_t ztest_ddt_prune;
 ztest_func_t ztest_spa_upgrade;
 ztest_func_t ztest_device_removal;
 ztest_func_t ztest_spa_checkpoint_create_discard;
@@ -417,6 +423,7 @@ ztest_info_t ztest_info[] = {
 	ZTI_INIT(ztest_dmu_snapshot_hold, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_mmp_enable_disable, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_reguid, 1, &zopt_rarely),
+	ZTI_INIT(ztest_ddt_prune, 1, &zopt_rarely),
 	ZTI_INIT(ztest_scrub, 1, &zopt_rarely),
 	ZTI_INIT(ztest_spa_upgrade, 1, &zopt_rarely),
 	ZTI_INIT(ztest_dsl_dataset_promote_busy, 1, &zopt_rarely),
@@ -1379,7 +1386,7 @@ ztest_rll_lock(rll_t *rll, rl_type_t type)
 {
 	mutex_enter(&rll->rll_lock);
 
-	if (type == RL_READER) {
+	if (type == ZTRL_READER) {
 		while (rll->rll_writer != NULL)
 			(void) cv_wait(&rll->rll_cv, &rll->rll_lock);
 		rll->rll_readers++;
@@ -1835,7 +1842,7 @@ ztest_replay_remove(void *arg1, void *arg2, boolean_t byteswap)
 	    zap_lookup(os, lr->lr_doid, name, sizeof (object), 1, &object));
 	ASSERT(object != 0);
 
-	ztest_object_lock(zd, object, RL_WRITER);
+	ztest_object_lock(zd, object, ZTRL_WRITER);
 
 	VERIFY3U(0, ==, dmu_object_info(os, object, &doi));
 
@@ -1905,8 +1912,8 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 	if (bt->bt_magic != BT_MAGIC)
 		bt = NULL;
 
-	ztest_object_lock(zd, lr->lr_foid, RL_READER);
-	rl = ztest_range_lock(zd, lr->lr_foid, offset, length, RL_WRITER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_READER);
+	rl = ztest_range_lock(zd, lr->lr_foid, offset, length, ZTRL_WRITER);
 
 	VERIFY3U(0, ==, dmu_bonus_hold(os, lr->lr_foid, FTAG, &db));
 
@@ -2008,9 +2015,9 @@ ztest_replay_truncate(void *arg1, void *arg2, boolean_t byteswap)
 	if (byteswap)
 		byteswap_uint64_array(lr, sizeof (*lr));
 
-	ztest_object_lock(zd, lr->lr_foid, RL_READER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_READER);
 	rl = ztest_range_lock(zd, lr->lr_foid, lr->lr_offset, lr->lr_length,
-	    RL_WRITER);
+	    ZTRL_WRITER);
 
 	tx = dmu_tx_create(os);
 
@@ -2050,7 +2057,7 @@ ztest_replay_setattr(void *arg1, void *arg2, boolean_t byteswap)
 	if (byteswap)
 		byteswap_uint64_array(lr, sizeof (*lr));
 
-	ztest_object_lock(zd, lr->lr_foid, RL_WRITER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_WRITER);
 
 	VERIFY3U(0, ==, dmu_bonus_hold(os, lr->lr_foid, FTAG, &db));
 
@@ -2174,7 +2181,7 @@ ztest_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
 	ASSERT3P(zio, !=, NULL);
 	ASSERT3U(size, !=, 0);
 
-	ztest_object_lock(zd, object, RL_READER);
+	ztest_object_lock(zd, object, ZTRL_READER);
 	error = dmu_bonus_hold(os, object, FTAG, &db);
 	if (error) {
 		ztest_object_unlock(zd, object);
@@ -2199,7 +2206,7 @@ ztest_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
 
 	if (buf != NULL) {	/* immediate write */
 		zgd->zgd_lr = (struct locked_range *)ztest_range_lock(zd,
-		    object, offset, size, RL_READER);
+		    object, offset, size, ZTRL_READER);
 
 		error = dmu_read(os, object, offset, size, buf,
 		    DMU_READ_NO_PREFETCH);
@@ -2214,7 +2221,7 @@ ztest_get_data(void *arg, lr_write_t *lr, char *buf, struct lwb *lwb,
 		}
 
 		zgd->zgd_lr = (struct locked_range *)ztest_range_lock(zd,
-		    object, offset, size, RL_READER);
+		    object, offset, size, ZTRL_READER);
 
 		error = dmu_buf_hold(os, object, offset, zgd, &db,
 		    DMU_READ_NO_PREFETCH);
@@ -2291,7 +2298,7 @@ ztest_lookup(ztest_ds_t *zd, ztest_od_t *od, int count)
 			ASSERT(od->od_object != 0);
 			ASSERT(missing == 0);	/* there should be no gaps */
 
-			ztest_object_lock(zd, od->od_object, RL_READER);
+			ztest_object_lock(zd, od->od_object, ZTRL_READER);
 			VERIFY3U(0, ==, dmu_bonus_hold(zd->zd_os,
 			    od->od_object, FTAG, &db));
 			dmu_object_info_from_db(db, &doi);
@@ -2464,8 +2471,8 @@ ztest_prealloc(ztest_ds_t *zd, uint64_t object, uint64_t offset, uint64_t size)
 
 	txg_wait_synced(dmu_objset_pool(os), 0);
 
-	ztest_object_lock(zd, object, RL_READER);
-	rl = ztest_range_lock(zd, object, offset, size, RL_WRITER);
+	ztest_object_lock(zd, object, ZTRL_READER);
+	rl = ztest_range_lock(zd, object, offset, size, ZTRL_WRITER);
 
 	tx = dmu_tx_create(os);
 
@@ -3337,6 +3344,7 @@ ztest_vdev_attach_detach(ztest_ds_t *zd, uint64_t id)
 	uint64_t oldsize, newsize;
 	char *oldpath, *newpath;
 	int replacing;
+	int rebuild = B_FALSE;
 	int oldvd_has_siblings = B_FALSE;
 	int newvd_is_spare = B_FALSE;
 	int oldvd_is_log;
@@ -3416,6 +3424,16 @@ ztest_vdev_attach_detach(ztest_ds_t *zd, uint64_t id)
 	pvd = oldvd->vdev_parent;
 	pguid = pvd->vdev_guid;
 
+	/*
+	 * Half of the time, populate the new device of a mirror with a
+	 * sequential rebuild instead of a resilver.
+	 */
+	if (ztest_random(2) == 0 && (oldvd == oldvd->vdev_top ||
+	    oldvd->vdev_top->vdev_ops == &vdev_mirror_ops ||
+	    oldvd->vdev_top->vdev_ops == &vdev_replacing_ops ||
+	    oldvd->vdev_top->vdev_ops == &vdev_spare_ops))
+		rebuild = B_TRUE;
+
 	/*
 	 * If oldvd has siblings, then half of the time, detach it.  Prior
 	 * to the detach the pool is scrubbed in order to prevent creating
@@ -3503,7 +3521,7 @@ ztest_vdev_attach_detach(ztest_ds_t *zd, uint64_t id)
 	root = make_vdev_root(newpath, NULL, NULL, newvd == NULL ? newsize : 0,
 	    ashift, NULL, 0, 0, 1);
 
-	error = spa_vdev_attach(spa, oldguid, root, replacing);
+	error = spa_vdev_attach(spa, oldguid, root, replacing, rebuild);
 
 	nvlist_free(root);
 
@@ -5498,7 +5516,7 @@ ztest_verify_dnode_bt(ztest_ds_t *zd, uint64_t id)
 		dmu_object_info_t doi;
 		dmu_buf_t *db;
 
-		ztest_object_lock(zd, obj, RL_READER);
+		ztest_object_lock(zd, obj, ZTRL_READER);
 		if (dmu_bonus_hold(os, obj, FTAG, &db) != 0) {
 			ztest_object_unlock(zd, obj);
 			continue;
@@ -5553,6 +5571,8 @@ ztest_spa_prop_get_set(ztest_ds_t *zd, uint64_t id)
 	(void) pthread_rwlock_rdlock(&ztest_name_lock);
 
 	(void) ztest_spa_prop_set_uint64(ZPOOL_PROP_AUTOTRIM, ztest_random(2));
+	(void) ztest_spa_prop_set_uint64(ZPOOL_PROP_DEDUP_TABLE_QUOTA,
+	    ztest_random(2) * (1ULL << (16 + ztest_random(6))));
 
 	VERIFY0(spa_prop_get(ztest_spa, &props));
 
@@ -6035,9 +6055,14 @@ ztest_scrub(ztest_ds_t *zd, uint64_t id)
 		return;
 
 	/*
-	 * Start a scrub, wait a moment, then force a restart.
+	 * Start a scrub, wait a moment, then force a restart. Sometimes
+	 * start with an incremental scrub of the blocks born since the
+	 * last completed one.
 	 */
-	(void) spa_scan(spa, POOL_SCAN_SCRUB);
+	if (ztest_random(2) == 0)
+		(void) spa_scan_incremental(spa);
+	else
+		(void) spa_scan(spa, POOL_SCAN_SCRUB);
 	(void) poll(NULL, 0, 100);
 
 	error = ztest_scrub_impl(spa);
@@ -6079,6 +6104,36 @@ ztest_reguid(ztest_ds_t *zd, uint64_t id)
 	VERIFY3U(load, ==, spa_load_guid(spa));
 }
 
+/*
+ * Prune unique entries from the DDTs, either by age or by percentage.
+ */
+/* ARGSUSED */
+void
+ztest_ddt_prune(ztest_ds_t *zd, uint64_t id)
+{
+	spa_t *spa = ztest_spa;
+	zpool_ddt_prune_unit_t unit;
+	uint64_t amount;
+	int error;
+
+	if (ztest_random(2) == 0) {
+		unit = ZPOOL_DDT_PRUNE_AGE;
+		amount = 0;
+	} else {
+		unit = ZPOOL_DDT_PRUNE_PERCENTAGE;
+		amount = 1 + ztest_random(100);
+	}
+
+	(void) pthread_rwlock_rdlock(&ztest_name_lock);
+	error = ddt_prune_unique_entries(spa, unit, amount);
+	(void) pthread_rwlock_unlock(&ztest_name_lock);
+
+	if (error != 0 && error != ENOTSUP && error != ENOSPC) {
+		fatal(0, "ddt_prune_unique_entries(%s, %d, %llu) = %d",
+		    spa_name(spa), unit, (u_longlong_t)amount, error);
+	}
+}
+
 void
 ztest_fletcher(ztest_ds_t *zd, uint64_t id)
 {
@@ -6617,6 +6672,21 @@ ztest_resume_thread(void *arg)
 		 */
 		if (ztest_random(10) == 0)
 			zfs_abd_scatter_enabled = ztest_random(2);
+
+		/*
+		 * Periodically toggle the DDT log, which flushes and destroys
+		 * the logs, and vary how often they are flushed.
+		 */
+		if (ztest_random(10) == 0)
+			zfs_dedup_log_enabled = ztest_random(2);
+		if (ztest_random(10) == 0)
+			zfs_dedup_log_flush_records = 1 + ztest_random(1024);
+
+		/*
+		 * Periodically vary how much of the DDT is kept in the ARC.
+		 */
+		if (ztest_random(10) == 0)
+			zfs_arc_ddt_min = ztest_random(2) * (8ULL << 20);
 	}
 
 	thread_exit();
@@ -6940,6 +7010,8 @@ ztest_run(ztest_shared_t *zs)
 	ztest_spa = spa;
 
 	VERIFY0(vdev_raidz_impl_set("cycle"));
+	VERIFY0(sha256_impl_set("cycle"));
+	VERIFY0(blake3_impl_set("cycle"));
 
 	dmu_objset_stats_t dds;
 	VERIFY0(ztest_dmu_objset_own(ztest_opts.zo_pool,
@@ -0,0 +1,25 @@
+dnl #
+dnl # 4.14 API,
+dnl # The zstd compression library was added to the kernel.  It is used
+dnl # when available to provide compression=zstd, otherwise zstd is
+dnl # reported as unsupported.
+dnl #
+AC_DEFUN([ZFS_AC_KERNEL_ZSTD], [
+	AC_MSG_CHECKING([whether kernel provides zstd compression])
+	ZFS_LINUX_TRY_COMPILE_SYMBOL([
+		#include <linux/zstd.h>
+	], [
+		ZSTD_parameters params = ZSTD_getParams(3, 0, 0);
+		size_t wsize = ZSTD_CCtxWorkspaceBound(params.cParams);
+		ZSTD_CCtx *cctx __attribute__ ((unused)) =
+		    ZSTD_initCCtx(NULL, wsize);
+		ZSTD_DCtx *dctx __attribute__ ((unused)) =
+		    ZSTD_initDCtx(NULL, ZSTD_DCtxWorkspaceBound());
+	], [ZSTD_initCCtx], [lib/zstd/compress.c], [
+		AC_MSG_RESULT(yes)
+		AC_DEFINE(HAVE_KERNEL_ZSTD, 1,
+		    [kernel provides zstd compression])
+	], [
+		AC_MSG_RESULT(no)
+	])
+])
@@ -0,0 +1,18 @@
+dnl #
+dnl # Check for libzstd
+dnl #
+AC_DEFUN([ZFS_AC_CONFIG_USER_LIBZSTD], [
+	LIBZSTD=
+
+	AC_CHECK_HEADER([zstd.h], [], [AC_MSG_FAILURE([
+	*** zstd.h missing, libzstd-devel package required])])
+
+	AC_SEARCH_LIBS([ZSTD_compress], [zstd], [], [AC_MSG_FAILURE([
+	*** ZSTD_compress() missing, libzstd-devel package required])])
+
+	AC_SEARCH_LIBS([ZSTD_decompress], [zstd], [], [AC_MSG_FAILURE([
+	*** ZSTD_decompress() missing, libzstd-devel package required])])
+
+	AC_SUBST([LIBZSTD], ["-lzstd"])
+	AC_DEFINE([HAVE_LIBZSTD], 1, [Define if you have libzstd])
+])
@@ -129,6 +129,7 @@ int lzc_reopen(const char *, boolean_t);
 
 int lzc_pool_checkpoint(const char *);
 int lzc_pool_checkpoint_discard(const char *);
+int lzc_ddt_prune(const char *, zpool_ddt_prune_unit_t, uint64_t);
 
 #ifdef	__cplusplus
 }
@@ -46,6 +46,7 @@ typedef enum abd_flags {
 	ABD_FLAG_MULTI_ZONE  = 1 << 3,	/* pages split over memory zones */
 	ABD_FLAG_MULTI_CHUNK = 1 << 4,	/* pages split over multiple chunks */
 	ABD_FLAG_LINEAR_PAGE = 1 << 5,	/* linear but allocd from page */
+	ABD_FLAG_FROM_PAGES = 1 << 6,	/* scatter over pinned user pages */
 } abd_flags_t;
 
 typedef struct abd {
@@ -128,6 +129,7 @@ void abd_zero_off(abd_t *, size_t, size_t);
 unsigned int abd_scatter_bio_map_off(struct bio *, abd_t *, unsigned int,
 		size_t);
 unsigned long abd_nr_pages_off(abd_t *, unsigned int, size_t);
+abd_t *abd_get_from_pages(struct page **, uint_t, size_t);
 #endif
 
 void abd_raidz_gen_iterate(abd_t **cabds, abd_t *dabd,
@@ -145,6 +145,8 @@ typedef enum arc_flags
 	 */
 	ARC_FLAG_COMPRESSED_ARC		= 1 << 20,
 	ARC_FLAG_SHARED_DATA		= 1 << 21,
+	/* buffer holds a dedup table block */
+	ARC_FLAG_DDT			= 1 << 22,
 
 	/*
 	 * The arc buffer's compression mode is stored in the top 7 bits of the
@@ -292,6 +294,8 @@ void arc_tempreserve_clear(uint64_t reserve);
 int arc_tempreserve_space(spa_t *spa, uint64_t reserve, uint64_t txg);
 
 uint64_t arc_target_bytes(void);
+uint64_t arc_ddt_size(void);
+uint64_t arc_ddt_reserve(void);
 void arc_init(void);
 void arc_fini(void);
 
@@ -302,6 +306,8 @@ void arc_fini(void);
 void l2arc_add_vdev(spa_t *spa, vdev_t *vd);
 void l2arc_remove_vdev(vdev_t *vd);
 boolean_t l2arc_vdev_present(vdev_t *vd);
+void l2arc_spa_rebuild_start(spa_t *spa);
+void l2arc_spa_rebuild_stop(spa_t *spa);
 void l2arc_init(void);
 void l2arc_fini(void);
 void l2arc_start(void);
@@ -154,6 +154,11 @@ typedef struct l1arc_buf_hdr {
 	kcondvar_t		b_cv;
 	uint8_t			b_byteswap;
 
+	/* NUMA node the data buffers were last allocated for */
+	uint16_t		b_alloc_node;
+	/* NUMA node selecting the sublist, fixed while on an arcs_list */
+	uint16_t		b_list_node;
+
 
 	/* protected by arc state mutex */
 	arc_state_t		*b_state;
@@ -204,6 +209,144 @@ typedef struct arc_buf_hdr_crypt {
 	uint8_t			b_mac[ZIO_DATA_MAC_LEN];
 } arc_buf_hdr_crypt_t;
 
+/*
+ * Persistent L2ARC
+ *
+ * The L2ARC buffer headers are periodically written to the cache device
+ * itself, so that after a reboot or pool re-import the contents of the
+ * L2ARC can be reconstructed ("rebuilt") instead of starting cold.
+ *
+ * The on-disk layout of a cache device looks like this:
+ *
+ *	+------+------+-------------------------------------------------+
+ *	| VDEV | dev  |   buf buf lb buf buf buf lb buf ...  |          |
+ *	|labels| hdr  |  \______ payload ______/             | <- hand  |
+ *	+------+------+-------------------------------------------------+
+ *
+ * The device header (l2arc_dev_hdr_phys_t) lives right after the front
+ * vdev labels and holds pointers to the two most recently written log
+ * blocks.  Each log block (l2arc_log_blk_phys_t) describes a batch of
+ * buffers written to the device before it (its "payload") and points
+ * back to an older log block, forming two interleaved chains which are
+ * walked backwards in time by l2arc_rebuild() at pool import.
+ *
+ * Log blocks are written inline with the data buffers by
+ * l2arc_write_buffers(), so they are evicted by the write hand just like
+ * ordinary buffers.  A log block pointer is only followed during rebuild
+ * if neither the log block nor its payload has been overwritten since.
+ */
+#define	L2ARC_PERSISTENT_VERSION	1
+#define	L2ARC_DEV_HDR_MAGIC		0x5a46534341434845LLU	/* ZFSCACHE */
+#define	L2ARC_LOG_BLK_MAGIC		0x4c4f47424c4b4844LLU	/* LOGBLKHD */
+
+/* Maximum number of buffers described by a single log block. */
+#define	L2ARC_LOG_BLK_MAX_ENTRIES	(1022)
+
+/*
+ * A log block pointer.  The lbp_prop field encodes the logical and
+ * allocated size of the log block, its compression and checksum type
+ * using the L2BLK_* macros below.
+ */
+typedef struct l2arc_log_blkptr {
+	uint64_t	lbp_daddr;		/* device offset of log block */
+	uint64_t	lbp_payload_asize;	/* aligned size of payload */
+	uint64_t	lbp_payload_start;	/* offset of 1st payload buf */
+	uint64_t	lbp_prop;
+	zio_cksum_t	lbp_cksum;		/* fletcher4 of log block */
+} l2arc_log_blkptr_t;
+
+typedef enum l2arc_dev_hdr_flags_t {
+	L2ARC_DEV_HDR_EVICT_FIRST = (1 << 0)	/* mirror of l2ad_first */
+} l2arc_dev_hdr_flags_t;
+
+/*
+ * The persistent device header, written right after the front vdev labels
+ * and protected by an embedded checksum like the labels themselves.
+ */
+typedef struct l2arc_dev_hdr_phys {
+	uint64_t	dh_magic;		/* L2ARC_DEV_HDR_MAGIC */
+	uint64_t	dh_version;		/* L2ARC_PERSISTENT_VERSION */
+	uint64_t	dh_spa_guid;
+	uint64_t	dh_vdev_guid;
+	uint64_t	dh_log_entries;		/* mirror of l2ad_log_entries */
+	uint64_t	dh_evict;		/* mirror of l2ad_evict */
+	uint64_t	dh_flags;		/* l2arc_dev_hdr_flags_t */
+	uint64_t	dh_start;		/* mirror of l2ad_start */
+	uint64_t	dh_end;			/* mirror of l2ad_end */
+	/*
+	 * Heads of the two log block chains: [0] is the most recently
+	 * written log block, [1] the one before it.
+	 */
+	l2arc_log_blkptr_t	dh_start_lbps[2];
+	uint64_t	dh_lb_asize;		/* mirror of l2ad_lb_asize */
+	uint64_t	dh_lb_count;		/* mirror of l2ad_lb_count */
+	uint64_t	dh_pad[32];		/* pad to 512 bytes */
+	zio_eck_t	dh_tail;
+} l2arc_dev_hdr_phys_t;
+CTASSERT_GLOBAL(sizeof (l2arc_dev_hdr_phys_t) == SPA_MINBLOCKSIZE);
+
+/*
+ * A single buffer described by a log block.  The le_prop field encodes
+ * the buffer's logical and physical size, compression, type and flags.
+ */
+typedef struct l2arc_log_ent_phys {
+	dva_t		le_dva;			/* dva of buffer */
+	uint64_t	le_birth;		/* birth txg of buffer */
+	uint64_t	le_prop;
+	uint64_t	le_daddr;		/* buf location on l2dev */
+	uint64_t	le_pad[3];		/* pad to 64 bytes */
+} l2arc_log_ent_phys_t;
+
+typedef struct l2arc_log_blk_phys {
+	uint64_t		lb_magic;	/* L2ARC_LOG_BLK_MAGIC */
+	/*
+	 * Pointer to the log block written two blocks before this one,
+	 * i.e. the previous block on the same chain.
+	 */
+	l2arc_log_blkptr_t	lb_prev_lbp;
+	uint64_t		lb_pad[7];	/* pad header to 128 bytes */
+	l2arc_log_ent_phys_t	lb_entries[L2ARC_LOG_BLK_MAX_ENTRIES];
+} l2arc_log_blk_phys_t;				/* 64K total */
+CTASSERT_GLOBAL(IS_P2ALIGNED(sizeof (l2arc_log_blk_phys_t),
+    SPA_MINBLOCKSIZE));
+
+/*
+ * Accessors for the lbp_prop and le_prop fields.  Sizes are stored in
+ * units of SPA_MINBLOCKSIZE with a bias of 1, as in a blkptr_t.
+ */
+#define	L2BLK_GET_LSIZE(field)	\
+	BF64_GET_SB((field), 0, SPA_LSIZEBITS, SPA_MINBLOCKSHIFT, 1)
+#define	L2BLK_SET_LSIZE(field, x)	\
+	BF64_SET_SB((field), 0, SPA_LSIZEBITS, SPA_MINBLOCKSHIFT, 1, x)
+#define	L2BLK_GET_PSIZE(field)	\
+	BF64_GET_SB((field), 16, SPA_PSIZEBITS, SPA_MINBLOCKSHIFT, 1)
+#define	L2BLK_SET_PSIZE(field, x)	\
+	BF64_SET_SB((field), 16, SPA_PSIZEBITS, SPA_MINBLOCKSHIFT, 1, x)
+#define	L2BLK_GET_COMPRESS(field)	\
+	BF64_GET((field), 32, SPA_COMPRESSBITS)
+#define	L2BLK_SET_COMPRESS(field, x)	\
+	BF64_SET((field), 32, SPA_COMPRESSBITS, x)
+#define	L2BLK_GET_PREFETCH(field)	BF64_GET((field), 39, 1)
+#define	L2BLK_SET_PREFETCH(field, x)	BF64_SET((field), 39, 1, x)
+#define	L2BLK_GET_CHECKSUM(field)	BF64_GET((field), 40, 8)
+#define	L2BLK_SET_CHECKSUM(field, x)	BF64_SET((field), 40, 8, x)
+#define	L2BLK_GET_TYPE(field)		BF64_GET((field), 48, 8)
+#define	L2BLK_SET_TYPE(field, x)	BF64_SET((field), 48, 8, x)
+#define	L2BLK_GET_PROTECTED(field)	BF64_GET((field), 56, 1)
+#define	L2BLK_SET_PROTECTED(field, x)	BF64_SET((field), 56, 1, x)
+
+/* In-memory reference to a log block present on an L2ARC device. */
+typedef struct l2arc_lb_ptr_buf {
+	l2arc_log_blkptr_t	*lb_ptr;
+	list_node_t		node;
+} l2arc_lb_ptr_buf_t;
+
+/* A log block buffer which is in flight to the L2ARC device. */
+typedef struct l2arc_lb_abd_buf {
+	abd_t			*abd;
+	list_node_t		node;
+} l2arc_lb_abd_buf_t;
+
 typedef struct l2arc_dev {
 	vdev_t			*l2ad_vdev;	/* vdev */
 	spa_t			*l2ad_spa;	/* spa */
@@ -216,6 +359,24 @@ typedef struct l2arc_dev {
 	list_t			l2ad_buflist;	/* buffer list */
 	list_node_t		l2ad_node;	/* device list node */
 	zfs_refcount_t		l2ad_alloc;	/* allocated bytes */
+	/*
+	 * Persistent L2ARC state.
+	 */
+	l2arc_dev_hdr_phys_t	*l2ad_dev_hdr;	/* persistent device header */
+	uint64_t		l2ad_dev_hdr_asize; /* aligned hdr size */
+	l2arc_log_blk_phys_t	l2ad_log_blk;	/* currently open log block */
+	int			l2ad_log_ent_idx; /* index into cur log blk */
+	/* aligned size and start offset of the current log block payload */
+	uint64_t		l2ad_log_blk_payload_asize;
+	uint64_t		l2ad_log_blk_payload_start;
+	uint64_t		l2ad_log_entries; /* entries per log block */
+	uint64_t		l2ad_evict;	/* evicted up to this offset */
+	boolean_t		l2ad_rebuild;	/* rebuild pending or running */
+	boolean_t		l2ad_rebuild_began; /* rebuild thread started */
+	boolean_t		l2ad_rebuild_cancel; /* rebuild must stop */
+	list_t			l2ad_lbptr_list; /* log blocks on the device */
+	zfs_refcount_t		l2ad_lb_asize;	/* aligned size of log blks */
+	zfs_refcount_t		l2ad_lb_count;	/* number of log blocks */
 } l2arc_dev_t;
 
 typedef struct l2arc_buf_hdr {
@@ -230,6 +391,7 @@ typedef struct l2arc_buf_hdr {
 typedef struct l2arc_write_callback {
 	l2arc_dev_t	*l2wcb_dev;		/* device info */
 	arc_buf_hdr_t	*l2wcb_head;		/* head of write buflist */
+	list_t		l2wcb_abd_list;		/* in-flight log blocks */
 } l2arc_write_callback_t;
 
 struct arc_buf_hdr {
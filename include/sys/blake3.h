@@ -0,0 +1,86 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * BLAKE3 hash function, see https://github.com/BLAKE3-team/BLAKE3 for the
+ * specification.  Only the fixed 256-bit output of the regular and keyed
+ * hashing modes is provided.
+ */
+
+#ifndef	_SYS_BLAKE3_H
+#define	_SYS_BLAKE3_H
+
+#ifdef  _KERNEL
+#include <sys/types.h>
+#else
+#include <stdint.h>
+#include <stdlib.h>
+#endif
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	BLAKE3_KEY_LEN		32
+#define	BLAKE3_OUT_LEN		32
+#define	BLAKE3_BLOCK_LEN	64
+#define	BLAKE3_CHUNK_LEN	1024
+
+/*
+ * Depth of the chaining value stack, enough for inputs of up to 2^64
+ * bytes (2^54 chunks) plus one entry for the chunk being merged.
+ */
+#define	BLAKE3_MAX_DEPTH	54
+
+typedef struct {
+	uint32_t	cv[8];		/* chaining value of this chunk */
+	uint64_t	chunk_counter;	/* index of this chunk */
+	uint8_t		buf[BLAKE3_BLOCK_LEN]; /* pending input block */
+	uint8_t		buf_len;	/* bytes in buf */
+	uint8_t		blocks_compressed; /* blocks hashed into cv */
+	uint8_t		flags;		/* domain flags for all blocks */
+} blake3_chunk_state_t;
+
+typedef struct {
+	uint32_t	key[8];		/* key words, or the IV if unkeyed */
+	blake3_chunk_state_t chunk;	/* the chunk currently being hashed */
+	uint8_t		cv_stack_len;	/* entries in cv_stack */
+	uint8_t		cv_stack[(BLAKE3_MAX_DEPTH + 1) * BLAKE3_OUT_LEN];
+} BLAKE3_CTX;
+
+extern void Blake3_Init(BLAKE3_CTX *ctx);
+extern void Blake3_InitKeyed(BLAKE3_CTX *ctx,
+    const uint8_t key[BLAKE3_KEY_LEN]);
+extern void Blake3_Update(BLAKE3_CTX *ctx, const void *data, size_t len);
+extern void Blake3_Final(const BLAKE3_CTX *ctx, uint8_t *out);
+
+/*
+ * Implementation selection, see module/icp/algs/blake3/blake3_impl.c
+ */
+extern void blake3_impl_init(void);
+extern void blake3_impl_fini(void);
+extern int blake3_impl_set(const char *name);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_BLAKE3_H */
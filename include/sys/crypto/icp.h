@@ -46,5 +46,6 @@ void icp_fini(void);
 
 int aes_impl_set(const char *);
 int gcm_impl_set(const char *);
+int sha256_impl_set(const char *);
 
 #endif /* _SYS_CRYPTO_ALGS_H */
@@ -162,6 +162,13 @@ typedef struct dbuf_dirty_record {
 			boolean_t dr_nopwrite;
 			boolean_t dr_has_raw_params;
 
+			/*
+			 * Set when the block was written by Direct I/O.  The
+			 * data exists only on disk at dr_overridden_by and
+			 * dr_data is NULL.
+			 */
+			boolean_t dr_diowrite;
+
 			/*
 			 * If dr_has_raw_params is set, the following crypt
 			 * params will be set on the BP that's written.
@@ -351,6 +358,11 @@ void dmu_buf_write_embedded(dmu_buf_t *dbuf, void *data,
 void dmu_buf_redact(dmu_buf_t *dbuf, dmu_tx_t *tx);
 void dbuf_destroy(dmu_buf_impl_t *db);
 
+blkptr_t *dbuf_get_bp(dmu_buf_impl_t *db);
+dbuf_dirty_record_t *dbuf_direct_write_prepare(dmu_buf_impl_t *db,
+    dmu_tx_t *tx);
+void dbuf_direct_write_abort(dmu_buf_impl_t *db, dmu_tx_t *tx);
+
 void dbuf_unoverride(dbuf_dirty_record_t *dr);
 void dbuf_sync_list(list_t *list, int level, dmu_tx_t *tx);
 void dbuf_release_bp(dmu_buf_impl_t *db);
@@ -131,6 +131,57 @@ struct ddt_entry {
 	avl_node_t	dde_node;
 };
 
+/*
+ * On-disk DDT log record.  The log of a DDT is an array of these, appended
+ * to in every txg (see ddt_log.c).  The info word holds the class of the
+ * entry after the update (DDT_CLASSES if it was removed) and the DDT object
+ * the entry was stored in when it was first logged (DDT_TYPES if none).
+ */
+typedef struct ddt_log_record {
+	ddt_key_t	dlr_key;
+	ddt_phys_t	dlr_phys[DDT_PHYS_TYPES];
+	uint64_t	dlr_info;
+} ddt_log_record_t;
+
+#define	DLR_GET_CLASS(dlr)		BF64_GET((dlr)->dlr_info, 0, 8)
+#define	DLR_SET_CLASS(dlr, x)		BF64_SET((dlr)->dlr_info, 0, 8, x)
+
+#define	DLR_GET_OBJ_TYPE(dlr)		BF64_GET((dlr)->dlr_info, 8, 8)
+#define	DLR_SET_OBJ_TYPE(dlr, x)	BF64_SET((dlr)->dlr_info, 8, 8, x)
+
+#define	DLR_GET_OBJ_CLASS(dlr)		BF64_GET((dlr)->dlr_info, 16, 8)
+#define	DLR_SET_OBJ_CLASS(dlr, x)	BF64_SET((dlr)->dlr_info, 16, 8, x)
+
+/*
+ * Bonus buffer of the DDT log object.
+ */
+typedef struct ddt_log_phys {
+	uint64_t	dlp_count;	/* number of records in the log */
+} ddt_log_phys_t;
+
+/*
+ * In-core DDT log entry: the latest logged state of a key, which takes
+ * precedence over what the DDT objects hold for it until the log is flushed.
+ */
+typedef struct ddt_log_entry {
+	ddt_key_t	dle_key;
+	ddt_phys_t	dle_phys[DDT_PHYS_TYPES];
+	enum ddt_class	dle_class;	/* DDT_CLASSES if removed */
+	enum ddt_type	dle_obj_type;	/* DDT_TYPES if not in an object */
+	enum ddt_class	dle_obj_class;
+	uint64_t	dle_index;	/* latest record for this key */
+	avl_node_t	dle_node;
+} ddt_log_entry_t;
+
+/*
+ * Records staged to be appended to a DDT log in syncing context.
+ */
+typedef struct ddt_log_update {
+	dmu_tx_t	*dlu_tx;
+	ddt_log_record_t *dlu_records;
+	uint64_t	dlu_count;
+} ddt_log_update_t;
+
 /*
  * In-core ddt
  */
@@ -146,6 +197,9 @@ struct ddt {
 	ddt_histogram_t	ddt_histogram[DDT_TYPES][DDT_CLASSES];
 	ddt_histogram_t	ddt_histogram_cache[DDT_TYPES][DDT_CLASSES];
 	ddt_object_t	ddt_object_stats[DDT_TYPES][DDT_CLASSES];
+	uint64_t	ddt_log_object;
+	uint64_t	ddt_log_count;
+	avl_tree_t	ddt_log_tree;
 	avl_node_t	ddt_node;
 };
 
@@ -219,6 +273,8 @@ extern void ddt_get_dedup_stats(spa_t *spa, ddt_stat_t *dds_total);
 
 extern uint64_t ddt_get_dedup_dspace(spa_t *spa);
 extern uint64_t ddt_get_pool_dedup_ratio(spa_t *spa);
+extern uint64_t ddt_get_ddt_dsize(spa_t *spa);
+extern boolean_t ddt_over_quota(spa_t *spa);
 
 extern size_t ddt_compress(void *src, uchar_t *dst, size_t s_len, size_t d_len);
 extern void ddt_decompress(uchar_t *src, void *dst, size_t s_len, size_t d_len);
@@ -247,6 +303,27 @@ extern void ddt_sync(spa_t *spa, uint64_t txg);
 extern int ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde);
 extern int ddt_object_update(ddt_t *ddt, enum ddt_type type,
     enum ddt_class class, ddt_entry_t *dde, dmu_tx_t *tx);
+extern int ddt_object_remove(ddt_t *ddt, enum ddt_type type,
+    enum ddt_class class, ddt_entry_t *dde, dmu_tx_t *tx);
+extern void ddt_flush_logs(spa_t *spa, dmu_tx_t *tx);
+extern int ddt_prune_unique_entries(spa_t *spa, zpool_ddt_prune_unit_t unit,
+    uint64_t amount);
+
+extern void ddt_log_alloc(ddt_t *ddt);
+extern void ddt_log_free(ddt_t *ddt);
+extern int ddt_log_load(ddt_t *ddt);
+extern void ddt_log_name(ddt_t *ddt, char *name);
+extern boolean_t ddt_log_contains(ddt_t *ddt, const ddt_key_t *ddk);
+extern boolean_t ddt_log_lookup(ddt_t *ddt, ddt_entry_t *dde);
+extern void ddt_log_begin(ddt_t *ddt, ddt_log_update_t *dlu, dmu_tx_t *tx);
+extern void ddt_log_entry(ddt_t *ddt, ddt_log_update_t *dlu,
+    const ddt_entry_t *dde, enum ddt_type otype, enum ddt_class oclass,
+    enum ddt_class nclass);
+extern void ddt_log_commit(ddt_t *ddt, ddt_log_update_t *dlu);
+extern void ddt_log_flush(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx);
+extern int ddt_log_walk(ddt_t *ddt, enum ddt_class class, uint64_t *walk,
+    ddt_entry_t *dde);
 
 extern const ddt_ops_t ddt_zap_ops;
 
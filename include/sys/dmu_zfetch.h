@@ -44,6 +44,14 @@ typedef struct zstream {
 	uint64_t	zs_blkid;	/* expect next access at this blkid */
 	uint64_t	zs_pf_blkid;	/* next block to prefetch */
 
+	/*
+	 * Distance in blocks between the starts of consecutive accesses of
+	 * a reverse or strided stream (negative when the stream moves
+	 * backward), or 0 for a forward sequential stream.  For a strided
+	 * stream, zs_pf_blkid is the start of the next access to prefetch.
+	 */
+	int64_t		zs_stride;
+
 	/*
 	 * We will next prefetch the L1 indirect block of this level-0
 	 * block id.
@@ -55,10 +63,14 @@ typedef struct zstream {
 	list_node_t	zs_node;	/* link for zf_stream */
 } zstream_t;
 
+#define	ZFETCH_HIST_SIZE	4
+
 typedef struct zfetch {
 	kmutex_t	zf_lock;	/* protects zfetch structure */
 	list_t		zf_stream;	/* list of zstream_t's */
 	struct dnode	*zf_dnode;	/* dnode that owns this zfetch */
+	/* first blkids of the most recent misses, newest first */
+	uint64_t	zf_hist[ZFETCH_HIST_SIZE];
 } zfetch_t;
 
 void		zfetch_init(void);
@@ -66,8 +78,7 @@ void		zfetch_fini(void);
 
 void		dmu_zfetch_init(zfetch_t *, struct dnode *);
 void		dmu_zfetch_fini(zfetch_t *);
-void		dmu_zfetch(zfetch_t *, uint64_t, uint64_t, boolean_t,
-    boolean_t);
+void		dmu_zfetch(zfetch_t *, uint64_t, uint64_t, boolean_t);
 
 
 #ifdef	__cplusplus
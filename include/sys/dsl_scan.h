@@ -72,6 +72,7 @@ typedef struct dsl_scan_phys {
 typedef enum dsl_scan_flags {
 	DSF_VISIT_DS_AGAIN = 1<<0,
 	DSF_SCRUB_PAUSED = 1<<1,
+	DSF_SCRUB_INCREMENTAL = 1<<2,	/* scrub from the last scrubbed txg */
 } dsl_scan_flags_t;
 
 #define	DSL_SCAN_FLAGS_MASK (DSF_VISIT_DS_AGAIN)
@@ -112,6 +113,7 @@ typedef struct dsl_scan {
 	uint64_t scn_done_txg;
 	uint64_t scn_sync_start_time;
 	uint64_t scn_issued_before_pass;
+	uint64_t scn_last_scrubbed_txg;	/* max txg of the last full scrub */
 
 	/* for freeing blocks */
 	boolean_t scn_is_bptree;
@@ -130,6 +132,12 @@ typedef struct dsl_scan {
 	zio_t *scn_zio_root;		/* root zio for waiting on IO */
 	taskq_t *scn_taskq;		/* task queue for issuing extents */
 
+	/* asynchronous issuing, see zfs_scan_issue_async */
+	zio_t *scn_issue_root;		/* root zio while issuers run */
+	boolean_t scn_issue_stop;	/* issuers should exit */
+	uint64_t scn_issue_start_time;	/* when the issuers were started */
+	uint64_t scn_issue_next_id;	/* next top-level vdev to issue */
+
 	/* for controlling scan prefetch, protected by spa_scrub_lock */
 	boolean_t scn_prefetch_stop;	/* prefetch should stop */
 	zbookmark_phys_t scn_prefetch_bookmark;	/* prefetch start bookmark */
@@ -164,7 +172,9 @@ void dsl_scan_fini(struct dsl_pool *dp);
 void dsl_scan_sync(struct dsl_pool *, dmu_tx_t *);
 int dsl_scan_cancel(struct dsl_pool *);
 int dsl_scan(struct dsl_pool *, pool_scan_func_t);
+int dsl_scan_incremental(struct dsl_pool *);
 boolean_t dsl_scan_scrubbing(const struct dsl_pool *dp);
+boolean_t dsl_scan_walking_ddt(const struct dsl_pool *dp);
 int dsl_scrub_set_pause_resume(const struct dsl_pool *dp, pool_scrub_cmd_t cmd);
 void dsl_resilver_restart(struct dsl_pool *, uint64_t txg);
 boolean_t dsl_scan_resilvering(struct dsl_pool *dp);
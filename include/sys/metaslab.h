@@ -48,6 +48,8 @@ extern metaslab_ops_t *zfs_metaslab_ops;
 int metaslab_init(metaslab_group_t *, uint64_t, uint64_t, uint64_t,
     metaslab_t **);
 void metaslab_fini(metaslab_t *);
+range_seg_type_t metaslab_calculate_range_tree_type(vdev_t *, metaslab_t *,
+    uint64_t *, uint64_t *);
 
 void metaslab_set_unflushed_txg(metaslab_t *, uint64_t, dmu_tx_t *);
 void metaslab_set_estimated_condensed_size(metaslab_t *, uint64_t, dmu_tx_t *);
@@ -131,6 +133,9 @@ void metaslab_group_histogram_remove(metaslab_group_t *, metaslab_t *);
 void metaslab_group_alloc_decrement(spa_t *, uint64_t, void *, int, int,
     boolean_t);
 void metaslab_group_alloc_verify(spa_t *, const blkptr_t *, void *, int);
+void metaslab_group_write_latency_add(metaslab_group_t *, hrtime_t);
+void metaslab_group_write_latency_update(metaslab_group_t *);
+uint64_t metaslab_group_max_queue_depth(metaslab_group_t *, uint64_t);
 void metaslab_recalculate_weight_and_sort(metaslab_t *);
 void metaslab_disable(metaslab_t *);
 void metaslab_enable(metaslab_t *, boolean_t);
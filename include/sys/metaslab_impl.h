@@ -189,6 +189,12 @@ struct metaslab_class {
 
 	uint64_t		mc_alloc_groups; /* # of allocatable groups */
 
+	/*
+	 * Lowest mg_write_latency of the groups in this class, used by
+	 * the adaptive allocation throttle.
+	 */
+	uint64_t		mc_min_write_latency;
+
 	uint64_t		mc_alloc;	/* total allocated space */
 	uint64_t		mc_deferred;	/* total deferred frees */
 	uint64_t		mc_space;	/* total space (alloc + free) */
@@ -259,6 +265,18 @@ struct metaslab_group {
 	uint64_t		*mg_cur_max_alloc_queue_depth;
 	zfs_refcount_t		*mg_alloc_queue_depth;
 	int			mg_allocators;
+
+	/*
+	 * When zio_dva_throttle_adaptive is set, mg_max_alloc_queue_depth
+	 * is scaled down for groups whose async writes complete more slowly
+	 * than those of the fastest group in the class, so that the slow
+	 * devices do not hold up the end of the txg.  Completion latencies
+	 * are accumulated in mg_write_latency_{sum,count} and folded into
+	 * the moving average mg_write_latency (in ns) once per txg.
+	 */
+	uint64_t		mg_write_latency;
+	uint64_t		mg_write_latency_sum;
+	uint64_t		mg_write_latency_count;
 	/*
 	 * A metalab group that can no longer allocate the minimum block
 	 * size will set mg_no_free_space. Once a metaslab group is out
@@ -494,7 +512,7 @@ struct metaslab {
 	 * only difference is that the ms_allocatable_by_size is ordered by
 	 * segment sizes.
 	 */
-	avl_tree_t	ms_allocatable_by_size;
+	zfs_btree_t	ms_allocatable_by_size;
 	uint64_t	ms_lbas[MAX_LBAS];
 
 	metaslab_group_t *ms_group;	/* metaslab group		*/
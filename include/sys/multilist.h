@@ -73,6 +73,9 @@ struct multilist {
 
 void multilist_destroy(multilist_t *);
 multilist_t *multilist_create(size_t, size_t, multilist_sublist_index_func_t *);
+multilist_t *multilist_create_impl(size_t, size_t, unsigned int,
+    multilist_sublist_index_func_t *);
+unsigned int multilist_get_default_num_sublists(void);
 
 void multilist_insert(multilist_t *, void *);
 void multilist_remove(multilist_t *, void *);
@@ -816,6 +816,8 @@ extern int spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps);
 #define	SPA_ASYNC_INITIALIZE_RESTART		0x100
 #define	SPA_ASYNC_TRIM_RESTART			0x200
 #define	SPA_ASYNC_AUTOTRIM_RESTART		0x400
+#define	SPA_ASYNC_L2CACHE_REBUILD		0x800
+#define	SPA_ASYNC_REBUILD_DONE			0x1000
 
 /*
  * Controls the behavior of spa_vdev_remove().
@@ -826,7 +828,7 @@ extern int spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps);
 /* device manipulation */
 extern int spa_vdev_add(spa_t *spa, nvlist_t *nvroot);
 extern int spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot,
-    int replacing);
+    int replacing, int rebuild);
 extern int spa_vdev_detach(spa_t *spa, uint64_t guid, uint64_t pguid,
     int replace_done);
 extern int spa_vdev_remove(spa_t *spa, uint64_t guid, boolean_t unspare);
@@ -855,6 +857,7 @@ extern void spa_l2cache_drop(spa_t *spa);
 
 /* scanning */
 extern int spa_scan(spa_t *spa, pool_scan_func_t func);
+extern int spa_scan_incremental(spa_t *spa);
 extern int spa_scan_stop(spa_t *spa);
 extern int spa_scrub_pause_resume(spa_t *spa, pool_scrub_cmd_t flag);
 
@@ -1061,6 +1064,14 @@ extern metaslab_class_t *spa_normal_class(spa_t *spa);
 extern metaslab_class_t *spa_log_class(spa_t *spa);
 extern metaslab_class_t *spa_special_class(spa_t *spa);
 extern metaslab_class_t *spa_dedup_class(spa_t *spa);
+
+/* Allocator selection policies, see spa_allocator_affinity */
+#define	SPA_ALLOCATOR_HASH	0
+#define	SPA_ALLOCATOR_CPU	1
+#define	SPA_ALLOCATOR_NUMA	2
+
+extern int spa_allocator_affinity;
+extern int spa_select_allocator(spa_t *spa, uint64_t hash);
 extern metaslab_class_t *spa_preferred_class(spa_t *spa, uint64_t size,
     dmu_object_type_t objtype, uint_t level, uint_t special_smallblk);
 
@@ -1176,6 +1187,8 @@ extern void spa_get_errlists(spa_t *spa, avl_tree_t *last, avl_tree_t *scrub);
 /* vdev cache */
 extern void vdev_cache_stat_init(void);
 extern void vdev_cache_stat_fini(void);
+extern void vdev_queue_stat_init(void);
+extern void vdev_queue_stat_fini(void);
 
 /* vdev mirror */
 extern void vdev_mirror_stat_init(void);
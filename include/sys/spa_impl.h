@@ -305,6 +305,9 @@ struct spa {
 	spa_condensing_indirect_t	*spa_condensing_indirect;
 	zthr_t		*spa_condense_zthr;	/* zthr doing condense. */
 
+	struct vdev_raidz_expand *spa_raidz_expand; /* expansion in progress */
+	zthr_t		*spa_raidz_expand_zthr;	/* zthr doing the reflow */
+
 	uint64_t	spa_checkpoint_txg;	/* the txg of the checkpoint */
 	spa_checkpoint_info_t spa_checkpoint_info; /* checkpoint accounting */
 	zthr_t		*spa_checkpoint_discard_zthr;
@@ -359,7 +362,11 @@ struct spa {
 	uint64_t	spa_autoexpand;		/* lun expansion on/off */
 	ddt_t		*spa_ddt[ZIO_CHECKSUM_FUNCTIONS]; /* in-core DDTs */
 	uint64_t	spa_ddt_stat_object;	/* DDT statistics */
+	uint64_t	spa_ddt_txg_times_object; /* txg -> time, for pruning */
+	uint64_t	spa_ddt_txg_times_last;	/* time of last record */
 	uint64_t	spa_dedup_dspace;	/* Cache get_dedup_dspace() */
+	uint64_t	spa_dedup_dsize;	/* Cache get_ddt_dsize() */
+	uint64_t	spa_dedup_table_quota;	/* property DDT quota */
 	uint64_t	spa_dedup_checksum;	/* default dedup checksum */
 	uint64_t	spa_dspace;		/* dspace in normal class */
 	kmutex_t	spa_vdev_top_lock;	/* dueling offline/remove */
@@ -399,6 +406,8 @@ struct spa {
 	hrtime_t	spa_ccw_fail_time;	/* Conf cache write fail time */
 	taskq_t		*spa_zvol_taskq;	/* Taskq for minor management */
 	taskq_t		*spa_prefetch_taskq;	/* Taskq for prefetch threads */
+	taskq_t		*spa_zfetch_taskq;	/* Taskq for zfetch */
+	uint64_t	spa_zfetch_queued;	/* zfetch tasks queued */
 	uint64_t	spa_multihost;		/* multihost aware (mmp) */
 	mmp_thread_t	spa_mmp;		/* multihost mmp thread */
 	list_t		spa_leaf_list;		/* list of leaf vdevs */
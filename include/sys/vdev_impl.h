@@ -62,6 +62,7 @@ struct abd;
 
 extern int zfs_vdev_queue_depth_pct;
 extern int zfs_vdev_def_queue_depth;
+extern uint32_t zfs_vdev_async_write_min_active;
 extern uint32_t zfs_vdev_async_write_max_active;
 
 /*
@@ -70,7 +71,8 @@ extern uint32_t zfs_vdev_async_write_max_active;
 typedef int	vdev_open_func_t(vdev_t *vd, uint64_t *size, uint64_t *max_size,
     uint64_t *ashift);
 typedef void	vdev_close_func_t(vdev_t *vd);
-typedef uint64_t vdev_asize_func_t(vdev_t *vd, uint64_t psize);
+typedef uint64_t vdev_asize_func_t(vdev_t *vd, uint64_t psize,
+    uint64_t txg);
 typedef void	vdev_io_start_func_t(zio_t *zio);
 typedef void	vdev_io_done_func_t(zio_t *zio);
 typedef void	vdev_state_change_func_t(vdev_t *vd, int, int);
@@ -86,8 +88,8 @@ typedef void	vdev_remap_func_t(vdev_t *vd, uint64_t offset, uint64_t size,
  * Given a target vdev, translates the logical range "in" to the physical
  * range "res"
  */
-typedef void vdev_xlation_func_t(vdev_t *cvd, const range_seg_t *in,
-    range_seg_t *res);
+typedef void vdev_xlation_func_t(vdev_t *cvd, const range_seg64_t *in,
+    range_seg64_t *res);
 
 typedef const struct vdev_ops {
 	vdev_open_func_t		*vdev_op_open;
@@ -131,6 +133,7 @@ struct vdev_cache {
 
 typedef struct vdev_queue_class {
 	uint32_t	vqc_active;
+	uint32_t	vqc_passthrough_active;	/* updated atomically */
 
 	/*
 	 * Sorted by offset or timestamp, depending on if the queue is
@@ -149,6 +152,17 @@ struct vdev_queue {
 	uint64_t	vq_last_offset;
 	hrtime_t	vq_io_complete_ts; /* time last i/o completed */
 	hrtime_t	vq_io_delta_ts;
+
+	/*
+	 * Latency-targeted scheduling (zfs_vdev_queue_latency_target_us).
+	 * The max_active of the async classes is scaled by vq_async_scale
+	 * percent, which is adjusted at the end of each window from the
+	 * share of sync i/os that completed over the target.
+	 */
+	uint32_t	vq_async_scale;
+	hrtime_t	vq_lat_window_start;
+	uint64_t	vq_lat_sync_ios;
+	uint64_t	vq_lat_sync_over;
 	zio_t		vq_io_search; /* used as local for stack reduction */
 	kmutex_t	vq_lock;
 };
@@ -254,6 +268,7 @@ struct vdev {
 	uint64_t	vdev_deflate_ratio; /* deflation ratio (x512)	*/
 	uint64_t	vdev_islog;	/* is an intent log device	*/
 	uint64_t	vdev_removing;	/* device is being removed?	*/
+	boolean_t	vdev_rz_expanding; /* raidz is being expanded?	*/
 	boolean_t	vdev_ishole;	/* is a hole in the namespace	*/
 	uint64_t	vdev_top_zap;
 	vdev_alloc_bias_t vdev_alloc_bias; /* metaslab allocation bias	*/
@@ -297,6 +312,17 @@ struct vdev {
 	uint64_t	vdev_trim_secure;	/* requested secure TRIM */
 	time_t		vdev_trim_action_time;	/* start and end time */
 
+	/* Sequential rebuild related (top-level vdevs only) */
+	boolean_t	vdev_rebuild_exit_wanted;
+	kthread_t	*vdev_rebuild_thread;
+	/* Protects vdev_rebuild_thread and the rebuild progress. */
+	kmutex_t	vdev_rebuild_lock;
+	kcondvar_t	vdev_rebuild_cv;
+	uint64_t	vdev_rebuild_max_txg;	/* DTLs covered by this pass */
+	uint64_t	vdev_rebuild_ms;	/* next metaslab to copy */
+	uint64_t	vdev_rebuild_errors;	/* failed reads this pass */
+	uint64_t	vdev_rebuild_bytes_done;
+
 	/* for limiting outstanding I/Os (initialize and TRIM) */
 	kmutex_t	vdev_initialize_io_lock;
 	kcondvar_t	vdev_initialize_io_cv;
@@ -304,6 +330,9 @@ struct vdev {
 	kmutex_t	vdev_trim_io_lock;
 	kcondvar_t	vdev_trim_io_cv;
 	uint64_t	vdev_trim_inflight[2];
+	kmutex_t	vdev_rebuild_io_lock;
+	kcondvar_t	vdev_rebuild_io_cv;
+	uint64_t	vdev_rebuild_inflight;
 
 	/*
 	 * Values stored in the config for an indirect or removing vdev.
@@ -360,6 +389,7 @@ struct vdev {
 	uint64_t	vdev_degraded;	/* persistent degraded state	*/
 	uint64_t	vdev_removed;	/* persistent removed state	*/
 	uint64_t	vdev_resilver_txg; /* persistent resilvering state */
+	uint64_t	vdev_rebuild_txg; /* attached for sequential rebuild */
 	uint64_t	vdev_nparity;	/* number of parity devices for raidz */
 	char		*vdev_path;	/* vdev path (if any)		*/
 	char		*vdev_devid;	/* vdev devid (if any)		*/
@@ -526,9 +556,10 @@ extern vdev_ops_t vdev_indirect_ops;
 /*
  * Common size functions
  */
-extern void vdev_default_xlate(vdev_t *vd, const range_seg_t *in,
-    range_seg_t *out);
-extern uint64_t vdev_default_asize(vdev_t *vd, uint64_t psize);
+extern void vdev_default_xlate(vdev_t *vd, const range_seg64_t *in,
+    range_seg64_t *out);
+extern uint64_t vdev_default_asize(vdev_t *vd, uint64_t psize,
+    uint64_t txg);
 extern uint64_t vdev_get_min_asize(vdev_t *vd);
 extern void vdev_set_min_asize(vdev_t *vd);
 
@@ -26,13 +26,20 @@
 #define	_SYS_VDEV_RAIDZ_H
 
 #include <sys/types.h>
+#include <sys/avl.h>
+#include <sys/txg.h>
+#include <sys/zfs_rlock.h>
 
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
 struct zio;
+struct raidz_row;
 struct raidz_map;
+struct vdev;
+struct spa;
+struct nvlist;
 #if !defined(_KERNEL)
 struct kernel_param {};
 #endif
@@ -44,7 +51,112 @@ struct raidz_map *vdev_raidz_map_alloc(struct zio *, uint64_t, uint64_t,
     uint64_t);
 void vdev_raidz_map_free(struct raidz_map *);
 void vdev_raidz_generate_parity(struct raidz_map *);
-int vdev_raidz_reconstruct(struct raidz_map *, const int *, int);
+void vdev_raidz_reconstruct(struct raidz_map *, const int *, int);
+
+/*
+ * vdev_raidz expansion interface
+ */
+struct vdev_raidz *vdev_raidz_init(struct vdev *, struct nvlist *);
+void vdev_raidz_fini(struct vdev *);
+void vdev_raidz_config_generate(struct vdev *, struct nvlist *);
+void vdev_raidz_attach_sync(void *, struct dmu_tx *);
+void spa_start_raidz_expansion_thread(struct spa *);
+int spa_raidz_expand_get_stats(struct spa *, pool_raidz_expand_stat_t *);
+int vdev_raidz_load(struct vdev *);
+void vdev_raidz_reflow_copy_scratch(struct spa *);
+void vdev_raidz_expand_resume(struct spa *);
+boolean_t vdev_raidz_expanding(struct vdev *);
+
+/*
+ * State of an in-progress (or finished) expansion of a raidz vdev.  There
+ * is at most one of these per pool; spa_raidz_expand points to it while
+ * the reflow is running.
+ */
+typedef struct vdev_raidz_expand {
+	uint64_t vre_vdev_id;
+
+	kmutex_t vre_lock;
+	kcondvar_t vre_cv;
+
+	/*
+	 * How much i/o is outstanding (issued and not completed).
+	 */
+	uint64_t vre_outstanding_bytes;
+
+	/*
+	 * Next offset to issue i/o for.
+	 */
+	uint64_t vre_offset;
+
+	/*
+	 * Reflow offset of the last synced txg whose uberblock has been
+	 * written out.  Normal i/o uses this to decide whether a block is
+	 * at its old or new location; it is only advanced while holding the
+	 * rangelock over the newly-reflowed range.
+	 */
+	uint64_t vre_synced_offset;
+
+	/*
+	 * Lowest offset of a failed expansion i/o.  The expansion will
+	 * retry from here.  Once the expansion thread notices the failure
+	 * and acknowledges it, this will be set back to UINT64_MAX.
+	 */
+	uint64_t vre_failed_offset;
+	boolean_t vre_waiting_for_resilver;
+
+	/*
+	 * Offset that is completing each txg
+	 */
+	uint64_t vre_offset_pertxg[TXG_SIZE];
+
+	/*
+	 * Bytes copied in each txg.
+	 */
+	uint64_t vre_bytes_copied_pertxg[TXG_SIZE];
+
+	/*
+	 * The rangelock prevents normal read/write zio's from happening while
+	 * there are expansion (reflow) i/os in progress to the same offsets.
+	 */
+	rangelock_t vre_rangelock;
+
+	/*
+	 * These fields are stored on-disk in the vdev_top_zap:
+	 */
+	dsl_scan_state_t vre_state;
+	uint64_t vre_start_time;
+	uint64_t vre_end_time;
+	uint64_t vre_bytes_copied;
+} vdev_raidz_expand_t;
+
+/*
+ * Private data of a raidz top-level vdev (vdev_tsd).
+ */
+typedef struct vdev_raidz {
+	/*
+	 * Number of child vdevs when this raidz vdev was created (i.e. before
+	 * any raidz expansions).
+	 */
+	int vd_original_width;
+
+	/*
+	 * The current number of child vdevs, which may be more than the
+	 * original width if an expansion is in progress or has completed.
+	 */
+	int vd_physical_width;
+
+	/*
+	 * Tracks the logical width of blocks born in each txg range, so
+	 * that blocks written before an expansion can still be located.
+	 */
+	avl_tree_t vd_expand_txgs;
+	kmutex_t vd_expand_lock;
+
+	/*
+	 * If this vdev is being expanded, spa_raidz_expand is set to this
+	 */
+	vdev_raidz_expand_t vn_vre;
+} vdev_raidz_t;
 
 /*
  * vdev_raidz_math interface
@@ -52,9 +164,9 @@ int vdev_raidz_reconstruct(struct raidz_map *, const int *, int);
 void vdev_raidz_math_init(void);
 void vdev_raidz_math_fini(void);
 const struct raidz_impl_ops *vdev_raidz_math_get_ops(void);
-int vdev_raidz_math_generate(struct raidz_map *);
-int vdev_raidz_math_reconstruct(struct raidz_map *, const int *, const int *,
-    const int);
+int vdev_raidz_math_generate(struct raidz_map *, struct raidz_row *);
+int vdev_raidz_math_reconstruct(struct raidz_map *, struct raidz_row *,
+    const int *, const int *, const int);
 int vdev_raidz_impl_set(const char *);
 
 #ifdef	__cplusplus
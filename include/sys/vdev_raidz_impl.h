@@ -76,9 +76,9 @@ extern const char *raidz_rec_name[RAIDZ_REC_NUM];
  * Methods used to define raidz implementation
  *
  * @raidz_gen_f	Parity generation function
- *     @par1	pointer to raidz_map
+ *     @par1	pointer to raidz_row
  * @raidz_rec_f	Data reconstruction function
- *     @par1	pointer to raidz_map
+ *     @par1	pointer to raidz_row
  *     @par2	array of reconstruction targets
  * @will_work_f Function returns TRUE if impl. is supported on the system
  * @init_impl_f Function is called once on init
@@ -107,27 +107,40 @@ typedef struct raidz_col {
 	uint64_t rc_size;		/* I/O size */
 	abd_t *rc_abd;			/* I/O data */
 	void *rc_gdata;			/* used to store the "good" version */
+	abd_t *rc_orig_data;		/* pre-reconstruction copy */
 	int rc_error;			/* I/O error for this device */
+	int rc_shadow_error;		/* I/O error for the shadow location */
+	uint64_t rc_shadow_devidx;	/* shadow child, or UINT64_MAX */
+	uint64_t rc_shadow_offset;	/* shadow device offset */
 	uint8_t rc_tried;		/* Did we attempt this I/O column? */
 	uint8_t rc_skipped;		/* Did we skip this I/O column? */
+	uint8_t rc_need_orig_restore;	/* need to restore from orig_data? */
 } raidz_col_t;
 
+typedef struct raidz_row {
+	uint64_t rr_cols;		/* Regular column count */
+	uint64_t rr_scols;		/* Count including skipped columns */
+	uint64_t rr_bigcols;		/* Number of oversized columns */
+	uint64_t rr_missingdata;	/* Count of missing data devices */
+	uint64_t rr_missingparity;	/* Count of missing parity devices */
+	uint64_t rr_firstdatacol;	/* First data column/parity count */
+	uint64_t rr_physcols;		/* Child count of this row's layout */
+	raidz_col_t rr_col[1];		/* Flexible array of I/O columns */
+} raidz_row_t;
+
 typedef struct raidz_map {
-	uint64_t rm_cols;		/* Regular column count */
-	uint64_t rm_scols;		/* Count including skipped columns */
-	uint64_t rm_bigcols;		/* Number of oversized columns */
 	uint64_t rm_asize;		/* Actual total I/O size */
-	uint64_t rm_missingdata;	/* Count of missing data devices */
-	uint64_t rm_missingparity;	/* Count of missing parity devices */
-	uint64_t rm_firstdatacol;	/* First data column/parity count */
 	uint64_t rm_nskip;		/* Skipped sectors for padding */
 	uint64_t rm_skipstart;		/* Column index of padding start */
+	uint64_t rm_original_width;	/* Width before any expansion */
 	abd_t *rm_abd_copy;		/* rm_asize-buffer of copied data */
 	uintptr_t rm_reports;		/* # of referencing checksum reports */
 	uint8_t	rm_freed;		/* map no longer has referencing ZIO */
 	uint8_t	rm_ecksuminjected;	/* checksum error was injected */
+	struct locked_range *rm_lr;	/* range lock held during expansion */
 	const raidz_impl_ops_t *rm_ops;	/* RAIDZ math operations */
-	raidz_col_t rm_col[1];		/* Flexible array of I/O columns */
+	int rm_nrows;			/* Regular row count */
+	raidz_row_t *rm_row[1];		/* Flexible array of rows */
 } raidz_map_t;
 
 #define	RAIDZ_ORIGINAL_IMPL	(INT_MAX)
@@ -154,7 +167,7 @@ extern const raidz_impl_ops_t vdev_raidz_aarch64_neonx2_impl;
 #endif
 
 /*
- * Commonly used raidz_map helpers
+ * Commonly used raidz_row helpers
  *
  * raidz_parity		Returns parity of the RAIDZ block
  * raidz_ncols		Returns number of columns the block spans
@@ -164,13 +177,13 @@ extern const raidz_impl_ops_t vdev_raidz_aarch64_neonx2_impl;
  * raidz_big_size	Returns size of big columns
  * raidz_short_size	Returns size of short columns
  */
-#define	raidz_parity(rm)	((rm)->rm_firstdatacol)
-#define	raidz_ncols(rm)		((rm)->rm_cols)
-#define	raidz_nbigcols(rm)	((rm)->rm_bigcols)
-#define	raidz_col_p(rm, c)	((rm)->rm_col + (c))
-#define	raidz_col_size(rm, c)	((rm)->rm_col[c].rc_size)
-#define	raidz_big_size(rm)	(raidz_col_size(rm, CODE_P))
-#define	raidz_short_size(rm)	(raidz_col_size(rm, raidz_ncols(rm)-1))
+#define	raidz_parity(rr)	((rr)->rr_firstdatacol)
+#define	raidz_ncols(rr)		((rr)->rr_cols)
+#define	raidz_nbigcols(rr)	((rr)->rr_bigcols)
+#define	raidz_col_p(rr, c)	((rr)->rr_col + (c))
+#define	raidz_col_size(rr, c)	((rr)->rr_col[c].rc_size)
+#define	raidz_big_size(rr)	(raidz_col_size(rr, CODE_P))
+#define	raidz_short_size(rr)	(raidz_col_size(rr, raidz_ncols(rr)-1))
 
 /*
  * Macro defines an RAIDZ parity generation method
@@ -180,10 +193,10 @@ extern const raidz_impl_ops_t vdev_raidz_aarch64_neonx2_impl;
  */
 #define	_RAIDZ_GEN_WRAP(code, impl)					\
 static void								\
-impl ## _gen_ ## code(void *rmp)					\
+impl ## _gen_ ## code(void *rrp)					\
 {									\
-	raidz_map_t *rm = (raidz_map_t *)rmp;				\
-	raidz_generate_## code ## _impl(rm);				\
+	raidz_row_t *rr = (raidz_row_t *)rrp;				\
+	raidz_generate_## code ## _impl(rr);				\
 }
 
 /*
@@ -194,10 +207,10 @@ impl ## _gen_ ## code(void *rmp)					\
  */
 #define	_RAIDZ_REC_WRAP(code, impl)					\
 static int								\
-impl ## _rec_ ## code(void *rmp, const int *tgtidx)			\
+impl ## _rec_ ## code(void *rrp, const int *tgtidx)			\
 {									\
-	raidz_map_t *rm = (raidz_map_t *)rmp;				\
-	return (raidz_reconstruct_## code ## _impl(rm, tgtidx));	\
+	raidz_row_t *rr = (raidz_row_t *)rrp;				\
+	return (raidz_reconstruct_## code ## _impl(rr, tgtidx));	\
 }
 
 /*
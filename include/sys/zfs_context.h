@@ -649,6 +649,12 @@ extern void delay(clock_t ticks);
 #define	max_ncpus	64
 #define	boot_ncpus	(sysconf(_SC_NPROCESSORS_ONLN))
 
+/*
+ * Userland treats the whole machine as a single NUMA node.
+ */
+#define	nr_node_ids	1
+#define	numa_node_id()	0
+
 /*
  * Process priorities as defined by setpriority(2) and getpriority(2).
  */
@@ -45,7 +45,12 @@ extern "C" {
  *
  * After the lwb is "opened", it can transition into the "issued" state
  * via zil_lwb_write_issue(). Again, the zilog's "zl_issuer_lock" must
- * be held when making this transition.
+ * be held when making this transition. The "issued" lwb is queued on a
+ * list private to the thread that issued it, and its zios are started by
+ * zil_lwb_write_start() only after that thread has dropped the
+ * "zl_issuer_lock". This keeps checksumming and submitting the log block
+ * write out of the lock, so that the next committer can begin filling
+ * the following lwb while the previous one is being sent to disk.
  *
  * After the lwb's write zio completes, it transitions into the "write
  * done" state via zil_lwb_write_done(); and then into the "flush done"
@@ -102,6 +107,7 @@ typedef struct lwb {
 	dmu_tx_t	*lwb_tx;	/* tx for log block allocation */
 	uint64_t	lwb_max_txg;	/* highest txg in this lwb */
 	list_node_t	lwb_node;	/* zilog->zl_lwb_list linkage */
+	list_node_t	lwb_issue_node;	/* list of lwbs to be started */
 	list_t		lwb_itxs;	/* list of itx's */
 	list_t		lwb_waiters;	/* list of zil_commit_waiter's */
 	avl_tree_t	lwb_vdev_tree;	/* vdevs to flush after lwb write */
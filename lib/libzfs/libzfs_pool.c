@@ -350,6 +350,26 @@ zpool_get_prop(zpool_handle_t *zhp, zpool_prop_t prop, char *buf,
 				(void) zfs_nicenum(intval, buf, len);
 			break;
 
+		case ZPOOL_PROP_DEDUP_TABLE_SIZE:
+			if (literal) {
+				(void) snprintf(buf, len, "%llu",
+				    (u_longlong_t)intval);
+			} else {
+				(void) zfs_nicebytes(intval, buf, len);
+			}
+			break;
+
+		case ZPOOL_PROP_DEDUP_TABLE_QUOTA:
+			if (intval == 0) {
+				(void) strlcpy(buf, "none", len);
+			} else if (literal) {
+				(void) snprintf(buf, len, "%llu",
+				    (u_longlong_t)intval);
+			} else {
+				(void) zfs_nicebytes(intval, buf, len);
+			}
+			break;
+
 		case ZPOOL_PROP_EXPANDSZ:
 		case ZPOOL_PROP_CHECKPOINT:
 			if (intval == 0) {
@@ -1462,6 +1482,34 @@ zpool_discard_checkpoint(zpool_handle_t *zhp)
 	return (0);
 }
 
+/*
+ * Prune the old unique entries of the dedup table of the given pool.
+ */
+int
+zpool_ddt_prune(zpool_handle_t *zhp, zpool_ddt_prune_unit_t unit,
+    uint64_t amount)
+{
+	libzfs_handle_t *hdl = zhp->zpool_hdl;
+	char msg[1024];
+	int error;
+
+	error = lzc_ddt_prune(zhp->zpool_name, unit, amount);
+	if (error != 0) {
+		(void) snprintf(msg, sizeof (msg), dgettext(TEXT_DOMAIN,
+		    "cannot prune dedup table of '%s'"), zhp->zpool_name);
+		if (error == ENOTSUP) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "the ddt_prune feature must be enabled"));
+			(void) zfs_error(hdl, EZFS_BADVERSION, msg);
+		} else {
+			(void) zpool_standard_error(hdl, error, msg);
+		}
+		return (-1);
+	}
+
+	return (0);
+}
+
 /*
  * Add the given vdevs to the pool.  The caller must have already performed the
  * necessary verification to ensure that the vdev specification is well-formed.
@@ -2332,10 +2380,10 @@ zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd)
 
 	/* ECANCELED on a scrub means we resumed a paused scrub */
 	if (err == ECANCELED && func == POOL_SCAN_SCRUB &&
-	    cmd == POOL_SCRUB_NORMAL)
+	    cmd != POOL_SCRUB_PAUSE)
 		return (0);
 
-	if (err == ENOENT && func != POOL_SCAN_NONE && cmd == POOL_SCRUB_NORMAL)
+	if (err == ENOENT && func != POOL_SCAN_NONE && cmd != POOL_SCRUB_PAUSE)
 		return (0);
 
 	if (func == POOL_SCAN_SCRUB) {
@@ -2343,7 +2391,8 @@ zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd)
 			(void) snprintf(msg, sizeof (msg), dgettext(TEXT_DOMAIN,
 			    "cannot pause scrubbing %s"), zc.zc_name);
 		} else {
-			assert(cmd == POOL_SCRUB_NORMAL);
+			assert(cmd == POOL_SCRUB_NORMAL ||
+			    cmd == POOL_SCRUB_INCREMENTAL);
 			(void) snprintf(msg, sizeof (msg), dgettext(TEXT_DOMAIN,
 			    "cannot scrub %s"), zc.zc_name);
 		}
@@ -3087,10 +3136,12 @@ is_replacing_spare(nvlist_t *search, nvlist_t *tgt, int which)
 /*
  * Attach new_disk (fully described by nvroot) to old_disk.
  * If 'replacing' is specified, the new disk will replace the old one.
+ * If 'rebuild' is specified, the new disk is populated by a sequential
+ * rebuild rather than a resilver.
  */
 int
-zpool_vdev_attach(zpool_handle_t *zhp,
-    const char *old_disk, const char *new_disk, nvlist_t *nvroot, int replacing)
+zpool_vdev_attach(zpool_handle_t *zhp, const char *old_disk,
+    const char *new_disk, nvlist_t *nvroot, int replacing, boolean_t rebuild)
 {
 	zfs_cmd_t zc = {"\0"};
 	char msg[1024];
@@ -3125,6 +3176,7 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 
 	verify(nvlist_lookup_uint64(tgt, ZPOOL_CONFIG_GUID, &zc.zc_guid) == 0);
 	zc.zc_cookie = replacing;
+	zc.zc_simple = rebuild;
 
 	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
 	    &child, &children) != 0 || children != 1) {
@@ -3181,7 +3233,11 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 		/*
 		 * Can't attach to or replace this type of vdev.
 		 */
-		if (replacing) {
+		if (rebuild) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "sequential resilver is only supported for "
+			    "mirrors"));
+		} else if (replacing) {
 			uint64_t version = zpool_get_prop_int(zhp,
 			    ZPOOL_PROP_VERSION, NULL);
 
@@ -3197,8 +3253,8 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 				    "cannot replace a replacing device"));
 		} else {
 			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
-			    "can only attach to mirrors and top-level "
-			    "disks"));
+			    "can only attach to mirrors, top-level disks, and "
+			    "raidz vdevs (with the raidz_expansion feature)"));
 		}
 		(void) zfs_error(hdl, EZFS_BADTARGET, msg);
 		break;
@@ -3219,6 +3275,17 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 		(void) zfs_error(hdl, EZFS_BADDEV, msg);
 		break;
 
+	case ENXIO:
+		/*
+		 * A raidz can only be expanded while all its children are
+		 * healthy.
+		 */
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+		    "raidz vdev has devices that are offline or being "
+		    "replaced"));
+		(void) zfs_error(hdl, EZFS_BADDEV, msg);
+		break;
+
 	case EOVERFLOW:
 		/*
 		 * The new device is too small.
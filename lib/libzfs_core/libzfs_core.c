@@ -1387,6 +1387,37 @@ lzc_pool_checkpoint_discard(const char *pool)
 	return (error);
 }
 
+/*
+ * Prune the unique entries of the dedup table of the specified pool that
+ * are older than the given number of days (ZPOOL_DDT_PRUNE_AGE), or the
+ * given percentage of its oldest unique entries (ZPOOL_DDT_PRUNE_PERCENTAGE).
+ *
+ * If this function returns 0 the entries were successfully pruned.
+ *
+ * This method may also return:
+ *
+ * ENOTSUP
+ * 	The ddt_prune feature is not enabled on the pool.
+ */
+int
+lzc_ddt_prune(const char *pool, zpool_ddt_prune_unit_t unit, uint64_t amount)
+{
+	int error;
+
+	nvlist_t *result = NULL;
+	nvlist_t *args = fnvlist_alloc();
+
+	fnvlist_add_uint64(args, DDT_PRUNE_UNIT, (uint64_t)unit);
+	fnvlist_add_uint64(args, DDT_PRUNE_AMOUNT, amount);
+
+	error = lzc_ioctl(ZFS_IOC_DDT_PRUNE, pool, args, &result);
+
+	fnvlist_free(args);
+	fnvlist_free(result);
+
+	return (error);
+}
+
 /*
  * Executes a read-only channel program.
  *
@@ -0,0 +1,296 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * BLAKE3 tree hashing.
+ *
+ * The input is split into 1 KiB chunks which form the leaves of a binary
+ * tree.  Each chunk is hashed into a chaining value, and pairs of chaining
+ * values are hashed into their parent's.  The chaining values of complete
+ * subtrees are kept on a stack and merged as soon as the next chunk
+ * arrives, which is all that is needed because the tree is always filled
+ * from the left.  Whole chunks are passed in batches to the hash_many()
+ * method of the selected implementation, which hashes them in parallel
+ * using SIMD instructions where available.
+ *
+ * The last chunk and the root node are only hashed in Blake3_Final(),
+ * since only then is it known which node receives the ROOT flag.
+ */
+
+#include <sys/zfs_context.h>
+#include <blake3/blake3_impl.h>
+
+/*
+ * A node whose chaining value or root output has not been computed yet.
+ */
+typedef struct blake3_output {
+	uint32_t	cv[8];
+	uint8_t		block[BLAKE3_BLOCK_LEN];
+	uint8_t		block_len;
+	uint64_t	counter;
+	uint8_t		flags;
+} blake3_output_t;
+
+static void
+blake3_chunk_state_init(blake3_chunk_state_t *cs, const uint32_t key[8],
+    uint64_t counter, uint8_t flags)
+{
+	bcopy(key, cs->cv, sizeof (cs->cv));
+	cs->chunk_counter = counter;
+	bzero(cs->buf, sizeof (cs->buf));
+	cs->buf_len = 0;
+	cs->blocks_compressed = 0;
+	cs->flags = flags;
+}
+
+static size_t
+blake3_chunk_state_len(const blake3_chunk_state_t *cs)
+{
+	return (BLAKE3_BLOCK_LEN * (size_t)cs->blocks_compressed +
+	    cs->buf_len);
+}
+
+static uint8_t
+blake3_chunk_state_start_flag(const blake3_chunk_state_t *cs)
+{
+	return (cs->blocks_compressed == 0 ? BLAKE3_CHUNK_START : 0);
+}
+
+/*
+ * Add up to a chunk's worth of input.  A full block is only compressed
+ * once more input arrives, the last block of the chunk needs the
+ * CHUNK_END flag.
+ */
+static void
+blake3_chunk_state_update(blake3_chunk_state_t *cs, const uint8_t *in,
+    size_t len)
+{
+	uint32_t state[16];
+	size_t take;
+
+	while (len > 0) {
+		if (cs->buf_len == BLAKE3_BLOCK_LEN) {
+			blake3_compress_generic(cs->cv, cs->buf,
+			    BLAKE3_BLOCK_LEN, cs->chunk_counter,
+			    cs->flags | blake3_chunk_state_start_flag(cs),
+			    state);
+			bcopy(state, cs->cv, sizeof (cs->cv));
+			cs->blocks_compressed++;
+			bzero(cs->buf, sizeof (cs->buf));
+			cs->buf_len = 0;
+		}
+
+		take = MIN(BLAKE3_BLOCK_LEN - cs->buf_len, len);
+		bcopy(in, cs->buf + cs->buf_len, take);
+		cs->buf_len += take;
+		in += take;
+		len -= take;
+	}
+}
+
+static void
+blake3_chunk_state_output(const blake3_chunk_state_t *cs, blake3_output_t *o)
+{
+	bcopy(cs->cv, o->cv, sizeof (o->cv));
+	bcopy(cs->buf, o->block, sizeof (o->block));
+	o->block_len = cs->buf_len;
+	o->counter = cs->chunk_counter;
+	o->flags = cs->flags | blake3_chunk_state_start_flag(cs) |
+	    BLAKE3_CHUNK_END;
+}
+
+static void
+blake3_parent_output(const uint8_t block[BLAKE3_BLOCK_LEN],
+    const uint32_t key[8], uint8_t flags, blake3_output_t *o)
+{
+	bcopy(key, o->cv, sizeof (o->cv));
+	bcopy(block, o->block, sizeof (o->block));
+	o->block_len = BLAKE3_BLOCK_LEN;
+	o->counter = 0;
+	o->flags = flags | BLAKE3_PARENT;
+}
+
+static void
+blake3_output_cv(const blake3_output_t *o, uint8_t cv[BLAKE3_OUT_LEN])
+{
+	uint32_t state[16];
+	int i;
+
+	blake3_compress_generic(o->cv, o->block, o->block_len, o->counter,
+	    o->flags, state);
+	for (i = 0; i < 8; i++)
+		blake3_store32(cv + 4 * i, state[i]);
+}
+
+static void
+blake3_output_root(const blake3_output_t *o, uint8_t out[BLAKE3_OUT_LEN])
+{
+	uint32_t state[16];
+	int i;
+
+	blake3_compress_generic(o->cv, o->block, o->block_len, 0,
+	    o->flags | BLAKE3_ROOT, state);
+	for (i = 0; i < 8; i++)
+		blake3_store32(out + 4 * i, state[i]);
+}
+
+/*
+ * Push the chaining value of a completed chunk, first merging it with
+ * every completed subtree of the same size.  Their number is given by the
+ * trailing zero bits of the total number of chunks hashed so far.
+ */
+static void
+blake3_push_cv(BLAKE3_CTX *ctx, const uint8_t chunk_cv[BLAKE3_OUT_LEN],
+    uint64_t total_chunks)
+{
+	uint8_t block[BLAKE3_BLOCK_LEN];
+	blake3_output_t o;
+
+	bcopy(chunk_cv, block + BLAKE3_OUT_LEN, BLAKE3_OUT_LEN);
+
+	while ((total_chunks & 1) == 0) {
+		ASSERT3U(ctx->cv_stack_len, >, 0);
+		ctx->cv_stack_len--;
+		bcopy(&ctx->cv_stack[ctx->cv_stack_len * BLAKE3_OUT_LEN],
+		    block, BLAKE3_OUT_LEN);
+		blake3_parent_output(block, ctx->key, ctx->chunk.flags, &o);
+		blake3_output_cv(&o, block + BLAKE3_OUT_LEN);
+		total_chunks >>= 1;
+	}
+
+	ASSERT3U(ctx->cv_stack_len, <=, BLAKE3_MAX_DEPTH);
+	bcopy(block + BLAKE3_OUT_LEN,
+	    &ctx->cv_stack[ctx->cv_stack_len * BLAKE3_OUT_LEN], BLAKE3_OUT_LEN);
+	ctx->cv_stack_len++;
+}
+
+static void
+blake3_init_common(BLAKE3_CTX *ctx, const uint32_t key[8], uint8_t flags)
+{
+	bcopy(key, ctx->key, sizeof (ctx->key));
+	blake3_chunk_state_init(&ctx->chunk, key, 0, flags);
+	ctx->cv_stack_len = 0;
+}
+
+void
+Blake3_Init(BLAKE3_CTX *ctx)
+{
+	blake3_init_common(ctx, blake3_iv, 0);
+}
+
+void
+Blake3_InitKeyed(BLAKE3_CTX *ctx, const uint8_t key[BLAKE3_KEY_LEN])
+{
+	uint32_t key_words[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		key_words[i] = blake3_load32(key + 4 * i);
+
+	blake3_init_common(ctx, key_words, BLAKE3_KEYED_HASH);
+}
+
+void
+Blake3_Update(BLAKE3_CTX *ctx, const void *data, size_t len)
+{
+	uint8_t cvs[BLAKE3_MAX_SIMD_DEGREE * BLAKE3_OUT_LEN];
+	const blake3_impl_ops_t *ops;
+	const uint8_t *in = data;
+	blake3_output_t o;
+	uint64_t counter;
+	size_t i, n;
+
+	if (len == 0)
+		return;
+
+	/*
+	 * Fill the pending chunk.  If more input follows it is not the last
+	 * chunk, so its chaining value can be computed now.
+	 */
+	if (blake3_chunk_state_len(&ctx->chunk) > 0) {
+		n = MIN(BLAKE3_CHUNK_LEN -
+		    blake3_chunk_state_len(&ctx->chunk), len);
+		blake3_chunk_state_update(&ctx->chunk, in, n);
+		in += n;
+		len -= n;
+		if (len == 0)
+			return;
+
+		counter = ctx->chunk.chunk_counter;
+		blake3_chunk_state_output(&ctx->chunk, &o);
+		blake3_output_cv(&o, cvs);
+		blake3_push_cv(ctx, cvs, counter + 1);
+		blake3_chunk_state_init(&ctx->chunk, ctx->key, counter + 1,
+		    ctx->chunk.flags);
+	}
+
+	/*
+	 * Hash whole chunks in batches, always leaving at least one byte of
+	 * input for the pending chunk since the last chunk may be the root.
+	 */
+	ops = blake3_impl_get_ops();
+	while (len > BLAKE3_CHUNK_LEN) {
+		n = MIN((len - 1) / BLAKE3_CHUNK_LEN, BLAKE3_MAX_SIMD_DEGREE);
+		counter = ctx->chunk.chunk_counter;
+
+		ops->hash_many(in, n, ctx->key, counter, ctx->chunk.flags, cvs);
+		for (i = 0; i < n; i++)
+			blake3_push_cv(ctx, &cvs[i * BLAKE3_OUT_LEN],
+			    counter + i + 1);
+
+		blake3_chunk_state_init(&ctx->chunk, ctx->key, counter + n,
+		    ctx->chunk.flags);
+		in += n * BLAKE3_CHUNK_LEN;
+		len -= n * BLAKE3_CHUNK_LEN;
+	}
+
+	blake3_chunk_state_update(&ctx->chunk, in, len);
+}
+
+/*
+ * Write the 256-bit digest to out.  The context is not modified, so more
+ * input may still be added afterwards.
+ */
+void
+Blake3_Final(const BLAKE3_CTX *ctx, uint8_t *out)
+{
+	uint8_t block[BLAKE3_BLOCK_LEN];
+	blake3_output_t o;
+	int i;
+
+	/* Merge the pending chunk with all subtrees up to the root */
+	blake3_chunk_state_output(&ctx->chunk, &o);
+	for (i = ctx->cv_stack_len; i > 0; i--) {
+		bcopy(&ctx->cv_stack[(i - 1) * BLAKE3_OUT_LEN], block,
+		    BLAKE3_OUT_LEN);
+		blake3_output_cv(&o, block + BLAKE3_OUT_LEN);
+		blake3_parent_output(block, ctx->key, ctx->chunk.flags, &o);
+	}
+
+	blake3_output_root(&o, out);
+}
+
+#if defined(_KERNEL)
+EXPORT_SYMBOL(Blake3_Init);
+EXPORT_SYMBOL(Blake3_InitKeyed);
+EXPORT_SYMBOL(Blake3_Update);
+EXPORT_SYMBOL(Blake3_Final);
+#endif
@@ -0,0 +1,48 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/isa_defs.h>
+
+#if defined(__x86_64) && defined(HAVE_AVX512F)
+
+#include <linux/simd_x86.h>
+
+/*
+ * AVX-512F implementation, hashing 16 chunks in parallel.
+ */
+#define	BLAKE3_SIMD_LANES	16
+#define	BLAKE3_SIMD_TARGET	"avx512f"
+
+#include "blake3_simd_impl.h"
+
+static boolean_t
+blake3_avx512_will_work(void)
+{
+	return (kfpu_allowed() && zfs_avx512f_available());
+}
+
+const blake3_impl_ops_t blake3_avx512_impl = {
+	.hash_many = &simd_hash_many,
+	.is_supported = &blake3_avx512_will_work,
+	.name = "avx512"
+};
+
+#endif /* defined(__x86_64) && defined(HAVE_AVX512F) */
@@ -0,0 +1,147 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Portable BLAKE3 compression function.
+ */
+
+#include <sys/zfs_context.h>
+#include <blake3/blake3_impl.h>
+
+const uint32_t blake3_iv[8] = {
+	0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+	0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
+};
+
+/* The message word permutation applied before each round */
+const uint8_t blake3_msg_schedule[BLAKE3_ROUNDS][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+	{ 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+	{ 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+	{ 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+	{ 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+	{ 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+#define	ROTR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+#define	G(s, a, b, c, d, x, y)					\
+{								\
+	s[a] = s[a] + s[b] + (x);				\
+	s[d] = ROTR32(s[d] ^ s[a], 16);				\
+	s[c] = s[c] + s[d];					\
+	s[b] = ROTR32(s[b] ^ s[c], 12);				\
+	s[a] = s[a] + s[b] + (y);				\
+	s[d] = ROTR32(s[d] ^ s[a], 8);				\
+	s[c] = s[c] + s[d];					\
+	s[b] = ROTR32(s[b] ^ s[c], 7);				\
+}
+
+static inline void
+blake3_round(uint32_t s[16], const uint32_t m[16], const uint8_t sched[16])
+{
+	/* Mix the columns */
+	G(s, 0, 4, 8, 12, m[sched[0]], m[sched[1]]);
+	G(s, 1, 5, 9, 13, m[sched[2]], m[sched[3]]);
+	G(s, 2, 6, 10, 14, m[sched[4]], m[sched[5]]);
+	G(s, 3, 7, 11, 15, m[sched[6]], m[sched[7]]);
+
+	/* Mix the diagonals */
+	G(s, 0, 5, 10, 15, m[sched[8]], m[sched[9]]);
+	G(s, 1, 6, 11, 12, m[sched[10]], m[sched[11]]);
+	G(s, 2, 7, 8, 13, m[sched[12]], m[sched[13]]);
+	G(s, 3, 4, 9, 14, m[sched[14]], m[sched[15]]);
+}
+
+void
+blake3_compress_generic(const uint32_t cv[8],
+    const uint8_t block[BLAKE3_BLOCK_LEN], uint8_t block_len,
+    uint64_t counter, uint8_t flags, uint32_t out[16])
+{
+	uint32_t m[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		m[i] = blake3_load32(block + 4 * i);
+
+	for (i = 0; i < 8; i++)
+		out[i] = cv[i];
+	out[8] = blake3_iv[0];
+	out[9] = blake3_iv[1];
+	out[10] = blake3_iv[2];
+	out[11] = blake3_iv[3];
+	out[12] = (uint32_t)counter;
+	out[13] = (uint32_t)(counter >> 32);
+	out[14] = (uint32_t)block_len;
+	out[15] = (uint32_t)flags;
+
+	for (i = 0; i < BLAKE3_ROUNDS; i++)
+		blake3_round(out, m, blake3_msg_schedule[i]);
+
+	for (i = 0; i < 8; i++) {
+		out[i] ^= out[i + 8];
+		out[i + 8] ^= cv[i];
+	}
+}
+
+static void
+blake3_generic_hash_many(const uint8_t *in, size_t nchunks,
+    const uint32_t key[8], uint64_t counter, uint8_t flags, uint8_t *out)
+{
+	uint32_t cv[8], state[16];
+	size_t c, b;
+	int i;
+
+	for (c = 0; c < nchunks; c++, counter++) {
+		bcopy(key, cv, sizeof (cv));
+
+		for (b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+			uint8_t bflags = flags;
+
+			if (b == 0)
+				bflags |= BLAKE3_CHUNK_START;
+			if (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1)
+				bflags |= BLAKE3_CHUNK_END;
+
+			blake3_compress_generic(cv, in, BLAKE3_BLOCK_LEN,
+			    counter, bflags, state);
+			bcopy(state, cv, sizeof (cv));
+			in += BLAKE3_BLOCK_LEN;
+		}
+
+		for (i = 0; i < 8; i++)
+			blake3_store32(out + 4 * i, cv[i]);
+		out += BLAKE3_OUT_LEN;
+	}
+}
+
+static boolean_t
+blake3_generic_will_work(void)
+{
+	return (B_TRUE);
+}
+
+const blake3_impl_ops_t blake3_generic_impl = {
+	.hash_many = &blake3_generic_hash_many,
+	.is_supported = &blake3_generic_will_work,
+	.name = "generic"
+};
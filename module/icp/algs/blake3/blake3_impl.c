@@ -0,0 +1,431 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/crypto/icp.h>
+#include <blake3/blake3_impl.h>
+#include <linux/simd.h>
+
+/*
+ * Implementation of the BLAKE3 hash_many() selection.  All supported
+ * implementations are benchmarked when the module is loaded and the fastest
+ * one is used by default.  The results are reported by the blake3_bench
+ * kstat, and the icp_blake3_impl module parameter allows a specific
+ * implementation to be selected.
+ */
+
+static blake3_impl_ops_t blake3_fastest_impl = {
+	.name = "fastest"
+};
+
+/* All compiled in implementations */
+const blake3_impl_ops_t *blake3_all_impl[] = {
+	&blake3_generic_impl,
+#if defined(__x86_64) && defined(HAVE_SSE4_1)
+	&blake3_sse41_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX2)
+	&blake3_avx2_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX512F)
+	&blake3_avx512_impl,
+#endif
+};
+
+/* Indicate that benchmark has been completed */
+static boolean_t blake3_impl_initialized = B_FALSE;
+
+/* Select blake3 implementation */
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX-1)
+
+#define	BLAKE3_IMPL_READ(i) (*(volatile uint32_t *) &(i))
+
+static uint32_t icp_blake3_impl = IMPL_FASTEST;
+static uint32_t user_sel_impl = IMPL_FASTEST;
+
+/* Hold all supported implementations */
+static size_t blake3_supp_impl_cnt = 0;
+static blake3_impl_ops_t *blake3_supp_impl[ARRAY_SIZE(blake3_all_impl)];
+
+#if defined(_KERNEL)
+static kstat_t *blake3_kstat;
+
+/*
+ * One entry per supported implementation holding its benchmark result in
+ * bytes per second, followed by the index of the fastest implementation
+ * and the current selection.
+ */
+static struct blake3_kstat {
+	uint64_t value;
+} blake3_stat_data[ARRAY_SIZE(blake3_all_impl) + 2];
+
+#define	BLAKE3_STAT_FASTEST	(&blake3_stat_data[blake3_supp_impl_cnt])
+#define	BLAKE3_STAT_ACTIVE	(&blake3_stat_data[blake3_supp_impl_cnt + 1])
+#endif
+
+/*
+ * Returns the BLAKE3 operations.  When a SIMD implementation is not
+ * allowed in the current context, or the implementations have not been
+ * initialized yet, then fallback to the generic implementation.
+ */
+const blake3_impl_ops_t *
+blake3_impl_get_ops(void)
+{
+	if (!blake3_impl_initialized || !kfpu_allowed())
+		return (&blake3_generic_impl);
+
+	const blake3_impl_ops_t *ops = NULL;
+	const uint32_t impl = BLAKE3_IMPL_READ(icp_blake3_impl);
+
+	switch (impl) {
+	case IMPL_FASTEST:
+		ops = &blake3_fastest_impl;
+		break;
+	case IMPL_CYCLE:
+		/* Cycle through supported implementations */
+		ASSERT3U(blake3_supp_impl_cnt, >, 0);
+		static size_t cycle_impl_idx = 0;
+		size_t idx = (++cycle_impl_idx) % blake3_supp_impl_cnt;
+		ops = blake3_supp_impl[idx];
+		break;
+	default:
+		ASSERT3U(impl, <, blake3_supp_impl_cnt);
+		ASSERT3U(blake3_supp_impl_cnt, >, 0);
+		if (impl < ARRAY_SIZE(blake3_all_impl))
+			ops = blake3_supp_impl[impl];
+		break;
+	}
+
+	ASSERT3P(ops, !=, NULL);
+
+	return (ops);
+}
+
+#if defined(_KERNEL)
+/*
+ * BLAKE3 kstats
+ */
+static int
+blake3_kstat_headers(char *buf, size_t size)
+{
+	ssize_t off = 0;
+
+	off += snprintf(buf + off, size, "%-17s", "implementation");
+	(void) snprintf(buf + off, size - off, "%-15s\n", "bytes/s");
+
+	return (0);
+}
+
+static int
+blake3_kstat_data(char *buf, size_t size, void *data)
+{
+	struct blake3_kstat *curr_stat = (struct blake3_kstat *)data;
+	ssize_t off = 0;
+
+	if (curr_stat == BLAKE3_STAT_FASTEST) {
+		off += snprintf(buf + off, size - off, "%-17s", "fastest");
+		off += snprintf(buf + off, size - off, "%-15s\n",
+		    blake3_supp_impl[curr_stat->value]->name);
+	} else if (curr_stat == BLAKE3_STAT_ACTIVE) {
+		const uint32_t impl = BLAKE3_IMPL_READ(icp_blake3_impl);
+		const uint64_t fastest = BLAKE3_STAT_FASTEST->value;
+		const char *name;
+
+		if (impl == IMPL_FASTEST)
+			name = blake3_supp_impl[fastest]->name;
+		else if (impl == IMPL_CYCLE)
+			name = "cycle";
+		else
+			name = blake3_supp_impl[impl]->name;
+
+		off += snprintf(buf + off, size - off, "%-17s", "active");
+		off += snprintf(buf + off, size - off, "%-15s\n", name);
+	} else {
+		ptrdiff_t id = curr_stat - blake3_stat_data;
+
+		off += snprintf(buf + off, size - off, "%-17s",
+		    blake3_supp_impl[id]->name);
+		off += snprintf(buf + off, size - off, "%-15llu\n",
+		    (u_longlong_t)curr_stat->value);
+	}
+
+	return (0);
+}
+
+static void *
+blake3_kstat_addr(kstat_t *ksp, loff_t n)
+{
+	if (n <= blake3_supp_impl_cnt + 1)
+		ksp->ks_private = (void *) (blake3_stat_data + n);
+	else
+		ksp->ks_private = NULL;
+
+	return (ksp->ks_private);
+}
+
+#define	BLAKE3_BENCH_NS	(MSEC2NSEC(10))		/* 10ms */
+
+/*
+ * Measure the throughput of each supported implementation hashing a
+ * 128KiB buffer and record the fastest one.
+ */
+static void
+blake3_benchmark_impl(void)
+{
+	static const size_t data_size = 128 * 1024;
+	const size_t nchunks = data_size / BLAKE3_CHUNK_LEN;
+	uint8_t *databuf = vmem_alloc(data_size, KM_SLEEP);
+	uint8_t *cvs = kmem_alloc(nchunks * BLAKE3_OUT_LEN, KM_SLEEP);
+	uint64_t run_bw, run_time_ns, best_run = 0;
+	hrtime_t start;
+	size_t c, n;
+	int i, l;
+
+	for (i = 0; i < data_size / sizeof (uint64_t); i++)
+		((uint64_t *)databuf)[i] = (uintptr_t)(databuf+i); /* warm-up */
+
+	for (i = 0; i < blake3_supp_impl_cnt; i++) {
+		const blake3_impl_ops_t *ops = blake3_supp_impl[i];
+		uint64_t run_count = 0;
+
+		kpreempt_disable();
+		start = gethrtime();
+		do {
+			for (l = 0; l < 4; l++, run_count++) {
+				/* in the batches used by Blake3_Update() */
+				for (c = 0; c < nchunks; c += n) {
+					n = MIN(nchunks - c,
+					    BLAKE3_MAX_SIMD_DEGREE);
+					ops->hash_many(databuf +
+					    c * BLAKE3_CHUNK_LEN, n,
+					    blake3_iv, c, 0,
+					    cvs + c * BLAKE3_OUT_LEN);
+				}
+			}
+
+			run_time_ns = gethrtime() - start;
+		} while (run_time_ns < BLAKE3_BENCH_NS);
+		kpreempt_enable();
+
+		run_bw = data_size * run_count * NANOSEC;
+		run_bw /= run_time_ns;	/* B/s */
+
+		blake3_stat_data[i].value = run_bw;
+
+		if (run_bw > best_run) {
+			best_run = run_bw;
+			BLAKE3_STAT_FASTEST->value = i;
+			memcpy(&blake3_fastest_impl, ops,
+			    sizeof (blake3_fastest_impl));
+		}
+	}
+
+	kmem_free(cvs, nchunks * BLAKE3_OUT_LEN);
+	vmem_free(databuf, data_size);
+}
+#endif /* _KERNEL */
+
+/*
+ * Initialize and benchmark all supported implementations.
+ */
+/* ARGSUSED */
+static void
+blake3_benchmark(void *arg)
+{
+	blake3_impl_ops_t *curr_impl;
+	int i, c;
+
+	/* Move supported implementations into blake3_supp_impl */
+	for (i = 0, c = 0; i < ARRAY_SIZE(blake3_all_impl); i++) {
+		curr_impl = (blake3_impl_ops_t *)blake3_all_impl[i];
+
+		if (curr_impl->is_supported())
+			blake3_supp_impl[c++] = (blake3_impl_ops_t *)curr_impl;
+	}
+	blake3_supp_impl_cnt = c;
+
+#if defined(_KERNEL)
+	blake3_benchmark_impl();
+#else
+	/*
+	 * Skip the benchmark in user space to avoid impacting libzpool
+	 * consumers.  The last implementation is assumed to be the fastest.
+	 */
+	memcpy(&blake3_fastest_impl, blake3_supp_impl[c - 1],
+	    sizeof (blake3_fastest_impl));
+#endif
+	strcpy(blake3_fastest_impl.name, "fastest");
+}
+
+void
+blake3_impl_init(void)
+{
+#if defined(_KERNEL)
+	/*
+	 * The benchmarks are run in a kernel thread to allow Linux 5.0+
+	 * kernels to use SIMD operations, see include/linux/simd_x86.h.
+	 */
+	taskqid_t id = taskq_dispatch(system_taskq, blake3_benchmark,
+	    NULL, TQ_SLEEP);
+	if (id != TASKQID_INVALID) {
+		taskq_wait_id(system_taskq, id);
+	} else {
+		blake3_benchmark(NULL);
+	}
+
+	/* Install kstats for all implementations */
+	blake3_kstat = kstat_create("zfs", 0, "blake3_bench", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (blake3_kstat != NULL) {
+		blake3_kstat->ks_data = NULL;
+		blake3_kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(blake3_kstat,
+		    blake3_kstat_headers,
+		    blake3_kstat_data,
+		    blake3_kstat_addr);
+		kstat_install(blake3_kstat);
+	}
+#else
+	blake3_benchmark(NULL);
+#endif
+
+	/* Finish initialization */
+	atomic_swap_32(&icp_blake3_impl, user_sel_impl);
+	blake3_impl_initialized = B_TRUE;
+}
+
+void
+blake3_impl_fini(void)
+{
+#if defined(_KERNEL)
+	if (blake3_kstat != NULL) {
+		kstat_delete(blake3_kstat);
+		blake3_kstat = NULL;
+	}
+#endif
+}
+
+static const struct {
+	char *name;
+	uint32_t sel;
+} blake3_impl_opts[] = {
+		{ "cycle",	IMPL_CYCLE },
+		{ "fastest",	IMPL_FASTEST },
+};
+
+/*
+ * Function sets desired blake3 implementation.
+ *
+ * If we are called before init(), user preference will be saved in
+ * user_sel_impl, and applied in later init() call. This occurs when module
+ * parameter is specified on module load. Otherwise, directly update
+ * icp_blake3_impl.
+ *
+ * @val		Name of blake3 implementation to use
+ * @param	Unused.
+ */
+int
+blake3_impl_set(const char *val)
+{
+	int err = -EINVAL;
+	char req_name[BLAKE3_IMPL_NAME_MAX];
+	uint32_t impl = BLAKE3_IMPL_READ(user_sel_impl);
+	size_t i;
+
+	/* sanitize input */
+	i = strnlen(val, BLAKE3_IMPL_NAME_MAX);
+	if (i == 0 || i >= BLAKE3_IMPL_NAME_MAX)
+		return (err);
+
+	strlcpy(req_name, val, BLAKE3_IMPL_NAME_MAX);
+	while (i > 0 && isspace(req_name[i-1]))
+		i--;
+	req_name[i] = '\0';
+
+	/* Check mandatory options */
+	for (i = 0; i < ARRAY_SIZE(blake3_impl_opts); i++) {
+		if (strcmp(req_name, blake3_impl_opts[i].name) == 0) {
+			impl = blake3_impl_opts[i].sel;
+			err = 0;
+			break;
+		}
+	}
+
+	/* check all supported impl if init() was already called */
+	if (err != 0 && blake3_impl_initialized) {
+		/* check all supported implementations */
+		for (i = 0; i < blake3_supp_impl_cnt; i++) {
+			if (strcmp(req_name, blake3_supp_impl[i]->name) == 0) {
+				impl = i;
+				err = 0;
+				break;
+			}
+		}
+	}
+
+	if (err == 0) {
+		if (blake3_impl_initialized)
+			atomic_swap_32(&icp_blake3_impl, impl);
+		else
+			atomic_swap_32(&user_sel_impl, impl);
+	}
+
+	return (err);
+}
+
+#if defined(_KERNEL)
+#include <linux/mod_compat.h>
+
+static int
+icp_blake3_impl_set(const char *val, zfs_kernel_param_t *kp)
+{
+	return (blake3_impl_set(val));
+}
+
+static int
+icp_blake3_impl_get(char *buffer, zfs_kernel_param_t *kp)
+{
+	int i, cnt = 0;
+	char *fmt;
+	const uint32_t impl = BLAKE3_IMPL_READ(icp_blake3_impl);
+
+	ASSERT(blake3_impl_initialized);
+
+	/* list mandatory options */
+	for (i = 0; i < ARRAY_SIZE(blake3_impl_opts); i++) {
+		fmt = (impl == blake3_impl_opts[i].sel) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, blake3_impl_opts[i].name);
+	}
+
+	/* list all supported implementations */
+	for (i = 0; i < blake3_supp_impl_cnt; i++) {
+		fmt = (i == impl) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, blake3_supp_impl[i]->name);
+	}
+
+	return (cnt);
+}
+
+module_param_call(icp_blake3_impl, icp_blake3_impl_set, icp_blake3_impl_get,
+    NULL, 0644);
+MODULE_PARM_DESC(icp_blake3_impl, "Select blake3 implementation.");
+#endif
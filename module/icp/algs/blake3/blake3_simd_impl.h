@@ -0,0 +1,263 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Template for the x86 SIMD implementations of blake3_impl_ops_t
+ * hash_many().  Each lane of a vector holds one word of the state of a
+ * different chunk, so BLAKE3_SIMD_LANES chunks are hashed in parallel
+ * with exactly the operations of the portable compression function.
+ *
+ * The vectors are written with the GCC vector extensions rather than
+ * intrinsics, which are not available to kernel code.  Functions using
+ * them are compiled for the instruction set named by BLAKE3_SIMD_TARGET
+ * and may only be called between kfpu_begin() and kfpu_end().
+ *
+ * The including file defines:
+ *
+ *   BLAKE3_SIMD_LANES	number of 32-bit lanes per vector, 4, 8 or 16
+ *   BLAKE3_SIMD_TARGET	target attribute for the vector code
+ */
+
+#ifndef	_BLAKE3_SIMD_IMPL_H
+#define	_BLAKE3_SIMD_IMPL_H
+
+#include <sys/zfs_context.h>
+#include <blake3/blake3_impl.h>
+#include <linux/simd.h>
+
+#if !defined(BLAKE3_SIMD_LANES) || !defined(BLAKE3_SIMD_TARGET)
+#error "BLAKE3_SIMD_LANES and BLAKE3_SIMD_TARGET must be defined"
+#endif
+
+#define	LANES	BLAKE3_SIMD_LANES
+
+typedef uint32_t v_t __attribute__((vector_size(LANES * 4)));
+
+/* Used to access the input and output, which may be unaligned */
+typedef uint32_t v_unaligned_t
+    __attribute__((vector_size(LANES * 4), aligned(1), may_alias));
+
+#define	SIMD_TARGET	__attribute__((target(BLAKE3_SIMD_TARGET)))
+#define	SIMD_INLINE	static inline __attribute__((always_inline)) SIMD_TARGET
+
+/*
+ * Masks interleaving the low and high halves of two vectors,
+ * { a0, b0, a1, b1, ... } and { aN/2, bN/2, ... }.
+ */
+#if LANES == 4
+#define	INTERLEAVE_LO	0, 4, 1, 5
+#define	INTERLEAVE_HI	2, 6, 3, 7
+#elif LANES == 8
+#define	INTERLEAVE_LO	0, 8, 1, 9, 2, 10, 3, 11
+#define	INTERLEAVE_HI	4, 12, 5, 13, 6, 14, 7, 15
+#elif LANES == 16
+#define	INTERLEAVE_LO	0, 16, 1, 17, 2, 18, 3, 19, \
+			4, 20, 5, 21, 6, 22, 7, 23
+#define	INTERLEAVE_HI	8, 24, 9, 25, 10, 26, 11, 27, \
+			12, 28, 13, 29, 14, 30, 15, 31
+#else
+#error "Unsupported BLAKE3_SIMD_LANES"
+#endif
+
+#if defined(__clang__)
+#define	SHUFFLE_LO(a, b)	__builtin_shufflevector(a, b, INTERLEAVE_LO)
+#define	SHUFFLE_HI(a, b)	__builtin_shufflevector(a, b, INTERLEAVE_HI)
+#else
+static const v_t simd_interleave_lo = { INTERLEAVE_LO };
+static const v_t simd_interleave_hi = { INTERLEAVE_HI };
+#define	SHUFFLE_LO(a, b)	__builtin_shuffle(a, b, simd_interleave_lo)
+#define	SHUFFLE_HI(a, b)	__builtin_shuffle(a, b, simd_interleave_hi)
+#endif
+
+#define	VROTR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+#define	VG(s, a, b, c, d, x, y)					\
+{								\
+	s[a] = s[a] + s[b] + (x);				\
+	s[d] = VROTR(s[d] ^ s[a], 16);				\
+	s[c] = s[c] + s[d];					\
+	s[b] = VROTR(s[b] ^ s[c], 12);				\
+	s[a] = s[a] + s[b] + (y);				\
+	s[d] = VROTR(s[d] ^ s[a], 8);				\
+	s[c] = s[c] + s[d];					\
+	s[b] = VROTR(s[b] ^ s[c], 7);				\
+}
+
+/*
+ * Local copy of blake3_msg_schedule, so the message indices become
+ * constants once the rounds are inlined.
+ */
+static const uint8_t simd_msg_schedule[BLAKE3_ROUNDS][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+	{ 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+	{ 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+	{ 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+	{ 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+	{ 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+SIMD_INLINE v_t
+simd_splat(uint32_t x)
+{
+	v_t v = { 0 };
+
+	return (v + x);
+}
+
+SIMD_INLINE void
+simd_round(v_t s[16], const v_t m[16], const int r)
+{
+	const uint8_t *sched = simd_msg_schedule[r];
+
+	VG(s, 0, 4, 8, 12, m[sched[0]], m[sched[1]]);
+	VG(s, 1, 5, 9, 13, m[sched[2]], m[sched[3]]);
+	VG(s, 2, 6, 10, 14, m[sched[4]], m[sched[5]]);
+	VG(s, 3, 7, 11, 15, m[sched[6]], m[sched[7]]);
+
+	VG(s, 0, 5, 10, 15, m[sched[8]], m[sched[9]]);
+	VG(s, 1, 6, 11, 12, m[sched[10]], m[sched[11]]);
+	VG(s, 2, 7, 8, 13, m[sched[12]], m[sched[13]]);
+	VG(s, 3, 4, 9, 14, m[sched[14]], m[sched[15]]);
+}
+
+/*
+ * Transpose LANES vectors in place.  Each step interleaves vector i with
+ * vector i + LANES / 2, after log2(LANES) steps row i holds column i.
+ */
+SIMD_INLINE void
+simd_transpose(v_t v[LANES])
+{
+	v_t t[LANES];
+	int i, step;
+
+	for (step = 1; step < LANES; step <<= 1) {
+		for (i = 0; i < LANES / 2; i++) {
+			t[2 * i] = SHUFFLE_LO(v[i], v[i + LANES / 2]);
+			t[2 * i + 1] = SHUFFLE_HI(v[i], v[i + LANES / 2]);
+		}
+		for (i = 0; i < LANES; i++)
+			v[i] = t[i];
+	}
+}
+
+/*
+ * Load message block b of every lane, m[j] holding word j of each.
+ */
+SIMD_INLINE void
+simd_load_msg(const uint8_t *const lane_in[LANES], int b, v_t m[16])
+{
+	int g, l;
+
+	for (g = 0; g < 16; g += LANES) {
+		for (l = 0; l < LANES; l++) {
+			m[g + l] = *(const v_unaligned_t *)(lane_in[l] +
+			    b * BLAKE3_BLOCK_LEN + g * 4);
+		}
+		simd_transpose(&m[g]);
+	}
+}
+
+/*
+ * Hash nlanes <= LANES chunks.  Unused lanes repeat the first chunk and
+ * their results are discarded.
+ */
+static void SIMD_TARGET
+simd_hash_lanes(const uint8_t *in, size_t nlanes, const uint32_t key[8],
+    uint64_t counter, uint8_t flags, uint8_t *out)
+{
+	const uint8_t *lane_in[LANES];
+	v_t s[16], m[16], ctr_lo, ctr_hi;
+	uint32_t cv[8][LANES];
+	size_t l;
+	int b, i;
+
+	for (l = 0; l < LANES; l++) {
+		size_t src = (l < nlanes) ? l : 0;
+
+		lane_in[l] = in + src * BLAKE3_CHUNK_LEN;
+		ctr_lo[l] = (uint32_t)(counter + src);
+		ctr_hi[l] = (uint32_t)((counter + src) >> 32);
+	}
+
+	for (i = 0; i < 8; i++)
+		s[i] = simd_splat(key[i]);
+
+	for (b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+		uint8_t bflags = flags;
+
+		if (b == 0)
+			bflags |= BLAKE3_CHUNK_START;
+		if (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1)
+			bflags |= BLAKE3_CHUNK_END;
+
+		simd_load_msg(lane_in, b, m);
+
+		s[8] = simd_splat(blake3_iv[0]);
+		s[9] = simd_splat(blake3_iv[1]);
+		s[10] = simd_splat(blake3_iv[2]);
+		s[11] = simd_splat(blake3_iv[3]);
+		s[12] = ctr_lo;
+		s[13] = ctr_hi;
+		s[14] = simd_splat(BLAKE3_BLOCK_LEN);
+		s[15] = simd_splat(bflags);
+
+		simd_round(s, m, 0);
+		simd_round(s, m, 1);
+		simd_round(s, m, 2);
+		simd_round(s, m, 3);
+		simd_round(s, m, 4);
+		simd_round(s, m, 5);
+		simd_round(s, m, 6);
+
+		for (i = 0; i < 8; i++)
+			s[i] ^= s[i + 8];
+	}
+
+	for (i = 0; i < 8; i++)
+		*(v_unaligned_t *)cv[i] = s[i];
+
+	for (l = 0; l < nlanes; l++) {
+		for (i = 0; i < 8; i++)
+			blake3_store32(out + l * BLAKE3_OUT_LEN + 4 * i,
+			    cv[i][l]);
+	}
+}
+
+static void
+simd_hash_many(const uint8_t *in, size_t nchunks, const uint32_t key[8],
+    uint64_t counter, uint8_t flags, uint8_t *out)
+{
+	size_t n;
+
+	kfpu_begin();
+	while (nchunks > 0) {
+		n = MIN(nchunks, LANES);
+		simd_hash_lanes(in, n, key, counter, flags, out);
+		in += n * BLAKE3_CHUNK_LEN;
+		out += n * BLAKE3_OUT_LEN;
+		counter += n;
+		nchunks -= n;
+	}
+	kfpu_end();
+}
+
+#endif	/* _BLAKE3_SIMD_IMPL_H */
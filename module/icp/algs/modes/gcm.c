@@ -36,6 +36,24 @@
 	(o)->mul((uint64_t *)(void *)(c)->gcm_ghash, (c)->gcm_H, \
 	(uint64_t *)(void *)(t));
 
+#if defined(__x86_64) && defined(HAVE_AES) && defined(HAVE_PCLMULQDQ)
+#define	CAN_USE_GCM_AESNI
+
+#include <aes/aes_impl.h>
+
+/* Bulk AES-NI and PCLMULQDQ routines, see gcm_aesni.S */
+extern void gcm_aesni_encrypt_blocks(const uint8_t *, uint8_t *, size_t,
+    const uint32_t *, int, uint64_t *, uint64_t *, const uint64_t *);
+extern void gcm_aesni_decrypt_blocks(const uint8_t *, uint8_t *, size_t,
+    const uint32_t *, int, uint64_t *, uint64_t *, const uint64_t *);
+extern void gcm_mul_pclmulqdq(uint64_t *, uint64_t *, uint64_t *);
+
+static void gcm_aesni_init(gcm_ctx_t *);
+static int gcm_aesni_encrypt(gcm_ctx_t *, uint8_t *, size_t, crypto_data_t *,
+    size_t *);
+static size_t gcm_aesni_decrypt(gcm_ctx_t *, uint8_t *, size_t);
+#endif
+
 /*
  * Encrypt multiple blocks of data in GCM mode.  Decrypt for GCM mode
  * is done in another function.
@@ -61,6 +79,30 @@ gcm_mode_encrypt_contiguous_blocks(gcm_ctx_t *ctx, char *data, size_t length,
 	uint64_t counter;
 	uint64_t counter_mask = ntohll(0x00000000ffffffffULL);
 
+#ifdef CAN_USE_GCM_AESNI
+	/*
+	 * Hand all whole blocks to the bulk routines when there is no
+	 * partial block left over from a previous call.
+	 */
+	if (ctx->gcm_use_aesni && ctx->gcm_remainder_len == 0 &&
+	    out != NULL && length >= block_size && kfpu_allowed()) {
+		size_t done;
+		int rv;
+
+		rv = gcm_aesni_encrypt(ctx, datap, P2ALIGN(length, block_size),
+		    out, &done);
+		if (rv != CRYPTO_SUCCESS)
+			return (rv);
+
+		data += done;
+		datap += done;
+		length -= done;
+		remainder -= done;
+		if (length == 0)
+			return (CRYPTO_SUCCESS);
+	}
+#endif
+
 	if (length + ctx->gcm_remainder_len < block_size) {
 		/* accumulate bytes here and return */
 		bcopy(datap,
@@ -338,6 +380,19 @@ gcm_decrypt_final(gcm_ctx_t *ctx, crypto_data_t *out, size_t block_size,
 	ghash = (uint8_t *)ctx->gcm_ghash;
 	blockp = ctx->gcm_pt_buf;
 	remainder = pt_len;
+
+#ifdef CAN_USE_GCM_AESNI
+	if (ctx->gcm_use_aesni && remainder >= block_size && kfpu_allowed()) {
+		size_t done;
+
+		done = gcm_aesni_decrypt(ctx, blockp,
+		    P2ALIGN(remainder, block_size));
+		processed += done;
+		blockp += done;
+		remainder -= done;
+	}
+#endif
+
 	while (remainder > 0) {
 		/* Incomplete last block */
 		if (remainder < block_size) {
@@ -562,6 +617,9 @@ gcm_init_ctx(gcm_ctx_t *gcm_ctx, char *param, size_t block_size,
 	    encrypt_block, copy_block, xor_block) != 0) {
 		rv = CRYPTO_MECHANISM_PARAM_INVALID;
 	}
+#ifdef CAN_USE_GCM_AESNI
+	gcm_aesni_init(gcm_ctx);
+#endif
 out:
 	return (rv);
 }
@@ -597,6 +655,9 @@ gmac_init_ctx(gcm_ctx_t *gcm_ctx, char *param, size_t block_size,
 	    encrypt_block, copy_block, xor_block) != 0) {
 		rv = CRYPTO_MECHANISM_PARAM_INVALID;
 	}
+#ifdef CAN_USE_GCM_AESNI
+	gcm_aesni_init(gcm_ctx);
+#endif
 out:
 	return (rv);
 }
@@ -809,6 +870,134 @@ gcm_impl_set(const char *val)
 	return (err);
 }
 
+#ifdef CAN_USE_GCM_AESNI
+/*
+ * Number of bytes the bulk routines process between kfpu_begin() and
+ * kfpu_end().  Larger chunks amortize the FPU state save and restore over
+ * more data, smaller chunks bound the time spent with preemption
+ * disabled.  Rounded down to a multiple of the block size.
+ */
+static uint32_t icp_gcm_aesni_chunk_size = 32 * 1024;
+
+static boolean_t
+gcm_aesni_will_work(void)
+{
+	return (kfpu_allowed() && zfs_aes_available() &&
+	    zfs_pclmulqdq_available());
+}
+
+static size_t
+gcm_aesni_chunk(void)
+{
+	return (MAX(P2ALIGN((size_t)GCM_IMPL_READ(icp_gcm_aesni_chunk_size),
+	    AES_BLOCK_LEN), AES_BLOCK_LEN));
+}
+
+/*
+ * Decide whether the bulk routines may be used for this context, and if
+ * so precompute the powers of H they need.  This requires the AES key
+ * schedule to be in the AES-NI format, and is only done when the
+ * "fastest" GCM implementation is selected so that the other settings
+ * of icp_gcm_impl keep their block at a time behavior.
+ */
+static void
+gcm_aesni_init(gcm_ctx_t *ctx)
+{
+	const aes_key_t *ks = (aes_key_t *)ctx->gcm_keysched;
+	int i;
+
+	ctx->gcm_use_aesni = B_FALSE;
+
+	if (GCM_IMPL_READ(icp_gcm_impl) != IMPL_FASTEST ||
+	    !gcm_aesni_will_work() || ks == NULL ||
+	    ks->ops->generate != aes_aesni_impl.generate)
+		return;
+
+	kfpu_begin();
+	bcopy(ctx->gcm_H, ctx->gcm_Htable[0], sizeof (ctx->gcm_H));
+	for (i = 1; i < ARRAY_SIZE(ctx->gcm_Htable); i++) {
+		gcm_mul_pclmulqdq(ctx->gcm_Htable[i - 1], ctx->gcm_H,
+		    ctx->gcm_Htable[i]);
+	}
+	kfpu_end();
+
+	ctx->gcm_use_aesni = B_TRUE;
+}
+
+/*
+ * Encrypt and hash "length" bytes of whole blocks at "datap", writing the
+ * ciphertext to "out".  The ciphertext is produced into a bounce buffer
+ * one chunk at a time, as "out" may be scattered over several iovecs.
+ * The number of bytes consumed is returned in "donep".
+ */
+static int
+gcm_aesni_encrypt(gcm_ctx_t *ctx, uint8_t *datap, size_t length,
+    crypto_data_t *out, size_t *donep)
+{
+	const aes_key_t *ks = (aes_key_t *)ctx->gcm_keysched;
+	size_t chunk_size = MIN(gcm_aesni_chunk(), length);
+	size_t done = 0;
+	uint8_t *ct_buf;
+	int rv = CRYPTO_SUCCESS;
+
+	ASSERT0(P2PHASE(length, AES_BLOCK_LEN));
+
+	*donep = 0;
+	ct_buf = vmem_alloc(chunk_size, ctx->gcm_kmflag);
+	if (ct_buf == NULL)
+		return (CRYPTO_HOST_MEMORY);
+
+	while (done < length) {
+		size_t n = MIN(length - done, chunk_size);
+
+		kfpu_begin();
+		gcm_aesni_encrypt_blocks(datap + done, ct_buf,
+		    n / AES_BLOCK_LEN, ks->encr_ks.ks32, ks->nr,
+		    ctx->gcm_cb, ctx->gcm_ghash, ctx->gcm_Htable[0]);
+		kfpu_end();
+
+		rv = crypto_put_output_data(ct_buf, out, n);
+		if (rv != CRYPTO_SUCCESS)
+			break;
+		out->cd_offset += n;
+		ctx->gcm_processed_data_len += n;
+		done += n;
+	}
+
+	vmem_free(ct_buf, chunk_size);
+	*donep = done;
+
+	return (rv);
+}
+
+/*
+ * Hash and decrypt, in place, "length" bytes of whole blocks at "datap".
+ */
+static size_t
+gcm_aesni_decrypt(gcm_ctx_t *ctx, uint8_t *datap, size_t length)
+{
+	const aes_key_t *ks = (aes_key_t *)ctx->gcm_keysched;
+	size_t chunk_size = gcm_aesni_chunk();
+	size_t done = 0;
+
+	ASSERT0(P2PHASE(length, AES_BLOCK_LEN));
+
+	while (done < length) {
+		size_t n = MIN(length - done, chunk_size);
+
+		kfpu_begin();
+		gcm_aesni_decrypt_blocks(datap + done, datap + done,
+		    n / AES_BLOCK_LEN, ks->encr_ks.ks32, ks->nr,
+		    ctx->gcm_cb, ctx->gcm_ghash, ctx->gcm_Htable[0]);
+		kfpu_end();
+
+		done += n;
+	}
+
+	return (done);
+}
+#endif /* CAN_USE_GCM_AESNI */
+
 #if defined(_KERNEL)
 #include <linux/mod_compat.h>
 
@@ -845,4 +1034,12 @@ icp_gcm_impl_get(char *buffer, zfs_kernel_param_t *kp)
 module_param_call(icp_gcm_impl, icp_gcm_impl_set, icp_gcm_impl_get,
     NULL, 0644);
 MODULE_PARM_DESC(icp_gcm_impl, "Select gcm implementation.");
+
+#ifdef CAN_USE_GCM_AESNI
+/* BEGIN CSTYLED */
+module_param(icp_gcm_aesni_chunk_size, uint, 0644);
+MODULE_PARM_DESC(icp_gcm_aesni_chunk_size,
+	"Bytes of AES-GCM processed per FPU section by the AES-NI path.");
+/* END CSTYLED */
+#endif
 #endif
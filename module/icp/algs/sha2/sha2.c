@@ -40,6 +40,7 @@
 #define	_SHA2_IMPL
 #include <sys/sha2.h>
 #include <sha2/sha2_consts.h>
+#include <sha2/sha2_impl.h>
 
 #define	_RESTRICT_KYWD
 
@@ -55,16 +56,19 @@ static void Encode64(uint8_t *, uint64_t *, size_t);
 /* userspace only supports the generic version */
 #if	defined(__amd64) && defined(_KERNEL)
 #define	SHA512Transform(ctx, in) SHA512TransformBlocks((ctx), (in), 1)
-#define	SHA256Transform(ctx, in) SHA256TransformBlocks((ctx), (in), 1)
 
 void SHA512TransformBlocks(SHA2_CTX *ctx, const void *in, size_t num);
-void SHA256TransformBlocks(SHA2_CTX *ctx, const void *in, size_t num);
 
 #else
-static void SHA256Transform(SHA2_CTX *, const uint8_t *);
 static void SHA512Transform(SHA2_CTX *, const uint8_t *);
 #endif	/* __amd64 && _KERNEL */
 
+/*
+ * SHA-256 blocks are processed by the implementation returned by
+ * sha256_impl_get_ops(), see sha256_impl.c.
+ */
+static void SHA256Transform(SHA2_CTX *, const uint8_t *);
+
 static uint8_t PADDING[128] = { 0x80, /* all zeros */ };
 
 /*
@@ -143,7 +147,6 @@ static uint8_t PADDING[128] = { 0x80, /* all zeros */ };
 #endif	/* _BIG_ENDIAN */
 
 
-#if	!defined(__amd64) || !defined(_KERNEL)
 /* SHA256 Transform */
 
 static void
@@ -352,7 +355,45 @@ SHA256Transform(SHA2_CTX *ctx, const uint8_t *blk)
 	ctx->state.s32[7] += h;
 }
 
+static void
+sha256_generic_blocks(SHA2_CTX *ctx, const void *in, size_t num)
+{
+	const uint8_t *blk = in;
+
+	for (; num > 0; num--, blk += 64)
+		SHA256Transform(ctx, blk);
+}
+
+static boolean_t
+sha256_generic_will_work(void)
+{
+	return (B_TRUE);
+}
+
+const sha256_impl_ops_t sha256_generic_impl = {
+	.transform = &sha256_generic_blocks,
+	.is_supported = &sha256_generic_will_work,
+	.name = "generic"
+};
+
+#if defined(__x86_64)
+void SHA256TransformBlocks(SHA2_CTX *ctx, const void *in, size_t num);
+
+static boolean_t
+sha256_x86_64_will_work(void)
+{
+	return (B_TRUE);
+}
+
+const sha256_impl_ops_t sha256_x86_64_impl = {
+	.transform = &SHA256TransformBlocks,
+	.is_supported = &sha256_x86_64_will_work,
+	.name = "x86_64"
+};
+#endif	/* __x86_64 */
 
+
+#if	!defined(__amd64) || !defined(_KERNEL)
 /* SHA384 and SHA512 Transform */
 
 static void
@@ -784,12 +825,14 @@ SHA2Update(SHA2_CTX *ctx, const void *inptr, size_t input_len)
 	uint32_t	i, buf_index, buf_len, buf_limit;
 	const uint8_t	*input = inptr;
 	uint32_t	algotype = ctx->algotype;
+	const sha256_impl_ops_t *ops = NULL;
 
 	/* check for noop */
 	if (input_len == 0)
 		return;
 
 	if (algotype <= SHA256_HMAC_GEN_MECH_INFO_TYPE) {
+		ops = sha256_impl_get_ops();
 		buf_limit = 64;
 
 		/* compute number of bytes mod 64 */
@@ -832,42 +875,34 @@ SHA2Update(SHA2_CTX *ctx, const void *inptr, size_t input_len)
 		if (buf_index) {
 			bcopy(input, &ctx->buf_un.buf8[buf_index], buf_len);
 			if (algotype <= SHA256_HMAC_GEN_MECH_INFO_TYPE)
-				SHA256Transform(ctx, ctx->buf_un.buf8);
+				ops->transform(ctx, ctx->buf_un.buf8, 1);
 			else
 				SHA512Transform(ctx, ctx->buf_un.buf8);
 
 			i = buf_len;
 		}
 
-#if !defined(__amd64) || !defined(_KERNEL)
-		if (algotype <= SHA256_HMAC_GEN_MECH_INFO_TYPE) {
-			for (; i + buf_limit - 1 < input_len; i += buf_limit) {
-				SHA256Transform(ctx, &input[i]);
-			}
-		} else {
-			for (; i + buf_limit - 1 < input_len; i += buf_limit) {
-				SHA512Transform(ctx, &input[i]);
-			}
-		}
-
-#else
 		uint32_t block_count;
 		if (algotype <= SHA256_HMAC_GEN_MECH_INFO_TYPE) {
 			block_count = (input_len - i) >> 6;
 			if (block_count > 0) {
-				SHA256TransformBlocks(ctx, &input[i],
-				    block_count);
+				ops->transform(ctx, &input[i], block_count);
 				i += block_count << 6;
 			}
 		} else {
+#if !defined(__amd64) || !defined(_KERNEL)
+			for (; i + buf_limit - 1 < input_len; i += buf_limit) {
+				SHA512Transform(ctx, &input[i]);
+			}
+#else
 			block_count = (input_len - i) >> 7;
 			if (block_count > 0) {
 				SHA512TransformBlocks(ctx, &input[i],
 				    block_count);
 				i += block_count << 7;
 			}
-		}
 #endif	/* !__amd64 || !_KERNEL */
+		}
 
 		/*
 		 * general optimization:
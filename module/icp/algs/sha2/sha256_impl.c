@@ -0,0 +1,413 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/crypto/icp.h>
+#define	_SHA2_IMPL
+#include <sys/sha2.h>
+#include <sha2/sha2_impl.h>
+#include <linux/simd.h>
+
+/*
+ * Implementation of the SHA-256 block transform selection.  All supported
+ * implementations are benchmarked when the module is loaded and the fastest
+ * one is used by default.  The results are reported by the sha256_bench
+ * kstat, and the icp_sha256_impl module parameter allows a specific
+ * implementation to be selected.
+ */
+
+static sha256_impl_ops_t sha256_fastest_impl = {
+	.name = "fastest"
+};
+
+/* All compiled in implementations */
+const sha256_impl_ops_t *sha256_all_impl[] = {
+	&sha256_generic_impl,
+#if defined(__x86_64)
+	&sha256_x86_64_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_SHA_NI)
+	&sha256_shani_impl,
+#endif
+};
+
+/*
+ * Fastest implementation which doesn't use the FPU, used when SIMD
+ * instructions are not allowed in the current context.
+ */
+#if defined(__x86_64)
+#define	SHA256_NOSIMD_IMPL	(&sha256_x86_64_impl)
+#else
+#define	SHA256_NOSIMD_IMPL	(&sha256_generic_impl)
+#endif
+
+/* Indicate that benchmark has been completed */
+static boolean_t sha256_impl_initialized = B_FALSE;
+
+/* Select sha256 implementation */
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX-1)
+
+#define	SHA256_IMPL_READ(i) (*(volatile uint32_t *) &(i))
+
+static uint32_t icp_sha256_impl = IMPL_FASTEST;
+static uint32_t user_sel_impl = IMPL_FASTEST;
+
+/* Hold all supported implementations */
+static size_t sha256_supp_impl_cnt = 0;
+static sha256_impl_ops_t *sha256_supp_impl[ARRAY_SIZE(sha256_all_impl)];
+
+#if defined(_KERNEL)
+static kstat_t *sha256_kstat;
+
+/*
+ * One entry per supported implementation holding its benchmark result in
+ * bytes per second, followed by the index of the fastest implementation
+ * and the current selection.
+ */
+static struct sha256_kstat {
+	uint64_t value;
+} sha256_stat_data[ARRAY_SIZE(sha256_all_impl) + 2];
+
+#define	SHA256_STAT_FASTEST	(&sha256_stat_data[sha256_supp_impl_cnt])
+#define	SHA256_STAT_ACTIVE	(&sha256_stat_data[sha256_supp_impl_cnt + 1])
+#endif
+
+/*
+ * Returns the SHA-256 block transform.  When a SIMD implementation is not
+ * allowed in the current context, or the implementations have not been
+ * initialized yet, then fallback to the fastest non-SIMD implementation.
+ */
+const sha256_impl_ops_t *
+sha256_impl_get_ops(void)
+{
+	if (!sha256_impl_initialized || !kfpu_allowed())
+		return (SHA256_NOSIMD_IMPL);
+
+	const sha256_impl_ops_t *ops = NULL;
+	const uint32_t impl = SHA256_IMPL_READ(icp_sha256_impl);
+
+	switch (impl) {
+	case IMPL_FASTEST:
+		ops = &sha256_fastest_impl;
+		break;
+	case IMPL_CYCLE:
+		/* Cycle through supported implementations */
+		ASSERT3U(sha256_supp_impl_cnt, >, 0);
+		static size_t cycle_impl_idx = 0;
+		size_t idx = (++cycle_impl_idx) % sha256_supp_impl_cnt;
+		ops = sha256_supp_impl[idx];
+		break;
+	default:
+		ASSERT3U(impl, <, sha256_supp_impl_cnt);
+		ASSERT3U(sha256_supp_impl_cnt, >, 0);
+		if (impl < ARRAY_SIZE(sha256_all_impl))
+			ops = sha256_supp_impl[impl];
+		break;
+	}
+
+	ASSERT3P(ops, !=, NULL);
+
+	return (ops);
+}
+
+#if defined(_KERNEL)
+/*
+ * SHA-256 kstats
+ */
+static int
+sha256_kstat_headers(char *buf, size_t size)
+{
+	ssize_t off = 0;
+
+	off += snprintf(buf + off, size, "%-17s", "implementation");
+	(void) snprintf(buf + off, size - off, "%-15s\n", "bytes/s");
+
+	return (0);
+}
+
+static int
+sha256_kstat_data(char *buf, size_t size, void *data)
+{
+	struct sha256_kstat *curr_stat = (struct sha256_kstat *)data;
+	ssize_t off = 0;
+
+	if (curr_stat == SHA256_STAT_FASTEST) {
+		off += snprintf(buf + off, size - off, "%-17s", "fastest");
+		off += snprintf(buf + off, size - off, "%-15s\n",
+		    sha256_supp_impl[curr_stat->value]->name);
+	} else if (curr_stat == SHA256_STAT_ACTIVE) {
+		const uint32_t impl = SHA256_IMPL_READ(icp_sha256_impl);
+		const uint64_t fastest = SHA256_STAT_FASTEST->value;
+		const char *name;
+
+		if (impl == IMPL_FASTEST)
+			name = sha256_supp_impl[fastest]->name;
+		else if (impl == IMPL_CYCLE)
+			name = "cycle";
+		else
+			name = sha256_supp_impl[impl]->name;
+
+		off += snprintf(buf + off, size - off, "%-17s", "active");
+		off += snprintf(buf + off, size - off, "%-15s\n", name);
+	} else {
+		ptrdiff_t id = curr_stat - sha256_stat_data;
+
+		off += snprintf(buf + off, size - off, "%-17s",
+		    sha256_supp_impl[id]->name);
+		off += snprintf(buf + off, size - off, "%-15llu\n",
+		    (u_longlong_t)curr_stat->value);
+	}
+
+	return (0);
+}
+
+static void *
+sha256_kstat_addr(kstat_t *ksp, loff_t n)
+{
+	if (n <= sha256_supp_impl_cnt + 1)
+		ksp->ks_private = (void *) (sha256_stat_data + n);
+	else
+		ksp->ks_private = NULL;
+
+	return (ksp->ks_private);
+}
+
+#define	SHA256_BENCH_NS	(MSEC2NSEC(10))		/* 10ms */
+
+/*
+ * Measure the throughput of each supported implementation over a 128KiB
+ * buffer and record the fastest one.
+ */
+static void
+sha256_benchmark(void)
+{
+	static const size_t data_size = 128 * 1024;
+	char *databuf = vmem_alloc(data_size, KM_SLEEP);
+	uint64_t run_bw, run_time_ns, best_run = 0;
+	hrtime_t start;
+	SHA2_CTX ctx;
+	int i, l;
+
+	for (i = 0; i < data_size / sizeof (uint64_t); i++)
+		((uint64_t *)databuf)[i] = (uintptr_t)(databuf+i); /* warm-up */
+
+	for (i = 0; i < sha256_supp_impl_cnt; i++) {
+		const sha256_impl_ops_t *ops = sha256_supp_impl[i];
+		uint64_t run_count = 0;
+
+		SHA2Init(SHA256, &ctx);
+
+		kpreempt_disable();
+		start = gethrtime();
+		do {
+			for (l = 0; l < 4; l++, run_count++) {
+				ops->transform(&ctx, databuf, data_size / 64);
+			}
+
+			run_time_ns = gethrtime() - start;
+		} while (run_time_ns < SHA256_BENCH_NS);
+		kpreempt_enable();
+
+		run_bw = data_size * run_count * NANOSEC;
+		run_bw /= run_time_ns;	/* B/s */
+
+		sha256_stat_data[i].value = run_bw;
+
+		if (run_bw > best_run) {
+			best_run = run_bw;
+			SHA256_STAT_FASTEST->value = i;
+			memcpy(&sha256_fastest_impl, ops,
+			    sizeof (sha256_fastest_impl));
+		}
+	}
+
+	vmem_free(databuf, data_size);
+}
+#endif /* _KERNEL */
+
+/*
+ * Initialize and benchmark all supported implementations.
+ */
+/* ARGSUSED */
+void
+sha256_impl_init(void *arg)
+{
+	sha256_impl_ops_t *curr_impl;
+	int i, c;
+
+	/* Move supported implementations into sha256_supp_impl */
+	for (i = 0, c = 0; i < ARRAY_SIZE(sha256_all_impl); i++) {
+		curr_impl = (sha256_impl_ops_t *)sha256_all_impl[i];
+
+		if (curr_impl->is_supported())
+			sha256_supp_impl[c++] = (sha256_impl_ops_t *)curr_impl;
+	}
+	sha256_supp_impl_cnt = c;
+
+#if defined(_KERNEL)
+	sha256_benchmark();
+#else
+	/*
+	 * Skip the benchmark in user space to avoid impacting libzpool
+	 * consumers.  The last implementation is assumed to be the fastest.
+	 */
+	memcpy(&sha256_fastest_impl, sha256_supp_impl[c - 1],
+	    sizeof (sha256_fastest_impl));
+#endif
+	strcpy(sha256_fastest_impl.name, "fastest");
+
+	/* Finish initialization */
+	atomic_swap_32(&icp_sha256_impl, user_sel_impl);
+	sha256_impl_initialized = B_TRUE;
+
+#if defined(_KERNEL)
+	/* Install kstats for all implementations */
+	sha256_kstat = kstat_create("zfs", 0, "sha256_bench", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (sha256_kstat != NULL) {
+		sha256_kstat->ks_data = NULL;
+		sha256_kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(sha256_kstat,
+		    sha256_kstat_headers,
+		    sha256_kstat_data,
+		    sha256_kstat_addr);
+		kstat_install(sha256_kstat);
+	}
+#endif
+}
+
+void
+sha256_impl_fini(void)
+{
+#if defined(_KERNEL)
+	if (sha256_kstat != NULL) {
+		kstat_delete(sha256_kstat);
+		sha256_kstat = NULL;
+	}
+#endif
+}
+
+static const struct {
+	char *name;
+	uint32_t sel;
+} sha256_impl_opts[] = {
+		{ "cycle",	IMPL_CYCLE },
+		{ "fastest",	IMPL_FASTEST },
+};
+
+/*
+ * Function sets desired sha256 implementation.
+ *
+ * If we are called before init(), user preference will be saved in
+ * user_sel_impl, and applied in later init() call. This occurs when module
+ * parameter is specified on module load. Otherwise, directly update
+ * icp_sha256_impl.
+ *
+ * @val		Name of sha256 implementation to use
+ * @param	Unused.
+ */
+int
+sha256_impl_set(const char *val)
+{
+	int err = -EINVAL;
+	char req_name[SHA256_IMPL_NAME_MAX];
+	uint32_t impl = SHA256_IMPL_READ(user_sel_impl);
+	size_t i;
+
+	/* sanitize input */
+	i = strnlen(val, SHA256_IMPL_NAME_MAX);
+	if (i == 0 || i >= SHA256_IMPL_NAME_MAX)
+		return (err);
+
+	strlcpy(req_name, val, SHA256_IMPL_NAME_MAX);
+	while (i > 0 && isspace(req_name[i-1]))
+		i--;
+	req_name[i] = '\0';
+
+	/* Check mandatory options */
+	for (i = 0; i < ARRAY_SIZE(sha256_impl_opts); i++) {
+		if (strcmp(req_name, sha256_impl_opts[i].name) == 0) {
+			impl = sha256_impl_opts[i].sel;
+			err = 0;
+			break;
+		}
+	}
+
+	/* check all supported impl if init() was already called */
+	if (err != 0 && sha256_impl_initialized) {
+		/* check all supported implementations */
+		for (i = 0; i < sha256_supp_impl_cnt; i++) {
+			if (strcmp(req_name, sha256_supp_impl[i]->name) == 0) {
+				impl = i;
+				err = 0;
+				break;
+			}
+		}
+	}
+
+	if (err == 0) {
+		if (sha256_impl_initialized)
+			atomic_swap_32(&icp_sha256_impl, impl);
+		else
+			atomic_swap_32(&user_sel_impl, impl);
+	}
+
+	return (err);
+}
+
+#if defined(_KERNEL)
+#include <linux/mod_compat.h>
+
+static int
+icp_sha256_impl_set(const char *val, zfs_kernel_param_t *kp)
+{
+	return (sha256_impl_set(val));
+}
+
+static int
+icp_sha256_impl_get(char *buffer, zfs_kernel_param_t *kp)
+{
+	int i, cnt = 0;
+	char *fmt;
+	const uint32_t impl = SHA256_IMPL_READ(icp_sha256_impl);
+
+	ASSERT(sha256_impl_initialized);
+
+	/* list mandatory options */
+	for (i = 0; i < ARRAY_SIZE(sha256_impl_opts); i++) {
+		fmt = (impl == sha256_impl_opts[i].sel) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, sha256_impl_opts[i].name);
+	}
+
+	/* list all supported implementations */
+	for (i = 0; i < sha256_supp_impl_cnt; i++) {
+		fmt = (i == impl) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, sha256_supp_impl[i]->name);
+	}
+
+	return (cnt);
+}
+
+module_param_call(icp_sha256_impl, icp_sha256_impl_set, icp_sha256_impl_get,
+    NULL, 0644);
+MODULE_PARM_DESC(icp_sha256_impl, "Select sha256 implementation.");
+#endif
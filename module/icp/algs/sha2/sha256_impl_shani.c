@@ -0,0 +1,58 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#if defined(__x86_64) && defined(HAVE_SHA_NI)
+
+#include <linux/simd_x86.h>
+#define	_SHA2_IMPL
+#include <sys/sha2.h>
+#include <sha2/sha2_impl.h>
+
+/* This function is used to execute the SHA-NI instructions: */
+extern void sha256_shani_transform(uint32_t *state, const void *in,
+	size_t nblocks);
+
+/*
+ * Process nblocks 64-byte blocks of input, updating the chaining state
+ * in the SHA-256 context.
+ */
+static void
+sha256_shani_blocks(SHA2_CTX *ctx, const void *in, size_t nblocks)
+{
+	kfpu_begin();
+	sha256_shani_transform(ctx->state.s32, in, nblocks);
+	kfpu_end();
+}
+
+static boolean_t
+sha256_shani_will_work(void)
+{
+	return (kfpu_allowed() && zfs_sha_ni_available() &&
+	    zfs_ssse3_available() && zfs_sse4_1_available());
+}
+
+const sha256_impl_ops_t sha256_shani_impl = {
+	.transform = &sha256_shani_blocks,
+	.is_supported = &sha256_shani_will_work,
+	.name = "shani"
+};
+
+#endif /* defined(__x86_64) && defined(HAVE_SHA_NI) */
@@ -38,6 +38,7 @@
 #include <sys/crypto/sched_impl.h>
 #include <sys/modhash_impl.h>
 #include <sys/crypto/icp.h>
+#include <sys/blake3.h>
 
 /*
  * Changes made to the original Illumos Crypto Layer for the ICP:
@@ -109,6 +110,7 @@
 void __exit
 icp_fini(void)
 {
+	blake3_impl_fini();
 	skein_mod_fini();
 	sha2_mod_fini();
 	sha1_mod_fini();
@@ -145,6 +147,7 @@ icp_init(void)
 	sha1_mod_init();
 	sha2_mod_init();
 	skein_mod_init();
+	blake3_impl_init();
 
 	return (0);
 }
@@ -0,0 +1,110 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_BLAKE3_IMPL_H
+#define	_BLAKE3_IMPL_H
+
+#include <sys/blake3.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/* Domain separation flags */
+#define	BLAKE3_CHUNK_START	(1 << 0)
+#define	BLAKE3_CHUNK_END	(1 << 1)
+#define	BLAKE3_PARENT		(1 << 2)
+#define	BLAKE3_ROOT		(1 << 3)
+#define	BLAKE3_KEYED_HASH	(1 << 4)
+
+#define	BLAKE3_ROUNDS		7
+
+extern const uint32_t blake3_iv[8];
+extern const uint8_t blake3_msg_schedule[BLAKE3_ROUNDS][16];
+
+static inline uint32_t
+blake3_load32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static inline void
+blake3_store32(uint8_t *p, uint32_t w)
+{
+	p[0] = (uint8_t)w;
+	p[1] = (uint8_t)(w >> 8);
+	p[2] = (uint8_t)(w >> 16);
+	p[3] = (uint8_t)(w >> 24);
+}
+
+/*
+ * Portable compression function, used for partial chunks, parent nodes
+ * and the root node.  Returns the full 16 word output state in out.
+ */
+extern void blake3_compress_generic(const uint32_t cv[8],
+    const uint8_t block[BLAKE3_BLOCK_LEN], uint8_t block_len,
+    uint64_t counter, uint8_t flags, uint32_t out[16]);
+
+/*
+ * Methods used to define BLAKE3 implementation
+ *
+ * @blake3_hash_many_f Hashes nchunks complete, consecutive chunks of
+ *	input, the first of which has index counter, and stores their
+ *	chaining values in out
+ * @blake3_will_work_f Function tests whether method will function
+ */
+typedef void		(*blake3_hash_many_f)(const uint8_t *in, size_t nchunks,
+    const uint32_t key[8], uint64_t counter, uint8_t flags, uint8_t *out);
+typedef boolean_t	(*blake3_will_work_f)(void);
+
+#define	BLAKE3_IMPL_NAME_MAX	(16)
+
+typedef struct blake3_impl_ops {
+	blake3_hash_many_f hash_many;
+	blake3_will_work_f is_supported;
+	char name[BLAKE3_IMPL_NAME_MAX];
+} blake3_impl_ops_t;
+
+extern const blake3_impl_ops_t blake3_generic_impl;
+#if defined(__x86_64) && defined(HAVE_SSE4_1)
+extern const blake3_impl_ops_t blake3_sse41_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX2)
+extern const blake3_impl_ops_t blake3_avx2_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX512F)
+extern const blake3_impl_ops_t blake3_avx512_impl;
+#endif
+
+/* Maximum number of chunks passed to hash_many() at once */
+#define	BLAKE3_MAX_SIMD_DEGREE	16
+
+/*
+ * Returns optimal allowed BLAKE3 implementation
+ */
+extern const blake3_impl_ops_t *blake3_impl_get_ops(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _BLAKE3_IMPL_H */
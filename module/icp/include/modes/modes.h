@@ -196,6 +196,12 @@ typedef struct ccm_ctx {
  *
  * gcm_kmflag:		Current value of kmflag. Used only for allocating
  *			the plaintext buffer during decryption.
+ *
+ * gcm_use_aesni:	Process whole blocks with the bulk AES-NI and
+ *			PCLMULQDQ routines instead of one block at a time.
+ *
+ * gcm_Htable:		H, H^2, H^3 and H^4, used by the bulk routines to
+ *			hash four blocks with a single reduction.
  */
 typedef struct gcm_ctx {
 	struct common_ctx gcm_common;
@@ -209,6 +215,8 @@ typedef struct gcm_ctx {
 	uint64_t gcm_len_a_len_c[2];
 	uint8_t *gcm_pt_buf;
 	int gcm_kmflag;
+	boolean_t gcm_use_aesni;
+	uint64_t gcm_Htable[4][2];
 } gcm_ctx_t;
 
 #define	gcm_keysched		gcm_common.cc_keysched
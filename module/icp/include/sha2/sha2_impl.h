@@ -57,6 +57,42 @@ typedef struct sha2_hmac_ctx {
 	SHA2_CTX		hc_ocontext;	/* outer SHA2 context */
 } sha2_hmac_ctx_t;
 
+/*
+ * Methods used to define SHA-256 block transform implementation
+ *
+ * @sha256_transform_f Function processes a number of 64-byte blocks
+ * @sha256_will_work_f Function tests whether method will function
+ */
+typedef void		(*sha256_transform_f)(SHA2_CTX *, const void *, size_t);
+typedef boolean_t	(*sha256_will_work_f)(void);
+
+#define	SHA256_IMPL_NAME_MAX (16)
+
+typedef struct sha256_impl_ops {
+	sha256_transform_f transform;
+	sha256_will_work_f is_supported;
+	char name[SHA256_IMPL_NAME_MAX];
+} sha256_impl_ops_t;
+
+extern const sha256_impl_ops_t sha256_generic_impl;
+#if defined(__x86_64)
+extern const sha256_impl_ops_t sha256_x86_64_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_SHA_NI)
+extern const sha256_impl_ops_t sha256_shani_impl;
+#endif
+
+/*
+ * Initializes and benchmarks supported implementations
+ */
+void sha256_impl_init(void *arg);
+void sha256_impl_fini(void);
+
+/*
+ * Returns optimal allowed SHA-256 implementation
+ */
+const sha256_impl_ops_t *sha256_impl_get_ops(void);
+
 #ifdef	__cplusplus
 }
 #endif
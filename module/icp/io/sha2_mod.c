@@ -216,6 +216,23 @@ sha2_mod_init(void)
 {
 	int ret;
 
+#if defined(_KERNEL)
+	/*
+	 * Benchmark the SHA-256 implementations in a dedicated kernel
+	 * thread to allow Linux 5.0+ kernels to use SIMD operations.
+	 * See the comment in include/linux/simd_x86.h for details.
+	 */
+	taskqid_t id = taskq_dispatch(system_taskq, sha256_impl_init,
+	    NULL, TQ_SLEEP);
+	if (id != TASKQID_INVALID) {
+		taskq_wait_id(system_taskq, id);
+	} else {
+		sha256_impl_init(NULL);
+	}
+#else
+	sha256_impl_init(NULL);
+#endif
+
 	if ((ret = mod_install(&modlinkage)) != 0)
 		return (ret);
 
@@ -248,6 +265,8 @@ sha2_mod_fini(void)
 		sha2_prov_handle = 0;
 	}
 
+	sha256_impl_fini();
+
 	return (mod_remove(&modlinkage));
 }
 
@@ -53,6 +53,7 @@
 #include <sys/strings.h>
 #include <linux/kmap_compat.h>
 #include <linux/uaccess.h>
+#include <linux/mm.h>
 
 /*
  * Move "n" bytes at byte address "p"; "rw" indicates the direction
@@ -275,4 +276,74 @@ uioskip(uio_t *uiop, size_t n)
 	uiop->uio_resid -= n;
 }
 EXPORT_SYMBOL(uioskip);
+
+/*
+ * Pin the user pages backing the first n bytes of the uio so they can be
+ * handed directly to the I/O pipeline.  Every iovec touched must start on a
+ * page boundary and all but the last must be a whole number of pages long,
+ * so that the pinned pages describe the data contiguously.  "rw" is the
+ * direction of the uio move; UIO_READ pins the pages for writing.  On
+ * success the number of pinned pages is returned in *npages and the uio is
+ * left unmodified.  Returns EINVAL if the uio is unsuitable, or EFAULT if
+ * the pages could not all be pinned.
+ */
+int
+uio_get_user_pages(uio_t *uio, size_t n, enum uio_rw rw,
+    struct page **pages, uint_t *npages)
+{
+	const struct iovec *iov = uio->uio_iov;
+	ulong_t cnt = uio->uio_iovcnt;
+	size_t skip = uio->uio_skip;
+	uint_t pinned = 0;
+
+	if (uio->uio_segflg != UIO_USERSPACE || n > uio->uio_resid)
+		return (EINVAL);
+
+	for (; n > 0 && cnt; iov++, cnt--, skip = 0) {
+		unsigned long addr = (unsigned long)iov->iov_base + skip;
+		size_t len = MIN(iov->iov_len - skip, n);
+		int nr, got;
+
+		if (len == 0)
+			continue;
+		if (!IS_P2ALIGNED(addr, PAGESIZE) ||
+		    (len < n && !IS_P2ALIGNED(len, PAGESIZE)))
+			break;
+
+		nr = P2ROUNDUP(len, PAGESIZE) >> PAGE_SHIFT;
+		got = get_user_pages_fast(addr, nr,
+		    rw == UIO_READ ? FOLL_WRITE : 0, &pages[pinned]);
+		if (got > 0)
+			pinned += got;
+		if (got != nr) {
+			uio_put_user_pages(pages, pinned, B_FALSE);
+			return (EFAULT);
+		}
+		n -= len;
+	}
+
+	if (n != 0) {
+		uio_put_user_pages(pages, pinned, B_FALSE);
+		return (EINVAL);
+	}
+
+	*npages = pinned;
+	return (0);
+}
+EXPORT_SYMBOL(uio_get_user_pages);
+
+/*
+ * Release pages pinned by uio_get_user_pages().  Pages which were the
+ * target of a read must be marked dirty before they are released.
+ */
+void
+uio_put_user_pages(struct page **pages, uint_t npages, boolean_t dirty)
+{
+	for (uint_t i = 0; i < npages; i++) {
+		if (dirty)
+			set_page_dirty_lock(pages[i]);
+		put_page(pages[i]);
+	}
+}
+EXPORT_SYMBOL(uio_put_user_pages);
 #endif /* _KERNEL */
@@ -257,6 +257,11 @@ abd_chunkcnt_for_bytes(size_t size)
  * progressively decreased until it can be satisfied without performing
  * reclaim or compaction.  When necessary this function will degenerate to
  * allocating individual pages and allowing reclaim to satisfy allocations.
+ *
+ * Compound pages are only taken from the NUMA node of the calling CPU, so
+ * that a shortage of high order pages on that node results in smaller
+ * local chunks rather than a buffer placed on a remote node.  Individual
+ * pages may still come from any node.
  */
 static void
 abd_alloc_pages(abd_t *abd, size_t size)
@@ -266,11 +271,13 @@ abd_alloc_pages(abd_t *abd, size_t size)
 	struct scatterlist *sg;
 	struct page *page, *tmp_page = NULL;
 	gfp_t gfp = __GFP_NOWARN | GFP_NOIO;
-	gfp_t gfp_comp = (gfp | __GFP_NORETRY | __GFP_COMP) & ~__GFP_RECLAIM;
+	gfp_t gfp_comp = (gfp | __GFP_NORETRY | __GFP_COMP | __GFP_THISNODE) &
+	    ~__GFP_RECLAIM;
 	int max_order = MIN(zfs_abd_scatter_max_order, MAX_ORDER - 1);
 	int nr_pages = abd_chunkcnt_for_bytes(size);
 	int chunks = 0, zones = 0;
 	size_t remaining_size;
+	int local_nid = numa_node_id();
 	int nid = NUMA_NO_NODE;
 	int alloc_pages = 0;
 
@@ -283,7 +290,8 @@ abd_alloc_pages(abd_t *abd, size_t size)
 		order = MIN(highbit64(nr_pages - alloc_pages) - 1, max_order);
 		chunk_pages = (1U << order);
 
-		page = alloc_pages_node(nid, order ? gfp_comp : gfp, order);
+		page = alloc_pages_node(local_nid, order ? gfp_comp : gfp,
+		    order);
 		if (page == NULL) {
 			if (order == 0) {
 				ABDSTAT_BUMP(abdstat_scatter_page_alloc_retry);
@@ -577,7 +585,8 @@ abd_verify(abd_t *abd)
 	ASSERT3U(abd->abd_size, <=, SPA_MAXBLOCKSIZE);
 	ASSERT3U(abd->abd_flags, ==, abd->abd_flags & (ABD_FLAG_LINEAR |
 	    ABD_FLAG_OWNER | ABD_FLAG_META | ABD_FLAG_MULTI_ZONE |
-	    ABD_FLAG_MULTI_CHUNK | ABD_FLAG_LINEAR_PAGE));
+	    ABD_FLAG_MULTI_CHUNK | ABD_FLAG_LINEAR_PAGE |
+	    ABD_FLAG_FROM_PAGES));
 	IMPLY(abd->abd_parent != NULL, !(abd->abd_flags & ABD_FLAG_OWNER));
 	IMPLY(abd->abd_flags & ABD_FLAG_META, abd->abd_flags & ABD_FLAG_OWNER);
 	if (abd_is_linear(abd)) {
@@ -876,9 +885,51 @@ abd_get_from_buf(void *buf, size_t size)
 	return (abd);
 }
 
+#if defined(_KERNEL)
 /*
- * Free an ABD allocated from abd_get_offset() or abd_get_from_buf(). Will not
- * free the underlying scatterlist or buffer.
+ * Allocate a scatter ABD structure over an array of pages, typically user
+ * pages pinned for Direct I/O. Each page contributes a full PAGESIZE chunk
+ * starting at offset zero. The scatterlist is owned by the ABD and released
+ * by abd_put(), but the pages are not; the caller must keep them pinned for
+ * the lifetime of the ABD and release them afterwards.
+ */
+abd_t *
+abd_get_from_pages(struct page **pages, uint_t npages, size_t size)
+{
+	struct sg_table table;
+	struct scatterlist *sg;
+	abd_t *abd;
+	int i;
+
+	VERIFY3U(size, <=, SPA_MAXBLOCKSIZE);
+	VERIFY3U(size, <=, (size_t)npages * PAGESIZE);
+	VERIFY3U(npages, >, 0);
+
+	while (sg_alloc_table(&table, npages, __GFP_NOWARN | GFP_NOIO)) {
+		ABDSTAT_BUMP(abdstat_scatter_sg_table_retry);
+		schedule_timeout_interruptible(1);
+	}
+
+	for_each_sg(table.sgl, sg, npages, i)
+		sg_set_page(sg, pages[i], PAGESIZE, 0);
+
+	abd = abd_alloc_struct();
+	abd->abd_flags = ABD_FLAG_FROM_PAGES;
+	abd->abd_size = size;
+	abd->abd_parent = NULL;
+	zfs_refcount_create(&abd->abd_children);
+
+	ABD_SCATTER(abd).abd_offset = 0;
+	ABD_SCATTER(abd).abd_sgl = table.sgl;
+	ABD_SCATTER(abd).abd_nents = table.nents;
+
+	return (abd);
+}
+#endif /* _KERNEL */
+
+/*
+ * Free an ABD allocated from abd_get_offset(), abd_get_from_buf() or
+ * abd_get_from_pages(). Will not free the underlying buffer or pages.
  */
 void
 abd_put(abd_t *abd)
@@ -891,6 +942,16 @@ abd_put(abd_t *abd)
 		    abd->abd_size, abd);
 	}
 
+#if defined(_KERNEL)
+	if (abd->abd_flags & ABD_FLAG_FROM_PAGES) {
+		struct sg_table table;
+
+		table.sgl = ABD_SCATTER(abd).abd_sgl;
+		table.nents = table.orig_nents = ABD_SCATTER(abd).abd_nents;
+		sg_free_table(&table);
+	}
+#endif
+
 	zfs_refcount_destroy(&abd->abd_children);
 	abd_free_struct(abd);
 }
@@ -1162,6 +1223,9 @@ abd_iterate_func(abd_t *abd, size_t off, size_t size,
 	int ret = 0;
 	struct abd_iter aiter;
 
+	if (size == 0)
+		return (0);
+
 	abd_verify(abd);
 	ASSERT3U(off + size, <=, abd->abd_size);
 
@@ -1290,6 +1354,9 @@ abd_iterate_func2(abd_t *dabd, abd_t *sabd, size_t doff, size_t soff,
 	int ret = 0;
 	struct abd_iter daiter, saiter;
 
+	if (size == 0)
+		return (0);
+
 	abd_verify(dabd);
 	abd_verify(sabd);
 
@@ -407,6 +407,7 @@ unsigned long zfs_arc_meta_limit = 0;
 unsigned long zfs_arc_meta_min = 0;
 unsigned long zfs_arc_dnode_limit = 0;
 unsigned long zfs_arc_dnode_reduce_percent = 10;
+unsigned long zfs_arc_ddt_min = 0;
 int zfs_arc_grow_retry = 0;
 int zfs_arc_shrink_shift = 0;
 int zfs_arc_p_min_shift = 0;
@@ -489,6 +490,11 @@ typedef struct arc_stats {
 	 * not from the spa we're trying to evict from.
 	 */
 	kstat_named_t arcstat_evict_skip;
+	/*
+	 * Number of dedup table buffers skipped because the cached DDT
+	 * blocks were within the zfs_arc_ddt_min reservation.
+	 */
+	kstat_named_t arcstat_evict_ddt_skip;
 	/*
 	 * Number of times arc_evict_state() was unable to evict enough
 	 * buffers to reach its target amount.
@@ -706,6 +712,24 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_l2_psize;
 	/* Not updated directly; only synced in arc_kstat_update. */
 	kstat_named_t arcstat_l2_hdr_size;
+	/*
+	 * Persistent L2ARC: log blocks written and currently present on the
+	 * cache devices, and the outcome of rebuilds at pool import.
+	 */
+	kstat_named_t arcstat_l2_log_blk_writes;
+	kstat_named_t arcstat_l2_log_blk_asize;
+	kstat_named_t arcstat_l2_log_blk_count;
+	kstat_named_t arcstat_l2_rebuild_success;
+	kstat_named_t arcstat_l2_rebuild_unsupported;
+	kstat_named_t arcstat_l2_rebuild_io_errors;
+	kstat_named_t arcstat_l2_rebuild_dh_errors;
+	kstat_named_t arcstat_l2_rebuild_cksum_lb_errors;
+	kstat_named_t arcstat_l2_rebuild_lowmem;
+	kstat_named_t arcstat_l2_rebuild_size;
+	kstat_named_t arcstat_l2_rebuild_asize;
+	kstat_named_t arcstat_l2_rebuild_bufs;
+	kstat_named_t arcstat_l2_rebuild_bufs_precached;
+	kstat_named_t arcstat_l2_rebuild_log_blks;
 	kstat_named_t arcstat_memory_throttle_count;
 	kstat_named_t arcstat_memory_direct_count;
 	kstat_named_t arcstat_memory_indirect_count;
@@ -728,6 +752,9 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_need_free;
 	kstat_named_t arcstat_sys_free;
 	kstat_named_t arcstat_raw_size;
+	/* Not updated directly; only synced in arc_kstat_update. */
+	kstat_named_t arcstat_ddt_size;
+	kstat_named_t arcstat_ddt_min;
 } arc_stats_t;
 
 static arc_stats_t arc_stats = {
@@ -749,6 +776,7 @@ static arc_stats_t arc_stats = {
 	{ "mutex_miss",			KSTAT_DATA_UINT64 },
 	{ "access_skip",		KSTAT_DATA_UINT64 },
 	{ "evict_skip",			KSTAT_DATA_UINT64 },
+	{ "evict_ddt_skip",		KSTAT_DATA_UINT64 },
 	{ "evict_not_enough",		KSTAT_DATA_UINT64 },
 	{ "evict_l2_cached",		KSTAT_DATA_UINT64 },
 	{ "evict_l2_eligible",		KSTAT_DATA_UINT64 },
@@ -808,6 +836,20 @@ static arc_stats_t arc_stats = {
 	{ "l2_size",			KSTAT_DATA_UINT64 },
 	{ "l2_asize",			KSTAT_DATA_UINT64 },
 	{ "l2_hdr_size",		KSTAT_DATA_UINT64 },
+	{ "l2_log_blk_writes",		KSTAT_DATA_UINT64 },
+	{ "l2_log_blk_asize",		KSTAT_DATA_UINT64 },
+	{ "l2_log_blk_count",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_success",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_unsupported",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_io_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_dh_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_cksum_lb_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_lowmem",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_size",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_asize",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs_precached",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_log_blks",	KSTAT_DATA_UINT64 },
 	{ "memory_throttle_count",	KSTAT_DATA_UINT64 },
 	{ "memory_direct_count",	KSTAT_DATA_UINT64 },
 	{ "memory_indirect_count",	KSTAT_DATA_UINT64 },
@@ -828,7 +870,9 @@ static arc_stats_t arc_stats = {
 	{ "demand_hit_prescient_prefetch", KSTAT_DATA_UINT64 },
 	{ "arc_need_free",		KSTAT_DATA_UINT64 },
 	{ "arc_sys_free",		KSTAT_DATA_UINT64 },
-	{ "arc_raw_size",		KSTAT_DATA_UINT64 }
+	{ "arc_raw_size",		KSTAT_DATA_UINT64 },
+	{ "arc_ddt_size",		KSTAT_DATA_UINT64 },
+	{ "arc_ddt_min",		KSTAT_DATA_UINT64 }
 };
 
 #define	ARCSTAT(stat)	(arc_stats.stat.value.ui64)
@@ -869,6 +913,30 @@ static arc_stats_t arc_stats = {
 		}							\
 	}
 
+/*
+ * Per-NUMA-node hit and miss counters.  Hits and misses are charged to the
+ * node of the CPU issuing the request; a remote hit is a hit on a buffer
+ * whose data was allocated for a different node.  These are exported at the
+ * end of the arcstats kstat as node<N>_hits, node<N>_misses and
+ * node<N>_remote_hits.
+ */
+typedef struct arc_numa_stats {
+	kstat_named_t ans_hits;
+	kstat_named_t ans_misses;
+	kstat_named_t ans_remote_hits;
+} arc_numa_stats_t;
+
+#define	ARCSTAT_NUMA_BUMP(node, stat) \
+	atomic_inc_64(&arc_numa_stats[(node)].stat.value.ui64)
+
+/*
+ * Number of NUMA nodes the arc state sublists are partitioned across.
+ */
+static int		arc_numa_nodes;
+static arc_numa_stats_t	*arc_numa_stats;
+static kstat_named_t	*arc_ks_data;
+static size_t		arc_ks_ndata;
+
 kstat_t			*arc_ksp;
 static arc_state_t	*arc_anon;
 static arc_state_t	*arc_mru;
@@ -925,6 +993,7 @@ aggsum_t astat_dnode_size;
 aggsum_t astat_bonus_size;
 aggsum_t astat_hdr_size;
 aggsum_t astat_l2_hdr_size;
+aggsum_t astat_ddt_size;
 
 static hrtime_t arc_growtime;
 static list_t arc_prune_list;
@@ -954,6 +1023,7 @@ static taskq_t *arc_prune_taskq;
 #define	HDR_PROTECTED(hdr)	((hdr)->b_flags & ARC_FLAG_PROTECTED)
 #define	HDR_NOAUTH(hdr)		((hdr)->b_flags & ARC_FLAG_NOAUTH)
 #define	HDR_SHARED_DATA(hdr)	((hdr)->b_flags & ARC_FLAG_SHARED_DATA)
+#define	HDR_DDT(hdr)		((hdr)->b_flags & ARC_FLAG_DDT)
 
 #define	HDR_ISTYPE_METADATA(hdr)	\
 	((hdr)->b_flags & ARC_FLAG_BUFC_METADATA)
@@ -1004,18 +1074,29 @@ struct ht_lock {
 #endif
 };
 
-#define	BUF_LOCKS 8192
+/*
+ * The hash table is protected by an array of padded mutexes, each of which
+ * covers every (ht_lock_mask + 1)'th bucket.  The array holds at least
+ * BUF_LOCKS entries and is grown to BUF_LOCKS_PER_CPU entries per CPU
+ * (rounded up to a power of two, and never more than one per bucket) so
+ * that the chance of two CPUs colliding on a lock stays constant as the
+ * core count grows.
+ */
+#define	BUF_LOCKS		8192
+#define	BUF_LOCKS_PER_CPU	256
 typedef struct buf_hash_table {
 	uint64_t ht_mask;
 	arc_buf_hdr_t **ht_table;
-	struct ht_lock ht_locks[BUF_LOCKS];
+	uint64_t ht_lock_mask;
+	struct ht_lock *ht_locks;
 } buf_hash_table_t;
 
 static buf_hash_table_t buf_hash_table;
 
 #define	BUF_HASH_INDEX(spa, dva, birth) \
 	(buf_hash(spa, dva, birth) & buf_hash_table.ht_mask)
-#define	BUF_HASH_LOCK_NTRY(idx) (buf_hash_table.ht_locks[idx & (BUF_LOCKS-1)])
+#define	BUF_HASH_LOCK_NTRY(idx) \
+	(buf_hash_table.ht_locks[(idx) & buf_hash_table.ht_lock_mask])
 #define	BUF_HASH_LOCK(idx)	(&(BUF_HASH_LOCK_NTRY(idx).ht_lock))
 #define	HDR_LOCK(hdr) \
 	(BUF_HASH_LOCK(BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth)))
@@ -1057,6 +1138,15 @@ int l2arc_noprefetch = B_TRUE;			/* don't cache prefetch bufs */
 int l2arc_feed_again = B_TRUE;			/* turbo warmup */
 int l2arc_norw = B_FALSE;			/* no reads during writes */
 
+/*
+ * Persistent L2ARC tunables.  Rebuilding the L2ARC contents at pool import
+ * can be disabled with l2arc_rebuild_enabled.  Devices smaller than
+ * l2arc_rebuild_blocks_min_l2size are not worth the overhead of writing
+ * log blocks and are treated as non-persistent.
+ */
+int l2arc_rebuild_enabled = B_TRUE;
+unsigned long l2arc_rebuild_blocks_min_l2size = 1024 * 1024 * 1024;
+
 /*
  * L2ARC Internals
  */
@@ -1097,6 +1187,9 @@ static kmutex_t l2arc_feed_thr_lock;
 static kcondvar_t l2arc_feed_thr_cv;
 static uint8_t l2arc_thread_exit;
 
+static kmutex_t l2arc_rebuild_thr_lock;
+static kcondvar_t l2arc_rebuild_thr_cv;
+
 static abd_t *arc_get_data_abd(arc_buf_hdr_t *, uint64_t, void *);
 static void *arc_get_data_buf(arc_buf_hdr_t *, uint64_t, void *);
 static void arc_get_data_impl(arc_buf_hdr_t *, uint64_t, void *);
@@ -1120,6 +1213,21 @@ static inline void arc_hdr_clear_flags(arc_buf_hdr_t *hdr, arc_flags_t flags);
 static boolean_t l2arc_write_eligible(uint64_t, arc_buf_hdr_t *);
 static void l2arc_read_done(zio_t *);
 
+/*
+ * Persistent L2ARC routines.
+ */
+static void l2arc_dev_hdr_update(l2arc_dev_t *dev);
+static int l2arc_dev_hdr_read(l2arc_dev_t *dev);
+static boolean_t l2arc_log_blkptr_valid(l2arc_dev_t *dev,
+    const l2arc_log_blkptr_t *lbp);
+static boolean_t l2arc_log_blk_insert(l2arc_dev_t *dev,
+    const arc_buf_hdr_t *hdr);
+static uint64_t l2arc_log_blk_commit(l2arc_dev_t *dev, zio_t *pio,
+    l2arc_write_callback_t *cb);
+static uint64_t l2arc_log_blk_overhead(uint64_t write_sz, l2arc_dev_t *dev);
+static boolean_t l2arc_range_check_overlap(uint64_t bottom, uint64_t top,
+    uint64_t check);
+
 
 /*
  * We use Cityhash for this. It's fast, and has good hash properties without
@@ -1160,6 +1268,21 @@ buf_hash_find(uint64_t spa, const blkptr_t *bp, kmutex_t **lockp)
 	kmutex_t *hash_lock = BUF_HASH_LOCK(idx);
 	arc_buf_hdr_t *hdr;
 
+	/*
+	 * The table is sized so that most buckets are empty, which makes
+	 * the common miss cheap to detect without taking the hash lock.
+	 * The bucket head is only compared against NULL here, never
+	 * dereferenced, so racing with buf_hash_insert() or
+	 * buf_hash_remove() is harmless: it is indistinguishable from
+	 * the lookup having completed just before the insert, a case all
+	 * callers already handle since the answer can go stale as soon
+	 * as the lock is dropped.
+	 */
+	if (buf_hash_table.ht_table[idx] == NULL) {
+		*lockp = NULL;
+		return (NULL);
+	}
+
 	mutex_enter(hash_lock);
 	for (hdr = buf_hash_table.ht_table[idx]; hdr != NULL;
 	    hdr = hdr->b_hash_next) {
@@ -1275,8 +1398,15 @@ buf_fini(void)
 	kmem_free(buf_hash_table.ht_table,
 	    (buf_hash_table.ht_mask + 1) * sizeof (void *));
 #endif
-	for (i = 0; i < BUF_LOCKS; i++)
+	for (i = 0; i <= buf_hash_table.ht_lock_mask; i++)
 		mutex_destroy(&buf_hash_table.ht_locks[i].ht_lock);
+#if defined(_KERNEL)
+	vmem_free(buf_hash_table.ht_locks,
+	    (buf_hash_table.ht_lock_mask + 1) * sizeof (struct ht_lock));
+#else
+	kmem_free(buf_hash_table.ht_locks,
+	    (buf_hash_table.ht_lock_mask + 1) * sizeof (struct ht_lock));
+#endif
 	kmem_cache_destroy(hdr_full_cache);
 	kmem_cache_destroy(hdr_full_crypt_cache);
 	kmem_cache_destroy(hdr_l2only_cache);
@@ -1413,6 +1543,7 @@ buf_init(void)
 {
 	uint64_t *ct = NULL;
 	uint64_t hsize = 1ULL << 12;
+	uint64_t nlocks = BUF_LOCKS;
 	int i, j;
 
 	/*
@@ -1457,7 +1588,19 @@ retry:
 		for (ct = zfs_crc64_table + i, *ct = i, j = 8; j > 0; j--)
 			*ct = (*ct >> 1) ^ (-(*ct & 1) & ZFS_CRC64_POLY);
 
-	for (i = 0; i < BUF_LOCKS; i++) {
+	while (nlocks < (uint64_t)max_ncpus * BUF_LOCKS_PER_CPU &&
+	    nlocks < hsize)
+		nlocks <<= 1;
+	nlocks = MIN(nlocks, hsize);
+	buf_hash_table.ht_lock_mask = nlocks - 1;
+#if defined(_KERNEL)
+	buf_hash_table.ht_locks =
+	    vmem_zalloc(nlocks * sizeof (struct ht_lock), KM_SLEEP);
+#else
+	buf_hash_table.ht_locks =
+	    kmem_zalloc(nlocks * sizeof (struct ht_lock), KM_SLEEP);
+#endif
+	for (i = 0; i < nlocks; i++) {
 		mutex_init(&buf_hash_table.ht_locks[i].ht_lock,
 		    NULL, MUTEX_DEFAULT, NULL);
 	}
@@ -2460,6 +2603,7 @@ remove_reference(arc_buf_hdr_t *hdr, kmutex_t *hash_lock, void *tag)
 	 */
 	if (((cnt = zfs_refcount_remove(&hdr->b_l1hdr.b_refcnt, tag)) == 0) &&
 	    (state != arc_anon)) {
+		hdr->b_l1hdr.b_list_node = hdr->b_l1hdr.b_alloc_node;
 		multilist_insert(state->arcs_list[arc_buf_type(hdr)], hdr);
 		ASSERT3U(hdr->b_l1hdr.b_bufcnt, >, 0);
 		arc_evictable_space_increment(hdr, state);
@@ -2580,6 +2724,7 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *hdr,
 			 * beforehand.
 			 */
 			ASSERT(HDR_HAS_L1HDR(hdr));
+			hdr->b_l1hdr.b_list_node = hdr->b_l1hdr.b_alloc_node;
 			multilist_insert(new_state->arcs_list[buftype], hdr);
 
 			if (GHOST_STATE(new_state)) {
@@ -2718,6 +2863,22 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *hdr,
 		}
 	}
 
+	/*
+	 * Track how much of the cached (non-ghost) data belongs to dedup
+	 * tables, so that arc_evict_state_impl() can honor zfs_arc_ddt_min.
+	 */
+	if (HDR_DDT(hdr)) {
+		boolean_t old_cached = (old_state == arc_mru ||
+		    old_state == arc_mfu);
+		boolean_t new_cached = (new_state == arc_mru ||
+		    new_state == arc_mfu);
+
+		if (new_cached && !old_cached)
+			aggsum_add(&astat_ddt_size, HDR_GET_LSIZE(hdr));
+		else if (old_cached && !new_cached)
+			aggsum_add(&astat_ddt_size, -HDR_GET_LSIZE(hdr));
+	}
+
 	if (HDR_HAS_L1HDR(hdr))
 		hdr->b_l1hdr.b_state = new_state;
 
@@ -3417,6 +3578,40 @@ arc_hdr_alloc(uint64_t spa, int32_t psize, int32_t lsize,
 	return (hdr);
 }
 
+/*
+ * Allocate an L2ARC-only header for a buffer restored from a persistent
+ * L2ARC log block by l2arc_rebuild().
+ */
+static arc_buf_hdr_t *
+arc_buf_alloc_l2only(size_t size, arc_buf_contents_t type, l2arc_dev_t *dev,
+    dva_t dva, uint64_t daddr, int32_t psize, uint64_t birth,
+    enum zio_compress compress, boolean_t protected, boolean_t prefetch)
+{
+	arc_buf_hdr_t *hdr;
+
+	ASSERT(size != 0);
+	hdr = kmem_cache_alloc(hdr_l2only_cache, KM_SLEEP);
+	hdr->b_birth = birth;
+	hdr->b_type = type;
+	hdr->b_flags = 0;
+	arc_hdr_set_flags(hdr, arc_bufc_to_flags(type) | ARC_FLAG_HAS_L2HDR);
+	HDR_SET_LSIZE(hdr, size);
+	HDR_SET_PSIZE(hdr, psize);
+	arc_hdr_set_compress(hdr, compress);
+	if (protected)
+		arc_hdr_set_flags(hdr, ARC_FLAG_PROTECTED);
+	if (prefetch)
+		arc_hdr_set_flags(hdr, ARC_FLAG_PREFETCH);
+	hdr->b_spa = spa_load_guid(dev->l2ad_vdev->vdev_spa);
+
+	hdr->b_dva = dva;
+
+	hdr->b_l2hdr.b_dev = dev;
+	hdr->b_l2hdr.b_daddr = daddr;
+
+	return (hdr);
+}
+
 /*
  * Transition between the two allocation states for the arc_buf_hdr struct.
  * The arc_buf_hdr struct can be allocated with (hdr_full_cache) or without
@@ -4090,6 +4285,18 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 			continue;
 		}
 
+		/*
+		 * Dedup table blocks are kept resident up to the
+		 * zfs_arc_ddt_min reservation, unless we are flushing.
+		 * The sublist lock keeps the header's state stable here.
+		 */
+		if (bytes != ARC_EVICT_ALL && HDR_DDT(hdr) &&
+		    !GHOST_STATE(hdr->b_l1hdr.b_state) &&
+		    aggsum_compare(&astat_ddt_size, arc_ddt_reserve()) < 0) {
+			ARCSTAT_BUMP(arcstat_evict_ddt_skip);
+			continue;
+		}
+
 		hash_lock = HDR_LOCK(hdr);
 
 		/*
@@ -4150,6 +4357,21 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 	return (bytes_evicted);
 }
 
+/*
+ * Map step 'scan_idx' of an eviction scan onto a sublist index.  The arc
+ * state sublists are grouped by NUMA node (see
+ * arc_state_multilist_index_func()), so step i visits node
+ * (i % arc_numa_nodes).
+ */
+static inline int
+arc_evict_sublist_idx(int num_sublists, int scan_idx)
+{
+	int per_node = num_sublists / arc_numa_nodes;
+
+	return ((scan_idx % arc_numa_nodes) * per_node +
+	    scan_idx / arc_numa_nodes);
+}
+
 /*
  * Evict buffers from the given arc state, until we've removed the
  * specified number of bytes. Move the removed buffers to the
@@ -4206,7 +4428,7 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 	 * we're evicting all available buffers.
 	 */
 	while (total_evicted < bytes || bytes == ARC_EVICT_ALL) {
-		int sublist_idx = multilist_get_random_index(ml);
+		int scan_idx = multilist_get_random_index(ml);
 		uint64_t scan_evicted = 0;
 
 		/*
@@ -4226,9 +4448,14 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 		 * this is to try and evenly balance eviction across all
 		 * sublists. Always starting at the same sublist
 		 * (e.g. index 0) would cause evictions to favor certain
-		 * sublists over others.
+		 * sublists over others.  Consecutive steps of the scan
+		 * visit sublists of different NUMA nodes, so that a small
+		 * eviction target is spread across all nodes rather than
+		 * being taken from whichever node's sublists come first.
 		 */
 		for (int i = 0; i < num_sublists; i++) {
+			int sublist_idx = arc_evict_sublist_idx(num_sublists,
+			    scan_idx);
 			uint64_t bytes_remaining;
 			uint64_t bytes_evicted;
 
@@ -4246,8 +4473,8 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 			total_evicted += bytes_evicted;
 
 			/* we've reached the end, wrap to the beginning */
-			if (++sublist_idx >= num_sublists)
-				sublist_idx = 0;
+			if (++scan_idx >= num_sublists)
+				scan_idx = 0;
 		}
 
 		/*
@@ -5512,6 +5739,13 @@ arc_get_data_abd(arc_buf_hdr_t *hdr, uint64_t size, void *tag)
 	arc_buf_contents_t type = arc_buf_type(hdr);
 
 	arc_get_data_impl(hdr, size, tag);
+
+	/*
+	 * abd_alloc() prefers pages from the node of the calling CPU.
+	 * Remember that node so the header is kept on that node's
+	 * sublists the next time it becomes evictable.
+	 */
+	hdr->b_l1hdr.b_alloc_node = numa_node_id();
 	if (type == ARC_BUFC_METADATA) {
 		return (abd_alloc(size, B_TRUE));
 	} else {
@@ -5821,6 +6055,19 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 	}
 }
 
+/*
+ * Charge an ARC hit to the NUMA node of the calling CPU.
+ */
+static void
+arc_numa_hit(arc_buf_hdr_t *hdr)
+{
+	int node = numa_node_id();
+
+	ARCSTAT_NUMA_BUMP(node, ans_hits);
+	if (hdr->b_l1hdr.b_alloc_node != node)
+		ARCSTAT_NUMA_BUMP(node, ans_remote_hits);
+}
+
 /*
  * This routine is called by dbuf_hold() to update the arc_access() state
  * which otherwise would be skipped for entries in the dbuf cache.
@@ -5863,6 +6110,7 @@ arc_buf_access(arc_buf_t *buf)
 	ARCSTAT_BUMP(arcstat_hits);
 	ARCSTAT_CONDSTAT(!HDR_PREFETCH(hdr) && !HDR_PRESCIENT_PREFETCH(hdr),
 	    demand, prefetch, !HDR_ISTYPE_METADATA(hdr), data, metadata, hits);
+	arc_numa_hit(hdr);
 }
 
 /* a generic arc_read_done_func_t which you can use */
@@ -6325,6 +6573,7 @@ top:
 		ARCSTAT_CONDSTAT(!HDR_PREFETCH(hdr),
 		    demand, prefetch, !HDR_ISTYPE_METADATA(hdr),
 		    data, metadata, hits);
+		arc_numa_hit(hdr);
 
 		if (done)
 			done(NULL, zb, bp, buf, private);
@@ -6359,6 +6608,8 @@ top:
 			    encrypted_read);
 
 			if (!embedded_bp) {
+				if (DMU_OT_IS_DDT(BP_GET_TYPE(bp)))
+					arc_hdr_set_flags(hdr, ARC_FLAG_DDT);
 				hdr->b_dva = *BP_IDENTITY(bp);
 				hdr->b_birth = BP_PHYSICAL_BIRTH(bp);
 				exists = buf_hash_insert(hdr, &hash_lock);
@@ -6513,6 +6764,7 @@ top:
 			ARCSTAT_CONDSTAT(!HDR_PREFETCH(hdr),
 			    demand, prefetch, !HDR_ISTYPE_METADATA(hdr), data,
 			    metadata, misses);
+			ARCSTAT_NUMA_BUMP(numa_node_id(), ans_misses);
 		}
 
 		if (vd != NULL && l2arc_ndev != 0 && !(l2arc_norw && devw)) {
@@ -7166,6 +7418,10 @@ arc_write_done(zio_t *zio)
 		if (BP_IS_HOLE(zio->io_bp) || BP_IS_EMBEDDED(zio->io_bp)) {
 			buf_discard_identity(hdr);
 		} else {
+			if (DMU_OT_IS_DDT(BP_GET_TYPE(zio->io_bp)))
+				arc_hdr_set_flags(hdr, ARC_FLAG_DDT);
+			else
+				arc_hdr_clear_flags(hdr, ARC_FLAG_DDT);
 			hdr->b_dva = *BP_IDENTITY(zio->io_bp);
 			hdr->b_birth = BP_PHYSICAL_BIRTH(zio->io_bp);
 		}
@@ -7471,7 +7727,7 @@ arc_kstat_update_state(arc_state_t *state, kstat_named_t *size,
 static int
 arc_kstat_update(kstat_t *ksp, int rw)
 {
-	arc_stats_t *as = ksp->ks_data;
+	arc_stats_t *as = &arc_stats;
 
 	if (rw == KSTAT_WRITE) {
 		return (SET_ERROR(EACCES));
@@ -7507,6 +7763,8 @@ arc_kstat_update(kstat_t *ksp, int rw)
 		ARCSTAT(arcstat_dbuf_size) = aggsum_value(&astat_dbuf_size);
 		ARCSTAT(arcstat_dnode_size) = aggsum_value(&astat_dnode_size);
 		ARCSTAT(arcstat_bonus_size) = aggsum_value(&astat_bonus_size);
+		ARCSTAT(arcstat_ddt_size) = aggsum_value(&astat_ddt_size);
+		ARCSTAT(arcstat_ddt_min) = arc_ddt_reserve();
 
 		as->arcstat_memory_all_bytes.value.ui64 =
 		    arc_all_memory();
@@ -7514,6 +7772,12 @@ arc_kstat_update(kstat_t *ksp, int rw)
 		    arc_free_memory();
 		as->arcstat_memory_available_bytes.value.i64 =
 		    arc_available_memory();
+
+		/*
+		 * The kstat data is a copy of arc_stats followed by the
+		 * per-node counters, which are updated in place.
+		 */
+		bcopy(as, ksp->ks_data, sizeof (arc_stats));
 	}
 
 	return (0);
@@ -7525,11 +7789,18 @@ arc_kstat_update(kstat_t *ksp, int rw)
  * code is laid out; arc_evict_state() assumes ARC buffers are evenly
  * distributed between all sublists and uses this assumption when
  * deciding which sublist to evict from and how much to evict from it.
+ *
+ * The sublists are split into arc_numa_nodes equally sized groups, one
+ * per NUMA node, and a header is placed in the group of the node its
+ * data was allocated for.  Within a group the hash spreads headers
+ * evenly.
  */
 unsigned int
 arc_state_multilist_index_func(multilist_t *ml, void *obj)
 {
 	arc_buf_hdr_t *hdr = obj;
+	unsigned int per_node = multilist_get_num_sublists(ml) /
+	    arc_numa_nodes;
 
 	/*
 	 * We rely on b_dva to generate evenly distributed index
@@ -7549,9 +7820,66 @@ arc_state_multilist_index_func(multilist_t *ml, void *obj)
 	 * distributed evenly. Otherwise, in the case that the multilist
 	 * has a power of two number of sublists, each sublists' usage
 	 * would not be evenly distributed.
+	 *
+	 * The node is taken from b_list_node, which is only updated
+	 * while the header is not on any arcs_list.
 	 */
-	return (buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth) %
-	    multilist_get_num_sublists(ml));
+	ASSERT3U(hdr->b_l1hdr.b_list_node, <, arc_numa_nodes);
+	return (hdr->b_l1hdr.b_list_node * per_node +
+	    buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth) % per_node);
+}
+
+static void
+arc_numa_stat_init(kstat_named_t *ksn, int node, const char *stat)
+{
+	(void) snprintf(ksn->name, KSTAT_STRLEN, "node%d_%s", node, stat);
+	ksn->data_type = KSTAT_DATA_UINT64;
+	ksn->value.ui64 = 0;
+}
+
+/*
+ * Allocate the arcstats kstat data: a copy of arc_stats followed by one
+ * arc_numa_stats_t per NUMA node.
+ */
+static void
+arc_numa_stats_init(void)
+{
+	int stats_per_node = sizeof (arc_numa_stats_t) / sizeof (kstat_named_t);
+
+	arc_ks_ndata = sizeof (arc_stats) / sizeof (kstat_named_t) +
+	    arc_numa_nodes * stats_per_node;
+	arc_ks_data = kmem_zalloc(arc_ks_ndata * sizeof (kstat_named_t),
+	    KM_SLEEP);
+	bcopy(&arc_stats, arc_ks_data, sizeof (arc_stats));
+	arc_numa_stats = (arc_numa_stats_t *)&arc_ks_data[
+	    sizeof (arc_stats) / sizeof (kstat_named_t)];
+
+	for (int i = 0; i < arc_numa_nodes; i++) {
+		arc_numa_stats_t *ans = &arc_numa_stats[i];
+
+		arc_numa_stat_init(&ans->ans_hits, i, "hits");
+		arc_numa_stat_init(&ans->ans_misses, i, "misses");
+		arc_numa_stat_init(&ans->ans_remote_hits, i, "remote_hits");
+	}
+}
+
+static void
+arc_numa_stats_fini(void)
+{
+	kmem_free(arc_ks_data, arc_ks_ndata * sizeof (kstat_named_t));
+	arc_ks_data = NULL;
+	arc_numa_stats = NULL;
+}
+
+static multilist_t *
+arc_state_multilist_create(void)
+{
+	unsigned int per_node = MAX(multilist_get_default_num_sublists() /
+	    arc_numa_nodes, 1);
+
+	return (multilist_create_impl(sizeof (arc_buf_hdr_t),
+	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
+	    per_node * arc_numa_nodes, arc_state_multilist_index_func));
 }
 
 /*
@@ -7658,46 +7986,28 @@ arc_state_init(void)
 	arc_mfu_ghost = &ARC_mfu_ghost;
 	arc_l2c_only = &ARC_l2c_only;
 
+	arc_numa_nodes = MAX(nr_node_ids, 1);
+
 	arc_mru->arcs_list[ARC_BUFC_METADATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_mru->arcs_list[ARC_BUFC_DATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_mru_ghost->arcs_list[ARC_BUFC_METADATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_mru_ghost->arcs_list[ARC_BUFC_DATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_mfu->arcs_list[ARC_BUFC_METADATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_mfu->arcs_list[ARC_BUFC_DATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_mfu_ghost->arcs_list[ARC_BUFC_METADATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_mfu_ghost->arcs_list[ARC_BUFC_DATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_l2c_only->arcs_list[ARC_BUFC_METADATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 	arc_l2c_only->arcs_list[ARC_BUFC_DATA] =
-	    multilist_create(sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node),
-	    arc_state_multilist_index_func);
+	    arc_state_multilist_create();
 
 	zfs_refcount_create(&arc_anon->arcs_esize[ARC_BUFC_METADATA]);
 	zfs_refcount_create(&arc_anon->arcs_esize[ARC_BUFC_DATA]);
@@ -7728,6 +8038,7 @@ arc_state_init(void)
 	aggsum_init(&astat_bonus_size, 0);
 	aggsum_init(&astat_dnode_size, 0);
 	aggsum_init(&astat_dbuf_size, 0);
+	aggsum_init(&astat_ddt_size, 0);
 
 	arc_anon->arcs_state = ARC_STATE_ANON;
 	arc_mru->arcs_state = ARC_STATE_MRU;
@@ -7780,6 +8091,7 @@ arc_state_fini(void)
 	aggsum_fini(&astat_bonus_size);
 	aggsum_fini(&astat_dnode_size);
 	aggsum_fini(&astat_dbuf_size);
+	aggsum_fini(&astat_ddt_size);
 }
 
 uint64_t
@@ -7788,6 +8100,26 @@ arc_target_bytes(void)
 	return (arc_c);
 }
 
+/*
+ * Bytes of dedup table blocks currently cached in the ARC.
+ */
+uint64_t
+arc_ddt_size(void)
+{
+	return (aggsum_value(&astat_ddt_size));
+}
+
+/*
+ * Bytes of dedup table blocks protected from eviction.  The reservation
+ * is capped at half of the target ARC size so that it can never starve
+ * the rest of the cache.
+ */
+uint64_t
+arc_ddt_reserve(void)
+{
+	return (MIN(zfs_arc_ddt_min, arc_c / 2));
+}
+
 void
 arc_init(void)
 {
@@ -7869,11 +8201,13 @@ arc_init(void)
 	arc_prune_taskq = taskq_create("arc_prune", max_ncpus, defclsyspri,
 	    max_ncpus, INT_MAX, TASKQ_PREPOPULATE | TASKQ_DYNAMIC);
 
+	arc_numa_stats_init();
+
 	arc_ksp = kstat_create("zfs", 0, "arcstats", "misc", KSTAT_TYPE_NAMED,
-	    sizeof (arc_stats) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	    arc_ks_ndata, KSTAT_FLAG_VIRTUAL);
 
 	if (arc_ksp != NULL) {
-		arc_ksp->ks_data = &arc_stats;
+		arc_ksp->ks_data = arc_ks_data;
 		arc_ksp->ks_update = arc_kstat_update;
 		kstat_install(arc_ksp);
 	}
@@ -7924,6 +8258,7 @@ arc_fini(void)
 		kstat_delete(arc_ksp);
 		arc_ksp = NULL;
 	}
+	arc_numa_stats_fini();
 
 	taskq_wait(arc_prune_taskq);
 	taskq_destroy(arc_prune_taskq);
@@ -8128,9 +8463,9 @@ l2arc_write_eligible(uint64_t spa_guid, arc_buf_hdr_t *hdr)
 }
 
 static uint64_t
-l2arc_write_size(void)
+l2arc_write_size(l2arc_dev_t *dev)
 {
-	uint64_t size;
+	uint64_t size, dev_size;
 
 	/*
 	 * Make sure our globals have meaningful values in case the user
@@ -8147,6 +8482,25 @@ l2arc_write_size(void)
 	if (arc_warm == B_FALSE)
 		size += l2arc_write_boost;
 
+	/*
+	 * Make sure the write size, including the worst case log block
+	 * overhead, fits on the device.  l2arc_evict() relies on this to
+	 * terminate when it wraps the write hand around.
+	 */
+	dev_size = dev->l2ad_end - dev->l2ad_start;
+	if (size + l2arc_log_blk_overhead(size, dev) >= dev_size) {
+		cmn_err(CE_NOTE, "l2arc_write_max or l2arc_write_boost plus "
+		    "the overhead of log blocks (persistent L2ARC, %llu "
+		    "bytes) exceeds the size of the cache device (guid %llu), "
+		    "resetting them to the default (%d)",
+		    (u_longlong_t)l2arc_log_blk_overhead(size, dev),
+		    (u_longlong_t)dev->l2ad_vdev->vdev_guid, L2ARC_WRITE_SIZE);
+		size = l2arc_write_max = l2arc_write_boost = L2ARC_WRITE_SIZE;
+
+		if (arc_warm == B_FALSE)
+			size += l2arc_write_boost;
+	}
+
 	return (size);
 
 }
@@ -8212,10 +8566,13 @@ l2arc_dev_get_next(void)
 		else if (next == first)
 			break;
 
-	} while (vdev_is_dead(next->l2ad_vdev));
+	} while (vdev_is_dead(next->l2ad_vdev) || next->l2ad_rebuild);
 
-	/* if we were unable to find any usable vdevs, return NULL */
-	if (vdev_is_dead(next->l2ad_vdev))
+	/*
+	 * If we were unable to find any usable vdevs, return NULL.  Devices
+	 * which are still being rebuilt are not written to.
+	 */
+	if (vdev_is_dead(next->l2ad_vdev) || next->l2ad_rebuild)
 		next = NULL;
 
 	l2arc_dev_last = next;
@@ -8265,7 +8622,10 @@ static void
 l2arc_write_done(zio_t *zio)
 {
 	l2arc_write_callback_t *cb;
+	l2arc_lb_abd_buf_t *abd_buf;
+	l2arc_lb_ptr_buf_t *lb_ptr_buf;
 	l2arc_dev_t *dev;
+	l2arc_dev_hdr_phys_t *l2dhdr;
 	list_t *buflist;
 	arc_buf_hdr_t *head, *hdr, *hdr_prev;
 	kmutex_t *hash_lock;
@@ -8275,6 +8635,8 @@ l2arc_write_done(zio_t *zio)
 	ASSERT3P(cb, !=, NULL);
 	dev = cb->l2wcb_dev;
 	ASSERT3P(dev, !=, NULL);
+	l2dhdr = dev->l2ad_dev_hdr;
+	ASSERT3P(l2dhdr, !=, NULL);
 	head = cb->l2wcb_head;
 	ASSERT3P(head, !=, NULL);
 	buflist = &dev->l2ad_buflist;
@@ -8366,6 +8728,57 @@ top:
 		mutex_exit(hash_lock);
 	}
 
+	/*
+	 * Free the log block buffers written along with the data.  If the
+	 * write failed, the log blocks never made it to the device: drop
+	 * them from the list of log blocks present on the device (they were
+	 * inserted at its head) and reclaim their space.
+	 */
+	while ((abd_buf = list_remove_tail(&cb->l2wcb_abd_list)) != NULL) {
+		abd_free(abd_buf->abd);
+		kmem_free(abd_buf, sizeof (*abd_buf));
+		if (zio->io_error != 0) {
+			lb_ptr_buf = list_remove_head(&dev->l2ad_lbptr_list);
+			uint64_t asize =
+			    L2BLK_GET_PSIZE(lb_ptr_buf->lb_ptr->lbp_prop);
+			bytes_dropped += asize;
+			ARCSTAT_INCR(arcstat_l2_log_blk_asize, -asize);
+			ARCSTAT_BUMPDOWN(arcstat_l2_log_blk_count);
+			(void) zfs_refcount_remove_many(&dev->l2ad_lb_asize,
+			    asize, lb_ptr_buf);
+			(void) zfs_refcount_remove(&dev->l2ad_lb_count,
+			    lb_ptr_buf);
+			kmem_free(lb_ptr_buf->lb_ptr,
+			    sizeof (l2arc_log_blkptr_t));
+			kmem_free(lb_ptr_buf, sizeof (l2arc_lb_ptr_buf_t));
+		}
+	}
+	list_destroy(&cb->l2wcb_abd_list);
+
+	if (zio->io_error != 0) {
+		/*
+		 * Point the device header back at the newest log blocks
+		 * which are still present, or invalidate it entirely if
+		 * there are none.
+		 */
+		lb_ptr_buf = list_head(&dev->l2ad_lbptr_list);
+		for (int i = 0; i < 2; i++) {
+			if (lb_ptr_buf == NULL) {
+				if (i == 0) {
+					bzero(l2dhdr, dev->l2ad_dev_hdr_asize);
+				} else {
+					bzero(&l2dhdr->dh_start_lbps[i],
+					    sizeof (l2arc_log_blkptr_t));
+				}
+				break;
+			}
+			bcopy(lb_ptr_buf->lb_ptr, &l2dhdr->dh_start_lbps[i],
+			    sizeof (l2arc_log_blkptr_t));
+			lb_ptr_buf = list_next(&dev->l2ad_lbptr_list,
+			    lb_ptr_buf);
+		}
+	}
+
 	atomic_inc_64(&l2arc_writes_done);
 	list_remove(buflist, head);
 	ASSERT(!HDR_HAS_L1HDR(head));
@@ -8648,6 +9061,10 @@ l2arc_sublist_lock(int list_num)
  * bytes.  This distance may span populated buffers, it may span nothing.
  * This is clearing a region on the L2ARC device ready for writing.
  * If the 'all' boolean is set, every buffer is evicted.
+ *
+ * The end of the evicted region is recorded in l2ad_evict and persisted
+ * in the device header, so that l2arc_rebuild() can tell which log blocks
+ * may already have been overwritten.
  */
 static void
 l2arc_evict(l2arc_dev_t *dev, uint64_t distance, boolean_t all)
@@ -8655,23 +9072,29 @@ l2arc_evict(l2arc_dev_t *dev, uint64_t distance, boolean_t all)
 	list_t *buflist;
 	arc_buf_hdr_t *hdr, *hdr_prev;
 	kmutex_t *hash_lock;
+	l2arc_lb_ptr_buf_t *lb_ptr_buf, *lb_ptr_buf_prev;
+	vdev_t *vd = dev->l2ad_vdev;
+	boolean_t rerun;
 	uint64_t taddr;
 
 	buflist = &dev->l2ad_buflist;
 
-	if (!all && dev->l2ad_first) {
-		/*
-		 * This is the first sweep through the device.  There is
-		 * nothing to evict.
-		 */
-		return;
-	}
+	/*
+	 * Log blocks are written along with the buffers, so account for
+	 * their worst case overhead.
+	 */
+	distance += l2arc_log_blk_overhead(distance, dev);
 
-	if (dev->l2ad_hand >= (dev->l2ad_end - (2 * distance))) {
+top:
+	rerun = B_FALSE;
+	if (dev->l2ad_hand >= (dev->l2ad_end - distance)) {
 		/*
-		 * When nearing the end of the device, evict to the end
-		 * before the device write hand jumps to the start.
+		 * When there is no room left for the upcoming write, evict
+		 * to the end of the device, then move the write and evict
+		 * hands back to the start and evict from there.
+		 * l2arc_write_size() makes sure this terminates.
 		 */
+		rerun = B_TRUE;
 		taddr = dev->l2ad_end;
 	} else {
 		taddr = dev->l2ad_hand + distance;
@@ -8679,8 +9102,43 @@ l2arc_evict(l2arc_dev_t *dev, uint64_t distance, boolean_t all)
 	DTRACE_PROBE4(l2arc__evict, l2arc_dev_t *, dev, list_t *, buflist,
 	    uint64_t, taddr, boolean_t, all);
 
-top:
+	if (!all && dev->l2ad_first) {
+		/*
+		 * This is the first sweep through the device.  There is
+		 * nothing to evict.
+		 */
+		goto out;
+	}
+
+	dev->l2ad_evict = MAX(dev->l2ad_evict, taddr);
+
+retry:
 	mutex_enter(&dev->l2ad_mtx);
+
+	/*
+	 * Drop the log blocks which are about to be overwritten, oldest
+	 * first, and give back the space they were accounted for.
+	 */
+	for (lb_ptr_buf = list_tail(&dev->l2ad_lbptr_list); lb_ptr_buf;
+	    lb_ptr_buf = lb_ptr_buf_prev) {
+		lb_ptr_buf_prev = list_prev(&dev->l2ad_lbptr_list, lb_ptr_buf);
+
+		uint64_t asize = L2BLK_GET_PSIZE(lb_ptr_buf->lb_ptr->lbp_prop);
+
+		if (!all && l2arc_log_blkptr_valid(dev, lb_ptr_buf->lb_ptr))
+			break;
+
+		vdev_space_update(vd, -asize, 0, 0);
+		ARCSTAT_INCR(arcstat_l2_log_blk_asize, -asize);
+		ARCSTAT_BUMPDOWN(arcstat_l2_log_blk_count);
+		(void) zfs_refcount_remove_many(&dev->l2ad_lb_asize, asize,
+		    lb_ptr_buf);
+		(void) zfs_refcount_remove(&dev->l2ad_lb_count, lb_ptr_buf);
+		list_remove(&dev->l2ad_lbptr_list, lb_ptr_buf);
+		kmem_free(lb_ptr_buf->lb_ptr, sizeof (l2arc_log_blkptr_t));
+		kmem_free(lb_ptr_buf, sizeof (l2arc_lb_ptr_buf_t));
+	}
+
 	for (hdr = list_tail(buflist); hdr; hdr = hdr_prev) {
 		hdr_prev = list_prev(buflist, hdr);
 
@@ -8700,7 +9158,7 @@ top:
 			mutex_exit(&dev->l2ad_mtx);
 			mutex_enter(hash_lock);
 			mutex_exit(hash_lock);
-			goto top;
+			goto retry;
 		}
 
 		/*
@@ -8712,7 +9170,7 @@ top:
 		ASSERT(!HDR_L2_WRITING(hdr));
 		ASSERT(!HDR_L2_WRITE_HEAD(hdr));
 
-		if (!all && (hdr->b_l2hdr.b_daddr >= taddr ||
+		if (!all && (hdr->b_l2hdr.b_daddr >= dev->l2ad_evict ||
 		    hdr->b_l2hdr.b_daddr < dev->l2ad_hand)) {
 			/*
 			 * We've evicted to the target address,
@@ -8749,6 +9207,20 @@ top:
 		mutex_exit(hash_lock);
 	}
 	mutex_exit(&dev->l2ad_mtx);
+
+out:
+	if (!all && rerun) {
+		/*
+		 * Bump the device hand to the device start; everything up
+		 * to the end has just been evicted.
+		 */
+		dev->l2ad_hand = dev->l2ad_start;
+		dev->l2ad_evict = dev->l2ad_start;
+		dev->l2ad_first = B_FALSE;
+		goto top;
+	}
+
+	ASSERT(all || dev->l2ad_hand + distance < dev->l2ad_end);
 }
 
 /*
@@ -8885,7 +9357,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 	arc_buf_hdr_t *hdr, *hdr_prev, *head;
 	uint64_t write_asize, write_psize, write_lsize, headroom;
 	boolean_t full;
-	l2arc_write_callback_t *cb;
+	l2arc_write_callback_t *cb = NULL;
 	zio_t *pio, *wzio;
 	uint64_t guid = spa_load_guid(spa);
 
@@ -9039,6 +9511,9 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 				    sizeof (l2arc_write_callback_t), KM_SLEEP);
 				cb->l2wcb_dev = dev;
 				cb->l2wcb_head = head;
+				list_create(&cb->l2wcb_abd_list,
+				    sizeof (l2arc_lb_abd_buf_t),
+				    offsetof(l2arc_lb_abd_buf_t, node));
 				pio = zio_root(spa, l2arc_write_done, cb,
 				    ZIO_FLAG_CANFAIL);
 			}
@@ -9073,6 +9548,15 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 
 			mutex_exit(hash_lock);
 
+			/*
+			 * Append the buffer to the current log block and
+			 * commit the log block to the device once it is full.
+			 */
+			if (l2arc_log_blk_insert(dev, hdr)) {
+				write_asize +=
+				    l2arc_log_blk_commit(dev, pio, cb);
+			}
+
 			(void) zio_nowait(wzio);
 		}
 
@@ -9087,28 +9571,35 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 		ASSERT0(write_lsize);
 		ASSERT(!HDR_HAS_L1HDR(head));
 		kmem_cache_free(hdr_l2only_cache, head);
+
+		/*
+		 * Nothing was written, but l2arc_evict() may still have
+		 * moved the evict hand forward.
+		 */
+		if (dev->l2ad_evict != dev->l2ad_dev_hdr->dh_evict)
+			l2arc_dev_hdr_update(dev);
+
 		return (0);
 	}
 
-	ASSERT3U(write_asize, <=, target_sz);
+	ASSERT3U(write_asize, <=,
+	    target_sz + l2arc_log_blk_overhead(target_sz, dev));
 	ARCSTAT_BUMP(arcstat_l2_writes_sent);
 	ARCSTAT_INCR(arcstat_l2_write_bytes, write_psize);
 	ARCSTAT_INCR(arcstat_l2_lsize, write_lsize);
 	ARCSTAT_INCR(arcstat_l2_psize, write_psize);
 
-	/*
-	 * Bump device hand to the device start if it is approaching the end.
-	 * l2arc_evict() will already have evicted ahead for this case.
-	 */
-	if (dev->l2ad_hand >= (dev->l2ad_end - target_sz)) {
-		dev->l2ad_hand = dev->l2ad_start;
-		dev->l2ad_first = B_FALSE;
-	}
-
 	dev->l2ad_writing = B_TRUE;
 	(void) zio_wait(pio);
 	dev->l2ad_writing = B_FALSE;
 
+	/*
+	 * Update the device header only once the writes have completed,
+	 * since l2arc_write_done() may have rolled back the log block
+	 * pointers it holds.
+	 */
+	l2arc_dev_hdr_update(dev);
+
 	return (write_asize);
 }
 
@@ -9187,7 +9678,7 @@ l2arc_feed_thread(void *unused)
 
 		ARCSTAT_BUMP(arcstat_l2_feeds);
 
-		size = l2arc_write_size();
+		size = l2arc_write_size(dev);
 
 		/*
 		 * Evict L2ARC buffers that will be overwritten.
@@ -9213,8 +9704,12 @@ l2arc_feed_thread(void *unused)
 	thread_exit();
 }
 
-boolean_t
-l2arc_vdev_present(vdev_t *vd)
+/*
+ * Returns the l2arc_dev_t associated with a particular vdev_t or NULL if
+ * the vdev_t isn't an L2ARC device.
+ */
+static l2arc_dev_t *
+l2arc_vdev_get(vdev_t *vd)
 {
 	l2arc_dev_t *dev;
 
@@ -9226,7 +9721,50 @@ l2arc_vdev_present(vdev_t *vd)
 	}
 	mutex_exit(&l2arc_dev_mtx);
 
-	return (dev != NULL);
+	return (dev);
+}
+
+boolean_t
+l2arc_vdev_present(vdev_t *vd)
+{
+	return (l2arc_vdev_get(vd) != NULL);
+}
+
+/*
+ * Decide whether the contents of a newly added cache device can be
+ * rebuilt from its persistent log blocks.  If so, the device is only
+ * marked as pending a rebuild here: reading the log blocks would stall
+ * the pool import, so l2arc_spa_rebuild_start() hands that off to a
+ * separate thread once the pool is loaded.  Otherwise a fresh device
+ * header is written so stale log blocks are never followed.
+ */
+static void
+l2arc_rebuild_dev(l2arc_dev_t *dev)
+{
+	spa_t *spa = dev->l2ad_spa;
+
+	/*
+	 * Every log block describes up to L2ARC_LOG_BLK_MAX_ENTRIES buffers
+	 * of at most SPA_MAXBLOCKSIZE each.  On small devices reduce the
+	 * number of entries per log block so that the payload of a log
+	 * block still fits on the device, and don't bother with log blocks
+	 * at all on devices smaller than l2arc_rebuild_blocks_min_l2size.
+	 */
+	if (dev->l2ad_end < l2arc_rebuild_blocks_min_l2size) {
+		dev->l2ad_log_entries = 0;
+	} else {
+		dev->l2ad_log_entries = MIN((dev->l2ad_end -
+		    dev->l2ad_start) >> SPA_MAXBLOCKSHIFT,
+		    L2ARC_LOG_BLK_MAX_ENTRIES);
+	}
+
+	if (l2arc_rebuild_enabled && dev->l2ad_log_entries > 0 &&
+	    l2arc_dev_hdr_read(dev) == 0) {
+		dev->l2ad_rebuild = B_TRUE;
+	} else if (spa_writeable(spa)) {
+		bzero(dev->l2ad_dev_hdr, dev->l2ad_dev_hdr_asize);
+		l2arc_dev_hdr_update(dev);
+	}
 }
 
 /*
@@ -9237,21 +9775,29 @@ void
 l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 {
 	l2arc_dev_t *adddev;
+	uint64_t l2dhdr_asize;
 
 	ASSERT(!l2arc_vdev_present(vd));
 
 	/*
-	 * Create a new l2arc device entry.
+	 * Create a new l2arc device entry.  It embeds the currently open
+	 * log block, so it is too large for kmem_alloc().
 	 */
-	adddev = kmem_zalloc(sizeof (l2arc_dev_t), KM_SLEEP);
+	adddev = vmem_zalloc(sizeof (l2arc_dev_t), KM_SLEEP);
 	adddev->l2ad_spa = spa;
 	adddev->l2ad_vdev = vd;
-	adddev->l2ad_start = VDEV_LABEL_START_SIZE;
+	/* leave room for the persistent device header */
+	l2dhdr_asize = adddev->l2ad_dev_hdr_asize =
+	    MAX(sizeof (*adddev->l2ad_dev_hdr), 1ULL << vd->vdev_ashift);
+	adddev->l2ad_start = VDEV_LABEL_START_SIZE + l2dhdr_asize;
 	adddev->l2ad_end = VDEV_LABEL_START_SIZE + vdev_get_min_asize(vd);
+	ASSERT3U(adddev->l2ad_start, <, adddev->l2ad_end);
 	adddev->l2ad_hand = adddev->l2ad_start;
+	adddev->l2ad_evict = adddev->l2ad_start;
 	adddev->l2ad_first = B_TRUE;
 	adddev->l2ad_writing = B_FALSE;
 	list_link_init(&adddev->l2ad_node);
+	adddev->l2ad_dev_hdr = kmem_zalloc(l2dhdr_asize, KM_SLEEP);
 
 	mutex_init(&adddev->l2ad_mtx, NULL, MUTEX_DEFAULT, NULL);
 	/*
@@ -9261,8 +9807,23 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	list_create(&adddev->l2ad_buflist, sizeof (arc_buf_hdr_t),
 	    offsetof(arc_buf_hdr_t, b_l2hdr.b_l2node));
 
+	/*
+	 * This is a list of pointers to log blocks that are still present
+	 * on the device.
+	 */
+	list_create(&adddev->l2ad_lbptr_list, sizeof (l2arc_lb_ptr_buf_t),
+	    offsetof(l2arc_lb_ptr_buf_t, node));
+
 	vdev_space_update(vd, 0, 0, adddev->l2ad_end - adddev->l2ad_hand);
 	zfs_refcount_create(&adddev->l2ad_alloc);
+	zfs_refcount_create(&adddev->l2ad_lb_asize);
+	zfs_refcount_create(&adddev->l2ad_lb_count);
+
+	/*
+	 * Decide whether the device can be rebuilt before it is visible to
+	 * l2arc_feed_thread(), which would otherwise start writing to it.
+	 */
+	l2arc_rebuild_dev(adddev);
 
 	/*
 	 * Add device to global list
@@ -9279,24 +9840,28 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 void
 l2arc_remove_vdev(vdev_t *vd)
 {
-	l2arc_dev_t *dev, *nextdev, *remdev = NULL;
+	l2arc_dev_t *remdev;
 
 	/*
 	 * Find the device by vdev
 	 */
-	mutex_enter(&l2arc_dev_mtx);
-	for (dev = list_head(l2arc_dev_list); dev; dev = nextdev) {
-		nextdev = list_next(l2arc_dev_list, dev);
-		if (vd == dev->l2ad_vdev) {
-			remdev = dev;
-			break;
-		}
-	}
+	remdev = l2arc_vdev_get(vd);
 	ASSERT3P(remdev, !=, NULL);
 
+	/*
+	 * Cancel any ongoing rebuild and wait for it to finish before the
+	 * device goes away.
+	 */
+	mutex_enter(&l2arc_rebuild_thr_lock);
+	remdev->l2ad_rebuild_cancel = B_TRUE;
+	while (remdev->l2ad_rebuild_began)
+		cv_wait(&l2arc_rebuild_thr_cv, &l2arc_rebuild_thr_lock);
+	mutex_exit(&l2arc_rebuild_thr_lock);
+
 	/*
 	 * Remove device from global list
 	 */
+	mutex_enter(&l2arc_dev_mtx);
 	list_remove(l2arc_dev_list, remdev);
 	l2arc_dev_last = NULL;		/* may have been invalidated */
 	atomic_dec_64(&l2arc_ndev);
@@ -9307,9 +9872,14 @@ l2arc_remove_vdev(vdev_t *vd)
 	 */
 	l2arc_evict(remdev, 0, B_TRUE);
 	list_destroy(&remdev->l2ad_buflist);
+	ASSERT(list_is_empty(&remdev->l2ad_lbptr_list));
+	list_destroy(&remdev->l2ad_lbptr_list);
 	mutex_destroy(&remdev->l2ad_mtx);
 	zfs_refcount_destroy(&remdev->l2ad_alloc);
-	kmem_free(remdev, sizeof (l2arc_dev_t));
+	zfs_refcount_destroy(&remdev->l2ad_lb_asize);
+	zfs_refcount_destroy(&remdev->l2ad_lb_count);
+	kmem_free(remdev->l2ad_dev_hdr, remdev->l2ad_dev_hdr_asize);
+	vmem_free(remdev, sizeof (l2arc_dev_t));
 }
 
 void
@@ -9322,6 +9892,8 @@ l2arc_init(void)
 
 	mutex_init(&l2arc_feed_thr_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&l2arc_feed_thr_cv, NULL, CV_DEFAULT, NULL);
+	mutex_init(&l2arc_rebuild_thr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&l2arc_rebuild_thr_cv, NULL, CV_DEFAULT, NULL);
 	mutex_init(&l2arc_dev_mtx, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&l2arc_free_on_write_mtx, NULL, MUTEX_DEFAULT, NULL);
 
@@ -9346,6 +9918,8 @@ l2arc_fini(void)
 
 	mutex_destroy(&l2arc_feed_thr_lock);
 	cv_destroy(&l2arc_feed_thr_cv);
+	mutex_destroy(&l2arc_rebuild_thr_lock);
+	cv_destroy(&l2arc_rebuild_thr_cv);
 	mutex_destroy(&l2arc_dev_mtx);
 	mutex_destroy(&l2arc_free_on_write_mtx);
 
@@ -9377,6 +9951,779 @@ l2arc_stop(void)
 	mutex_exit(&l2arc_feed_thr_lock);
 }
 
+/*
+ * Persistent L2ARC
+ *
+ * See the comment above l2arc_dev_hdr_phys_t in arc_impl.h for the
+ * on-disk layout.  The device header is read when a cache device is
+ * added (l2arc_add_vdev()).  If it belongs to this pool and device, a
+ * rebuild is started once the pool has finished loading, walking the
+ * log block chains from the newest log block backwards and recreating
+ * an L2ARC-only header for every buffer they describe.  Buffers which
+ * are already cached in the ARC are left alone.
+ *
+ * While a device is being rebuilt, l2arc_feed_thread() does not write to
+ * it.  Since every L2ARC read is verified against the block pointer's
+ * checksum, a stale log entry can at worst cause an L2ARC miss.
+ */
+
+/*
+ * Returns true if 'check' lies within the range [bottom, top] on the
+ * circular device address space, i.e. taking a wrap of the write hand
+ * into account when bottom > top.
+ */
+static boolean_t
+l2arc_range_check_overlap(uint64_t bottom, uint64_t top, uint64_t check)
+{
+	if (bottom < top)
+		return (bottom <= check && check <= top);
+	else if (bottom > top)
+		return (check <= top || bottom <= check);
+	else
+		return (check == top);
+}
+
+/*
+ * Returns the worst case amount of space taken up by log blocks when
+ * writing write_sz bytes of buffers to the device, assuming all of them
+ * are of the minimum block size.
+ */
+static uint64_t
+l2arc_log_blk_overhead(uint64_t write_sz, l2arc_dev_t *dev)
+{
+	uint64_t log_entries, log_blocks;
+
+	if (dev->l2ad_log_entries == 0)
+		return (0);
+
+	log_entries = write_sz >> SPA_MINBLOCKSHIFT;
+	log_blocks = (log_entries + dev->l2ad_log_entries - 1) /
+	    dev->l2ad_log_entries;
+
+	return (vdev_psize_to_asize(dev->l2ad_vdev,
+	    sizeof (l2arc_log_blk_phys_t)) * log_blocks);
+}
+
+/*
+ * Returns true if the log block pointed to by lbp is present on the
+ * device: both the log block and its payload must lie within the device
+ * and must not have been overwritten, that is they must not overlap the
+ * region between the write hand and the evict hand.
+ */
+static boolean_t
+l2arc_log_blkptr_valid(l2arc_dev_t *dev, const l2arc_log_blkptr_t *lbp)
+{
+	uint64_t asize = L2BLK_GET_PSIZE(lbp->lbp_prop);
+	uint64_t end = lbp->lbp_daddr + asize - 1;
+	uint64_t start = lbp->lbp_payload_start;
+	boolean_t evicted;
+
+	evicted =
+	    l2arc_range_check_overlap(start, end, dev->l2ad_hand) ||
+	    l2arc_range_check_overlap(start, end, dev->l2ad_evict) ||
+	    l2arc_range_check_overlap(dev->l2ad_hand, dev->l2ad_evict, start) ||
+	    l2arc_range_check_overlap(dev->l2ad_hand, dev->l2ad_evict, end);
+
+	return (start >= dev->l2ad_start && end <= dev->l2ad_end &&
+	    asize > 0 && asize <= sizeof (l2arc_log_blk_phys_t) &&
+	    (!evicted || dev->l2ad_first));
+}
+
+/*
+ * Writes the in-memory device header to the cache device.  The caller
+ * must hold the L2ARC config lock to keep the device from going away.
+ */
+static void
+l2arc_dev_hdr_update(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *l2dhdr = dev->l2ad_dev_hdr;
+	uint64_t l2dhdr_asize = dev->l2ad_dev_hdr_asize;
+	abd_t *abd;
+	int err;
+
+	VERIFY(spa_config_held(dev->l2ad_spa, SCL_STATE_ALL, RW_READER));
+
+	l2dhdr->dh_magic = L2ARC_DEV_HDR_MAGIC;
+	l2dhdr->dh_version = L2ARC_PERSISTENT_VERSION;
+	l2dhdr->dh_spa_guid = spa_guid(dev->l2ad_vdev->vdev_spa);
+	l2dhdr->dh_vdev_guid = dev->l2ad_vdev->vdev_guid;
+	l2dhdr->dh_log_entries = dev->l2ad_log_entries;
+	l2dhdr->dh_evict = dev->l2ad_evict;
+	l2dhdr->dh_start = dev->l2ad_start;
+	l2dhdr->dh_end = dev->l2ad_end;
+	l2dhdr->dh_lb_asize = zfs_refcount_count(&dev->l2ad_lb_asize);
+	l2dhdr->dh_lb_count = zfs_refcount_count(&dev->l2ad_lb_count);
+	l2dhdr->dh_flags = 0;
+	if (dev->l2ad_first)
+		l2dhdr->dh_flags |= L2ARC_DEV_HDR_EVICT_FIRST;
+
+	abd = abd_get_from_buf(l2dhdr, l2dhdr_asize);
+
+	err = zio_wait(zio_write_phys(NULL, dev->l2ad_vdev,
+	    VDEV_LABEL_START_SIZE, l2dhdr_asize, abd, ZIO_CHECKSUM_LABEL, NULL,
+	    NULL, ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL, B_FALSE));
+
+	abd_put(abd);
+
+	if (err != 0) {
+		zfs_dbgmsg("L2ARC IO error (%d) while writing device header, "
+		    "vdev guid: %llu", err,
+		    (u_longlong_t)dev->l2ad_vdev->vdev_guid);
+	}
+}
+
+/*
+ * Reads the device header from the cache device.  Returns 0 if it is
+ * intact and was written by this pool for this very device with the
+ * current geometry, an error otherwise.
+ */
+static int
+l2arc_dev_hdr_read(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *l2dhdr = dev->l2ad_dev_hdr;
+	uint64_t l2dhdr_asize = dev->l2ad_dev_hdr_asize;
+	abd_t *abd;
+	int err;
+
+	abd = abd_get_from_buf(l2dhdr, l2dhdr_asize);
+
+	err = zio_wait(zio_read_phys(NULL, dev->l2ad_vdev,
+	    VDEV_LABEL_START_SIZE, l2dhdr_asize, abd, ZIO_CHECKSUM_LABEL, NULL,
+	    NULL, ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_DONT_CACHE |
+	    ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY |
+	    ZIO_FLAG_SPECULATIVE, B_FALSE));
+
+	abd_put(abd);
+
+	if (err != 0) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_dh_errors);
+		zfs_dbgmsg("L2ARC IO error (%d) while reading device header, "
+		    "vdev guid: %llu", err,
+		    (u_longlong_t)dev->l2ad_vdev->vdev_guid);
+		return (err);
+	}
+
+	if (l2dhdr->dh_magic == BSWAP_64(L2ARC_DEV_HDR_MAGIC))
+		byteswap_uint64_array(l2dhdr, sizeof (*l2dhdr));
+
+	if (l2dhdr->dh_magic != L2ARC_DEV_HDR_MAGIC ||
+	    l2dhdr->dh_version != L2ARC_PERSISTENT_VERSION ||
+	    l2dhdr->dh_spa_guid != spa_guid(dev->l2ad_vdev->vdev_spa) ||
+	    l2dhdr->dh_vdev_guid != dev->l2ad_vdev->vdev_guid ||
+	    l2dhdr->dh_log_entries != dev->l2ad_log_entries ||
+	    l2dhdr->dh_start != dev->l2ad_start ||
+	    l2dhdr->dh_end != dev->l2ad_end ||
+	    !l2arc_range_check_overlap(dev->l2ad_start, dev->l2ad_end,
+	    l2dhdr->dh_evict)) {
+		/*
+		 * The device contains no header, or one written by another
+		 * pool, device or version of the persistent L2ARC.
+		 */
+		ARCSTAT_BUMP(arcstat_l2_rebuild_unsupported);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	return (0);
+}
+
+/*
+ * Appends a buffer which was just written to the device to the currently
+ * open log block.  Returns true if the log block is now full and must be
+ * committed with l2arc_log_blk_commit().
+ */
+static boolean_t
+l2arc_log_blk_insert(l2arc_dev_t *dev, const arc_buf_hdr_t *hdr)
+{
+	l2arc_log_blk_phys_t *lb = &dev->l2ad_log_blk;
+	l2arc_log_ent_phys_t *le;
+
+	if (dev->l2ad_log_entries == 0)
+		return (B_FALSE);
+
+	int index = dev->l2ad_log_ent_idx++;
+
+	ASSERT3S(index, <, dev->l2ad_log_entries);
+	ASSERT(HDR_HAS_L2HDR(hdr));
+
+	le = &lb->lb_entries[index];
+	bzero(le, sizeof (*le));
+	le->le_dva = hdr->b_dva;
+	le->le_birth = hdr->b_birth;
+	le->le_daddr = hdr->b_l2hdr.b_daddr;
+	if (index == 0)
+		dev->l2ad_log_blk_payload_start = le->le_daddr;
+	L2BLK_SET_LSIZE(le->le_prop, HDR_GET_LSIZE(hdr));
+	L2BLK_SET_PSIZE(le->le_prop, HDR_GET_PSIZE(hdr));
+	L2BLK_SET_COMPRESS(le->le_prop, HDR_GET_COMPRESS(hdr));
+	L2BLK_SET_TYPE(le->le_prop, hdr->b_type);
+	L2BLK_SET_PROTECTED(le->le_prop, !!(HDR_PROTECTED(hdr)));
+	L2BLK_SET_PREFETCH(le->le_prop, !!(HDR_PREFETCH(hdr)));
+
+	dev->l2ad_log_blk_payload_asize += vdev_psize_to_asize(dev->l2ad_vdev,
+	    HDR_GET_PSIZE(hdr));
+
+	return (dev->l2ad_log_ent_idx == dev->l2ad_log_entries);
+}
+
+/*
+ * Compresses and writes the currently open log block at the write hand,
+ * links it into the log block chain and makes the device header point
+ * at it.  The write is issued as a child of pio; the buffer is freed by
+ * l2arc_write_done().  Returns the allocated size of the log block.
+ */
+static uint64_t
+l2arc_log_blk_commit(l2arc_dev_t *dev, zio_t *pio, l2arc_write_callback_t *cb)
+{
+	l2arc_log_blk_phys_t *lb = &dev->l2ad_log_blk;
+	l2arc_dev_hdr_phys_t *l2dhdr = dev->l2ad_dev_hdr;
+	l2arc_log_blkptr_t *lbp = &l2dhdr->dh_start_lbps[0];
+	l2arc_lb_abd_buf_t *abd_buf;
+	l2arc_lb_ptr_buf_t *lb_ptr_buf;
+	uint64_t psize, asize;
+	uint8_t *tmpbuf;
+	abd_t *abd;
+	zio_t *wzio;
+
+	VERIFY3S(dev->l2ad_log_ent_idx, ==, dev->l2ad_log_entries);
+
+	tmpbuf = zio_buf_alloc(sizeof (*lb));
+	abd_buf = kmem_zalloc(sizeof (*abd_buf), KM_SLEEP);
+	lb_ptr_buf = kmem_zalloc(sizeof (l2arc_lb_ptr_buf_t), KM_SLEEP);
+	lb_ptr_buf->lb_ptr = kmem_zalloc(sizeof (l2arc_log_blkptr_t), KM_SLEEP);
+
+	/* link the log block into its chain */
+	lb->lb_prev_lbp = l2dhdr->dh_start_lbps[1];
+	lb->lb_magic = L2ARC_LOG_BLK_MAGIC;
+
+	/* try to compress the log block */
+	abd = abd_get_from_buf(lb, sizeof (*lb));
+	psize = zio_compress_data(ZIO_COMPRESS_LZ4, abd, tmpbuf, sizeof (*lb));
+	abd_put(abd);
+
+	/* a log block is never entirely zero */
+	ASSERT(psize != 0);
+	asize = vdev_psize_to_asize(dev->l2ad_vdev, psize);
+	ASSERT(asize <= sizeof (*lb));
+
+	/*
+	 * Make the device header point at the log block we are about to
+	 * write; the previous newest log block becomes the second one.
+	 */
+	l2dhdr->dh_start_lbps[1] = l2dhdr->dh_start_lbps[0];
+	bzero(lbp, sizeof (*lbp));
+	lbp->lbp_daddr = dev->l2ad_hand;
+	lbp->lbp_payload_asize = dev->l2ad_log_blk_payload_asize;
+	lbp->lbp_payload_start = dev->l2ad_log_blk_payload_start;
+	L2BLK_SET_LSIZE(lbp->lbp_prop, sizeof (*lb));
+	L2BLK_SET_PSIZE(lbp->lbp_prop, asize);
+	L2BLK_SET_CHECKSUM(lbp->lbp_prop, ZIO_CHECKSUM_FLETCHER_4);
+	if (asize < sizeof (*lb)) {
+		/* compression succeeded */
+		bzero(tmpbuf + psize, asize - psize);
+		L2BLK_SET_COMPRESS(lbp->lbp_prop, ZIO_COMPRESS_LZ4);
+	} else {
+		/* compression failed */
+		bcopy(lb, tmpbuf, sizeof (*lb));
+		L2BLK_SET_COMPRESS(lbp->lbp_prop, ZIO_COMPRESS_OFF);
+	}
+
+	/* checksum what we're about to write */
+	fletcher_4_native(tmpbuf, asize, NULL, &lbp->lbp_cksum);
+
+	/* perform the write itself */
+	abd_buf->abd = abd_get_from_buf(tmpbuf, sizeof (*lb));
+	abd_take_ownership_of_buf(abd_buf->abd, B_TRUE);
+	list_insert_tail(&cb->l2wcb_abd_list, abd_buf);
+
+	wzio = zio_write_phys(pio, dev->l2ad_vdev, dev->l2ad_hand,
+	    asize, abd_buf->abd, ZIO_CHECKSUM_OFF, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL, B_FALSE);
+	DTRACE_PROBE2(l2arc__write, vdev_t *, dev->l2ad_vdev, zio_t *, wzio);
+	(void) zio_nowait(wzio);
+
+	dev->l2ad_hand += asize;
+
+	/*
+	 * Add the log block to the list of log blocks present on the
+	 * device, newest first.
+	 */
+	bcopy(lbp, lb_ptr_buf->lb_ptr, sizeof (l2arc_log_blkptr_t));
+	mutex_enter(&dev->l2ad_mtx);
+	list_insert_head(&dev->l2ad_lbptr_list, lb_ptr_buf);
+	ARCSTAT_INCR(arcstat_l2_log_blk_asize, asize);
+	ARCSTAT_BUMP(arcstat_l2_log_blk_count);
+	(void) zfs_refcount_add_many(&dev->l2ad_lb_asize, asize, lb_ptr_buf);
+	(void) zfs_refcount_add(&dev->l2ad_lb_count, lb_ptr_buf);
+	mutex_exit(&dev->l2ad_mtx);
+	vdev_space_update(dev->l2ad_vdev, asize, 0, 0);
+
+	ARCSTAT_INCR(arcstat_l2_write_bytes, asize);
+	ARCSTAT_BUMP(arcstat_l2_log_blk_writes);
+
+	/* start a new log block */
+	dev->l2ad_log_ent_idx = 0;
+	dev->l2ad_log_blk_payload_asize = 0;
+	dev->l2ad_log_blk_payload_start = 0;
+
+	return (asize);
+}
+
+/*
+ * Returns true if restoring more headers would put the ARC under memory
+ * pressure.
+ */
+static boolean_t
+l2arc_hdr_limit_reached(void)
+{
+	int64_t s = aggsum_upper_bound(&astat_l2_hdr_size);
+
+	return (arc_reclaim_needed() || s > arc_meta_limit * 3 / 4);
+}
+
+/* Completion callback for log block reads issued by l2arc_rebuild(). */
+static void
+l2arc_blk_fetch_done(zio_t *zio)
+{
+	l2arc_read_callback_t *cb = zio->io_private;
+
+	if (cb->l2rcb_abd != NULL)
+		abd_put(cb->l2rcb_abd);
+	kmem_free(cb, sizeof (l2arc_read_callback_t));
+}
+
+/*
+ * Starts an asynchronous read of the log block pointed to by lbp into lb.
+ * The returned zio must be waited on with zio_wait().
+ */
+static zio_t *
+l2arc_log_blk_fetch(vdev_t *vd, const l2arc_log_blkptr_t *lbp,
+    l2arc_log_blk_phys_t *lb)
+{
+	l2arc_read_callback_t *cb;
+	uint64_t asize;
+	zio_t *pio;
+
+	asize = L2BLK_GET_PSIZE(lbp->lbp_prop);
+	ASSERT(asize <= sizeof (l2arc_log_blk_phys_t));
+
+	cb = kmem_zalloc(sizeof (l2arc_read_callback_t), KM_SLEEP);
+	cb->l2rcb_abd = abd_get_from_buf(lb, asize);
+	pio = zio_root(vd->vdev_spa, l2arc_blk_fetch_done, cb,
+	    ZIO_FLAG_DONT_CACHE | ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE |
+	    ZIO_FLAG_DONT_RETRY);
+	(void) zio_nowait(zio_read_phys(pio, vd, lbp->lbp_daddr, asize,
+	    cb->l2rcb_abd, ZIO_CHECKSUM_OFF, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_DONT_CACHE | ZIO_FLAG_CANFAIL |
+	    ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY, B_FALSE));
+
+	return (pio);
+}
+
+/*
+ * Reads and validates the log block pointed to by this_lbp, issuing the
+ * read for the next log block (next_lbp) ahead of time so that the device
+ * stays busy while this one is being restored.
+ */
+static int
+l2arc_log_blk_read(l2arc_dev_t *dev,
+    const l2arc_log_blkptr_t *this_lbp, const l2arc_log_blkptr_t *next_lbp,
+    l2arc_log_blk_phys_t *this_lb, l2arc_log_blk_phys_t *next_lb,
+    zio_t *this_io, zio_t **next_io)
+{
+	zio_cksum_t cksum;
+	abd_t *abd = NULL;
+	uint64_t asize;
+	int err = 0;
+
+	ASSERT(next_io != NULL && *next_io == NULL);
+	ASSERT(l2arc_log_blkptr_valid(dev, this_lbp));
+
+	/* The first log block has not been prefetched yet */
+	if (this_io == NULL)
+		this_io = l2arc_log_blk_fetch(dev->l2ad_vdev, this_lbp,
+		    this_lb);
+
+	if (l2arc_log_blkptr_valid(dev, next_lbp))
+		*next_io = l2arc_log_blk_fetch(dev->l2ad_vdev, next_lbp,
+		    next_lb);
+
+	if ((err = zio_wait(this_io)) != 0) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_io_errors);
+		zfs_dbgmsg("L2ARC IO error (%d) while reading log block, "
+		    "offset: %llu, vdev guid: %llu", err,
+		    (u_longlong_t)this_lbp->lbp_daddr,
+		    (u_longlong_t)dev->l2ad_vdev->vdev_guid);
+		goto cleanup;
+	}
+
+	/* Make sure the log block checks out */
+	asize = L2BLK_GET_PSIZE(this_lbp->lbp_prop);
+	fletcher_4_native(this_lb, asize, NULL, &cksum);
+	if (!ZIO_CHECKSUM_EQUAL(cksum, this_lbp->lbp_cksum)) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_cksum_lb_errors);
+		zfs_dbgmsg("L2ARC log block cksum failed, offset: %llu, "
+		    "vdev guid: %llu, l2ad_hand: %llu, l2ad_evict: %llu",
+		    (u_longlong_t)this_lbp->lbp_daddr,
+		    (u_longlong_t)dev->l2ad_vdev->vdev_guid,
+		    (u_longlong_t)dev->l2ad_hand,
+		    (u_longlong_t)dev->l2ad_evict);
+		err = SET_ERROR(ECKSUM);
+		goto cleanup;
+	}
+
+	switch (L2BLK_GET_COMPRESS(this_lbp->lbp_prop)) {
+	case ZIO_COMPRESS_OFF:
+		break;
+	case ZIO_COMPRESS_LZ4:
+		abd = abd_alloc_for_io(asize, B_TRUE);
+		abd_copy_from_buf_off(abd, this_lb, 0, asize);
+		if (zio_decompress_data(ZIO_COMPRESS_LZ4, abd, this_lb,
+		    asize, sizeof (*this_lb)) != 0) {
+			err = SET_ERROR(EINVAL);
+			goto cleanup;
+		}
+		break;
+	default:
+		err = SET_ERROR(EINVAL);
+		goto cleanup;
+	}
+
+	if (this_lb->lb_magic == BSWAP_64(L2ARC_LOG_BLK_MAGIC))
+		byteswap_uint64_array(this_lb, sizeof (*this_lb));
+	if (this_lb->lb_magic != L2ARC_LOG_BLK_MAGIC)
+		err = SET_ERROR(EINVAL);
+
+cleanup:
+	/* Abort an in-flight prefetch in case of error */
+	if (err != 0 && *next_io != NULL) {
+		(void) zio_wait(*next_io);
+		*next_io = NULL;
+	}
+	if (abd != NULL)
+		abd_free(abd);
+
+	return (err);
+}
+
+/*
+ * Restores the L2ARC header of a single buffer described by a log entry,
+ * unless the buffer is already cached.
+ */
+static void
+l2arc_hdr_restore(const l2arc_log_ent_phys_t *le, l2arc_dev_t *dev)
+{
+	arc_buf_hdr_t *hdr, *exists;
+	kmutex_t *hash_lock;
+	uint64_t psize = L2BLK_GET_PSIZE(le->le_prop);
+	uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev, psize);
+
+	/*
+	 * Do all the allocation before grabbing any locks, this lets us
+	 * sleep if memory is full and we don't have to deal with failed
+	 * allocations.
+	 */
+	hdr = arc_buf_alloc_l2only(L2BLK_GET_LSIZE(le->le_prop),
+	    L2BLK_GET_TYPE(le->le_prop), dev, le->le_dva, le->le_daddr,
+	    psize, le->le_birth, L2BLK_GET_COMPRESS(le->le_prop),
+	    L2BLK_GET_PROTECTED(le->le_prop), L2BLK_GET_PREFETCH(le->le_prop));
+
+	/*
+	 * Account for the buffer first, arc_hdr_destroy() undoes all of
+	 * this if the buffer turns out to be cached already.
+	 */
+	ARCSTAT_INCR(arcstat_l2_lsize, HDR_GET_LSIZE(hdr));
+	ARCSTAT_INCR(arcstat_l2_psize, psize);
+	vdev_space_update(dev->l2ad_vdev, asize, 0, 0);
+
+	mutex_enter(&dev->l2ad_mtx);
+	list_insert_tail(&dev->l2ad_buflist, hdr);
+	(void) zfs_refcount_add_many(&dev->l2ad_alloc, arc_hdr_size(hdr), hdr);
+	mutex_exit(&dev->l2ad_mtx);
+
+	exists = buf_hash_insert(hdr, &hash_lock);
+	if (exists != NULL) {
+		/* Buffer was already cached, no need to restore it. */
+		arc_hdr_destroy(hdr);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_bufs_precached);
+	}
+
+	mutex_exit(hash_lock);
+}
+
+/*
+ * Restores all buffers described by a log block.
+ */
+static void
+l2arc_log_blk_restore(l2arc_dev_t *dev, const l2arc_log_blk_phys_t *lb)
+{
+	uint64_t size = 0, asize = 0;
+	uint64_t log_entries = dev->l2ad_log_entries;
+
+	/*
+	 * Restore in reverse temporal order: l2ad_buflist is ordered from
+	 * the newest buffer at its head to the oldest at its tail, and
+	 * l2arc_hdr_restore() appends to the tail.
+	 */
+	for (int i = log_entries - 1; i >= 0; i--) {
+		const l2arc_log_ent_phys_t *le = &lb->lb_entries[i];
+
+		size += L2BLK_GET_LSIZE(le->le_prop);
+		asize += vdev_psize_to_asize(dev->l2ad_vdev,
+		    L2BLK_GET_PSIZE(le->le_prop));
+		l2arc_hdr_restore(le, dev);
+	}
+
+	ARCSTAT_INCR(arcstat_l2_rebuild_size, size);
+	ARCSTAT_INCR(arcstat_l2_rebuild_asize, asize);
+	ARCSTAT_INCR(arcstat_l2_rebuild_bufs, log_entries);
+	ARCSTAT_BUMP(arcstat_l2_rebuild_log_blks);
+}
+
+/*
+ * Waits for the L2ARC config lock without blocking device removal, which
+ * takes it as writer and then cancels the rebuild.  Returns false if the
+ * rebuild has been cancelled.
+ */
+static boolean_t
+l2arc_rebuild_config_enter(l2arc_dev_t *dev)
+{
+	spa_t *spa = dev->l2ad_spa;
+	vdev_t *vd = dev->l2ad_vdev;
+
+	for (;;) {
+		mutex_enter(&l2arc_rebuild_thr_lock);
+		if (dev->l2ad_rebuild_cancel) {
+			mutex_exit(&l2arc_rebuild_thr_lock);
+			return (B_FALSE);
+		}
+		mutex_exit(&l2arc_rebuild_thr_lock);
+
+		if (spa_config_tryenter(spa, SCL_L2ARC, vd, RW_READER))
+			return (B_TRUE);
+
+		delay(1);
+	}
+}
+
+/*
+ * Walks the log block chains of a cache device and restores the buffers
+ * they describe.  The device header was read and validated when the
+ * device was added.
+ */
+static int
+l2arc_rebuild(l2arc_dev_t *dev)
+{
+	vdev_t *vd = dev->l2ad_vdev;
+	l2arc_dev_hdr_phys_t *l2dhdr = dev->l2ad_dev_hdr;
+	l2arc_log_blk_phys_t *this_lb, *next_lb;
+	zio_t *this_io = NULL, *next_io = NULL;
+	l2arc_log_blkptr_t lbps[2];
+	l2arc_lb_ptr_buf_t *lb_ptr_buf;
+	boolean_t lock_held;
+	int err = 0;
+
+	/*
+	 * The config lock keeps the device from being removed while we
+	 * issue I/O to it; it is dropped while restoring a log block so
+	 * that a device removal or pool export can proceed and cancel us.
+	 */
+	if (!l2arc_rebuild_config_enter(dev))
+		return (SET_ERROR(ECANCELED));
+	lock_held = B_TRUE;
+
+	this_lb = vmem_zalloc(sizeof (*this_lb), KM_SLEEP);
+	next_lb = vmem_zalloc(sizeof (*next_lb), KM_SLEEP);
+
+	/*
+	 * Resume writing right after the newest log block, and keep on
+	 * evicting from where we left off.
+	 */
+	dev->l2ad_evict = MAX(l2dhdr->dh_evict, dev->l2ad_start);
+	dev->l2ad_hand = MAX(l2dhdr->dh_start_lbps[0].lbp_daddr +
+	    L2BLK_GET_PSIZE(l2dhdr->dh_start_lbps[0].lbp_prop),
+	    dev->l2ad_start);
+	dev->l2ad_first = !!(l2dhdr->dh_flags & L2ARC_DEV_HDR_EVICT_FIRST);
+
+	bcopy(l2dhdr->dh_start_lbps, lbps, sizeof (lbps));
+
+	for (;;) {
+		if (!l2arc_log_blkptr_valid(dev, &lbps[0]))
+			break;
+
+		if ((err = l2arc_log_blk_read(dev, &lbps[0], &lbps[1],
+		    this_lb, next_lb, this_io, &next_io)) != 0)
+			goto out;
+
+		/*
+		 * Don't swamp a system which is already low on memory with
+		 * new headers.  The device has been set up to chain new log
+		 * blocks, so the rebuild can be retried later by exporting
+		 * and importing the pool.
+		 */
+		if (l2arc_hdr_limit_reached()) {
+			ARCSTAT_BUMP(arcstat_l2_rebuild_lowmem);
+			cmn_err(CE_NOTE, "System running low on memory, "
+			    "aborting L2ARC rebuild.");
+			err = SET_ERROR(ENOMEM);
+			goto out;
+		}
+
+		spa_config_exit(dev->l2ad_spa, SCL_L2ARC, vd);
+		lock_held = B_FALSE;
+
+		l2arc_log_blk_restore(dev, this_lb);
+
+		/*
+		 * The log block was restored, add it to the list of log
+		 * blocks present on the device.
+		 */
+		uint64_t asize = L2BLK_GET_PSIZE(lbps[0].lbp_prop);
+		lb_ptr_buf = kmem_zalloc(sizeof (l2arc_lb_ptr_buf_t), KM_SLEEP);
+		lb_ptr_buf->lb_ptr = kmem_zalloc(sizeof (l2arc_log_blkptr_t),
+		    KM_SLEEP);
+		bcopy(&lbps[0], lb_ptr_buf->lb_ptr,
+		    sizeof (l2arc_log_blkptr_t));
+		mutex_enter(&dev->l2ad_mtx);
+		list_insert_tail(&dev->l2ad_lbptr_list, lb_ptr_buf);
+		ARCSTAT_INCR(arcstat_l2_log_blk_asize, asize);
+		ARCSTAT_BUMP(arcstat_l2_log_blk_count);
+		(void) zfs_refcount_add_many(&dev->l2ad_lb_asize, asize,
+		    lb_ptr_buf);
+		(void) zfs_refcount_add(&dev->l2ad_lb_count, lb_ptr_buf);
+		mutex_exit(&dev->l2ad_mtx);
+		vdev_space_update(vd, asize, 0, 0);
+
+		/*
+		 * Protect against looping over the whole device: once the
+		 * payload of the next (older) log block starts before the
+		 * evict hand and the current one after it, we have gone all
+		 * the way around and the older blocks have been overwritten.
+		 */
+		if (l2arc_range_check_overlap(lbps[1].lbp_payload_start,
+		    lbps[0].lbp_payload_start, dev->l2ad_evict) &&
+		    !dev->l2ad_first)
+			goto out;
+
+		if (!l2arc_rebuild_config_enter(dev)) {
+			err = SET_ERROR(ECANCELED);
+			goto out;
+		}
+		lock_held = B_TRUE;
+
+		/* Continue with the next log block */
+		lbps[0] = lbps[1];
+		lbps[1] = this_lb->lb_prev_lbp;
+		l2arc_log_blk_phys_t *tmp_lb = this_lb;
+		this_lb = next_lb;
+		next_lb = tmp_lb;
+		this_io = next_io;
+		next_io = NULL;
+	}
+
+	if (this_io != NULL)
+		(void) zio_wait(this_io);
+out:
+	if (next_io != NULL)
+		(void) zio_wait(next_io);
+	vmem_free(this_lb, sizeof (*this_lb));
+	vmem_free(next_lb, sizeof (*next_lb));
+
+	if (err == 0 && zfs_refcount_count(&dev->l2ad_lb_count) > 0) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_success);
+		zfs_dbgmsg("L2ARC rebuild successful, restored %llu log "
+		    "blocks, vdev guid: %llu",
+		    (u_longlong_t)zfs_refcount_count(&dev->l2ad_lb_count),
+		    (u_longlong_t)vd->vdev_guid);
+	} else if (err == 0) {
+		/*
+		 * Nothing was restored: the device header points at log
+		 * blocks which are no longer present.  Start over.
+		 */
+		zfs_dbgmsg("L2ARC rebuild found no valid log blocks, "
+		    "vdev guid: %llu", (u_longlong_t)vd->vdev_guid);
+		ASSERT(lock_held);
+		bzero(l2dhdr, dev->l2ad_dev_hdr_asize);
+		l2arc_dev_hdr_update(dev);
+	} else {
+		zfs_dbgmsg("L2ARC rebuild aborted (%d), restored %llu log "
+		    "blocks, vdev guid: %llu", err,
+		    (u_longlong_t)zfs_refcount_count(&dev->l2ad_lb_count),
+		    (u_longlong_t)vd->vdev_guid);
+	}
+
+	if (lock_held)
+		spa_config_exit(dev->l2ad_spa, SCL_L2ARC, vd);
+
+	return (err);
+}
+
+static void
+l2arc_dev_rebuild_thread(void *arg)
+{
+	l2arc_dev_t *dev = arg;
+
+	VERIFY(dev->l2ad_rebuild);
+	(void) l2arc_rebuild(dev);
+
+	mutex_enter(&l2arc_rebuild_thr_lock);
+	dev->l2ad_rebuild_began = B_FALSE;
+	dev->l2ad_rebuild = B_FALSE;
+	cv_broadcast(&l2arc_rebuild_thr_cv);
+	mutex_exit(&l2arc_rebuild_thr_lock);
+
+	thread_exit();
+}
+
+/*
+ * Starts a rebuild thread for every cache device of the pool which was
+ * found to hold a valid persistent L2ARC when it was added.  Called from
+ * the spa async thread once the pool has been loaded.
+ */
+void
+l2arc_spa_rebuild_start(spa_t *spa)
+{
+	ASSERT(MUTEX_HELD(&spa_namespace_lock));
+
+	for (int i = 0; i < spa->spa_l2cache.sav_count; i++) {
+		l2arc_dev_t *dev =
+		    l2arc_vdev_get(spa->spa_l2cache.sav_vdevs[i]);
+		if (dev == NULL)
+			continue;
+
+		mutex_enter(&l2arc_rebuild_thr_lock);
+		if (dev->l2ad_rebuild && !dev->l2ad_rebuild_began &&
+		    !dev->l2ad_rebuild_cancel) {
+			dev->l2ad_rebuild_began = B_TRUE;
+			(void) thread_create(NULL, 0, l2arc_dev_rebuild_thread,
+			    dev, 0, &p0, TS_RUN, minclsyspri);
+		}
+		mutex_exit(&l2arc_rebuild_thr_lock);
+	}
+}
+
+/*
+ * Cancels the rebuild threads of all cache devices of the pool and waits
+ * for them to exit.  Called when the pool is unloaded.
+ */
+void
+l2arc_spa_rebuild_stop(spa_t *spa)
+{
+	ASSERT(MUTEX_HELD(&spa_namespace_lock));
+
+	for (int i = 0; i < spa->spa_l2cache.sav_count; i++) {
+		l2arc_dev_t *dev =
+		    l2arc_vdev_get(spa->spa_l2cache.sav_vdevs[i]);
+		if (dev == NULL)
+			continue;
+
+		mutex_enter(&l2arc_rebuild_thr_lock);
+		dev->l2ad_rebuild_cancel = B_TRUE;
+		while (dev->l2ad_rebuild_began)
+			cv_wait(&l2arc_rebuild_thr_cv, &l2arc_rebuild_thr_lock);
+		mutex_exit(&l2arc_rebuild_thr_lock);
+	}
+}
+
 #if defined(_KERNEL)
 EXPORT_SYMBOL(arc_buf_size);
 EXPORT_SYMBOL(arc_write);
@@ -9469,6 +10816,14 @@ MODULE_PARM_DESC(l2arc_feed_again, "Turbo L2ARC warmup");
 module_param(l2arc_norw, int, 0644);
 MODULE_PARM_DESC(l2arc_norw, "No reads during writes");
 
+module_param(l2arc_rebuild_enabled, int, 0644);
+MODULE_PARM_DESC(l2arc_rebuild_enabled,
+	"Rebuild the L2ARC when importing a pool");
+
+module_param(l2arc_rebuild_blocks_min_l2size, ulong, 0644);
+MODULE_PARM_DESC(l2arc_rebuild_blocks_min_l2size,
+	"Min size in bytes to write rebuild log blocks in L2ARC");
+
 module_param(zfs_arc_lotsfree_percent, int, 0644);
 MODULE_PARM_DESC(zfs_arc_lotsfree_percent,
 	"System free memory I/O throttle in bytes");
@@ -9479,6 +10834,10 @@ MODULE_PARM_DESC(zfs_arc_sys_free, "System free memory target size in bytes");
 module_param(zfs_arc_dnode_limit, ulong, 0644);
 MODULE_PARM_DESC(zfs_arc_dnode_limit, "Minimum bytes of dnodes in arc");
 
+module_param(zfs_arc_ddt_min, ulong, 0644);
+MODULE_PARM_DESC(zfs_arc_ddt_min,
+	"Bytes of dedup table blocks kept resident in arc");
+
 module_param(zfs_arc_dnode_limit_percent, ulong, 0644);
 MODULE_PARM_DESC(zfs_arc_dnode_limit_percent,
 	"Percent of ARC meta buffers for dnodes");
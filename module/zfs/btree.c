@@ -0,0 +1,786 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+#include	<sys/btree.h>
+
+/*
+ * B-Tree implementation.  See sys/btree.h for an overview.
+ *
+ * All elements of a node are kept packed at the start of its element
+ * array, and a core node with n elements has n + 1 children.  Every node
+ * other than the root holds at least half its capacity of elements, with
+ * one exception: when elements are appended in order at the end of the
+ * tree, full nodes are split so that the left node stays full and the new
+ * right node starts out (nearly) empty.  Nothing relies on the minimum
+ * occupancy for correctness; it only bounds the size of merged nodes.
+ *
+ * Nodes don't keep track of their position in the parent, which is found
+ * by a linear scan of the parent's children when needed.  This is only
+ * required when moving between nodes, splitting or rebalancing, which
+ * happens once per node rather than once per element.
+ */
+
+kmem_cache_t *zfs_btree_leaf_cache;
+
+#define	BTREE_CORE_MIN		(BTREE_CORE_ELEMS / 2)
+
+static inline uint8_t *
+zfs_btree_elems(zfs_btree_hdr_t *hdr)
+{
+	return (hdr->bth_core ? ((zfs_btree_core_t *)hdr)->btc_elems :
+	    ((zfs_btree_leaf_t *)hdr)->btl_elems);
+}
+
+static inline void *
+zfs_btree_elem(zfs_btree_t *tree, zfs_btree_hdr_t *hdr, uint32_t idx)
+{
+	return (zfs_btree_elems(hdr) + (size_t)idx * tree->bt_elem_size);
+}
+
+static inline size_t
+zfs_btree_core_size(zfs_btree_t *tree)
+{
+	return (sizeof (zfs_btree_core_t) +
+	    (BTREE_CORE_ELEMS + 1) * tree->bt_elem_size);
+}
+
+static inline uint32_t
+zfs_btree_node_min(zfs_btree_t *tree, zfs_btree_hdr_t *hdr)
+{
+	return (hdr->bth_core ? BTREE_CORE_MIN : tree->bt_leaf_cap / 2);
+}
+
+void
+zfs_btree_init(void)
+{
+	zfs_btree_leaf_cache = kmem_cache_create("zfs_btree_leaf_cache",
+	    BTREE_LEAF_SIZE, 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+zfs_btree_fini(void)
+{
+	kmem_cache_destroy(zfs_btree_leaf_cache);
+}
+
+void
+zfs_btree_create(zfs_btree_t *tree, int (*compar) (const void *, const void *),
+    size_t size)
+{
+	/* Leaves must be able to hold a handful of elements. */
+	ASSERT3U(size, <=, (BTREE_LEAF_SIZE - sizeof (zfs_btree_leaf_t)) / 8);
+
+	bzero(tree, sizeof (*tree));
+	tree->bt_compar = compar;
+	tree->bt_elem_size = size;
+	/* Leave room for one extra element; see zfs_btree_add_idx(). */
+	tree->bt_leaf_cap =
+	    (BTREE_LEAF_SIZE - sizeof (zfs_btree_leaf_t)) / size - 1;
+	tree->bt_height = -1;
+	tree->bt_root = NULL;
+}
+
+static zfs_btree_hdr_t *
+zfs_btree_node_alloc(zfs_btree_t *tree, boolean_t core)
+{
+	zfs_btree_hdr_t *hdr;
+
+	if (core)
+		hdr = kmem_alloc(zfs_btree_core_size(tree), KM_SLEEP);
+	else
+		hdr = kmem_cache_alloc(zfs_btree_leaf_cache, KM_SLEEP);
+
+	hdr->bth_parent = NULL;
+	hdr->bth_core = core;
+	hdr->bth_count = 0;
+	tree->bt_num_nodes++;
+
+	return (hdr);
+}
+
+static void
+zfs_btree_node_free(zfs_btree_t *tree, zfs_btree_hdr_t *hdr)
+{
+	ASSERT3U(tree->bt_num_nodes, >, 0);
+	tree->bt_num_nodes--;
+
+	if (hdr->bth_core)
+		kmem_free(hdr, zfs_btree_core_size(tree));
+	else
+		kmem_cache_free(zfs_btree_leaf_cache, hdr);
+}
+
+/*
+ * Binary search for value among the elements of a node.  Returns the
+ * matching element, or NULL with *offset set to where value would be
+ * inserted.
+ */
+static void *
+zfs_btree_find_in_node(zfs_btree_t *tree, zfs_btree_hdr_t *hdr,
+    const void *value, uint32_t *offset)
+{
+	uint32_t min = 0, max = hdr->bth_count;
+
+	while (min < max) {
+		uint32_t idx = (min + max) / 2;
+		void *cur = zfs_btree_elem(tree, hdr, idx);
+		int comp = tree->bt_compar(cur, value);
+
+		if (comp < 0) {
+			min = idx + 1;
+		} else if (comp > 0) {
+			max = idx;
+		} else {
+			*offset = idx;
+			return (cur);
+		}
+	}
+
+	*offset = min;
+	return (NULL);
+}
+
+/* Returns the position of a node among its parent's children. */
+static uint32_t
+zfs_btree_child_idx(zfs_btree_core_t *parent, zfs_btree_hdr_t *child)
+{
+	uint32_t i;
+
+	for (i = 0; i < parent->btc_hdr.bth_count; i++) {
+		if (parent->btc_children[i] == child)
+			break;
+	}
+	VERIFY3P(parent->btc_children[i], ==, child);
+
+	return (i);
+}
+
+/* Returns true if hdr is the last node at its level of the tree. */
+static boolean_t
+zfs_btree_is_rightmost(zfs_btree_hdr_t *hdr)
+{
+	zfs_btree_core_t *parent;
+
+	for (; (parent = hdr->bth_parent) != NULL; hdr = &parent->btc_hdr) {
+		if (parent->btc_children[parent->btc_hdr.bth_count] != hdr)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+static zfs_btree_hdr_t *
+zfs_btree_first_leaf(zfs_btree_hdr_t *hdr)
+{
+	while (hdr->bth_core)
+		hdr = ((zfs_btree_core_t *)hdr)->btc_children[0];
+	return (hdr);
+}
+
+static zfs_btree_hdr_t *
+zfs_btree_last_leaf(zfs_btree_hdr_t *hdr)
+{
+	while (hdr->bth_core) {
+		zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+		hdr = core->btc_children[hdr->bth_count];
+	}
+	return (hdr);
+}
+
+void *
+zfs_btree_find(zfs_btree_t *tree, const void *value, zfs_btree_index_t *where)
+{
+	zfs_btree_hdr_t *hdr = tree->bt_root;
+	uint32_t offset = 0;
+	void *elem;
+
+	if (hdr == NULL) {
+		if (where != NULL) {
+			where->bti_node = NULL;
+			where->bti_offset = 0;
+			where->bti_before = B_TRUE;
+		}
+		return (NULL);
+	}
+
+	for (;;) {
+		elem = zfs_btree_find_in_node(tree, hdr, value, &offset);
+		if (elem != NULL || !hdr->bth_core)
+			break;
+		hdr = ((zfs_btree_core_t *)hdr)->btc_children[offset];
+	}
+
+	if (where != NULL) {
+		where->bti_node = hdr;
+		where->bti_offset = offset;
+		where->bti_before = (elem == NULL);
+	}
+
+	return (elem);
+}
+
+/*
+ * Link the new node "right", split off from "left", into the parent of
+ * "left" with "sep" as the separator element between them.  Splits the
+ * parent in turn if it overflows, and grows a new root if needed.
+ */
+static void
+zfs_btree_insert_into_parent(zfs_btree_t *tree, zfs_btree_hdr_t *left,
+    const void *sep, zfs_btree_hdr_t *right)
+{
+	size_t size = tree->bt_elem_size;
+	zfs_btree_core_t *parent = left->bth_parent;
+
+	if (parent == NULL) {
+		ASSERT3P(tree->bt_root, ==, left);
+		parent = (zfs_btree_core_t *)zfs_btree_node_alloc(tree, B_TRUE);
+		parent->btc_children[0] = left;
+		parent->btc_children[1] = right;
+		bcopy(sep, parent->btc_elems, size);
+		parent->btc_hdr.bth_count = 1;
+		left->bth_parent = right->bth_parent = parent;
+		tree->bt_root = &parent->btc_hdr;
+		tree->bt_height++;
+		return;
+	}
+
+	uint8_t *elems = parent->btc_elems;
+	uint32_t count = parent->btc_hdr.bth_count;
+	uint32_t i = zfs_btree_child_idx(parent, left);
+
+	memmove(elems + (i + 1) * size, elems + i * size, (count - i) * size);
+	bcopy(sep, elems + i * size, size);
+	memmove(&parent->btc_children[i + 2], &parent->btc_children[i + 1],
+	    (count - i) * sizeof (zfs_btree_hdr_t *));
+	parent->btc_children[i + 1] = right;
+	right->bth_parent = parent;
+	parent->btc_hdr.bth_count = ++count;
+
+	if (count <= BTREE_CORE_ELEMS)
+		return;
+
+	/*
+	 * Split the core node, keeping the children on either side of the
+	 * element that moves up.  See zfs_btree_split_leaf() for the choice
+	 * of the split point.
+	 */
+	uint32_t keep;
+	if (i == count - 1 && zfs_btree_is_rightmost(&parent->btc_hdr))
+		keep = count - 2;
+	else
+		keep = count / 2;
+
+	zfs_btree_core_t *new =
+	    (zfs_btree_core_t *)zfs_btree_node_alloc(tree, B_TRUE);
+	uint32_t new_count = count - keep - 1;
+
+	bcopy(elems + (keep + 1) * size, new->btc_elems, new_count * size);
+	bcopy(&parent->btc_children[keep + 1], new->btc_children,
+	    (new_count + 1) * sizeof (zfs_btree_hdr_t *));
+	for (uint32_t j = 0; j <= new_count; j++)
+		new->btc_children[j]->bth_parent = new;
+	new->btc_hdr.bth_count = new_count;
+	parent->btc_hdr.bth_count = keep;
+
+	/* The separator stays intact beyond the end of the parent. */
+	zfs_btree_insert_into_parent(tree, &parent->btc_hdr,
+	    elems + keep * size, &new->btc_hdr);
+}
+
+/*
+ * Split a leaf which has overflowed after inserting an element at
+ * "offset".
+ */
+static void
+zfs_btree_split_leaf(zfs_btree_t *tree, zfs_btree_hdr_t *hdr, uint32_t offset)
+{
+	size_t size = tree->bt_elem_size;
+	uint8_t *elems = zfs_btree_elems(hdr);
+	uint32_t count = hdr->bth_count;
+	uint32_t keep;
+
+	/*
+	 * Normally the elements are split evenly between the two leaves.
+	 * When appending at the very end of the tree more appends are likely
+	 * to follow, so keep the left leaf full instead of leaving a trail
+	 * of half-empty leaves behind.
+	 */
+	if (offset == count - 1 && zfs_btree_is_rightmost(hdr))
+		keep = count - 2;
+	else
+		keep = count / 2;
+
+	zfs_btree_hdr_t *new = zfs_btree_node_alloc(tree, B_FALSE);
+	new->bth_count = count - keep - 1;
+	bcopy(elems + (keep + 1) * size, zfs_btree_elems(new),
+	    new->bth_count * size);
+	hdr->bth_count = keep;
+
+	/* The separator stays intact beyond the end of the leaf. */
+	zfs_btree_insert_into_parent(tree, hdr, elems + keep * size, new);
+}
+
+void
+zfs_btree_add_idx(zfs_btree_t *tree, const void *value,
+    const zfs_btree_index_t *where)
+{
+	size_t size = tree->bt_elem_size;
+	zfs_btree_hdr_t *hdr = where->bti_node;
+	uint32_t offset = where->bti_offset;
+
+	ASSERT(where->bti_before);
+
+	if (tree->bt_root == NULL) {
+		ASSERT3P(hdr, ==, NULL);
+		ASSERT0(offset);
+		hdr = zfs_btree_node_alloc(tree, B_FALSE);
+		tree->bt_root = hdr;
+		tree->bt_height = 0;
+	}
+
+	/* zfs_btree_find() always returns insertion points in leaves. */
+	ASSERT(!hdr->bth_core);
+	ASSERT3U(offset, <=, hdr->bth_count);
+
+	uint8_t *elems = zfs_btree_elems(hdr);
+	memmove(elems + (offset + 1) * size, elems + offset * size,
+	    (hdr->bth_count - offset) * size);
+	bcopy(value, elems + offset * size, size);
+	hdr->bth_count++;
+	tree->bt_num_elems++;
+
+	if (hdr->bth_count > tree->bt_leaf_cap)
+		zfs_btree_split_leaf(tree, hdr, offset);
+}
+
+void
+zfs_btree_add(zfs_btree_t *tree, const void *value)
+{
+	zfs_btree_index_t where;
+
+	VERIFY3P(zfs_btree_find(tree, value, &where), ==, NULL);
+	zfs_btree_add_idx(tree, value, &where);
+}
+
+void *
+zfs_btree_first(zfs_btree_t *tree, zfs_btree_index_t *where)
+{
+	if (tree->bt_root == NULL) {
+		ASSERT0(tree->bt_num_elems);
+		return (NULL);
+	}
+
+	zfs_btree_hdr_t *leaf = zfs_btree_first_leaf(tree->bt_root);
+	ASSERT3U(leaf->bth_count, >, 0);
+
+	if (where != NULL) {
+		where->bti_node = leaf;
+		where->bti_offset = 0;
+		where->bti_before = B_FALSE;
+	}
+
+	return (zfs_btree_elem(tree, leaf, 0));
+}
+
+void *
+zfs_btree_last(zfs_btree_t *tree, zfs_btree_index_t *where)
+{
+	if (tree->bt_root == NULL) {
+		ASSERT0(tree->bt_num_elems);
+		return (NULL);
+	}
+
+	zfs_btree_hdr_t *leaf = zfs_btree_last_leaf(tree->bt_root);
+	ASSERT3U(leaf->bth_count, >, 0);
+
+	if (where != NULL) {
+		where->bti_node = leaf;
+		where->bti_offset = leaf->bth_count - 1;
+		where->bti_before = B_FALSE;
+	}
+
+	return (zfs_btree_elem(tree, leaf, leaf->bth_count - 1));
+}
+
+void *
+zfs_btree_next(zfs_btree_t *tree, const zfs_btree_index_t *idx,
+    zfs_btree_index_t *out_idx)
+{
+	zfs_btree_hdr_t *hdr = idx->bti_node;
+	uint32_t offset = idx->bti_offset;
+	zfs_btree_core_t *parent;
+
+	if (hdr == NULL)
+		return (NULL);
+
+	if (hdr->bth_core) {
+		/* The next element is the first one of the right subtree. */
+		ASSERT(!idx->bti_before);
+		zfs_btree_hdr_t *leaf = zfs_btree_first_leaf(
+		    ((zfs_btree_core_t *)hdr)->btc_children[offset + 1]);
+		out_idx->bti_node = leaf;
+		out_idx->bti_offset = 0;
+		out_idx->bti_before = B_FALSE;
+		return (zfs_btree_elem(tree, leaf, 0));
+	}
+
+	if (!idx->bti_before)
+		offset++;
+
+	if (offset < hdr->bth_count) {
+		out_idx->bti_node = hdr;
+		out_idx->bti_offset = offset;
+		out_idx->bti_before = B_FALSE;
+		return (zfs_btree_elem(tree, hdr, offset));
+	}
+
+	/*
+	 * We ran off the end of the leaf; the next element is the separator
+	 * to the right of the first ancestor we reached from a child other
+	 * than its last one.
+	 */
+	for (; (parent = hdr->bth_parent) != NULL; hdr = &parent->btc_hdr) {
+		uint32_t i = zfs_btree_child_idx(parent, hdr);
+		if (i < parent->btc_hdr.bth_count) {
+			out_idx->bti_node = &parent->btc_hdr;
+			out_idx->bti_offset = i;
+			out_idx->bti_before = B_FALSE;
+			return (zfs_btree_elem(tree, &parent->btc_hdr, i));
+		}
+	}
+
+	return (NULL);
+}
+
+void *
+zfs_btree_prev(zfs_btree_t *tree, const zfs_btree_index_t *idx,
+    zfs_btree_index_t *out_idx)
+{
+	zfs_btree_hdr_t *hdr = idx->bti_node;
+	uint32_t offset = idx->bti_offset;
+	zfs_btree_core_t *parent;
+
+	if (hdr == NULL)
+		return (NULL);
+
+	if (hdr->bth_core) {
+		/* The previous element is the last one of the left subtree. */
+		ASSERT(!idx->bti_before);
+		zfs_btree_hdr_t *leaf = zfs_btree_last_leaf(
+		    ((zfs_btree_core_t *)hdr)->btc_children[offset]);
+		out_idx->bti_node = leaf;
+		out_idx->bti_offset = leaf->bth_count - 1;
+		out_idx->bti_before = B_FALSE;
+		return (zfs_btree_elem(tree, leaf, leaf->bth_count - 1));
+	}
+
+	if (offset > 0) {
+		out_idx->bti_node = hdr;
+		out_idx->bti_offset = offset - 1;
+		out_idx->bti_before = B_FALSE;
+		return (zfs_btree_elem(tree, hdr, offset - 1));
+	}
+
+	for (; (parent = hdr->bth_parent) != NULL; hdr = &parent->btc_hdr) {
+		uint32_t i = zfs_btree_child_idx(parent, hdr);
+		if (i > 0) {
+			out_idx->bti_node = &parent->btc_hdr;
+			out_idx->bti_offset = i - 1;
+			out_idx->bti_before = B_FALSE;
+			return (zfs_btree_elem(tree, &parent->btc_hdr, i - 1));
+		}
+	}
+
+	return (NULL);
+}
+
+void *
+zfs_btree_get(zfs_btree_t *tree, zfs_btree_index_t *idx)
+{
+	ASSERT(!idx->bti_before);
+	ASSERT3U(idx->bti_offset, <, idx->bti_node->bth_count);
+
+	return (zfs_btree_elem(tree, idx->bti_node, idx->bti_offset));
+}
+
+static void zfs_btree_rebalance(zfs_btree_t *, zfs_btree_hdr_t *);
+
+/*
+ * Merge the child to the right of separator "sep" of a parent into the
+ * child to its left, pulling the separator down between them.
+ */
+static void
+zfs_btree_merge(zfs_btree_t *tree, zfs_btree_core_t *parent, uint32_t sep)
+{
+	size_t size = tree->bt_elem_size;
+	uint8_t *pelems = parent->btc_elems;
+	uint32_t pcount = parent->btc_hdr.bth_count;
+	zfs_btree_hdr_t *left = parent->btc_children[sep];
+	zfs_btree_hdr_t *right = parent->btc_children[sep + 1];
+	uint8_t *lelems = zfs_btree_elems(left);
+
+	bcopy(pelems + sep * size, lelems + left->bth_count * size, size);
+	bcopy(zfs_btree_elems(right), lelems + (left->bth_count + 1) * size,
+	    right->bth_count * size);
+	if (left->bth_core) {
+		zfs_btree_core_t *lcore = (zfs_btree_core_t *)left;
+		zfs_btree_core_t *rcore = (zfs_btree_core_t *)right;
+
+		for (uint32_t i = 0; i <= right->bth_count; i++) {
+			zfs_btree_hdr_t *child = rcore->btc_children[i];
+			lcore->btc_children[left->bth_count + 1 + i] = child;
+			child->bth_parent = lcore;
+		}
+	}
+	left->bth_count += right->bth_count + 1;
+	ASSERT3U(left->bth_count, <=, left->bth_core ? BTREE_CORE_ELEMS :
+	    tree->bt_leaf_cap);
+	zfs_btree_node_free(tree, right);
+
+	memmove(pelems + sep * size, pelems + (sep + 1) * size,
+	    (pcount - sep - 1) * size);
+	memmove(&parent->btc_children[sep + 1], &parent->btc_children[sep + 2],
+	    (pcount - sep - 1) * sizeof (zfs_btree_hdr_t *));
+	parent->btc_hdr.bth_count--;
+
+	zfs_btree_rebalance(tree, &parent->btc_hdr);
+}
+
+/*
+ * Restore the minimum occupancy of a node after an element has been
+ * removed from it, by borrowing an element from a sibling through the
+ * parent or, if neither sibling can spare one, by merging with a sibling.
+ */
+static void
+zfs_btree_rebalance(zfs_btree_t *tree, zfs_btree_hdr_t *hdr)
+{
+	size_t size = tree->bt_elem_size;
+	zfs_btree_core_t *parent = hdr->bth_parent;
+	uint32_t min = zfs_btree_node_min(tree, hdr);
+
+	if (parent == NULL) {
+		ASSERT3P(tree->bt_root, ==, hdr);
+		if (hdr->bth_count > 0)
+			return;
+
+		/* An empty root is replaced by its only child, if any. */
+		if (hdr->bth_core) {
+			tree->bt_root = ((zfs_btree_core_t *)hdr)->btc_children[0];
+			tree->bt_root->bth_parent = NULL;
+		} else {
+			tree->bt_root = NULL;
+		}
+		tree->bt_height--;
+		zfs_btree_node_free(tree, hdr);
+		return;
+	}
+
+	if (hdr->bth_count >= min)
+		return;
+
+	uint8_t *pelems = parent->btc_elems;
+	uint8_t *elems = zfs_btree_elems(hdr);
+	uint32_t i = zfs_btree_child_idx(parent, hdr);
+	zfs_btree_hdr_t *left = (i > 0) ? parent->btc_children[i - 1] : NULL;
+	zfs_btree_hdr_t *right = (i < parent->btc_hdr.bth_count) ?
+	    parent->btc_children[i + 1] : NULL;
+
+	if (left != NULL && left->bth_count > min) {
+		/* Rotate the last element of the left sibling through. */
+		memmove(elems + size, elems, hdr->bth_count * size);
+		bcopy(pelems + (i - 1) * size, elems, size);
+		bcopy(zfs_btree_elem(tree, left, left->bth_count - 1),
+		    pelems + (i - 1) * size, size);
+		if (hdr->bth_core) {
+			zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+			zfs_btree_core_t *lcore = (zfs_btree_core_t *)left;
+
+			memmove(&core->btc_children[1], &core->btc_children[0],
+			    (hdr->bth_count + 1) * sizeof (zfs_btree_hdr_t *));
+			core->btc_children[0] =
+			    lcore->btc_children[left->bth_count];
+			core->btc_children[0]->bth_parent = core;
+		}
+		left->bth_count--;
+		hdr->bth_count++;
+	} else if (right != NULL && right->bth_count > min) {
+		/* Rotate the first element of the right sibling through. */
+		uint8_t *relems = zfs_btree_elems(right);
+
+		bcopy(pelems + i * size, elems + hdr->bth_count * size, size);
+		bcopy(relems, pelems + i * size, size);
+		memmove(relems, relems + size, (right->bth_count - 1) * size);
+		if (hdr->bth_core) {
+			zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+			zfs_btree_core_t *rcore = (zfs_btree_core_t *)right;
+
+			core->btc_children[hdr->bth_count + 1] =
+			    rcore->btc_children[0];
+			core->btc_children[hdr->bth_count + 1]->bth_parent =
+			    core;
+			memmove(&rcore->btc_children[0],
+			    &rcore->btc_children[1],
+			    right->bth_count * sizeof (zfs_btree_hdr_t *));
+		}
+		right->bth_count--;
+		hdr->bth_count++;
+	} else if (left != NULL) {
+		zfs_btree_merge(tree, parent, i - 1);
+	} else {
+		ASSERT3P(right, !=, NULL);
+		zfs_btree_merge(tree, parent, i);
+	}
+}
+
+void
+zfs_btree_remove_idx(zfs_btree_t *tree, zfs_btree_index_t *where)
+{
+	size_t size = tree->bt_elem_size;
+	zfs_btree_hdr_t *hdr = where->bti_node;
+	uint32_t offset = where->bti_offset;
+
+	ASSERT(!where->bti_before);
+	ASSERT3U(offset, <, hdr->bth_count);
+
+	if (hdr->bth_core) {
+		/*
+		 * Replace the element with its in-order predecessor, which
+		 * always lives in a leaf, and remove that one instead.
+		 */
+		zfs_btree_hdr_t *leaf = zfs_btree_last_leaf(
+		    ((zfs_btree_core_t *)hdr)->btc_children[offset]);
+		bcopy(zfs_btree_elem(tree, leaf, leaf->bth_count - 1),
+		    zfs_btree_elem(tree, hdr, offset), size);
+		hdr = leaf;
+		offset = leaf->bth_count - 1;
+	}
+
+	uint8_t *elems = zfs_btree_elems(hdr);
+	memmove(elems + offset * size, elems + (offset + 1) * size,
+	    (hdr->bth_count - offset - 1) * size);
+	hdr->bth_count--;
+	tree->bt_num_elems--;
+
+	zfs_btree_rebalance(tree, hdr);
+}
+
+void
+zfs_btree_remove(zfs_btree_t *tree, const void *value)
+{
+	zfs_btree_index_t where;
+
+	VERIFY3P(zfs_btree_find(tree, value, &where), !=, NULL);
+	zfs_btree_remove_idx(tree, &where);
+}
+
+ulong_t
+zfs_btree_numnodes(zfs_btree_t *tree)
+{
+	return (tree->bt_num_elems);
+}
+
+static void
+zfs_btree_clear_node(zfs_btree_t *tree, zfs_btree_hdr_t *hdr)
+{
+	if (hdr->bth_core) {
+		zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+
+		for (uint32_t i = 0; i <= hdr->bth_count; i++)
+			zfs_btree_clear_node(tree, core->btc_children[i]);
+	}
+	zfs_btree_node_free(tree, hdr);
+}
+
+void
+zfs_btree_clear(zfs_btree_t *tree)
+{
+	if (tree->bt_root != NULL)
+		zfs_btree_clear_node(tree, tree->bt_root);
+
+	ASSERT0(tree->bt_num_nodes);
+	tree->bt_root = NULL;
+	tree->bt_height = -1;
+	tree->bt_num_elems = 0;
+}
+
+void
+zfs_btree_destroy(zfs_btree_t *tree)
+{
+	ASSERT0(tree->bt_num_elems);
+	ASSERT3P(tree->bt_root, ==, NULL);
+}
+
+/*
+ * Verify a subtree, whose elements must all lie strictly between lo and hi
+ * (either of which may be NULL).  Returns the number of elements in it.
+ */
+static uint64_t
+zfs_btree_verify_node(zfs_btree_t *tree, zfs_btree_hdr_t *hdr,
+    zfs_btree_core_t *parent, int64_t height, const void *lo, const void *hi)
+{
+	uint32_t count = hdr->bth_count;
+	uint64_t elems = count;
+
+	VERIFY3P(hdr->bth_parent, ==, parent);
+	VERIFY3S(height, >=, 0);
+	VERIFY3U(!!hdr->bth_core, ==, (height > 0));
+	VERIFY3U(count, <=, hdr->bth_core ? BTREE_CORE_ELEMS :
+	    tree->bt_leaf_cap);
+	if (parent != NULL || hdr->bth_core)
+		VERIFY3U(count, >, 0);
+
+	for (uint32_t i = 0; i < count; i++) {
+		void *elem = zfs_btree_elem(tree, hdr, i);
+		const void *prev = (i == 0) ? lo :
+		    zfs_btree_elem(tree, hdr, i - 1);
+
+		if (prev != NULL)
+			VERIFY3S(tree->bt_compar(prev, elem), ==, -1);
+	}
+	if (hi != NULL && count > 0) {
+		VERIFY3S(tree->bt_compar(zfs_btree_elem(tree, hdr, count - 1),
+		    hi), ==, -1);
+	}
+
+	if (hdr->bth_core) {
+		zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+
+		for (uint32_t i = 0; i <= count; i++) {
+			const void *clo = (i == 0) ? lo :
+			    zfs_btree_elem(tree, hdr, i - 1);
+			const void *chi = (i == count) ? hi :
+			    zfs_btree_elem(tree, hdr, i);
+
+			elems += zfs_btree_verify_node(tree,
+			    core->btc_children[i], core, height - 1, clo, chi);
+		}
+	}
+
+	return (elems);
+}
+
+void
+zfs_btree_verify(zfs_btree_t *tree)
+{
+	if (tree->bt_root == NULL) {
+		VERIFY0(tree->bt_num_elems);
+		VERIFY0(tree->bt_num_nodes);
+		VERIFY3S(tree->bt_height, ==, -1);
+		return;
+	}
+
+	VERIFY3U(zfs_btree_verify_node(tree, tree->bt_root, NULL,
+	    tree->bt_height, NULL, NULL), ==, tree->bt_num_elems);
+}
@@ -1323,6 +1323,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 {
 	dnode_t *dn;
 	zbookmark_phys_t zb;
+	blkptr_t *bpp;
 	uint32_t aflags = ARC_FLAG_NOWAIT;
 	int err, zio_flags = 0;
 
@@ -1368,11 +1369,13 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	/*
 	 * Recheck BP_IS_HOLE() after dnode_block_freed() in case dnode_sync()
 	 * processes the delete record and clears the bp while we are waiting
-	 * for the dn_mtx (resulting in a "no" from block_freed).
+	 * for the dn_mtx (resulting in a "no" from block_freed).  A block
+	 * written by Direct I/O in an open txg postdates any pending free.
 	 */
-	if (db->db_blkptr == NULL || BP_IS_HOLE(db->db_blkptr) ||
-	    (db->db_level == 0 && (dnode_block_freed(dn, db->db_blkid) ||
-	    BP_IS_HOLE(db->db_blkptr)))) {
+	bpp = dbuf_get_bp(db);
+	if (bpp == NULL || BP_IS_HOLE(bpp) ||
+	    (bpp == db->db_blkptr && db->db_level == 0 &&
+	    (dnode_block_freed(dn, db->db_blkid) || BP_IS_HOLE(bpp)))) {
 		arc_buf_contents_t type = DBUF_GET_BUFC_TYPE(db);
 
 		dbuf_set_data(db, arc_alloc_buf(db->db_objset->os_spa, db, type,
@@ -1411,7 +1414,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	 * will never happen under normal conditions, but can be useful for
 	 * debugging purposes.
 	 */
-	if (BP_IS_REDACTED(db->db_blkptr)) {
+	if (BP_IS_REDACTED(bpp)) {
 		ASSERT(dsl_dataset_feature_is_active(
 		    db->db_objset->os_dsl_dataset,
 		    SPA_FEATURE_REDACTED_DATASETS));
@@ -1428,7 +1431,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	 * All bps of an encrypted os should have the encryption bit set.
 	 * If this is not true it indicates tampering and we report an error.
 	 */
-	if (db->db_objset->os_encrypted && !BP_USES_CRYPT(db->db_blkptr)) {
+	if (db->db_objset->os_encrypted && !BP_USES_CRYPT(bpp)) {
 		spa_log_error(db->db_objset->os_spa, &zb);
 		zfs_panic_recover("unencrypted block in encrypted "
 		    "object set %llu", dmu_objset_id(db->db_objset));
@@ -1459,7 +1462,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	zio_flags = (flags & DB_RF_CANFAIL) ?
 	    ZIO_FLAG_CANFAIL : ZIO_FLAG_MUSTSUCCEED;
 
-	if ((flags & DB_RF_NO_DECRYPT) && BP_IS_PROTECTED(db->db_blkptr))
+	if ((flags & DB_RF_NO_DECRYPT) && BP_IS_PROTECTED(bpp))
 		zio_flags |= ZIO_FLAG_RAW;
 	/*
 	 * The zio layer will copy the provided blkptr later, but we need to
@@ -1468,7 +1471,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
 	 * an l1 cache hit) we don't acquire the db_mtx while holding the
 	 * parent's rwlock, which would be a lock ordering violation.
 	 */
-	blkptr_t bp = *db->db_blkptr;
+	blkptr_t bp = *bpp;
 	dmu_buf_unlock_parent(db, dblt, tag);
 	(void) arc_read(zio, db->db_objset->os_spa, &bp,
 	    dbuf_read_done, db, ZIO_PRIORITY_SYNC_READ, zio_flags,
@@ -1607,8 +1610,7 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 		}
 		mutex_exit(&db->db_mtx);
 		if (err == 0 && prefetch) {
-			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE,
-			    flags & DB_RF_HAVESTRUCT);
+			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE);
 		}
 		DB_DNODE_EXIT(db);
 		DBUF_STAT_BUMP(hash_hits);
@@ -1617,9 +1619,9 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 		boolean_t need_wait = B_FALSE;
 
 		db_lock_type_t dblt = dmu_buf_lock_parent(db, RW_READER, FTAG);
+		blkptr_t *bp = dbuf_get_bp(db);
 
-		if (zio == NULL &&
-		    db->db_blkptr != NULL && !BP_IS_HOLE(db->db_blkptr)) {
+		if (zio == NULL && bp != NULL && !BP_IS_HOLE(bp)) {
 			zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
 			need_wait = B_TRUE;
 		}
@@ -1629,8 +1631,7 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 		 * for us
 		 */
 		if (!err && prefetch) {
-			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE,
-			    flags & DB_RF_HAVESTRUCT);
+			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE);
 		}
 
 		DB_DNODE_EXIT(db);
@@ -1658,8 +1659,7 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 		 */
 		mutex_exit(&db->db_mtx);
 		if (prefetch) {
-			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE,
-			    flags & DB_RF_HAVESTRUCT);
+			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE);
 		}
 		DB_DNODE_EXIT(db);
 		DBUF_STAT_BUMP(hash_misses);
@@ -1734,6 +1734,17 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	if (!BP_IS_HOLE(bp) && !dr->dt.dl.dr_nopwrite)
 		zio_free(db->db_objset->os_spa, txg, bp);
 
+	/*
+	 * A Direct I/O write left no data buffer in the dirty record.  The
+	 * caller is about to modify whatever the dbuf now holds (if anything),
+	 * so that becomes the data to be written in this txg.
+	 */
+	if (dr->dt.dl.dr_diowrite) {
+		if (dr->dt.dl.dr_data == NULL)
+			dr->dt.dl.dr_data = db->db_buf;
+		dr->dt.dl.dr_diowrite = B_FALSE;
+	}
+
 	dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
 	dr->dt.dl.dr_nopwrite = B_FALSE;
 	dr->dt.dl.dr_has_raw_params = B_FALSE;
@@ -1746,7 +1757,8 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	 * the buf thawed to save the effort of freezing &
 	 * immediately re-thawing it.
 	 */
-	arc_release(dr->dt.dl.dr_data, db);
+	if (dr->dt.dl.dr_data != NULL)
+		arc_release(dr->dt.dl.dr_data, db);
 }
 
 /*
@@ -2303,7 +2315,13 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	}
 	DB_DNODE_EXIT(db);
 
-	if (db->db_state != DB_NOFILL) {
+	if (db->db_state == DB_UNCACHED) {
+		/* Only a Direct I/O write leaves a dirty dbuf uncached. */
+		ASSERT(dr->dt.dl.dr_diowrite);
+		dbuf_unoverride(dr);
+		ASSERT3P(db->db_buf, ==, NULL);
+		ASSERT3P(dr->dt.dl.dr_data, ==, NULL);
+	} else if (db->db_state != DB_NOFILL) {
 		dbuf_unoverride(dr);
 
 		ASSERT(db->db_buf != NULL);
@@ -2318,7 +2336,8 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	db->db_dirtycnt -= 1;
 
 	if (zfs_refcount_remove(&db->db_holds, (void *)(uintptr_t)txg) == 0) {
-		ASSERT(db->db_state == DB_NOFILL || arc_released(db->db_buf));
+		ASSERT(db->db_state == DB_NOFILL ||
+		    db->db_state == DB_UNCACHED || arc_released(db->db_buf));
 		dbuf_destroy(db);
 		return (B_TRUE);
 	}
@@ -2553,6 +2572,97 @@ dmu_buf_redact(dmu_buf_t *dbuf, dmu_tx_t *tx)
 	dbuf_override_impl(db, &bp, tx);
 }
 
+/*
+ * Return the block pointer which holds the current contents of this dbuf.
+ * This is normally db_blkptr, but when the most recent dirty record was
+ * written by Direct I/O its data exists only at the overridden block
+ * pointer until the txg is synced.
+ */
+blkptr_t *
+dbuf_get_bp(dmu_buf_impl_t *db)
+{
+	dbuf_dirty_record_t *dr = db->db_last_dirty;
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+
+	if (db->db_level == 0 && db->db_blkid != DMU_BONUS_BLKID &&
+	    dr != NULL && dr->dt.dl.dr_diowrite)
+		return (&dr->dt.dl.dr_overridden_by);
+
+	return (db->db_blkptr);
+}
+
+/*
+ * Prepare a level-0 dbuf to be overwritten in its entirety by a Direct I/O
+ * write.  Any cached copy of the block is discarded and the dbuf is dirtied
+ * without a data buffer; the caller then writes the block itself and
+ * records the resulting block pointer in the returned dirty record, which
+ * is left in DR_IN_DMU_SYNC until that write completes.
+ *
+ * Returns NULL if the dbuf holds dirty data that was not written by Direct
+ * I/O, or is in use by anyone other than the caller.  The write must then
+ * go through the dbuf like any other buffered write.
+ */
+dbuf_dirty_record_t *
+dbuf_direct_write_prepare(dmu_buf_impl_t *db, dmu_tx_t *tx)
+{
+	dbuf_dirty_record_t *dr;
+
+	ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+	ASSERT0(db->db_level);
+	ASSERT(tx->tx_txg != 0);
+
+	mutex_enter(&db->db_mtx);
+	while (db->db_state == DB_READ || db->db_state == DB_FILL)
+		cv_wait(&db->db_changed, &db->db_mtx);
+
+	if ((db->db_state != DB_UNCACHED && db->db_state != DB_CACHED) ||
+	    zfs_refcount_count(&db->db_holds) - 1 > db->db_dirtycnt) {
+		mutex_exit(&db->db_mtx);
+		return (NULL);
+	}
+	for (dr = db->db_last_dirty; dr != NULL; dr = dr->dr_next) {
+		if (!dr->dt.dl.dr_diowrite) {
+			mutex_exit(&db->db_mtx);
+			return (NULL);
+		}
+	}
+
+	if (db->db_buf != NULL) {
+		arc_buf_destroy(db->db_buf, db);
+		db->db_buf = NULL;
+	}
+	dbuf_clear_data(db);
+	db->db_state = DB_NOFILL;
+	mutex_exit(&db->db_mtx);
+
+	dr = dbuf_dirty(db, tx);
+
+	mutex_enter(&db->db_mtx);
+	ASSERT3U(dr->dr_txg, ==, tx->tx_txg);
+	ASSERT3P(dr->dt.dl.dr_data, ==, NULL);
+	ASSERT3U(dr->dt.dl.dr_override_state, ==, DR_NOT_OVERRIDDEN);
+	dr->dt.dl.dr_override_state = DR_IN_DMU_SYNC;
+	mutex_exit(&db->db_mtx);
+
+	return (dr);
+}
+
+/*
+ * Undo dbuf_direct_write_prepare() after the Direct I/O write failed,
+ * leaving the dbuf clean and uncached so the caller can fall back to a
+ * buffered write.
+ */
+void
+dbuf_direct_write_abort(dmu_buf_impl_t *db, dmu_tx_t *tx)
+{
+	mutex_enter(&db->db_mtx);
+	ASSERT3U(db->db_state, ==, DB_NOFILL);
+	VERIFY(!dbuf_undirty(db, tx));
+	db->db_state = DB_UNCACHED;
+	mutex_exit(&db->db_mtx);
+}
+
 /*
  * Directly assign a provided arc buf to a given dbuf if it's not referenced
  * by anybody except our caller. Otherwise copy arcbuf's contents to dbuf.
@@ -2601,7 +2711,8 @@ dbuf_assign_arcbuf(dmu_buf_impl_t *db, arc_buf_t *buf, dmu_tx_t *tx)
 
 		ASSERT(db->db_buf != NULL);
 		if (dr != NULL && dr->dr_txg == tx->tx_txg) {
-			ASSERT(dr->dt.dl.dr_data == db->db_buf);
+			ASSERT(dr->dt.dl.dr_data == db->db_buf ||
+			    dr->dt.dl.dr_diowrite);
 
 			if (!arc_released(db->db_buf)) {
 				ASSERT(dr->dt.dl.dr_override_state ==
@@ -4367,7 +4478,8 @@ dbuf_write_done(zio_t *zio, arc_buf_t *buf, void *vdb)
 		ASSERT(db->db_blkid != DMU_BONUS_BLKID);
 		ASSERT(dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN);
 		if (db->db_state != DB_NOFILL) {
-			if (dr->dt.dl.dr_data != db->db_buf)
+			if (dr->dt.dl.dr_data != NULL &&
+			    dr->dt.dl.dr_data != db->db_buf)
 				arc_buf_destroy(dr->dt.dl.dr_data, db);
 		}
 	} else {
@@ -4430,7 +4542,8 @@ dbuf_write_override_done(zio_t *zio)
 	if (!BP_EQUAL(zio->io_bp, obp)) {
 		if (!BP_IS_HOLE(obp))
 			dsl_free(spa_get_dsl(zio->io_spa), zio->io_txg, obp);
-		arc_release(dr->dt.dl.dr_data, db);
+		if (dr->dt.dl.dr_data != NULL)
+			arc_release(dr->dt.dl.dr_data, db);
 	}
 	mutex_exit(&db->db_mtx);
 
@@ -4602,6 +4715,15 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx)
 	dmu_write_policy(os, dn, db->db_level, wp_flag, &zp);
 	DB_DNODE_EXIT(db);
 
+	/*
+	 * A block written by Direct I/O has no data in memory to feed
+	 * the dedup verify path, so it is always written as-is.
+	 */
+	if (db->db_level == 0 && dr->dt.dl.dr_diowrite) {
+		zp.zp_dedup = B_FALSE;
+		zp.zp_dedup_verify = B_FALSE;
+	}
+
 	/*
 	 * We copy the blkptr now (rather than when we instantiate the dirty
 	 * record), because its value can change between open context and
@@ -33,10 +33,12 @@
 #include <sys/dmu_tx.h>
 #include <sys/arc.h>
 #include <sys/dsl_pool.h>
+#include <sys/dsl_synctask.h>
 #include <sys/zio_checksum.h>
 #include <sys/zio_compress.h>
 #include <sys/dsl_scan.h>
 #include <sys/abd.h>
+#include <sys/zfeature.h>
 
 static kmem_cache_t *ddt_cache;
 static kmem_cache_t *ddt_entry_cache;
@@ -46,6 +48,14 @@ static kmem_cache_t *ddt_entry_cache;
  */
 int zfs_dedup_prefetch = 0;
 
+/*
+ * Append DDT updates to a log instead of writing them to the DDT objects
+ * every txg, and merge the log into them once it holds
+ * zfs_dedup_log_flush_records records (see ddt_log.c).
+ */
+int zfs_dedup_log_enabled = 1;
+unsigned long zfs_dedup_log_flush_records = 65536;
+
 static const ddt_ops_t *ddt_ops[DDT_TYPES] = {
 	&ddt_zap_ops,
 };
@@ -202,7 +212,7 @@ ddt_object_update(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
 	    ddt->ddt_object[type][class], dde, tx));
 }
 
-static int
+int
 ddt_object_remove(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
     ddt_entry_t *dde, dmu_tx_t *tx)
 {
@@ -540,6 +550,48 @@ ddt_get_dedup_dspace(spa_t *spa)
 	return (spa->spa_dedup_dspace);
 }
 
+/*
+ * Returns the on-disk size of all dedup tables of the pool.
+ */
+uint64_t
+ddt_get_ddt_dsize(spa_t *spa)
+{
+	uint64_t dsize = 0;
+
+	if (spa->spa_dedup_dsize != ~0ULL)
+		return (spa->spa_dedup_dsize);
+
+	/* Sum and cache the sizes we recorded in ddt_object_sync(). */
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+			for (enum ddt_class class = 0; class < DDT_CLASSES;
+			    class++) {
+				dsize += ddt->ddt_object_stats[type][class].
+				    ddo_dspace;
+			}
+		}
+	}
+
+	spa->spa_dedup_dsize = dsize;
+	return (dsize);
+}
+
+/*
+ * Returns B_TRUE if the dedup tables have reached the dedup_table_quota
+ * pool property, in which case no new entries should be added to them.
+ * The size is only updated as the tables are synced, so the quota is
+ * enforced with a lag of a txg.
+ */
+boolean_t
+ddt_over_quota(spa_t *spa)
+{
+	if (spa->spa_dedup_table_quota == 0)
+		return (B_FALSE);
+
+	return (ddt_get_ddt_dsize(spa) >= spa->spa_dedup_table_quota);
+}
+
 uint64_t
 ddt_get_pool_dedup_ratio(spa_t *spa)
 {
@@ -701,23 +753,34 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 
 	dde->dde_loading = B_TRUE;
 
-	ddt_exit(ddt);
+	/*
+	 * A logged entry, including a logged removal, supersedes whatever
+	 * the DDT objects hold for this key.
+	 */
+	if (ddt_log_lookup(ddt, dde)) {
+		type = dde->dde_type;
+		class = dde->dde_class;
+		error = (type == DDT_TYPES) ? ENOENT : 0;
+	} else {
+		ddt_exit(ddt);
 
-	error = ENOENT;
+		error = ENOENT;
 
-	for (type = 0; type < DDT_TYPES; type++) {
-		for (class = 0; class < DDT_CLASSES; class++) {
-			error = ddt_object_lookup(ddt, type, class, dde);
-			if (error != ENOENT) {
-				ASSERT0(error);
-				break;
+		for (type = 0; type < DDT_TYPES; type++) {
+			for (class = 0; class < DDT_CLASSES; class++) {
+				error = ddt_object_lookup(ddt, type, class,
+				    dde);
+				if (error != ENOENT) {
+					ASSERT0(error);
+					break;
+				}
 			}
+			if (error != ENOENT)
+				break;
 		}
-		if (error != ENOENT)
-			break;
-	}
 
-	ddt_enter(ddt);
+		ddt_enter(ddt);
+	}
 
 	ASSERT(dde->dde_loaded == B_FALSE);
 	ASSERT(dde->dde_loading == B_TRUE);
@@ -799,6 +862,7 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
 	avl_create(&ddt->ddt_repair_tree, ddt_entry_compare,
 	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	ddt_log_alloc(ddt);
 	ddt->ddt_checksum = c;
 	ddt->ddt_spa = spa;
 	ddt->ddt_os = spa->spa_meta_objset;
@@ -813,6 +877,7 @@ ddt_table_free(ddt_t *ddt)
 	ASSERT(avl_numnodes(&ddt->ddt_repair_tree) == 0);
 	avl_destroy(&ddt->ddt_tree);
 	avl_destroy(&ddt->ddt_repair_tree);
+	ddt_log_free(ddt);
 	mutex_destroy(&ddt->ddt_lock);
 	kmem_cache_free(ddt_cache, ddt);
 }
@@ -840,6 +905,13 @@ ddt_load(spa_t *spa)
 	if (error)
 		return (error == ENOENT ? 0 : error);
 
+	error = zap_lookup(spa->spa_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_DDT_TXG_TIMES, sizeof (uint64_t), 1,
+	    &spa->spa_ddt_txg_times_object);
+	if (error != 0 && error != ENOENT)
+		return (error);
+	spa->spa_ddt_txg_times_last = 0;
+
 	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
 		ddt_t *ddt = spa->spa_ddt[c];
 		for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
@@ -851,12 +923,17 @@ ddt_load(spa_t *spa)
 			}
 		}
 
+		error = ddt_log_load(ddt);
+		if (error != 0 && error != ENOENT)
+			return (error);
+
 		/*
 		 * Seed the cached histograms.
 		 */
 		bcopy(ddt->ddt_histogram, &ddt->ddt_histogram_cache,
 		    sizeof (ddt->ddt_histogram));
 		spa->spa_dedup_dspace = ~0ULL;
+		spa->spa_dedup_dsize = ~0ULL;
 	}
 
 	return (0);
@@ -882,7 +959,11 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 	if (!BP_GET_DEDUP(bp))
 		return (B_FALSE);
 
-	if (max_class == DDT_CLASS_UNIQUE)
+	/*
+	 * Every dedup block has an entry of some class, unless it was pruned.
+	 */
+	if (max_class == DDT_CLASS_UNIQUE &&
+	    !spa_feature_is_active(spa, SPA_FEATURE_DDT_PRUNE))
 		return (B_TRUE);
 
 	ddt = spa->spa_ddt[BP_GET_CHECKSUM(bp)];
@@ -890,6 +971,16 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 
 	ddt_key_fill(&(dde->dde_key), bp);
 
+	ddt_enter(ddt);
+	if (ddt_log_lookup(ddt, dde)) {
+		boolean_t found = (dde->dde_class <= max_class);
+
+		ddt_exit(ddt);
+		kmem_cache_free(ddt_entry_cache, dde);
+		return (found);
+	}
+	ddt_exit(ddt);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		for (enum ddt_class class = 0; class <= max_class; class++) {
 			if (ddt_object_lookup(ddt, type, class, dde) == 0) {
@@ -913,6 +1004,17 @@ ddt_repair_start(ddt_t *ddt, const blkptr_t *bp)
 
 	dde = ddt_alloc(&ddk);
 
+	ddt_enter(ddt);
+	if (ddt_log_lookup(ddt, dde)) {
+		ddt_exit(ddt);
+		if (dde->dde_class != DDT_CLASS_UNIQUE &&
+		    dde->dde_class != DDT_CLASSES)
+			return (dde);
+		bzero(dde->dde_phys, sizeof (dde->dde_phys));
+		return (dde);
+	}
+	ddt_exit(ddt);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
 			/*
@@ -1008,7 +1110,8 @@ ddt_repair_table(ddt_t *ddt, zio_t *rio)
 }
 
 static void
-ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
+ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, ddt_log_update_t *dlu,
+    dmu_tx_t *tx, uint64_t txg)
 {
 	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
 	ddt_phys_t *ddp = dde->dde_phys;
@@ -1048,7 +1151,15 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	else
 		nclass = DDT_CLASS_UNIQUE;
 
-	if (otype != DDT_TYPES &&
+	/*
+	 * When logging, the DDT objects are left alone until the log is
+	 * flushed, but they are created right away so that the histogram of
+	 * the new class is synced.
+	 */
+	if (dlu != NULL) {
+		ddt_log_entry(ddt, dlu, dde, otype, oclass,
+		    total_refcnt != 0 ? nclass : DDT_CLASSES);
+	} else if (otype != DDT_TYPES &&
 	    (otype != ntype || oclass != nclass || total_refcnt == 0)) {
 		VERIFY(ddt_object_remove(ddt, otype, oclass, dde, tx) == 0);
 		ASSERT(ddt_object_lookup(ddt, otype, oclass, dde) == ENOENT);
@@ -1060,7 +1171,10 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 		ddt_stat_update(ddt, dde, 0);
 		if (!ddt_object_exists(ddt, ntype, nclass))
 			ddt_object_create(ddt, ntype, nclass, tx);
-		VERIFY(ddt_object_update(ddt, ntype, nclass, dde, tx) == 0);
+		if (dlu == NULL) {
+			VERIFY(ddt_object_update(ddt, ntype, nclass, dde,
+			    tx) == 0);
+		}
 
 		/*
 		 * If the class changes, the order that we scan this bp
@@ -1076,14 +1190,65 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	}
 }
 
+/*
+ * Updates are logged unless a scan is walking the DDT: the walk's position
+ * in the log is a record index, which a flush would invalidate.  The log is
+ * flushed when a scan starts (see dsl_scan_setup_sync()).
+ */
+static boolean_t
+ddt_log_enabled(ddt_t *ddt)
+{
+	spa_t *spa = ddt->ddt_spa;
+
+	return (zfs_dedup_log_enabled &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_DDT_LOG) &&
+	    !dsl_scan_walking_ddt(spa->spa_dsl_pool));
+}
+
+/*
+ * Sync the statistics of the DDT objects, and destroy them once empty.
+ */
+static void
+ddt_sync_objects(ddt_t *ddt, dmu_tx_t *tx)
+{
+	spa_t *spa = ddt->ddt_spa;
+
+	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+		uint64_t add, count = 0;
+		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
+			if (ddt_object_exists(ddt, type, class)) {
+				ddt_object_sync(ddt, type, class, tx);
+				VERIFY(ddt_object_count(ddt, type, class,
+				    &add) == 0);
+				count += add;
+			}
+		}
+		/* Logged entries still need the objects of their class. */
+		if (avl_numnodes(&ddt->ddt_log_tree) != 0)
+			continue;
+		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
+			if (count == 0 && ddt_object_exists(ddt, type, class))
+				ddt_object_destroy(ddt, type, class, tx);
+		}
+	}
+
+	bcopy(ddt->ddt_histogram, &ddt->ddt_histogram_cache,
+	    sizeof (ddt->ddt_histogram));
+	spa->spa_dedup_dspace = ~0ULL;
+	spa->spa_dedup_dsize = ~0ULL;
+}
+
 static void
 ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 {
 	spa_t *spa = ddt->ddt_spa;
+	ddt_log_update_t dlu;
 	ddt_entry_t *dde;
 	void *cookie = NULL;
+	boolean_t log = ddt_log_enabled(ddt);
 
-	if (avl_numnodes(&ddt->ddt_tree) == 0)
+	if (avl_numnodes(&ddt->ddt_tree) == 0 &&
+	    (log || ddt->ddt_log_object == 0))
 		return;
 
 	ASSERT(spa->spa_uberblock.ub_version >= SPA_VERSION_DEDUP);
@@ -1094,30 +1259,77 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		    DMU_POOL_DDT_STATS, tx);
 	}
 
+	/*
+	 * Merge the log into the DDT objects once it is full, or as soon as
+	 * it may no longer be used, in which case it is also destroyed.
+	 */
+	if (!log || ddt->ddt_log_count + avl_numnodes(&ddt->ddt_tree) >
+	    zfs_dedup_log_flush_records)
+		ddt_log_flush(ddt, tx);
+	if (!log && ddt->ddt_log_object != 0)
+		ddt_log_destroy(ddt, tx);
+
+	if (log)
+		ddt_log_begin(ddt, &dlu, tx);
+
 	while ((dde = avl_destroy_nodes(&ddt->ddt_tree, &cookie)) != NULL) {
-		ddt_sync_entry(ddt, dde, tx, txg);
+		ddt_sync_entry(ddt, dde, log ? &dlu : NULL, tx, txg);
 		ddt_free(dde);
 	}
 
-	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
-		uint64_t add, count = 0;
-		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
-			if (ddt_object_exists(ddt, type, class)) {
-				ddt_object_sync(ddt, type, class, tx);
-				VERIFY(ddt_object_count(ddt, type, class,
-				    &add) == 0);
-				count += add;
+	if (log)
+		ddt_log_commit(ddt, &dlu);
+
+	ddt_sync_objects(ddt, tx);
+}
+
+/*
+ * Merge the logs of all DDTs into the DDT objects.
+ */
+void
+ddt_flush_logs(spa_t *spa, dmu_tx_t *tx)
+{
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt == NULL || ddt->ddt_log_count == 0)
+			continue;
+		ddt_log_flush(ddt, tx);
+		for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+			for (enum ddt_class class = 0; class < DDT_CLASSES;
+			    class++) {
+				if (ddt_object_exists(ddt, type, class))
+					ddt_object_sync(ddt, type, class, tx);
 			}
 		}
-		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
-			if (count == 0 && ddt_object_exists(ddt, type, class))
-				ddt_object_destroy(ddt, type, class, tx);
-		}
 	}
+}
 
-	bcopy(ddt->ddt_histogram, &ddt->ddt_histogram_cache,
-	    sizeof (ddt->ddt_histogram));
-	spa->spa_dedup_dspace = ~0ULL;
+/*
+ * Record the time at which a txg synced, about once per
+ * DDT_TXG_TIME_INTERVAL seconds, so that an age can be mapped to the birth
+ * txg of DDT entries when pruning them.
+ */
+#define	DDT_TXG_TIME_INTERVAL	(60 * 60)
+
+static void
+ddt_sync_txg_time(spa_t *spa, dmu_tx_t *tx)
+{
+	objset_t *mos = spa->spa_meta_objset;
+	uint64_t now = gethrestime_sec();
+
+	if (spa->spa_ddt_stat_object == 0 ||
+	    !spa_feature_is_enabled(spa, SPA_FEATURE_DDT_PRUNE) ||
+	    now < spa->spa_ddt_txg_times_last + DDT_TXG_TIME_INTERVAL)
+		return;
+
+	if (spa->spa_ddt_txg_times_object == 0) {
+		spa->spa_ddt_txg_times_object = zap_create_link(mos,
+		    DMU_OTN_ZAP_METADATA, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_DDT_TXG_TIMES, tx);
+	}
+	VERIFY0(zap_update_int_key(mos, spa->spa_ddt_txg_times_object,
+	    dmu_tx_get_txg(tx), now, tx));
+	spa->spa_ddt_txg_times_last = now;
 }
 
 void
@@ -1143,6 +1355,8 @@ ddt_sync(spa_t *spa, uint64_t txg)
 	ASSERT3P(scn->scn_zio_root, ==, NULL);
 	scn->scn_zio_root = rio;
 
+	ddt_sync_txg_time(spa, tx);
+
 	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
 		ddt_t *ddt = spa->spa_ddt[c];
 		if (ddt == NULL)
@@ -1157,6 +1371,22 @@ ddt_sync(spa_t *spa, uint64_t txg)
 	dmu_tx_commit(tx);
 }
 
+/*
+ * Entries of the DDT objects that have been logged since are returned by
+ * the walk of the log instead.
+ */
+static boolean_t
+ddt_walk_logged(ddt_t *ddt, ddt_entry_t *dde)
+{
+	boolean_t logged;
+
+	ddt_enter(ddt);
+	logged = ddt_log_contains(ddt, &dde->dde_key);
+	ddt_exit(ddt);
+
+	return (logged);
+}
+
 int
 ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 {
@@ -1165,13 +1395,21 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 			do {
 				ddt_t *ddt = spa->spa_ddt[ddb->ddb_checksum];
 				int error = ENOENT;
-				if (ddt_object_exists(ddt, ddb->ddb_type,
-				    ddb->ddb_class)) {
-					error = ddt_object_walk(ddt,
+				if (ddb->ddb_type == DDT_TYPES) {
+					/* Walk the log after the objects */
+					error = ddt_log_walk(ddt,
+					    ddb->ddb_class, &ddb->ddb_cursor,
+					    dde);
+					dde->dde_type = DDT_TYPE_CURRENT;
+				} else if (ddt_object_exists(ddt,
+				    ddb->ddb_type, ddb->ddb_class)) {
+					while ((error = ddt_object_walk(ddt,
 					    ddb->ddb_type, ddb->ddb_class,
-					    &ddb->ddb_cursor, dde);
+					    &ddb->ddb_cursor, dde)) == 0 &&
+					    ddt_walk_logged(ddt, dde))
+						continue;
+					dde->dde_type = ddb->ddb_type;
 				}
-				dde->dde_type = ddb->ddb_type;
 				dde->dde_class = ddb->ddb_class;
 				if (error == 0)
 					return (0);
@@ -1180,14 +1418,343 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 				ddb->ddb_cursor = 0;
 			} while (++ddb->ddb_checksum < ZIO_CHECKSUM_FUNCTIONS);
 			ddb->ddb_checksum = 0;
-		} while (++ddb->ddb_type < DDT_TYPES);
+		} while (++ddb->ddb_type <= DDT_TYPES);
 		ddb->ddb_type = 0;
 	} while (++ddb->ddb_class < DDT_CLASSES);
 
 	return (SET_ERROR(ENOENT));
 }
 
+/*
+ * Pruning of unique entries.  The DDT objects are walked in open context to
+ * pick the entries to prune, which are then removed in batches by a sync
+ * task.  The blocks of pruned entries are no longer dedup candidates, and
+ * are freed directly rather than through the DDT (see zio_ddt_free()).
+ */
+#define	DDT_PRUNE_BATCH		4096
+#define	DDT_PRUNE_BUCKETS	1024
+
+typedef struct ddt_prune_arg {
+	ddt_t		*dpa_ddt;
+	uint64_t	dpa_cutoff;	/* prune entries born before this txg */
+	ddt_key_t	*dpa_keys;
+	uint64_t	dpa_count;
+	uint64_t	dpa_pruned;
+} ddt_prune_arg_t;
+
+typedef struct ddt_prune_histogram {
+	uint64_t	dph_width;	/* txgs per bucket */
+	uint64_t	dph_total;
+	uint64_t	*dph_buckets;
+} ddt_prune_histogram_t;
+
+typedef int ddt_prune_func_t(ddt_t *ddt, const ddt_entry_t *dde,
+    uint64_t birth, void *arg);
+
+/*
+ * Returns the birth txg of an entry that may be pruned, or 0 if the entry
+ * is not unique and must be kept.
+ */
+static uint64_t
+ddt_prune_birth(const ddt_entry_t *dde)
+{
+	const ddt_phys_t *ddp = dde->dde_phys;
+	uint64_t birth = 0, refcnt = 0;
+
+	if (ddp[DDT_PHYS_DITTO].ddp_phys_birth != 0)
+		return (0);
+
+	for (int p = DDT_PHYS_SINGLE; p <= DDT_PHYS_TRIPLE; p++) {
+		refcnt += ddp[p].ddp_refcnt;
+		birth = MAX(birth, ddp[p].ddp_phys_birth);
+	}
+
+	return (refcnt == 1 ? birth : 0);
+}
+
+/*
+ * Call func for each entry of the unique DDT objects that may be pruned.
+ * Entries that have been logged since are skipped, as the objects do not
+ * hold their current state.
+ */
+static int
+ddt_prune_walk(spa_t *spa, ddt_prune_func_t *func, void *arg)
+{
+	ddt_entry_t *dde = kmem_cache_alloc(ddt_entry_cache, KM_SLEEP);
+	int error = 0;
+
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt == NULL)
+			continue;
+		for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+			uint64_t walk = 0;
+
+			/* The object is destroyed once it has been emptied */
+			while (ddt_object_exists(ddt, type, DDT_CLASS_UNIQUE) &&
+			    (error = ddt_object_walk(ddt, type,
+			    DDT_CLASS_UNIQUE, &walk, dde)) == 0) {
+				uint64_t birth = ddt_prune_birth(dde);
+
+				if (birth == 0 || ddt_walk_logged(ddt, dde))
+					continue;
+				error = func(ddt, dde, birth, arg);
+				if (error != 0)
+					break;
+			}
+			if (error == ENOENT)
+				error = 0;
+			if (error != 0)
+				goto out;
+		}
+	}
+out:
+	kmem_cache_free(ddt_entry_cache, dde);
+	return (error);
+}
+
+/*
+ * Returns the txg which was syncing at the latest recorded time that is at
+ * least the given number of days ago, or 0 if there is none.
+ */
+static int
+ddt_prune_age_txg(spa_t *spa, uint64_t days, uint64_t *txgp)
+{
+	objset_t *mos = spa->spa_meta_objset;
+	uint64_t now = gethrestime_sec();
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	uint64_t cutoff;
+	int error;
+
+	*txgp = 0;
+	if (spa->spa_ddt_txg_times_object == 0 || days > now / 86400)
+		return (0);
+	cutoff = now - days * 86400;
+
+	for (zap_cursor_init(&zc, mos, spa->spa_ddt_txg_times_object);
+	    (error = zap_cursor_retrieve(&zc, &za)) == 0;
+	    zap_cursor_advance(&zc)) {
+		uint64_t txg = zfs_strtonum(za.za_name, NULL);
+
+		if (za.za_first_integer <= cutoff && txg > *txgp)
+			*txgp = txg;
+	}
+	zap_cursor_fini(&zc);
+
+	return (error == ENOENT ? 0 : error);
+}
+
+static int
+ddt_prune_histogram_add(ddt_t *ddt, const ddt_entry_t *dde, uint64_t birth,
+    void *arg)
+{
+	ddt_prune_histogram_t *dph = arg;
+
+	dph->dph_buckets[MIN(birth / dph->dph_width,
+	    DDT_PRUNE_BUCKETS - 1)]++;
+	dph->dph_total++;
+
+	return (0);
+}
+
+/*
+ * Returns the txg before which about the given percentage of the unique
+ * entries were born.  The births are bucketed by ranges of txgs, so that
+ * at most that percentage of entries is pruned.
+ */
+static int
+ddt_prune_percentage_txg(spa_t *spa, uint64_t percentage, uint64_t *txgp)
+{
+	ddt_prune_histogram_t dph;
+	uint64_t target, sum = 0;
+	int b, error;
+
+	dph.dph_width = spa_last_synced_txg(spa) / DDT_PRUNE_BUCKETS + 1;
+	dph.dph_total = 0;
+	dph.dph_buckets = kmem_zalloc(DDT_PRUNE_BUCKETS * sizeof (uint64_t),
+	    KM_SLEEP);
+
+	error = ddt_prune_walk(spa, ddt_prune_histogram_add, &dph);
+	if (error == 0) {
+		target = dph.dph_total * percentage / 100;
+		for (b = 0; b < DDT_PRUNE_BUCKETS; b++) {
+			if (sum + dph.dph_buckets[b] > target)
+				break;
+			sum += dph.dph_buckets[b];
+		}
+		*txgp = (b == DDT_PRUNE_BUCKETS) ? UINT64_MAX :
+		    b * dph.dph_width;
+	}
+
+	kmem_free(dph.dph_buckets, DDT_PRUNE_BUCKETS * sizeof (uint64_t));
+	return (error);
+}
+
+/* ARGSUSED */
+static int
+ddt_prune_check(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+
+	if (!spa_feature_is_enabled(spa, SPA_FEATURE_DDT_PRUNE))
+		return (SET_ERROR(ENOTSUP));
+
+	return (0);
+}
+
+static void
+ddt_prune_sync(void *arg, dmu_tx_t *tx)
+{
+	ddt_prune_arg_t *dpa = arg;
+	ddt_t *ddt = dpa->dpa_ddt;
+	spa_t *spa = ddt->ddt_spa;
+	ddt_entry_t *dde = kmem_cache_alloc(ddt_entry_cache, KM_SLEEP);
+	uint64_t pruned = 0;
+
+	for (uint64_t i = 0; i < dpa->dpa_count; i++) {
+		boolean_t busy;
+
+		dde->dde_key = dpa->dpa_keys[i];
+
+		/*
+		 * Entries that are updated in this txg, or that have been
+		 * logged since they were picked, are no longer candidates.
+		 */
+		ddt_enter(ddt);
+		busy = (avl_find(&ddt->ddt_tree, dde, NULL) != NULL ||
+		    ddt_log_contains(ddt, &dde->dde_key));
+		ddt_exit(ddt);
+		if (busy)
+			continue;
+
+		for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+			uint64_t birth;
+
+			if (ddt_object_lookup(ddt, type, DDT_CLASS_UNIQUE,
+			    dde) != 0)
+				continue;
+			birth = ddt_prune_birth(dde);
+			if (birth == 0 || birth >= dpa->dpa_cutoff)
+				continue;
+
+			dde->dde_type = type;
+			dde->dde_class = DDT_CLASS_UNIQUE;
+			ddt_stat_update(ddt, dde, -1ULL);
+			VERIFY0(ddt_object_remove(ddt, type, DDT_CLASS_UNIQUE,
+			    dde, tx));
+			pruned++;
+		}
+	}
+
+	kmem_cache_free(ddt_entry_cache, dde);
+
+	if (pruned != 0) {
+		if (!spa_feature_is_active(spa, SPA_FEATURE_DDT_PRUNE))
+			spa_feature_incr(spa, SPA_FEATURE_DDT_PRUNE, tx);
+		ddt_sync_objects(ddt, tx);
+	}
+	dpa->dpa_pruned += pruned;
+}
+
+static int
+ddt_prune_batch(spa_t *spa, ddt_prune_arg_t *dpa)
+{
+	int error;
+
+	error = dsl_sync_task(spa_name(spa), ddt_prune_check, ddt_prune_sync,
+	    dpa, 0, ZFS_SPACE_CHECK_EXTRA_RESERVED);
+	dpa->dpa_count = 0;
+
+	return (error);
+}
+
+static int
+ddt_prune_collect(ddt_t *ddt, const ddt_entry_t *dde, uint64_t birth,
+    void *arg)
+{
+	ddt_prune_arg_t *dpa = arg;
+	int error;
+
+	if (birth >= dpa->dpa_cutoff)
+		return (0);
+
+	if (dpa->dpa_ddt != ddt && dpa->dpa_count != 0) {
+		error = ddt_prune_batch(ddt->ddt_spa, dpa);
+		if (error != 0)
+			return (error);
+	}
+
+	dpa->dpa_ddt = ddt;
+	dpa->dpa_keys[dpa->dpa_count++] = dde->dde_key;
+
+	if (dpa->dpa_count == DDT_PRUNE_BATCH)
+		return (ddt_prune_batch(ddt->ddt_spa, dpa));
+
+	return (0);
+}
+
+/*
+ * Remove the unique entries born more than the given number of days ago,
+ * or the given percentage of the oldest unique entries, from the DDTs.
+ */
+int
+ddt_prune_unique_entries(spa_t *spa, zpool_ddt_prune_unit_t unit,
+    uint64_t amount)
+{
+	ddt_prune_arg_t dpa = { 0 };
+	int error;
+
+	if (!spa_feature_is_enabled(spa, SPA_FEATURE_DDT_PRUNE))
+		return (SET_ERROR(ENOTSUP));
+	if (!spa_writeable(spa))
+		return (SET_ERROR(EROFS));
+
+	switch (unit) {
+	case ZPOOL_DDT_PRUNE_AGE:
+		error = ddt_prune_age_txg(spa, amount, &dpa.dpa_cutoff);
+		break;
+	case ZPOOL_DDT_PRUNE_PERCENTAGE:
+		if (amount > 100)
+			return (SET_ERROR(EINVAL));
+		error = ddt_prune_percentage_txg(spa, amount, &dpa.dpa_cutoff);
+		break;
+	default:
+		return (SET_ERROR(EINVAL));
+	}
+	if (error != 0 || dpa.dpa_cutoff == 0)
+		return (error);
+
+	dpa.dpa_keys = vmem_alloc(DDT_PRUNE_BATCH * sizeof (ddt_key_t),
+	    KM_SLEEP);
+
+	error = ddt_prune_walk(spa, ddt_prune_collect, &dpa);
+	if (error == 0 && dpa.dpa_count != 0)
+		error = ddt_prune_batch(spa, &dpa);
+
+	vmem_free(dpa.dpa_keys, DDT_PRUNE_BATCH * sizeof (ddt_key_t));
+
+	zfs_dbgmsg("pruned %llu unique entries born before txg %llu "
+	    "from the DDTs of %s", (u_longlong_t)dpa.dpa_pruned,
+	    (u_longlong_t)dpa.dpa_cutoff, spa_name(spa));
+	if (dpa.dpa_pruned != 0) {
+		spa_history_log_internal(spa, "ddt prune", NULL,
+		    "pruned %llu entries", (u_longlong_t)dpa.dpa_pruned);
+	}
+
+	return (error);
+}
+
 #if defined(_KERNEL)
 module_param(zfs_dedup_prefetch, int, 0644);
 MODULE_PARM_DESC(zfs_dedup_prefetch, "Enable prefetching dedup-ed blks");
+
+module_param(zfs_dedup_log_enabled, int, 0644);
+MODULE_PARM_DESC(zfs_dedup_log_enabled, "Log DDT updates, flush in batches");
+
+/* BEGIN CSTYLED */
+module_param(zfs_dedup_log_flush_records, ulong, 0644);
+MODULE_PARM_DESC(zfs_dedup_log_flush_records,
+	"Number of DDT log records which triggers a flush");
+/* END CSTYLED */
 #endif
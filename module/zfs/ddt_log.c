@@ -0,0 +1,455 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/ddt.h>
+#include <sys/zap.h>
+#include <sys/dmu_tx.h>
+#include <sys/zio_checksum.h>
+#include <sys/zfeature.h>
+
+/*
+ * DDT log
+ *
+ * Each DDT entry lives in a ZAP object, keyed by its checksum.  Since the
+ * checksums are uniformly distributed, writing back the entries that changed
+ * in a txg dirties a different ZAP leaf block for nearly every entry, and
+ * once the DDT no longer fits in the ARC each of those updates must first
+ * read the leaf from disk.
+ *
+ * With the ddt_log feature, ddt_sync_table() instead appends the new state
+ * of every changed entry to a per-DDT log object, which is written
+ * sequentially, and keeps the latest logged state of each key in an AVL
+ * tree (ddt_log_tree).  Lookups consult the tree before the ZAP objects, so
+ * a logged entry shadows whatever the ZAP holds for the same key.  Once the
+ * log holds zfs_dedup_log_flush_records records, ddt_log_flush() merges the
+ * tree into the ZAP objects.  The tree is sorted in ZAP hash order, so the
+ * merge visits each leaf block once and in order, no matter how many
+ * entries in it were updated since the previous merge.
+ *
+ * The log is only appended to, and the ZAP objects are only modified by a
+ * merge, so the log and the ZAP objects are always consistent on disk.  On
+ * import, ddt_log_load() rebuilds the tree by replaying the log in order.
+ *
+ * The histograms of the DDT objects describe the logical state of the DDT,
+ * including the logged entries.  The cached object statistics (entry counts
+ * and sizes) only cover the ZAP objects.
+ */
+
+/*
+ * Number of records staged in memory before they are written to the log.
+ */
+#define	DDT_LOG_STAGED	(SPA_OLD_MAXBLOCKSIZE / sizeof (ddt_log_record_t))
+
+/*
+ * Sort by the first word of the checksum first: this is the hash of the
+ * ZAP key when the DDT objects are created with prehashed keys, and it
+ * determines the leaf block an entry lives in.
+ */
+static int
+ddt_log_compare(const void *x1, const void *x2)
+{
+	const ddt_log_entry_t *dle1 = x1;
+	const ddt_log_entry_t *dle2 = x2;
+	const uint64_t *k1 = (const uint64_t *)&dle1->dle_key;
+	const uint64_t *k2 = (const uint64_t *)&dle2->dle_key;
+	int cmp = 0;
+
+	for (int i = 0; i < DDT_KEY_WORDS; i++) {
+		cmp = AVL_CMP(k1[i], k2[i]);
+		if (likely(cmp))
+			break;
+	}
+
+	return (cmp);
+}
+
+void
+ddt_log_alloc(ddt_t *ddt)
+{
+	avl_create(&ddt->ddt_log_tree, ddt_log_compare,
+	    sizeof (ddt_log_entry_t), offsetof(ddt_log_entry_t, dle_node));
+}
+
+void
+ddt_log_free(ddt_t *ddt)
+{
+	ddt_log_entry_t *dle;
+	void *cookie = NULL;
+
+	while ((dle = avl_destroy_nodes(&ddt->ddt_log_tree, &cookie)) != NULL)
+		kmem_free(dle, sizeof (ddt_log_entry_t));
+	avl_destroy(&ddt->ddt_log_tree);
+}
+
+void
+ddt_log_name(ddt_t *ddt, char *name)
+{
+	(void) sprintf(name, DMU_POOL_DDT_LOG,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name);
+}
+
+static void
+ddt_log_create(ddt_t *ddt, dmu_tx_t *tx)
+{
+	objset_t *os = ddt->ddt_os;
+	char name[DDT_NAMELEN];
+
+	ASSERT0(ddt->ddt_log_object);
+
+	ddt_log_name(ddt, name);
+	ddt->ddt_log_object = dmu_object_alloc(os, DMU_OTN_UINT64_METADATA,
+	    SPA_OLD_MAXBLOCKSIZE, DMU_OTN_UINT64_METADATA,
+	    sizeof (ddt_log_phys_t), tx);
+	VERIFY0(zap_add(os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &ddt->ddt_log_object, tx));
+	ddt->ddt_log_count = 0;
+
+	spa_feature_incr(ddt->ddt_spa, SPA_FEATURE_DDT_LOG, tx);
+}
+
+void
+ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx)
+{
+	objset_t *os = ddt->ddt_os;
+	char name[DDT_NAMELEN];
+
+	ASSERT(ddt->ddt_log_object != 0);
+	ASSERT0(ddt->ddt_log_count);
+	ASSERT0(avl_numnodes(&ddt->ddt_log_tree));
+
+	ddt_log_name(ddt, name);
+	VERIFY0(zap_remove(os, DMU_POOL_DIRECTORY_OBJECT, name, tx));
+	VERIFY0(dmu_object_free(os, ddt->ddt_log_object, tx));
+	ddt->ddt_log_object = 0;
+
+	spa_feature_decr(ddt->ddt_spa, SPA_FEATURE_DDT_LOG, tx);
+}
+
+static void
+ddt_log_sync_count(ddt_t *ddt, dmu_tx_t *tx)
+{
+	dmu_buf_t *db;
+
+	VERIFY0(dmu_bonus_hold(ddt->ddt_os, ddt->ddt_log_object, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	((ddt_log_phys_t *)db->db_data)->dlp_count = ddt->ddt_log_count;
+	dmu_buf_rele(db, FTAG);
+}
+
+/*
+ * Apply a record to the in-core log.  The DDT object location is only
+ * taken from the first record for a key: the DDT objects do not change
+ * until the log is flushed, so all later records carry the same one.
+ */
+static void
+ddt_log_apply(ddt_t *ddt, const ddt_log_record_t *dlr, uint64_t index)
+{
+	ddt_log_entry_t *dle, dle_search;
+	avl_index_t where;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	dle_search.dle_key = dlr->dlr_key;
+	dle = avl_find(&ddt->ddt_log_tree, &dle_search, &where);
+	if (dle == NULL) {
+		dle = kmem_zalloc(sizeof (ddt_log_entry_t), KM_SLEEP);
+		dle->dle_key = dlr->dlr_key;
+		dle->dle_obj_type = DLR_GET_OBJ_TYPE(dlr);
+		dle->dle_obj_class = DLR_GET_OBJ_CLASS(dlr);
+		avl_insert(&ddt->ddt_log_tree, dle, where);
+	}
+
+	bcopy(dlr->dlr_phys, dle->dle_phys, sizeof (dle->dle_phys));
+	dle->dle_class = DLR_GET_CLASS(dlr);
+	dle->dle_index = index;
+}
+
+int
+ddt_log_load(ddt_t *ddt)
+{
+	objset_t *os = ddt->ddt_os;
+	ddt_log_record_t *dlr;
+	dmu_buf_t *db;
+	char name[DDT_NAMELEN];
+	int error;
+
+	ddt_log_name(ddt, name);
+	error = zap_lookup(os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &ddt->ddt_log_object);
+	if (error != 0)
+		return (error);
+
+	error = dmu_bonus_hold(os, ddt->ddt_log_object, FTAG, &db);
+	if (error != 0)
+		return (error);
+	ddt->ddt_log_count = ((ddt_log_phys_t *)db->db_data)->dlp_count;
+	dmu_buf_rele(db, FTAG);
+
+	dlr = vmem_alloc(DDT_LOG_STAGED * sizeof (ddt_log_record_t), KM_SLEEP);
+
+	for (uint64_t index = 0; index < ddt->ddt_log_count; ) {
+		uint64_t n = MIN(DDT_LOG_STAGED, ddt->ddt_log_count - index);
+
+		error = dmu_read(os, ddt->ddt_log_object,
+		    index * sizeof (ddt_log_record_t),
+		    n * sizeof (ddt_log_record_t), dlr, DMU_READ_PREFETCH);
+		if (error != 0)
+			break;
+
+		ddt_enter(ddt);
+		for (uint64_t i = 0; i < n; i++, index++)
+			ddt_log_apply(ddt, &dlr[i], index);
+		ddt_exit(ddt);
+	}
+
+	vmem_free(dlr, DDT_LOG_STAGED * sizeof (ddt_log_record_t));
+
+	return (error);
+}
+
+/*
+ * Returns B_TRUE if the key has been logged since the last flush, in which
+ * case the DDT objects may hold a stale entry for it.
+ */
+boolean_t
+ddt_log_contains(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	ddt_log_entry_t dle_search;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	if (avl_numnodes(&ddt->ddt_log_tree) == 0)
+		return (B_FALSE);
+
+	dle_search.dle_key = *ddk;
+	return (avl_find(&ddt->ddt_log_tree, &dle_search, NULL) != NULL);
+}
+
+/*
+ * Fill in the entry from the log.  Returns B_FALSE if the key has not been
+ * logged since the last flush, and the DDT objects should be searched.  A
+ * logged removal returns B_TRUE with dde_type set to DDT_TYPES.
+ */
+boolean_t
+ddt_log_lookup(ddt_t *ddt, ddt_entry_t *dde)
+{
+	ddt_log_entry_t *dle, dle_search;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	if (avl_numnodes(&ddt->ddt_log_tree) == 0)
+		return (B_FALSE);
+
+	dle_search.dle_key = dde->dde_key;
+	dle = avl_find(&ddt->ddt_log_tree, &dle_search, NULL);
+	if (dle == NULL)
+		return (B_FALSE);
+
+	bcopy(dle->dle_phys, dde->dde_phys, sizeof (dde->dde_phys));
+	dde->dde_class = dle->dle_class;
+	dde->dde_type = (dle->dle_class == DDT_CLASSES) ?
+	    DDT_TYPES : DDT_TYPE_CURRENT;
+
+	return (B_TRUE);
+}
+
+void
+ddt_log_begin(ddt_t *ddt, ddt_log_update_t *dlu, dmu_tx_t *tx)
+{
+	dlu->dlu_tx = tx;
+	dlu->dlu_records = vmem_alloc(DDT_LOG_STAGED *
+	    sizeof (ddt_log_record_t), KM_SLEEP);
+	dlu->dlu_count = 0;
+}
+
+static void
+ddt_log_write(ddt_t *ddt, ddt_log_update_t *dlu)
+{
+	dmu_tx_t *tx = dlu->dlu_tx;
+
+	if (dlu->dlu_count == 0)
+		return;
+
+	if (ddt->ddt_log_object == 0)
+		ddt_log_create(ddt, tx);
+
+	dmu_write(ddt->ddt_os, ddt->ddt_log_object,
+	    ddt->ddt_log_count * sizeof (ddt_log_record_t),
+	    dlu->dlu_count * sizeof (ddt_log_record_t), dlu->dlu_records, tx);
+	ddt->ddt_log_count += dlu->dlu_count;
+	dlu->dlu_count = 0;
+
+	ddt_log_sync_count(ddt, tx);
+}
+
+/*
+ * Log the new state of an entry.  otype and oclass are where the entry was
+ * found by ddt_lookup(), and nclass is its new class, or DDT_CLASSES if it
+ * is being removed.
+ */
+void
+ddt_log_entry(ddt_t *ddt, ddt_log_update_t *dlu, const ddt_entry_t *dde,
+    enum ddt_type otype, enum ddt_class oclass, enum ddt_class nclass)
+{
+	ddt_log_record_t *dlr;
+
+	if (dlu->dlu_count == DDT_LOG_STAGED)
+		ddt_log_write(ddt, dlu);
+
+	ddt_enter(ddt);
+
+	/*
+	 * An entry that is neither in the log nor in the DDT objects has
+	 * nothing to remove.
+	 */
+	if (nclass == DDT_CLASSES && otype == DDT_TYPES &&
+	    !ddt_log_contains(ddt, &dde->dde_key)) {
+		ddt_exit(ddt);
+		return;
+	}
+
+	dlr = &dlu->dlu_records[dlu->dlu_count];
+	bzero(dlr, sizeof (*dlr));
+	dlr->dlr_key = dde->dde_key;
+	bcopy(dde->dde_phys, dlr->dlr_phys, sizeof (dlr->dlr_phys));
+	DLR_SET_CLASS(dlr, nclass);
+	DLR_SET_OBJ_TYPE(dlr, otype);
+	DLR_SET_OBJ_CLASS(dlr, oclass);
+
+	ddt_log_apply(ddt, dlr, ddt->ddt_log_count + dlu->dlu_count);
+	dlu->dlu_count++;
+
+	ddt_exit(ddt);
+}
+
+void
+ddt_log_commit(ddt_t *ddt, ddt_log_update_t *dlu)
+{
+	ddt_log_write(ddt, dlu);
+	vmem_free(dlu->dlu_records, DDT_LOG_STAGED *
+	    sizeof (ddt_log_record_t));
+	dlu->dlu_records = NULL;
+}
+
+/*
+ * Merge the log into the DDT objects, in ZAP hash order, and truncate it.
+ * The caller is responsible for syncing the DDT objects' statistics.
+ */
+void
+ddt_log_flush(ddt_t *ddt, dmu_tx_t *tx)
+{
+	avl_tree_t *t = &ddt->ddt_log_tree;
+	ddt_log_entry_t *dle, *dle_next;
+	ddt_entry_t *dde;
+	uint64_t n = 0;
+
+	if (ddt->ddt_log_count == 0) {
+		ASSERT0(avl_numnodes(t));
+		return;
+	}
+
+	dde = kmem_zalloc(sizeof (ddt_entry_t), KM_SLEEP);
+
+	for (dle = avl_first(t); dle != NULL; dle = dle_next) {
+		enum ddt_type otype = dle->dle_obj_type;
+		enum ddt_class oclass = dle->dle_obj_class;
+		enum ddt_class nclass = dle->dle_class;
+
+		dle_next = AVL_NEXT(t, dle);
+
+		dde->dde_key = dle->dle_key;
+		bcopy(dle->dle_phys, dde->dde_phys, sizeof (dde->dde_phys));
+
+		if (otype != DDT_TYPES &&
+		    (otype != DDT_TYPE_CURRENT || oclass != nclass))
+			VERIFY0(ddt_object_remove(ddt, otype, oclass, dde, tx));
+		if (nclass != DDT_CLASSES) {
+			VERIFY0(ddt_object_update(ddt, DDT_TYPE_CURRENT,
+			    nclass, dde, tx));
+		}
+
+		/*
+		 * The DDT objects are now up to date for this key, so it
+		 * can be dropped from the log for concurrent lookups.
+		 */
+		ddt_enter(ddt);
+		avl_remove(t, dle);
+		ddt_exit(ddt);
+		kmem_free(dle, sizeof (ddt_log_entry_t));
+		n++;
+	}
+
+	kmem_free(dde, sizeof (ddt_entry_t));
+
+	zfs_dbgmsg("flushed %llu entries, %llu records from %s DDT log, "
+	    "txg %llu", (u_longlong_t)n, (u_longlong_t)ddt->ddt_log_count,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name,
+	    (u_longlong_t)dmu_tx_get_txg(tx));
+
+	VERIFY0(dmu_free_range(ddt->ddt_os, ddt->ddt_log_object, 0,
+	    DMU_OBJECT_END, tx));
+	ddt->ddt_log_count = 0;
+	ddt_log_sync_count(ddt, tx);
+}
+
+/*
+ * Walk the live entries of the given class in the log, in record order.
+ * A record is live if it is the latest record for its key.  The cursor is
+ * a record index, so it is invalidated by ddt_log_flush().
+ */
+int
+ddt_log_walk(ddt_t *ddt, enum ddt_class class, uint64_t *walk,
+    ddt_entry_t *dde)
+{
+	ddt_log_record_t dlr;
+	ddt_log_entry_t *dle, dle_search;
+	boolean_t live;
+	int error;
+
+	while (*walk < ddt->ddt_log_count) {
+		error = dmu_read(ddt->ddt_os, ddt->ddt_log_object,
+		    *walk * sizeof (dlr), sizeof (dlr), &dlr,
+		    DMU_READ_PREFETCH);
+		if (error != 0)
+			return (error);
+
+		ddt_enter(ddt);
+		dle_search.dle_key = dlr.dlr_key;
+		dle = avl_find(&ddt->ddt_log_tree, &dle_search, NULL);
+		live = (dle != NULL && dle->dle_index == *walk &&
+		    dle->dle_class == class);
+		ddt_exit(ddt);
+
+		(*walk)++;
+
+		if (live) {
+			dde->dde_key = dlr.dlr_key;
+			bcopy(dlr.dlr_phys, dde->dde_phys,
+			    sizeof (dde->dde_phys));
+			return (0);
+		}
+	}
+
+	return (SET_ERROR(ENOENT));
+}
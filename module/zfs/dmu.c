@@ -549,7 +549,7 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
 	if ((flags & DMU_READ_NO_PREFETCH) == 0 &&
 	    DNODE_META_IS_CACHEABLE(dn) && length <= zfetch_array_rd_sz) {
 		dmu_zfetch(&dn->dn_zfetch, blkid, nblks,
-		    read && DNODE_IS_CACHEABLE(dn), B_TRUE);
+		    read && DNODE_IS_CACHEABLE(dn));
 	}
 	rw_exit(&dn->dn_struct_rwlock);
 
@@ -1527,6 +1527,266 @@ dmu_write_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size,
 }
 #endif /* _KERNEL */
 
+/*
+ * Direct I/O.  These routines move whole blocks between the caller's buffer
+ * and disk without staging them in the ARC.  A block which is cached or
+ * dirty in the dbuf layer is still serviced from (or through) its dbuf, so
+ * that Direct I/O and buffered access to the same file stay coherent.
+ */
+static void
+dmu_direct_read_done(zio_t *zio)
+{
+	abd_put(zio->io_abd);
+}
+
+/*
+ * Read 'size' bytes at 'offset' from the object into 'data'.
+ */
+int
+dmu_read_abd(dnode_t *dn, uint64_t offset, uint64_t size, abd_t *data)
+{
+	objset_t *os = dn->dn_objset;
+	dmu_buf_t **dbp;
+	abd_t **bounce;
+	zio_t *rio;
+	uint64_t off = 0;
+	int numbufs, i, err;
+
+	err = dmu_buf_hold_array_by_dnode(dn, offset, size, FALSE, FTAG,
+	    &numbufs, &dbp, DMU_READ_NO_PREFETCH);
+	if (err)
+		return (err);
+
+	bounce = kmem_zalloc(numbufs * sizeof (abd_t *), KM_SLEEP);
+	rio = zio_root(os->os_spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+
+	for (i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		uint64_t bufoff = offset + off - db->db.db_offset;
+		uint64_t tocpy = MIN(db->db.db_size - bufoff, size - off);
+		boolean_t direct = B_FALSE, hole = B_FALSE;
+		zbookmark_phys_t zb;
+		blkptr_t bp;
+
+		mutex_enter(&db->db_mtx);
+		if (db->db_state == DB_UNCACHED) {
+			db_lock_type_t dblt =
+			    dmu_buf_lock_parent(db, RW_READER, FTAG);
+			blkptr_t *bpp = dbuf_get_bp(db);
+
+			if (bpp == NULL || BP_IS_HOLE(bpp) ||
+			    (bpp == db->db_blkptr &&
+			    dnode_block_freed(dn, db->db_blkid))) {
+				hole = B_TRUE;
+			} else if (!BP_IS_REDACTED(bpp) &&
+			    (!os->os_encrypted || BP_USES_CRYPT(bpp))) {
+				bp = *bpp;
+				direct = B_TRUE;
+			}
+			dmu_buf_unlock_parent(db, dblt, FTAG);
+		}
+		mutex_exit(&db->db_mtx);
+
+		if (hole) {
+			abd_zero_off(data, off, tocpy);
+		} else if (direct) {
+			SET_BOOKMARK(&zb, dmu_objset_id(os), dn->dn_object,
+			    0, db->db_blkid);
+			if (tocpy == db->db.db_size) {
+				zio_nowait(zio_read(rio, os->os_spa, &bp,
+				    abd_get_offset_size(data, off, tocpy),
+				    tocpy, dmu_direct_read_done, NULL,
+				    ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL,
+				    &zb));
+			} else {
+				bounce[i] = abd_alloc_for_io(db->db.db_size,
+				    B_FALSE);
+				zio_nowait(zio_read(rio, os->os_spa, &bp,
+				    bounce[i], db->db.db_size, NULL, NULL,
+				    ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL,
+				    &zb));
+			}
+		} else {
+			/* Cached, dirty or otherwise unusual; use the dbuf. */
+			err = dbuf_read(db, NULL,
+			    DB_RF_CANFAIL | DB_RF_NOPREFETCH);
+			if (err != 0)
+				break;
+			abd_copy_from_buf_off(data,
+			    (char *)db->db.db_data + bufoff, off, tocpy);
+		}
+
+		off += tocpy;
+	}
+
+	if (err == 0)
+		err = zio_wait(rio);
+	else
+		(void) zio_wait(rio);
+
+	for (i = 0, off = 0; i < numbufs; i++) {
+		dmu_buf_t *db = dbp[i];
+		uint64_t bufoff = offset + off - db->db_offset;
+		uint64_t tocpy = MIN(db->db_size - bufoff, size - off);
+
+		if (bounce[i] != NULL) {
+			if (err == 0)
+				abd_copy_off(data, bounce[i], off, bufoff,
+				    tocpy);
+			abd_free(bounce[i]);
+		}
+		off += tocpy;
+	}
+
+	kmem_free(bounce, numbufs * sizeof (abd_t *));
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	return (err);
+}
+
+static void
+dmu_direct_write_ready(zio_t *zio)
+{
+	dbuf_dirty_record_t *dr = zio->io_private;
+	blkptr_t *bp = zio->io_bp;
+
+	if (zio->io_error == 0) {
+		if (BP_IS_HOLE(bp)) {
+			/*
+			 * A block of zeros may compress to a hole, but the
+			 * block size still needs to be known for replay.
+			 */
+			BP_SET_LSIZE(bp, dr->dr_dbuf->db.db_size);
+		} else if (!BP_IS_EMBEDDED(bp)) {
+			ASSERT(BP_GET_LEVEL(bp) == 0);
+			BP_SET_FILL(bp, 1);
+		}
+	}
+}
+
+static void
+dmu_direct_write_done(zio_t *zio)
+{
+	dbuf_dirty_record_t *dr = zio->io_private;
+	dmu_buf_impl_t *db = dr->dr_dbuf;
+
+	abd_put(zio->io_abd);
+
+	mutex_enter(&db->db_mtx);
+	ASSERT(dr->dt.dl.dr_override_state == DR_IN_DMU_SYNC);
+	ASSERT3U(db->db_state, ==, DB_NOFILL);
+	if (zio->io_error == 0) {
+		dr->dt.dl.dr_override_state = DR_OVERRIDDEN;
+		dr->dt.dl.dr_copies = zio->io_prop.zp_copies;
+		dr->dt.dl.dr_nopwrite = B_FALSE;
+		dr->dt.dl.dr_diowrite = B_TRUE;
+
+		/* See the comment in dmu_sync_done(). */
+		if (BP_IS_HOLE(&dr->dt.dl.dr_overridden_by) &&
+		    dr->dt.dl.dr_overridden_by.blk_birth == 0)
+			BP_ZERO(&dr->dt.dl.dr_overridden_by);
+
+		/* The block's contents now live only on disk. */
+		db->db_state = DB_UNCACHED;
+	} else {
+		dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
+	}
+	cv_broadcast(&db->db_changed);
+	mutex_exit(&db->db_mtx);
+}
+
+/*
+ * Write 'size' bytes from 'data' to the object at 'offset', which must both
+ * be multiples of the object's block size.  Each block is written to its
+ * final location immediately, and the resulting block pointer is recorded
+ * in the dbuf's dirty record for this txg (much like dmu_sync()).  Blocks
+ * with buffered dirty data, or whose Direct I/O write fails, are instead
+ * copied into the dbuf and written out with the txg.
+ */
+int
+dmu_write_abd(dnode_t *dn, uint64_t offset, uint64_t size, abd_t *data,
+    dmu_tx_t *tx)
+{
+	objset_t *os = dn->dn_objset;
+	dbuf_dirty_record_t **drs;
+	dmu_buf_t **dbp;
+	zio_prop_t zp;
+	zio_t *pio;
+	int numbufs, i, err;
+
+	err = dmu_buf_hold_array_by_dnode(dn, offset, size, FALSE, FTAG,
+	    &numbufs, &dbp, DMU_READ_PREFETCH);
+	if (err)
+		return (err);
+
+	/*
+	 * Dedup and nopwrite both need the data to still be in memory when
+	 * the txg syncs, which it is not; see dbuf_write().
+	 */
+	dmu_write_policy(os, dn, 0, WP_DMU_SYNC, &zp);
+	zp.zp_dedup = B_FALSE;
+	zp.zp_dedup_verify = B_FALSE;
+	zp.zp_nopwrite = B_FALSE;
+
+	drs = kmem_zalloc(numbufs * sizeof (dbuf_dirty_record_t *), KM_SLEEP);
+	pio = zio_root(os->os_spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+
+	for (i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		uint64_t off = db->db.db_offset - offset;
+		dbuf_dirty_record_t *dr;
+		zbookmark_phys_t zb;
+
+		ASSERT3U(db->db.db_offset, >=, offset);
+		ASSERT3U(off + db->db.db_size, <=, size);
+
+		dr = dbuf_direct_write_prepare(db, tx);
+		if (dr == NULL) {
+			dmu_buf_will_fill(&db->db, tx);
+			abd_copy_to_buf_off(db->db.db_data, data, off,
+			    db->db.db_size);
+			dmu_buf_fill_done(&db->db, tx);
+			continue;
+		}
+
+		drs[i] = dr;
+		BP_ZERO(&dr->dt.dl.dr_overridden_by);
+		SET_BOOKMARK(&zb, dmu_objset_id(os), dn->dn_object, 0,
+		    db->db_blkid);
+		zio_nowait(zio_write(pio, os->os_spa, dmu_tx_get_txg(tx),
+		    &dr->dt.dl.dr_overridden_by,
+		    abd_get_offset_size(data, off, db->db.db_size),
+		    db->db.db_size, db->db.db_size, &zp,
+		    dmu_direct_write_ready, NULL, NULL, dmu_direct_write_done,
+		    dr, ZIO_PRIORITY_SYNC_WRITE, ZIO_FLAG_CANFAIL, &zb));
+	}
+
+	(void) zio_wait(pio);
+
+	/*
+	 * Any block whose write failed is dirtied again through the dbuf,
+	 * so the data goes out with the txg instead.
+	 */
+	for (i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		uint64_t off = db->db.db_offset - offset;
+
+		if (drs[i] == NULL ||
+		    drs[i]->dt.dl.dr_override_state == DR_OVERRIDDEN)
+			continue;
+
+		dbuf_direct_write_abort(db, tx);
+		dmu_buf_will_fill(&db->db, tx);
+		abd_copy_to_buf_off(db->db.db_data, data, off, db->db.db_size);
+		dmu_buf_fill_done(&db->db, tx);
+	}
+
+	kmem_free(drs, numbufs * sizeof (dbuf_dirty_record_t *));
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	return (0);
+}
+
 /*
  * Allocate a loaned anonymous arc buffer.
  */
@@ -1980,6 +2240,19 @@ dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
 	DB_DNODE_EXIT(db);
 
 	ASSERT(dr->dr_txg == txg);
+	if (dr->dt.dl.dr_diowrite) {
+		/*
+		 * This block was written directly to its final location by
+		 * Direct I/O; the log record simply needs to point at it.
+		 */
+		ASSERT(dr->dt.dl.dr_override_state == DR_OVERRIDDEN);
+		*zgd->zgd_bp = dr->dt.dl.dr_overridden_by;
+		mutex_exit(&db->db_mtx);
+		zil_lwb_add_block(zgd->zgd_lwb, zgd->zgd_bp);
+		done(zgd, 0);
+		return (0);
+	}
+
 	if (dr->dt.dl.dr_override_state == DR_IN_DMU_SYNC ||
 	    dr->dt.dl.dr_override_state == DR_OVERRIDDEN) {
 		/*
@@ -46,6 +46,7 @@
 #include <sys/zap.h>
 #include <sys/zvol.h>
 #include <sys/zio_checksum.h>
+#include <sys/zio_compress.h>
 #include <sys/zfs_znode.h>
 #include <zfs_fletcher.h>
 #include <sys/avl.h>
@@ -508,14 +509,18 @@ recv_begin_check_feature_flags_impl(uint64_t featureflags, spa_t *spa)
 		return (SET_ERROR(ENOTSUP));
 
 	/*
-	 * LZ4 compressed, embedded, mooched, large blocks, and large_dnodes
-	 * in the stream can only be used if those pool features are enabled
-	 * because we don't attempt to decompress / un-embed / un-mooch /
-	 * split up the blocks / dnodes during the receive process.
+	 * LZ4 and zstd compressed, embedded, mooched, large blocks, and
+	 * large_dnodes in the stream can only be used if those pool features
+	 * are enabled because we don't attempt to decompress / un-embed /
+	 * un-mooch / split up the blocks / dnodes during the receive process.
 	 */
 	if ((featureflags & DMU_BACKUP_FEATURE_LZ4) &&
 	    !spa_feature_is_enabled(spa, SPA_FEATURE_LZ4_COMPRESS))
 		return (SET_ERROR(ENOTSUP));
+	if ((featureflags & DMU_BACKUP_FEATURE_ZSTD) &&
+	    (!spa_feature_is_enabled(spa, SPA_FEATURE_ZSTD_COMPRESS) ||
+	    !zstd_available()))
+		return (SET_ERROR(ENOTSUP));
 	if ((featureflags & DMU_BACKUP_FEATURE_EMBED_DATA) &&
 	    !spa_feature_is_enabled(spa, SPA_FEATURE_EMBEDDED_DATA))
 		return (SET_ERROR(ENOTSUP));
@@ -34,6 +34,7 @@
 #include <sys/dmu.h>
 #include <sys/dbuf.h>
 #include <sys/kstat.h>
+#include <sys/spa_impl.h>
 
 /*
  * This tunable disables predictive prefetch.  Note that it leaves "prescient"
@@ -54,17 +55,29 @@ unsigned int	zfetch_max_distance = 8 * 1024 * 1024;
 unsigned int	zfetch_max_idistance = 64 * 1024 * 1024;
 /* max number of bytes in an array_read in which we allow prefetching (1MB) */
 unsigned long	zfetch_array_rd_sz = 1024 * 1024;
+/* max # of prefetch tasks queued per pool */
+unsigned int	zfetch_max_queued = 256;
 
 typedef struct zfetch_stats {
 	kstat_named_t zfetchstat_hits;
 	kstat_named_t zfetchstat_misses;
 	kstat_named_t zfetchstat_max_streams;
+	kstat_named_t zfetchstat_reverse_hits;
+	kstat_named_t zfetchstat_reverse_streams;
+	kstat_named_t zfetchstat_stride_hits;
+	kstat_named_t zfetchstat_stride_streams;
+	kstat_named_t zfetchstat_max_queued;
 } zfetch_stats_t;
 
 static zfetch_stats_t zfetch_stats = {
 	{ "hits",			KSTAT_DATA_UINT64 },
 	{ "misses",			KSTAT_DATA_UINT64 },
 	{ "max_streams",		KSTAT_DATA_UINT64 },
+	{ "reverse_hits",		KSTAT_DATA_UINT64 },
+	{ "reverse_streams",		KSTAT_DATA_UINT64 },
+	{ "stride_hits",		KSTAT_DATA_UINT64 },
+	{ "stride_streams",		KSTAT_DATA_UINT64 },
+	{ "max_queued",			KSTAT_DATA_UINT64 },
 };
 
 #define	ZFETCHSTAT_BUMP(stat) \
@@ -106,6 +119,7 @@ dmu_zfetch_init(zfetch_t *zf, dnode_t *dno)
 		return;
 
 	zf->zf_dnode = dno;
+	bzero(zf->zf_hist, sizeof (zf->zf_hist));
 
 	list_create(&zf->zf_stream, sizeof (zstream_t),
 	    offsetof(zstream_t, zs_node));
@@ -144,11 +158,13 @@ dmu_zfetch_fini(zfetch_t *zf)
 /*
  * If there aren't too many streams already, create a new stream.
  * The "blkid" argument is the next block that we expect this stream to access.
+ * For a reverse or strided stream ("stride" is not 0), it is the start of the
+ * access which is being made now, and is counted as its first hit.
  * While we're here, clean up old streams (which haven't been
  * accessed for at least zfetch_min_sec_reap seconds).
  */
-static void
-dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
+static zstream_t *
+dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid, int64_t stride)
 {
 	zstream_t *zs_next;
 	int numstreams = 0;
@@ -181,17 +197,215 @@ dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
 	    zfetch_max_distance));
 	if (numstreams >= max_streams) {
 		ZFETCHSTAT_BUMP(zfetchstat_max_streams);
-		return;
+		return (NULL);
 	}
 
 	zstream_t *zs = kmem_zalloc(sizeof (*zs), KM_SLEEP);
 	zs->zs_blkid = blkid;
 	zs->zs_pf_blkid = blkid;
 	zs->zs_ipf_blkid = blkid;
+	zs->zs_stride = stride;
 	zs->zs_atime = gethrtime();
 	mutex_init(&zs->zs_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	list_insert_head(&zf->zf_stream, zs);
+	return (zs);
+}
+
+/*
+ * Look for a reverse or strided pattern in the recent misses of this
+ * zfetch: the access at blkid is some distance away from one of them, which
+ * is itself (about) the same distance away from an older one.  Returns that
+ * distance, or 0 if there is no such pattern.
+ */
+static int64_t
+dmu_zfetch_stride_detect(zfetch_t *zf, uint64_t blkid, uint64_t nblks)
+{
+	int64_t max_stride =
+	    MAX(zfetch_max_distance >> zf->zf_dnode->dn_datablkshift, 1);
+
+	ASSERT(MUTEX_HELD(&zf->zf_lock));
+
+	for (int i = 0; i < ZFETCH_HIST_SIZE; i++) {
+		uint64_t h1 = zf->zf_hist[i];
+		int64_t stride = blkid - h1;
+
+		if (h1 == 0 || stride == 0 ||
+		    stride < -max_stride || stride > max_stride)
+			continue;
+
+		/* Forward sequential accesses are left to plain streams. */
+		if (stride > 0 && stride <= nblks)
+			continue;
+
+		for (int j = i + 1; j < ZFETCH_HIST_SIZE; j++) {
+			uint64_t h2 = zf->zf_hist[j];
+			int64_t diff = (int64_t)(h1 - h2) - stride;
+
+			/*
+			 * Accesses which aren't block-aligned may start a
+			 * block before or after where the stride puts them.
+			 */
+			if (h2 != 0 && diff >= -1 && diff <= 1)
+				return (stride);
+		}
+	}
+
+	return (0);
+}
+
+static void
+dmu_zfetch_hist_add(zfetch_t *zf, uint64_t blkid)
+{
+	ASSERT(MUTEX_HELD(&zf->zf_lock));
+
+	for (int i = ZFETCH_HIST_SIZE - 1; i > 0; i--)
+		zf->zf_hist[i] = zf->zf_hist[i - 1];
+	zf->zf_hist[0] = blkid;
+}
+
+/*
+ * Prefetches for a stream are issued by the pool's zfetch taskq, so that
+ * the reader only has to update the stream and never waits for them (or
+ * for dn_struct_rwlock).  The data blocks are za_naccess runs of za_nblks
+ * blocks, each za_stride blocks after the previous; when not fetching data
+ * only the level-1 blocks pointing to them are prefetched.  The level-1
+ * blocks from za_istart up to za_iend are prefetched as well.
+ */
+typedef struct zfetch_arg {
+	dnode_t		*za_dnode;
+	int64_t		za_start;
+	int64_t		za_stride;
+	int64_t		za_naccess;
+	uint64_t	za_nblks;
+	boolean_t	za_fetch_data;
+	int64_t		za_istart;
+	int64_t		za_iend;
+	taskq_ent_t	za_tqent;
+} zfetch_arg_t;
+
+static void
+dmu_zfetch_task(void *arg)
+{
+	zfetch_arg_t *za = arg;
+	dnode_t *dn = za->za_dnode;
+	spa_t *spa = dn->dn_objset->os_spa;
+	int epbs = dn->dn_indblkshift - SPA_BLKPTRSHIFT;
+	int64_t last_iblk = -1;
+
+	rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	for (int64_t i = 0; i < za->za_naccess; i++) {
+		int64_t start = za->za_start + i * za->za_stride;
+
+		for (int64_t b = MAX(start, 0);
+		    b < start + (int64_t)za->za_nblks; b++) {
+			if (za->za_fetch_data) {
+				dbuf_prefetch(dn, 0, b,
+				    ZIO_PRIORITY_ASYNC_READ,
+				    ARC_FLAG_PREDICTIVE_PREFETCH);
+			} else if ((b >> epbs) != last_iblk) {
+				last_iblk = b >> epbs;
+				dbuf_prefetch(dn, 1, last_iblk,
+				    ZIO_PRIORITY_ASYNC_READ,
+				    ARC_FLAG_PREDICTIVE_PREFETCH);
+			}
+		}
+	}
+	for (int64_t iblk = za->za_istart; iblk < za->za_iend; iblk++) {
+		dbuf_prefetch(dn, 1, iblk,
+		    ZIO_PRIORITY_ASYNC_READ, ARC_FLAG_PREDICTIVE_PREFETCH);
+	}
+	rw_exit(&dn->dn_struct_rwlock);
+
+	atomic_dec_64(&spa->spa_zfetch_queued);
+	dnode_rele(dn, za);
+	kmem_free(za, sizeof (*za));
+}
+
+/*
+ * Returns a zfetch_arg_t for prefetches on behalf of the given dnode, or
+ * NULL if there are already zfetch_max_queued of them waiting in this pool,
+ * in which case the prefetches are dropped.
+ */
+static zfetch_arg_t *
+dmu_zfetch_arg_alloc(dnode_t *dn)
+{
+	spa_t *spa = dn->dn_objset->os_spa;
+
+	if (atomic_inc_64_nv(&spa->spa_zfetch_queued) > zfetch_max_queued) {
+		atomic_dec_64(&spa->spa_zfetch_queued);
+		ZFETCHSTAT_BUMP(zfetchstat_max_queued);
+		return (NULL);
+	}
+
+	zfetch_arg_t *za = kmem_zalloc(sizeof (*za), KM_SLEEP);
+	taskq_init_ent(&za->za_tqent);
+	dnode_add_ref(dn, za);
+	za->za_dnode = dn;
+	return (za);
+}
+
+static void
+dmu_zfetch_dispatch(zfetch_arg_t *za)
+{
+	spa_t *spa = za->za_dnode->dn_objset->os_spa;
+
+	taskq_dispatch_ent(spa->spa_zfetch_taskq, dmu_zfetch_task, za, 0,
+	    &za->za_tqent);
+}
+
+/*
+ * The access at blkid belongs to the given reverse or strided stream; issue
+ * further prefetches for it.  Like for forward streams, we double the
+ * number of accesses that we are ahead of the reader by, but don't let the
+ * prefetched data get bigger than zfetch_max_distance.  Called with zf_lock
+ * and zs_lock held, which are dropped.
+ */
+static void
+dmu_zfetch_stride(zfetch_t *zf, zstream_t *zs, uint64_t blkid,
+    uint64_t nblks, boolean_t fetch_data)
+{
+	dnode_t *dn = zf->zf_dnode;
+	int64_t stride = zs->zs_stride;
+	int64_t dist, pf_start, pf_naccess, max_naccess;
+	boolean_t reverse = (stride < 0 && -stride <= nblks + 1);
+
+	ASSERT(MUTEX_HELD(&zf->zf_lock));
+	ASSERT(MUTEX_HELD(&zs->zs_lock));
+
+	/*
+	 * Previously, we were dist accesses ahead (zs_pf_blkid is the start
+	 * of the next access to prefetch).  Prefetch that many accesses
+	 * again, plus the one we are catching up by, starting no earlier
+	 * than the next access.
+	 */
+	dist = MAX(((int64_t)zs->zs_pf_blkid - (int64_t)blkid) / stride, 0);
+	pf_start = blkid + MAX(dist, 1) * stride;
+
+	max_naccess = (zfetch_max_distance >> dn->dn_datablkshift) / nblks;
+	pf_naccess = MAX(MIN(dist + 1, max_naccess - MAX(dist - 1, 0)), 0);
+
+	zs->zs_pf_blkid = pf_start + pf_naccess * stride;
+	zs->zs_atime = gethrtime();
+	zs->zs_blkid = blkid + stride;
+	mutex_exit(&zs->zs_lock);
+	mutex_exit(&zf->zf_lock);
+
+	zfetch_arg_t *za;
+	if (pf_naccess > 0 && (za = dmu_zfetch_arg_alloc(dn)) != NULL) {
+		za->za_start = pf_start;
+		za->za_stride = stride;
+		za->za_naccess = pf_naccess;
+		za->za_nblks = nblks;
+		za->za_fetch_data = fetch_data;
+		dmu_zfetch_dispatch(za);
+	}
+	ZFETCHSTAT_BUMP(zfetchstat_hits);
+	if (reverse) {
+		ZFETCHSTAT_BUMP(zfetchstat_reverse_hits);
+	} else {
+		ZFETCHSTAT_BUMP(zfetchstat_stride_hits);
+	}
 }
 
 /*
@@ -203,8 +417,7 @@ dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
  *   TRUE -- prefetch predicted data blocks plus following indirect blocks.
  */
 void
-dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data,
-    boolean_t have_lock)
+dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 {
 	zstream_t *zs;
 	int64_t pf_start, ipf_start, ipf_istart, ipf_iend;
@@ -233,18 +446,28 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data,
 	if (blkid == 0)
 		return;
 
-	if (!have_lock)
-		rw_enter(&zf->zf_dnode->dn_struct_rwlock, RW_READER);
 	mutex_enter(&zf->zf_lock);
 
 	/*
 	 * Find matching prefetch stream.  Depending on whether the accesses
 	 * are block-aligned, first block of the new access may either follow
-	 * the last block of the previous access, or be equal to it.
+	 * the last block of the previous access, or be equal to it.  For
+	 * reverse and strided streams, it may also be one past the expected
+	 * block.  zs_stride never changes, so it can be checked unlocked.
 	 */
 	for (zs = list_head(&zf->zf_stream); zs != NULL;
 	    zs = list_next(&zf->zf_stream, zs)) {
-		if (blkid == zs->zs_blkid || blkid + 1 == zs->zs_blkid) {
+		if (zs->zs_stride != 0) {
+			if (blkid + 1 >= zs->zs_blkid &&
+			    blkid <= zs->zs_blkid + 1) {
+				mutex_enter(&zs->zs_lock);
+				if (blkid + 1 >= zs->zs_blkid &&
+				    blkid <= zs->zs_blkid + 1)
+					break;
+				mutex_exit(&zs->zs_lock);
+			}
+		} else if (blkid == zs->zs_blkid ||
+		    blkid + 1 == zs->zs_blkid) {
 			mutex_enter(&zs->zs_lock);
 			/*
 			 * zs_blkid could have changed before we
@@ -259,10 +482,6 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data,
 					/* Already prefetched this before. */
 					mutex_exit(&zs->zs_lock);
 					mutex_exit(&zf->zf_lock);
-					if (!have_lock) {
-						rw_exit(&zf->zf_dnode->
-						    dn_struct_rwlock);
-					}
 					return;
 				}
 				break;
@@ -273,15 +492,37 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data,
 
 	if (zs == NULL) {
 		/*
-		 * This access is not part of any existing stream.  Create
-		 * a new stream for it.
+		 * This access is not part of any existing stream.  If it
+		 * completes a reverse or strided pattern with the recent
+		 * misses, start prefetching for that right away; otherwise
+		 * create a new (forward) stream for it.
 		 */
-		ZFETCHSTAT_BUMP(zfetchstat_misses);
+		int64_t stride = dmu_zfetch_stride_detect(zf, blkid, nblks);
+		dmu_zfetch_hist_add(zf, blkid);
+
+		if (stride != 0)
+			zs = dmu_zfetch_stream_create(zf, blkid, stride);
 
-		dmu_zfetch_stream_create(zf, end_of_access_blkid);
-		mutex_exit(&zf->zf_lock);
-		if (!have_lock)
-			rw_exit(&zf->zf_dnode->dn_struct_rwlock);
+		if (zs != NULL) {
+			if (stride < 0 && -stride <= nblks + 1) {
+				ZFETCHSTAT_BUMP(zfetchstat_reverse_streams);
+			} else {
+				ZFETCHSTAT_BUMP(zfetchstat_stride_streams);
+			}
+			mutex_enter(&zs->zs_lock);
+		} else {
+			ZFETCHSTAT_BUMP(zfetchstat_misses);
+
+			if (stride == 0)
+				(void) dmu_zfetch_stream_create(zf,
+				    end_of_access_blkid, 0);
+			mutex_exit(&zf->zf_lock);
+			return;
+		}
+	}
+
+	if (zs->zs_stride != 0) {
+		dmu_zfetch_stride(zf, zs, blkid, nblks, fetch_data);
 		return;
 	}
 
@@ -349,20 +590,20 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data,
 
 	/*
 	 * dbuf_prefetch() is asynchronous (even when it needs to read
-	 * indirect blocks), but we still prefer to drop our locks before
-	 * calling it to reduce the time we hold them.
+	 * indirect blocks), but walking the indirect blocks for a large
+	 * distance still takes a while, so leave it to the zfetch taskq.
 	 */
-
-	for (int i = 0; i < pf_nblks; i++) {
-		dbuf_prefetch(zf->zf_dnode, 0, pf_start + i,
-		    ZIO_PRIORITY_ASYNC_READ, ARC_FLAG_PREDICTIVE_PREFETCH);
+	zfetch_arg_t *za;
+	if ((pf_nblks > 0 || ipf_istart < ipf_iend) &&
+	    (za = dmu_zfetch_arg_alloc(zf->zf_dnode)) != NULL) {
+		za->za_start = pf_start;
+		za->za_naccess = (pf_nblks > 0);
+		za->za_nblks = pf_nblks;
+		za->za_fetch_data = B_TRUE;
+		za->za_istart = ipf_istart;
+		za->za_iend = ipf_iend;
+		dmu_zfetch_dispatch(za);
 	}
-	for (int64_t iblk = ipf_istart; iblk < ipf_iend; iblk++) {
-		dbuf_prefetch(zf->zf_dnode, 1, iblk,
-		    ZIO_PRIORITY_ASYNC_READ, ARC_FLAG_PREDICTIVE_PREFETCH);
-	}
-	if (!have_lock)
-		rw_exit(&zf->zf_dnode->dn_struct_rwlock);
 	ZFETCHSTAT_BUMP(zfetchstat_hits);
 }
 
@@ -383,5 +624,9 @@ MODULE_PARM_DESC(zfetch_max_distance,
 
 module_param(zfetch_array_rd_sz, ulong, 0644);
 MODULE_PARM_DESC(zfetch_array_rd_sz, "Number of bytes in a array_read");
+
+module_param(zfetch_max_queued, uint, 0644);
+MODULE_PARM_DESC(zfetch_max_queued,
+	"Max number of prefetch tasks queued per pool");
 /* END CSTYLED */
 #endif
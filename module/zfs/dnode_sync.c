@@ -546,7 +546,8 @@ dnode_undirty_dbufs(list_t *list)
 		db->db_dirtycnt -= 1;
 		if (db->db_level == 0) {
 			ASSERT(db->db_blkid == DMU_BONUS_BLKID ||
-			    dr->dt.dl.dr_data == db->db_buf);
+			    dr->dt.dl.dr_data == db->db_buf ||
+			    dr->dt.dl.dr_diowrite);
 			dbuf_unoverride(dr);
 		} else {
 			mutex_destroy(&dr->dt.di.dr_mtx);
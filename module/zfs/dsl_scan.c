@@ -89,6 +89,12 @@
  * I/O's issued since sequential I/O performance is significantly negatively
  * impacted if it is interleaved with random I/O.
  *
+ * By default the queues are only emptied while dsl_scan_sync() runs, which
+ * bounds the issuing time to a fraction of every txg. With
+ * zfs_scan_issue_async set, dsl_scan_sync() instead starts one issuing
+ * thread per top-level vdev and returns; the threads keep the vdev queues
+ * full until the next dsl_scan_sync() stops them and waits for their I/O.
+ *
  * Implementation Notes
  *
  * One side effect of the queued scanning algorithm is that the scanning code
@@ -148,6 +154,13 @@ int zfs_scan_strict_mem_lim = B_FALSE;
 unsigned long zfs_scan_vdev_limit = 4 << 20;
 
 int zfs_scan_issue_strategy = 0;
+
+/*
+ * Issue the sorted scan queues from threads that keep running between
+ * txgs, rather than only from syncing context (see scan_io_queues_start()).
+ */
+int zfs_scan_issue_async = 0;
+
 int zfs_scan_legacy = B_FALSE; /* don't queue & sort zios, go direct */
 unsigned long zfs_scan_max_ext_gap = 2 << 20; /* in bytes */
 
@@ -279,7 +292,7 @@ struct dsl_scan_io_queue {
 
 	/* trees used for sorting I/Os and extents of I/Os */
 	range_tree_t	*q_exts_by_addr;
-	avl_tree_t	q_exts_by_size;
+	zfs_btree_t	q_exts_by_size;
 	avl_tree_t	q_sios_by_addr;
 	uint64_t	q_sio_memused;
 
@@ -319,6 +332,8 @@ static void scan_io_queue_insert_impl(dsl_scan_io_queue_t *queue,
 
 static dsl_scan_io_queue_t *scan_io_queue_create(vdev_t *vd);
 static void scan_io_queues_destroy(dsl_scan_t *scn);
+static void scan_io_queues_stop(dsl_scan_t *scn);
+static void dsl_scan_update_stats(dsl_scan_t *scn);
 
 static kmem_cache_t *sio_cache[SPA_DVAS_PER_BP];
 
@@ -456,6 +471,12 @@ dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 	    sizeof (scan_prefetch_issue_ctx_t),
 	    offsetof(scan_prefetch_issue_ctx_t, spic_avl_node));
 
+	err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_LAST_SCRUBBED_TXG, sizeof (uint64_t), 1,
+	    &scn->scn_last_scrubbed_txg);
+	if (err != 0 && err != ENOENT)
+		return (err);
+
 	err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
 	    "scrub_func", sizeof (uint64_t), 1, &f);
 	if (err == 0) {
@@ -571,6 +592,7 @@ dsl_scan_fini(dsl_pool_t *dp)
 	if (dp->dp_scan != NULL) {
 		dsl_scan_t *scn = dp->dp_scan;
 
+		scan_io_queues_stop(scn);
 		if (scn->scn_taskq != NULL)
 			taskq_destroy(scn->scn_taskq);
 
@@ -600,6 +622,20 @@ dsl_scan_scrubbing(const dsl_pool_t *dp)
 	    scn_phys->scn_func == POOL_SCAN_SCRUB);
 }
 
+/*
+ * Returns B_TRUE until a running or paused scan has visited all the DDT
+ * classes it covers.
+ */
+boolean_t
+dsl_scan_walking_ddt(const dsl_pool_t *dp)
+{
+	dsl_scan_phys_t *scn_phys = &dp->dp_scan->scn_phys;
+
+	return (scn_phys->scn_state == DSS_SCANNING &&
+	    scn_phys->scn_ddt_bookmark.ddb_class <=
+	    scn_phys->scn_ddt_class_max);
+}
+
 boolean_t
 dsl_scan_is_paused_scrub(const dsl_scan_t *scn)
 {
@@ -637,6 +673,13 @@ dsl_scan_sync_state(dsl_scan_t *scn, dmu_tx_t *tx, state_sync_type_t sync_type)
 
 	ASSERT(sync_type != SYNC_MANDATORY || scn->scn_bytes_pending == 0);
 	if (scn->scn_bytes_pending == 0) {
+		/*
+		 * Asynchronous issuers may still have I/O in flight for the
+		 * last sios taken off the queues. Wait for it before
+		 * recording progress.
+		 */
+		scan_io_queues_stop(scn);
+
 		for (i = 0; i < spa->spa_root_vdev->vdev_children; i++) {
 			vdev_t *vd = spa->spa_root_vdev->vdev_child[i];
 			dsl_scan_io_queue_t *q = vd->vdev_scan_io_queue;
@@ -646,7 +689,8 @@ dsl_scan_sync_state(dsl_scan_t *scn, dmu_tx_t *tx, state_sync_type_t sync_type)
 
 			mutex_enter(&vd->vdev_scan_io_queue_lock);
 			ASSERT3P(avl_first(&q->q_sios_by_addr), ==, NULL);
-			ASSERT3P(avl_first(&q->q_exts_by_size), ==, NULL);
+			ASSERT3P(zfs_btree_first(&q->q_exts_by_size, NULL), ==,
+			    NULL);
 			ASSERT3P(range_tree_first(q->q_exts_by_addr), ==, NULL);
 			mutex_exit(&vd->vdev_scan_io_queue_lock);
 		}
@@ -673,6 +717,11 @@ dsl_scan_sync_state(dsl_scan_t *scn, dmu_tx_t *tx, state_sync_type_t sync_type)
 	}
 }
 
+typedef struct dsl_scan_setup_arg {
+	pool_scan_func_t dssa_func;
+	boolean_t dssa_incremental;	/* start from the last scrubbed txg */
+} dsl_scan_setup_arg_t;
+
 /* ARGSUSED */
 static int
 dsl_scan_setup_check(void *arg, dmu_tx_t *tx)
@@ -689,15 +738,16 @@ static void
 dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 {
 	dsl_scan_t *scn = dmu_tx_pool(tx)->dp_scan;
-	pool_scan_func_t *funcp = arg;
+	dsl_scan_setup_arg_t *dssa = arg;
 	dmu_object_type_t ot = 0;
 	dsl_pool_t *dp = scn->scn_dp;
 	spa_t *spa = dp->dp_spa;
 
 	ASSERT(!dsl_scan_is_running(scn));
-	ASSERT(*funcp > POOL_SCAN_NONE && *funcp < POOL_SCAN_FUNCS);
+	ASSERT(dssa->dssa_func > POOL_SCAN_NONE &&
+	    dssa->dssa_func < POOL_SCAN_FUNCS);
 	bzero(&scn->scn_phys, sizeof (scn->scn_phys));
-	scn->scn_phys.scn_func = *funcp;
+	scn->scn_phys.scn_func = dssa->dssa_func;
 	scn->scn_phys.scn_state = DSS_SCANNING;
 	scn->scn_phys.scn_min_txg = 0;
 	scn->scn_phys.scn_max_txg = tx->tx_txg;
@@ -712,6 +762,13 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 	scn->scn_checkpointing = B_FALSE;
 	spa_scan_stat_init(spa);
 
+	/*
+	 * The DDT walk keeps its position in a DDT log as a record index,
+	 * which a flush would invalidate, so the logs are merged into the
+	 * DDT objects now and bypassed until the walk is done.
+	 */
+	ddt_flush_logs(spa, tx);
+
 	if (DSL_SCAN_IS_SCRUB_RESILVER(scn)) {
 		scn->scn_phys.scn_ddt_class_max = zfs_scrub_ddt_class_max;
 
@@ -723,6 +780,20 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 			spa_event_notify(spa, NULL, NULL,
 			    ESC_ZFS_RESILVER_START);
 		} else {
+			/*
+			 * An incremental scrub only visits the blocks born
+			 * after the last complete scrub. This is only done
+			 * when no DTLs are outstanding, since the scrub then
+			 * gets to clear them for the whole txg range.
+			 */
+			if (dssa->dssa_incremental &&
+			    scn->scn_last_scrubbed_txg != 0) {
+				ASSERT3U(dssa->dssa_func, ==, POOL_SCAN_SCRUB);
+				scn->scn_phys.scn_min_txg =
+				    scn->scn_last_scrubbed_txg;
+				scn->scn_phys.scn_flags |=
+				    DSF_SCRUB_INCREMENTAL;
+			}
 			spa_event_notify(spa, NULL, NULL, ESC_ZFS_SCRUB_START);
 		}
 
@@ -758,19 +829,20 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 	dsl_scan_sync_state(scn, tx, SYNC_MANDATORY);
 
 	spa_history_log_internal(spa, "scan setup", tx,
-	    "func=%u mintxg=%llu maxtxg=%llu",
-	    *funcp, scn->scn_phys.scn_min_txg, scn->scn_phys.scn_max_txg);
+	    "func=%u mintxg=%llu maxtxg=%llu", dssa->dssa_func,
+	    scn->scn_phys.scn_min_txg, scn->scn_phys.scn_max_txg);
 }
 
 /*
  * Called by the ZFS_IOC_POOL_SCAN ioctl to start a scrub or resilver.
  * Can also be called to resume a paused scrub.
  */
-int
-dsl_scan(dsl_pool_t *dp, pool_scan_func_t func)
+static int
+dsl_scan_start(dsl_pool_t *dp, pool_scan_func_t func, boolean_t incremental)
 {
 	spa_t *spa = dp->dp_spa;
 	dsl_scan_t *scn = dp->dp_scan;
+	dsl_scan_setup_arg_t dssa = { func, incremental };
 
 	/*
 	 * Purge all vdev caches and probe all devices.  We do this here
@@ -803,7 +875,23 @@ dsl_scan(dsl_pool_t *dp, pool_scan_func_t func)
 	}
 
 	return (dsl_sync_task(spa_name(spa), dsl_scan_setup_check,
-	    dsl_scan_setup_sync, &func, 0, ZFS_SPACE_CHECK_EXTRA_RESERVED));
+	    dsl_scan_setup_sync, &dssa, 0, ZFS_SPACE_CHECK_EXTRA_RESERVED));
+}
+
+int
+dsl_scan(dsl_pool_t *dp, pool_scan_func_t func)
+{
+	return (dsl_scan_start(dp, func, B_FALSE));
+}
+
+/*
+ * Start a scrub which only verifies the blocks born after the last
+ * completed scrub, or a full scrub if the pool was never scrubbed.
+ */
+int
+dsl_scan_incremental(dsl_pool_t *dp)
+{
+	return (dsl_scan_start(dp, POOL_SCAN_SCRUB, B_TRUE));
 }
 
 /*
@@ -861,6 +949,8 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 	spa_t *spa = dp->dp_spa;
 	int i;
 
+	scan_io_queues_stop(scn);
+
 	/* Remove any remnants of an old-style scrub. */
 	for (i = 0; old_names[i]; i++) {
 		(void) zap_remove(dp->dp_meta_objset,
@@ -898,6 +988,20 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 
 	scn->scn_phys.scn_state = complete ? DSS_FINISHED : DSS_CANCELED;
 
+	/*
+	 * Remember up to which txg a complete scrub has verified the pool,
+	 * so that the next incremental scrub can skip the older blocks.
+	 * Scrubs limited to the range of outstanding DTLs don't count.
+	 */
+	if (complete && scn->scn_phys.scn_func == POOL_SCAN_SCRUB &&
+	    (scn->scn_phys.scn_min_txg == 0 ||
+	    (scn->scn_phys.scn_flags & DSF_SCRUB_INCREMENTAL))) {
+		scn->scn_last_scrubbed_txg = scn->scn_phys.scn_max_txg;
+		VERIFY0(zap_update(dp->dp_meta_objset,
+		    DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_LAST_SCRUBBED_TXG,
+		    sizeof (uint64_t), 1, &scn->scn_last_scrubbed_txg, tx));
+	}
+
 	if (dsl_scan_restarting(scn, tx))
 		spa_history_log_internal(spa, "scan aborted, restarting", tx,
 		    "errors=%llu", spa_get_errlog_size(spa));
@@ -928,7 +1032,8 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 			    scn->scn_phys.scn_max_txg, B_TRUE);
 
 			spa_event_notify(spa, NULL, NULL,
-			    scn->scn_phys.scn_min_txg ?
+			    scn->scn_phys.scn_min_txg != 0 &&
+			    !(scn->scn_phys.scn_flags & DSF_SCRUB_INCREMENTAL) ?
 			    ESC_ZFS_RESILVER_FINISH : ESC_ZFS_SCRUB_FINISH);
 		} else {
 			vdev_dtl_reassess(spa->spa_root_vdev, tx->tx_txg,
@@ -1235,8 +1340,8 @@ dsl_scan_should_clear(dsl_scan_t *scn)
 		queue = tvd->vdev_scan_io_queue;
 		if (queue != NULL) {
 			/* # extents in exts_by_size = # in exts_by_addr */
-			mused += avl_numnodes(&queue->q_exts_by_size) *
-			    sizeof (range_seg_t) + queue->q_sio_memused;
+			mused += zfs_btree_numnodes(&queue->q_exts_by_size) *
+			    sizeof (range_seg_gap_t) + queue->q_sio_memused;
 		}
 		mutex_exit(&tvd->vdev_scan_io_queue_lock);
 	}
@@ -2719,6 +2824,12 @@ scan_io_queues_update_seg_stats(dsl_scan_io_queue_t *q, uint64_t start,
 static boolean_t
 scan_io_queue_check_suspend(dsl_scan_t *scn)
 {
+	/* Asynchronous issuers run until scan_io_queues_stop() */
+	if (scn->scn_issue_root != NULL) {
+		return (scn->scn_issue_stop ||
+		    spa_shutting_down(scn->scn_dp->dp_spa));
+	}
+
 	/* See comment in dsl_scan_check_suspend() */
 	uint64_t curr_time_ns = gethrtime();
 	uint64_t scan_time_ns = curr_time_ns - scn->scn_sync_start_time;
@@ -2783,6 +2894,7 @@ scan_io_queue_issue(dsl_scan_io_queue_t *queue, list_t *io_list)
 static boolean_t
 scan_io_queue_gather(dsl_scan_io_queue_t *queue, range_seg_t *rs, list_t *list)
 {
+	range_tree_t *rt = queue->q_exts_by_addr;
 	scan_io_t *srch_sio, *sio, *next_sio;
 	avl_index_t idx;
 	uint_t num_sios = 0;
@@ -2791,9 +2903,12 @@ scan_io_queue_gather(dsl_scan_io_queue_t *queue, range_seg_t *rs, list_t *list)
 	ASSERT(rs != NULL);
 	ASSERT(MUTEX_HELD(&queue->q_vd->vdev_scan_io_queue_lock));
 
+	uint64_t rstart = rs_get_start(rs, rt);
+	uint64_t rend = rs_get_end(rs, rt);
+
 	srch_sio = sio_alloc(1);
 	srch_sio->sio_nr_dvas = 1;
-	SIO_SET_OFFSET(srch_sio, rs->rs_start);
+	SIO_SET_OFFSET(srch_sio, rstart);
 
 	/*
 	 * The exact start of the extent might not contain any matching zios,
@@ -2806,9 +2921,9 @@ scan_io_queue_gather(dsl_scan_io_queue_t *queue, range_seg_t *rs, list_t *list)
 		sio = avl_nearest(&queue->q_sios_by_addr, idx, AVL_AFTER);
 
 	while (sio != NULL &&
-	    SIO_GET_OFFSET(sio) < rs->rs_end && num_sios <= 32) {
-		ASSERT3U(SIO_GET_OFFSET(sio), >=, rs->rs_start);
-		ASSERT3U(SIO_GET_END_OFFSET(sio), <=, rs->rs_end);
+	    SIO_GET_OFFSET(sio) < rend && num_sios <= 32) {
+		ASSERT3U(SIO_GET_OFFSET(sio), >=, rstart);
+		ASSERT3U(SIO_GET_END_OFFSET(sio), <=, rend);
 
 		next_sio = AVL_NEXT(&queue->q_sios_by_addr, sio);
 		avl_remove(&queue->q_sios_by_addr, sio);
@@ -2826,20 +2941,43 @@ scan_io_queue_gather(dsl_scan_io_queue_t *queue, range_seg_t *rs, list_t *list)
 	 * in the segment we update it to reflect the work we were able to
 	 * complete. Otherwise, we remove it from the range tree entirely.
 	 */
-	if (sio != NULL && SIO_GET_OFFSET(sio) < rs->rs_end) {
-		range_tree_adjust_fill(queue->q_exts_by_addr, rs,
-		    -bytes_issued);
-		range_tree_resize_segment(queue->q_exts_by_addr, rs,
-		    SIO_GET_OFFSET(sio), rs->rs_end - SIO_GET_OFFSET(sio));
+	if (sio != NULL && SIO_GET_OFFSET(sio) < rend) {
+		range_tree_adjust_fill(rt, rs, -bytes_issued);
+		range_tree_resize_segment(rt, rs, SIO_GET_OFFSET(sio),
+		    rend - SIO_GET_OFFSET(sio));
 
 		return (B_TRUE);
 	} else {
-		range_tree_remove(queue->q_exts_by_addr, rs->rs_start,
-		    rs->rs_end - rs->rs_start);
+		range_tree_remove(rt, rstart, rend - rstart);
 		return (B_FALSE);
 	}
 }
 
+/*
+ * Returns the largest extent of the queue.  Since the extents in the
+ * q_exts_by_size tree are copies of those in q_exts_by_addr, look up the
+ * original, which is what the range tree functions need to be passed.
+ */
+static range_seg_t *
+scan_io_queue_largest_ext(dsl_scan_io_queue_t *queue)
+{
+	range_tree_t *rt = queue->q_exts_by_addr;
+	range_seg_t *size_rs = zfs_btree_first(&queue->q_exts_by_size, NULL);
+
+	if (size_rs == NULL)
+		return (NULL);
+
+	uint64_t start = rs_get_start(size_rs, rt);
+	uint64_t size = rs_get_end(size_rs, rt) - start;
+	range_seg_t *addr_rs = range_tree_find(rt, start, size);
+
+	ASSERT3P(addr_rs, !=, NULL);
+	ASSERT3U(rs_get_start(addr_rs, rt), ==, start);
+	ASSERT3U(rs_get_end(addr_rs, rt), ==, start + size);
+
+	return (addr_rs);
+}
+
 /*
  * This is called from the queue emptying thread and selects the next
  * extent from which we are to issue I/Os. The behavior of this function
@@ -2864,7 +3002,7 @@ scan_io_queue_fetch_ext(dsl_scan_io_queue_t *queue)
 		if (zfs_scan_issue_strategy == 1) {
 			return (range_tree_first(queue->q_exts_by_addr));
 		} else if (zfs_scan_issue_strategy == 2) {
-			return (avl_first(&queue->q_exts_by_size));
+			return (scan_io_queue_largest_ext(queue));
 		}
 	}
 
@@ -2880,7 +3018,7 @@ scan_io_queue_fetch_ext(dsl_scan_io_queue_t *queue)
 	if (scn->scn_checkpointing) {
 		return (range_tree_first(queue->q_exts_by_addr));
 	} else if (scn->scn_clearing) {
-		return (avl_first(&queue->q_exts_by_size));
+		return (scan_io_queue_largest_ext(queue));
 	} else {
 		return (NULL);
 	}
@@ -2973,6 +3111,26 @@ scan_io_queues_run_one(void *arg)
 	list_destroy(&sio_list);
 }
 
+static void
+scan_io_queues_taskq_create(dsl_scan_t *scn)
+{
+	spa_t *spa = scn->scn_dp->dp_spa;
+
+	if (scn->scn_taskq == NULL) {
+		int nthreads = spa->spa_root_vdev->vdev_children;
+
+		/*
+		 * We need to make this taskq *always* execute as many
+		 * threads in parallel as we have top-level vdevs and no
+		 * less, otherwise strange serialization of the calls to
+		 * scan_io_queues_run_one can occur during spa_sync runs
+		 * and that significantly impacts performance.
+		 */
+		scn->scn_taskq = taskq_create("dsl_scan_iss", nthreads,
+		    minclsyspri, nthreads, nthreads, TASKQ_PREPOPULATE);
+	}
+}
+
 /*
  * Performs an emptying run on all scan queues in the pool. This just
  * punches out one thread per top-level vdev, each of which processes
@@ -2993,19 +3151,7 @@ scan_io_queues_run(dsl_scan_t *scn)
 	if (scn->scn_bytes_pending == 0)
 		return;
 
-	if (scn->scn_taskq == NULL) {
-		int nthreads = spa->spa_root_vdev->vdev_children;
-
-		/*
-		 * We need to make this taskq *always* execute as many
-		 * threads in parallel as we have top-level vdevs and no
-		 * less, otherwise strange serialization of the calls to
-		 * scan_io_queues_run_one can occur during spa_sync runs
-		 * and that significantly impacts performance.
-		 */
-		scn->scn_taskq = taskq_create("dsl_scan_iss", nthreads,
-		    minclsyspri, nthreads, nthreads, TASKQ_PREPOPULATE);
-	}
+	scan_io_queues_taskq_create(scn);
 
 	for (uint64_t i = 0; i < spa->spa_root_vdev->vdev_children; i++) {
 		vdev_t *vd = spa->spa_root_vdev->vdev_child[i];
@@ -3027,6 +3173,152 @@ scan_io_queues_run(dsl_scan_t *scn)
 	taskq_wait(scn->scn_taskq);
 }
 
+/*
+ * Issuing thread of a top-level vdev's scan queue when zfs_scan_issue_async
+ * is set. Unlike scan_io_queues_run_one() this runs in open context, so the
+ * queue can be modified concurrently: extents are refetched for every batch
+ * of sios, and the config lock is only held while a batch is issued. The
+ * vdev is looked up by id each time because the queue may have been moved
+ * to a new top-level vdev (see dsl_scan_io_queue_vdev_xfer()) or destroyed
+ * while the lock was dropped. If a config change is waiting for the lock,
+ * the thread exits and issuing resumes in the next txg. Blocks freed while
+ * their sios are being issued are still safe to read since frees are
+ * deferred for several txgs, and the issuers are stopped every txg.
+ */
+static void
+scan_io_queue_issue_async(void *arg)
+{
+	dsl_scan_t *scn = arg;
+	spa_t *spa = scn->scn_dp->dp_spa;
+	uint64_t id = atomic_inc_64_nv(&scn->scn_issue_next_id) - 1;
+	boolean_t suspended = B_FALSE;
+	scan_io_t *sio;
+	list_t sio_list;
+
+	list_create(&sio_list, sizeof (scan_io_t),
+	    offsetof(scan_io_t, sio_nodes.sio_list_node));
+
+	while (!suspended && !scan_io_queue_check_suspend(scn) &&
+	    spa_config_tryenter(spa, SCL_CONFIG, FTAG, RW_READER)) {
+		dsl_scan_io_queue_t *queue = NULL;
+		range_seg_t *rs = NULL;
+		vdev_t *vd = NULL;
+
+		if (id < spa->spa_root_vdev->vdev_children) {
+			vd = spa->spa_root_vdev->vdev_child[id];
+			mutex_enter(&vd->vdev_scan_io_queue_lock);
+			queue = vd->vdev_scan_io_queue;
+			if (queue != NULL)
+				rs = scan_io_queue_fetch_ext(queue);
+			if (rs == NULL)
+				mutex_exit(&vd->vdev_scan_io_queue_lock);
+		}
+		if (rs == NULL) {
+			spa_config_exit(spa, SCL_CONFIG, FTAG);
+			break;
+		}
+
+		ASSERT(list_is_empty(&sio_list));
+		(void) scan_io_queue_gather(queue, rs, &sio_list);
+		scan_io_queues_update_seg_stats(queue,
+		    SIO_GET_OFFSET((scan_io_t *)list_head(&sio_list)),
+		    SIO_GET_END_OFFSET((scan_io_t *)list_tail(&sio_list)));
+		mutex_exit(&vd->vdev_scan_io_queue_lock);
+
+		suspended = scan_io_queue_issue(queue, &sio_list);
+
+		/* requeue any sios we did not get to */
+		mutex_enter(&vd->vdev_scan_io_queue_lock);
+		while ((sio = list_head(&sio_list)) != NULL) {
+			list_remove(&sio_list, sio);
+			scan_io_queue_insert_impl(queue, sio);
+		}
+		mutex_exit(&vd->vdev_scan_io_queue_lock);
+
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+	}
+
+	list_destroy(&sio_list);
+}
+
+/*
+ * Starts the asynchronous issuing threads, one per top-level vdev. They
+ * keep issuing from the queues until scan_io_queues_stop() is called by
+ * the next dsl_scan_sync(), or until the queues run dry.
+ */
+static void
+scan_io_queues_start(dsl_scan_t *scn)
+{
+	spa_t *spa = scn->scn_dp->dp_spa;
+	vdev_t *rvd = spa->spa_root_vdev;
+
+	ASSERT(scn->scn_is_sorted);
+	ASSERT(spa_config_held(spa, SCL_CONFIG, RW_READER));
+	ASSERT3P(scn->scn_issue_root, ==, NULL);
+
+	if (scn->scn_bytes_pending == 0)
+		return;
+
+	scan_io_queues_taskq_create(scn);
+
+	for (uint64_t i = 0; i < rvd->vdev_children; i++) {
+		vdev_t *vd = rvd->vdev_child[i];
+		dsl_scan_io_queue_t *queue;
+
+		mutex_enter(&vd->vdev_scan_io_queue_lock);
+		queue = vd->vdev_scan_io_queue;
+		if (queue != NULL) {
+			queue->q_maxinflight_bytes =
+			    MAX(dsl_scan_count_leaves(vd) * zfs_scan_vdev_limit,
+			    1ULL << 20);
+			queue->q_total_seg_size_this_txg = 0;
+			queue->q_segs_this_txg = 0;
+			queue->q_total_zio_size_this_txg = 0;
+			queue->q_zios_this_txg = 0;
+		}
+		mutex_exit(&vd->vdev_scan_io_queue_lock);
+	}
+
+	scn->scn_issue_root = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	scn->scn_issue_stop = B_FALSE;
+	scn->scn_issue_next_id = 0;
+	scn->scn_issue_start_time = gethrtime();
+
+	for (uint64_t i = 0; i < rvd->vdev_children; i++) {
+		VERIFY(taskq_dispatch(scn->scn_taskq,
+		    scan_io_queue_issue_async, scn, TQ_SLEEP) !=
+		    TASKQID_INVALID);
+	}
+}
+
+/*
+ * Stops the asynchronous issuing threads, if running, and waits for all
+ * the I/O they issued. This must be done in syncing context before the
+ * scan state or the queues are modified (other than by inserting and
+ * freeing sios, which is done under the queue locks).
+ */
+static void
+scan_io_queues_stop(dsl_scan_t *scn)
+{
+	if (scn->scn_issue_root == NULL)
+		return;
+
+	scn->scn_issue_stop = B_TRUE;
+	taskq_wait(scn->scn_taskq);
+	(void) zio_wait(scn->scn_issue_root);
+	scn->scn_issue_root = NULL;
+	scn->scn_issue_stop = B_FALSE;
+
+	dsl_scan_update_stats(scn);
+	zfs_dbgmsg("scan issued %llu blocks (%llu segs) asynchronously in "
+	    "%llums (avg_block_size = %llu, avg_seg_size = %llu)",
+	    (longlong_t)scn->scn_zios_this_txg,
+	    (longlong_t)scn->scn_segs_this_txg,
+	    (longlong_t)NSEC2MSEC(gethrtime() - scn->scn_issue_start_time),
+	    (longlong_t)scn->scn_avg_zio_size_this_txg,
+	    (longlong_t)scn->scn_avg_seg_size_this_txg);
+}
+
 static boolean_t
 dsl_scan_async_block_should_pause(dsl_scan_t *scn)
 {
@@ -3386,13 +3678,13 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 	 */
 	if (dsl_scan_restarting(scn, tx) ||
 	    (spa->spa_resilver_deferred && zfs_resilver_disable_defer)) {
-		pool_scan_func_t func = POOL_SCAN_SCRUB;
+		dsl_scan_setup_arg_t dssa = { POOL_SCAN_SCRUB, B_FALSE };
 		dsl_scan_done(scn, B_FALSE, tx);
 		if (vdev_resilver_needed(spa->spa_root_vdev, NULL, NULL))
-			func = POOL_SCAN_RESILVER;
+			dssa.dssa_func = POOL_SCAN_RESILVER;
 		zfs_dbgmsg("restarting scan func=%u txg=%llu",
-		    func, (longlong_t)tx->tx_txg);
-		dsl_scan_setup_sync(&func, tx);
+		    dssa.dssa_func, (longlong_t)tx->tx_txg);
+		dsl_scan_setup_sync(&dssa, tx);
 	}
 
 	/*
@@ -3401,6 +3693,12 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 	if (spa_sync_pass(spa) > 1)
 		return;
 
+	/*
+	 * Collect the asynchronous issuers started in the last txg before
+	 * touching the queues or the scan state.
+	 */
+	scan_io_queues_stop(scn);
+
 	/*
 	 * If the spa is shutting down, then stop scanning. This will
 	 * ensure that the scan does not dirty any new data during the
@@ -3603,25 +3901,35 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 	} else if (scn->scn_is_sorted && scn->scn_bytes_pending != 0) {
 		ASSERT(scn->scn_clearing);
 
-		/* need to issue scrubbing IOs from per-vdev queues */
-		scn->scn_zio_root = zio_root(dp->dp_spa, NULL,
-		    NULL, ZIO_FLAG_CANFAIL);
-		scan_io_queues_run(scn);
-		(void) zio_wait(scn->scn_zio_root);
-		scn->scn_zio_root = NULL;
-
-		/* calculate and dprintf the current memory usage */
-		(void) dsl_scan_should_clear(scn);
-		dsl_scan_update_stats(scn);
-
-		zfs_dbgmsg("scan issued %llu blocks (%llu segs) in %llums "
-		    "(avg_block_size = %llu, avg_seg_size = %llu)",
-		    (longlong_t)scn->scn_zios_this_txg,
-		    (longlong_t)scn->scn_segs_this_txg,
-		    (longlong_t)NSEC2MSEC(gethrtime() -
-		    scn->scn_sync_start_time),
-		    (longlong_t)scn->scn_avg_zio_size_this_txg,
-		    (longlong_t)scn->scn_avg_seg_size_this_txg);
+		/*
+		 * With zfs_scan_issue_async the issuers keep running in
+		 * open context and are collected by the next sync.
+		 */
+		if (zfs_scan_issue_async) {
+			scan_io_queues_start(scn);
+			(void) dsl_scan_should_clear(scn);
+		} else {
+			/* need to issue scrubbing IOs from per-vdev queues */
+			scn->scn_zio_root = zio_root(dp->dp_spa, NULL,
+			    NULL, ZIO_FLAG_CANFAIL);
+			scan_io_queues_run(scn);
+			(void) zio_wait(scn->scn_zio_root);
+			scn->scn_zio_root = NULL;
+
+			/* calculate and dprintf the current memory usage */
+			(void) dsl_scan_should_clear(scn);
+			dsl_scan_update_stats(scn);
+
+			zfs_dbgmsg("scan issued %llu blocks (%llu segs) in "
+			    "%llums (avg_block_size = %llu, "
+			    "avg_seg_size = %llu)",
+			    (longlong_t)scn->scn_zios_this_txg,
+			    (longlong_t)scn->scn_segs_this_txg,
+			    (longlong_t)NSEC2MSEC(gethrtime() -
+			    scn->scn_sync_start_time),
+			    (longlong_t)scn->scn_avg_zio_size_this_txg,
+			    (longlong_t)scn->scn_avg_seg_size_this_txg);
+		}
 	} else if (scn->scn_done_txg != 0 && scn->scn_done_txg <= tx->tx_txg) {
 		/* Finished with everything. Mark the scrub as complete */
 		zfs_dbgmsg("scan issuing complete txg %llu",
@@ -3930,7 +4238,8 @@ scan_exec_io(dsl_pool_t *dp, const blkptr_t *bp, int zio_flags,
 	}
 
 	count_block(scn, dp->dp_blkstats, bp);
-	zio_nowait(zio_read(scn->scn_zio_root, spa, bp, data, size,
+	zio_nowait(zio_read(queue != NULL && scn->scn_issue_root != NULL ?
+	    scn->scn_issue_root : scn->scn_zio_root, spa, bp, data, size,
 	    dsl_scan_scrub_done, queue, ZIO_PRIORITY_SCRUB, zio_flags, zb));
 }
 
@@ -3969,7 +4278,7 @@ scan_exec_io(dsl_pool_t *dp, const blkptr_t *bp, int zio_flags,
 static int
 ext_size_compare(const void *x, const void *y)
 {
-	const range_seg_t *rsa = x, *rsb = y;
+	const range_seg_gap_t *rsa = x, *rsb = y;
 	uint64_t sa = rsa->rs_end - rsa->rs_start,
 	    sb = rsb->rs_end - rsb->rs_start;
 	uint64_t score_a, score_b;
@@ -4014,8 +4323,8 @@ scan_io_queue_create(vdev_t *vd)
 	q->q_vd = vd;
 	q->q_sio_memused = 0;
 	cv_init(&q->q_zio_cv, NULL, CV_DEFAULT, NULL);
-	q->q_exts_by_addr = range_tree_create_impl(&rt_avl_ops,
-	    &q->q_exts_by_size, ext_size_compare, zfs_scan_max_ext_gap);
+	q->q_exts_by_addr = range_tree_create_impl(&rt_btree_ops, RANGE_SEG_GAP,
+	    &q->q_exts_by_size, 0, 0, ext_size_compare, zfs_scan_max_ext_gap);
 	avl_create(&q->q_sios_by_addr, sio_addr_compare,
 	    sizeof (scan_io_t), offsetof(scan_io_t, sio_nodes.sio_addr_node));
 
@@ -4037,6 +4346,12 @@ dsl_scan_io_queue_destroy(dsl_scan_io_queue_t *queue)
 
 	ASSERT(MUTEX_HELD(&queue->q_vd->vdev_scan_io_queue_lock));
 
+	/* asynchronous issuers may still have I/O in flight */
+	while (queue->q_inflight_bytes != 0) {
+		cv_wait(&queue->q_zio_cv,
+		    &queue->q_vd->vdev_scan_io_queue_lock);
+	}
+
 	while ((sio = avl_destroy_nodes(&queue->q_sios_by_addr, &cookie)) !=
 	    NULL) {
 		ASSERT(range_tree_contains(queue->q_exts_by_addr,
@@ -4231,6 +4546,10 @@ MODULE_PARM_DESC(zfs_free_bpobj_enabled, "Enable processing of the free_bpobj");
 module_param(zfs_scan_mem_lim_fact, int, 0644);
 MODULE_PARM_DESC(zfs_scan_mem_lim_fact, "Fraction of RAM for scan hard limit");
 
+module_param(zfs_scan_issue_async, int, 0644);
+MODULE_PARM_DESC(zfs_scan_issue_async,
+	"Issue sorted scrub IOs from open context between txg syncs");
+
 module_param(zfs_scan_issue_strategy, int, 0644);
 MODULE_PARM_DESC(zfs_scan_issue_strategy,
 	"IO issuing strategy during scrubbing. 0 = default, 1 = LBA, 2 = size");
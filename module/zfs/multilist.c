@@ -68,7 +68,7 @@ multilist_d2l(multilist_t *ml, void *obj)
  *     requirement, but a general rule of thumb in order to garner the
  *     best multi-threaded performance out of the data structure.
  */
-static multilist_t *
+multilist_t *
 multilist_create_impl(size_t size, size_t offset,
     unsigned int num, multilist_sublist_index_func_t *index_func)
 {
@@ -96,23 +96,27 @@ multilist_create_impl(size_t size, size_t offset,
 }
 
 /*
- * Allocate a new multilist, using the default number of sublists
- * (the number of CPUs, or at least 4, or the tunable
- * zfs_multilist_num_sublists).
+ * Return the default number of sublists: the number of CPUs, or at
+ * least 4, or the tunable zfs_multilist_num_sublists.
+ */
+unsigned int
+multilist_get_default_num_sublists(void)
+{
+	if (zfs_multilist_num_sublists > 0)
+		return (zfs_multilist_num_sublists);
+
+	return (MAX(boot_ncpus, 4));
+}
+
+/*
+ * Allocate a new multilist, using the default number of sublists.
  */
 multilist_t *
 multilist_create(size_t size, size_t offset,
     multilist_sublist_index_func_t *index_func)
 {
-	int num_sublists;
-
-	if (zfs_multilist_num_sublists > 0) {
-		num_sublists = zfs_multilist_num_sublists;
-	} else {
-		num_sublists = MAX(boot_ncpus, 4);
-	}
-
-	return (multilist_create_impl(size, offset, num_sublists, index_func));
+	return (multilist_create_impl(size, offset,
+	    multilist_get_default_num_sublists(), index_func));
 }
 
 /*
@@ -57,8 +57,10 @@
 #include <sys/vdev_indirect_mapping.h>
 #include <sys/vdev_indirect_births.h>
 #include <sys/vdev_initialize.h>
+#include <sys/vdev_rebuild.h>
 #include <sys/vdev_trim.h>
 #include <sys/vdev_disk.h>
+#include <sys/vdev_raidz.h>
 #include <sys/metaslab.h>
 #include <sys/metaslab_impl.h>
 #include <sys/mmp.h>
@@ -304,6 +306,8 @@ spa_prop_get_config(spa_t *spa, nvlist_t **nvp)
 
 		spa_prop_add_list(*nvp, ZPOOL_PROP_DEDUPRATIO, NULL,
 		    ddt_get_pool_dedup_ratio(spa), src);
+		spa_prop_add_list(*nvp, ZPOOL_PROP_DEDUP_TABLE_SIZE, NULL,
+		    ddt_get_ddt_dsize(spa), src);
 
 		spa_prop_add_list(*nvp, ZPOOL_PROP_HEALTH, NULL,
 		    rvd->vdev_state, src);
@@ -572,6 +576,13 @@ spa_prop_validate(spa_t *spa, nvlist_t *props)
 
 			break;
 
+		case ZPOOL_PROP_DEDUP_TABLE_QUOTA:
+			error = nvpair_value_uint64(elem, &intval);
+			if (!error && intval != 0 &&
+			    spa_version(spa) < SPA_VERSION_DEDUP)
+				error = SET_ERROR(ENOTSUP);
+			break;
+
 		case ZPOOL_PROP_BOOTFS:
 			/*
 			 * If the pool version is less than SPA_VERSION_BOOTFS,
@@ -1266,6 +1277,15 @@ spa_activate(spa_t *spa, int mode)
 	spa->spa_prefetch_taskq = taskq_create("z_prefetch", boot_ncpus,
 	    defclsyspri, 1, INT_MAX, TASKQ_DYNAMIC);
 
+	/*
+	 * Taskq which issues the predictive prefetches of dmu_zfetch(), so
+	 * that readers don't wait for them.  All entries are dispatched with
+	 * taskq_dispatch_ent(), and their number is bounded by
+	 * zfetch_max_queued.
+	 */
+	spa->spa_zfetch_taskq = taskq_create("z_zfetch", boot_ncpus,
+	    defclsyspri, 1, INT_MAX, TASKQ_DYNAMIC);
+
 	/*
 	 * The taskq to upgrade datasets in this pool. Currently used by
 	 * feature SPA_FEATURE_USEROBJ_ACCOUNTING/SPA_FEATURE_PROJECT_QUOTA.
@@ -1298,6 +1318,11 @@ spa_deactivate(spa_t *spa)
 		spa->spa_prefetch_taskq = NULL;
 	}
 
+	if (spa->spa_zfetch_taskq) {
+		taskq_destroy(spa->spa_zfetch_taskq);
+		spa->spa_zfetch_taskq = NULL;
+	}
+
 	if (spa->spa_upgrade_taskq) {
 		taskq_destroy(spa->spa_upgrade_taskq);
 		spa->spa_upgrade_taskq = NULL;
@@ -1512,8 +1537,14 @@ spa_unload(spa_t *spa)
 		vdev_initialize_stop_all(root_vdev, VDEV_INITIALIZE_ACTIVE);
 		vdev_trim_stop_all(root_vdev, VDEV_TRIM_ACTIVE);
 		vdev_autotrim_stop_all(spa);
+		vdev_rebuild_stop_all(spa);
 	}
 
+	/*
+	 * Stop any L2ARC rebuilds still in progress.
+	 */
+	l2arc_spa_rebuild_stop(spa);
+
 	/*
 	 * Stop syncing.
 	 */
@@ -1562,6 +1593,11 @@ spa_unload(spa_t *spa)
 		spa->spa_checkpoint_discard_zthr = NULL;
 	}
 
+	if (spa->spa_raidz_expand_zthr != NULL) {
+		zthr_destroy(spa->spa_raidz_expand_zthr);
+		spa->spa_raidz_expand_zthr = NULL;
+	}
+
 	spa_condense_fini(spa);
 
 	bpobj_close(&spa->spa_deferred_bpobj);
@@ -2348,6 +2384,8 @@ spa_spawn_aux_threads(spa_t *spa)
 	spa->spa_checkpoint_discard_zthr =
 	    zthr_create(spa_checkpoint_discard_thread_check,
 	    spa_checkpoint_discard_thread, spa);
+
+	spa_start_raidz_expansion_thread(spa);
 }
 
 /*
@@ -3667,6 +3705,8 @@ spa_ld_get_props(spa_t *spa)
 		spa_prop_find(spa, ZPOOL_PROP_AUTOEXPAND, &spa->spa_autoexpand);
 		spa_prop_find(spa, ZPOOL_PROP_MULTIHOST, &spa->spa_multihost);
 		spa_prop_find(spa, ZPOOL_PROP_AUTOTRIM, &spa->spa_autotrim);
+		spa_prop_find(spa, ZPOOL_PROP_DEDUP_TABLE_QUOTA,
+		    &spa->spa_dedup_table_quota);
 		spa->spa_autoreplace = (autoreplace != 0);
 	}
 
@@ -4243,6 +4283,15 @@ spa_load_impl(spa_t *spa, spa_import_type_t type, char **ereport)
 			return (error);
 	}
 
+	/*
+	 * If we crashed while the start of a raidz vdev being expanded was
+	 * reflowed through the scratch area, finish copying it into place
+	 * before anything else can write to the pool.
+	 */
+	if (spa_writeable(spa) && spa->spa_raidz_expand != NULL &&
+	    RRSS_GET_STATE(&spa->spa_uberblock) == RRSS_SCRATCH_VALID)
+		vdev_raidz_reflow_copy_scratch(spa);
+
 	/*
 	 * Retrieve the checkpoint txg if the pool has a checkpoint.
 	 */
@@ -4398,6 +4447,11 @@ spa_load_impl(spa_t *spa, spa_import_type_t type, char **ereport)
 		    vdev_resilver_needed(spa->spa_root_vdev, NULL, NULL))
 			spa_async_request(spa, SPA_ASYNC_RESILVER);
 
+		/*
+		 * Restore the contents of any persistent L2ARC devices.
+		 */
+		spa_async_request(spa, SPA_ASYNC_L2CACHE_REBUILD);
+
 		/*
 		 * Log the fact that we booted up (so that we can detect if
 		 * we rebooted in the middle of an operation).
@@ -5437,6 +5491,8 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	spa->spa_autoexpand = zpool_prop_default_numeric(ZPOOL_PROP_AUTOEXPAND);
 	spa->spa_multihost = zpool_prop_default_numeric(ZPOOL_PROP_MULTIHOST);
 	spa->spa_autotrim = zpool_prop_default_numeric(ZPOOL_PROP_AUTOTRIM);
+	spa->spa_dedup_table_quota =
+	    zpool_prop_default_numeric(ZPOOL_PROP_DEDUP_TABLE_QUOTA);
 
 	if (props != NULL) {
 		spa_configfile_set(spa, props, B_FALSE);
@@ -5864,6 +5920,7 @@ spa_export_common(char *pool, int new_state, nvlist_t **oldconfig,
 			vdev_initialize_stop_all(rvd, VDEV_INITIALIZE_ACTIVE);
 			vdev_trim_stop_all(rvd, VDEV_TRIM_ACTIVE);
 			vdev_autotrim_stop_all(spa);
+			vdev_rebuild_stop_all(spa);
 		}
 
 		/*
@@ -6087,9 +6144,14 @@ spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
  * extra rules: you can't attach to it after it's been created, and upon
  * completion of resilvering, the first disk (the one being replaced)
  * is automatically detached.
+ *
+ * If 'rebuild' is specified, the new device is populated by a sequential
+ * rebuild of the allocated space (see vdev_rebuild.c) instead of a resilver.
+ * This is only supported for mirrors.
  */
 int
-spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
+spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
+    int rebuild)
 {
 	uint64_t txg, dtl_max_txg;
 	ASSERTV(vdev_t *rvd = spa->spa_root_vdev);
@@ -6097,6 +6159,7 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	vdev_ops_t *pvops;
 	char *oldvdpath, *newvdpath;
 	int newvd_isspare;
+	boolean_t raidz;
 	int error;
 
 	ASSERT(spa_writeable(spa));
@@ -6118,10 +6181,45 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	if (oldvd == NULL)
 		return (spa_vdev_exit(spa, NULL, txg, ENODEV));
 
-	if (!oldvd->vdev_ops->vdev_op_leaf)
+	/*
+	 * Attaching to a raidz vdev itself (rather than to one of its
+	 * children) expands it by one child.
+	 */
+	raidz = (oldvd->vdev_ops == &vdev_raidz_ops);
+
+	if (raidz) {
+		if (!spa_feature_is_enabled(spa, SPA_FEATURE_RAIDZ_EXPANSION))
+			return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+
+		/* Only one expansion may be in progress at a time. */
+		if (spa->spa_raidz_expand != NULL) {
+			return (spa_vdev_exit(spa, NULL, txg,
+			    ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS));
+		}
+
+		if (replacing || oldvd != oldvd->vdev_top)
+			return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+	} else if (!oldvd->vdev_ops->vdev_op_leaf) {
 		return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+	}
 
-	pvd = oldvd->vdev_parent;
+	/*
+	 * A rebuild copies whole ranges of the top-level vdev, which only
+	 * yields a valid copy when it is made up of mirrors.
+	 */
+	if (rebuild) {
+		vdev_ops_t *tops = oldvd->vdev_top->vdev_ops;
+
+		if (raidz || (oldvd != oldvd->vdev_top &&
+		    tops != &vdev_mirror_ops && tops != &vdev_replacing_ops &&
+		    tops != &vdev_spare_ops))
+			return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+	}
+
+	if (raidz)
+		pvd = oldvd;
+	else
+		pvd = oldvd->vdev_parent;
 
 	if ((error = spa_config_parse(spa, &newrootvd, nvroot, NULL, 0,
 	    VDEV_ALLOC_ATTACH)) != 0)
@@ -6147,13 +6245,13 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	if (!replacing) {
 		/*
 		 * For attach, the only allowable parent is a mirror or the root
-		 * vdev.
+		 * vdev, unless we're expanding a raidz vdev.
 		 */
 		if (pvd->vdev_ops != &vdev_mirror_ops &&
-		    pvd->vdev_ops != &vdev_root_ops)
+		    pvd->vdev_ops != &vdev_root_ops && !raidz)
 			return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
 
-		pvops = &vdev_mirror_ops;
+		pvops = raidz ? &vdev_raidz_ops : &vdev_mirror_ops;
 	} else {
 		/*
 		 * Active hot spares can only be replaced by inactive hot
@@ -6189,7 +6287,8 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	/*
 	 * Make sure the new device is big enough.
 	 */
-	if (newvd->vdev_asize < vdev_get_min_asize(oldvd))
+	vdev_t *min_vdev = raidz ? oldvd->vdev_child[0] : oldvd;
+	if (newvd->vdev_asize < vdev_get_min_asize(min_vdev))
 		return (spa_vdev_exit(spa, newrootvd, txg, EOVERFLOW));
 
 	/*
@@ -6199,11 +6298,49 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	if (newvd->vdev_ashift > oldvd->vdev_top->vdev_ashift)
 		return (spa_vdev_exit(spa, newrootvd, txg, EDOM));
 
+	if (raidz) {
+		/*
+		 * The reflow reads every child, so they must all be healthy
+		 * leaves (i.e. not being replaced).
+		 */
+		for (int c = 0; c < oldvd->vdev_children; c++) {
+			vdev_t *cvd = oldvd->vdev_child[c];
+
+			if (vdev_is_dead(cvd) || !cvd->vdev_ops->vdev_op_leaf)
+				return (spa_vdev_exit(spa, newrootvd, txg,
+				    ENXIO));
+		}
+
+		/*
+		 * The start of the vdev is reflowed through the boot area of
+		 * the children, which must hold at least two rows of the new
+		 * width.
+		 */
+		if ((2ULL * (oldvd->vdev_children + 1)) << oldvd->vdev_ashift >
+		    VDEV_BOOT_SIZE)
+			return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
+
+		/*
+		 * Let the youngest allocations and frees sync (and the
+		 * deferral of those frees finish), and stop initializing and
+		 * TRIM, which don't know about the new layout, before adding
+		 * the new child.
+		 */
+		spa_vdev_config_exit(spa, NULL,
+		    txg + TXG_CONCURRENT_STATES + TXG_DEFER_SIZE, 0, FTAG);
+
+		vdev_initialize_stop_all(oldvd, VDEV_INITIALIZE_ACTIVE);
+		vdev_trim_stop_all(oldvd, VDEV_TRIM_ACTIVE);
+		vdev_autotrim_stop_wait(oldvd);
+
+		txg = spa_vdev_config_enter(spa);
+	}
+
 	/*
 	 * If this is an in-place replacement, update oldvd's path and devid
 	 * to make it distinguishable from newvd, and unopenable from now on.
 	 */
-	if (strcmp(oldvd->vdev_path, newvd->vdev_path) == 0) {
+	if (!raidz && strcmp(oldvd->vdev_path, newvd->vdev_path) == 0) {
 		spa_strfree(oldvd->vdev_path);
 		oldvd->vdev_path = kmem_alloc(strlen(newvd->vdev_path) + 5,
 		    KM_SLEEP);
@@ -6216,7 +6353,11 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	}
 
 	/* mark the device being resilvered */
-	newvd->vdev_resilver_txg = txg;
+	if (!raidz) {
+		newvd->vdev_resilver_txg = txg;
+		if (rebuild)
+			newvd->vdev_rebuild_txg = txg;
+	}
 
 	/*
 	 * If the parent is not a mirror, or if we're replacing, insert the new
@@ -6227,7 +6368,7 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 
 	ASSERT(pvd->vdev_top->vdev_parent == rvd);
 	ASSERT(pvd->vdev_ops == pvops);
-	ASSERT(oldvd->vdev_parent == pvd);
+	ASSERT(raidz || oldvd->vdev_parent == pvd);
 
 	/*
 	 * Extract the new device from its root and add it to pvd.
@@ -6246,43 +6387,74 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	ASSERT(pvd->vdev_top == tvd);
 	ASSERT(tvd->vdev_parent == rvd);
 
-	vdev_config_dirty(tvd);
+	if (raidz) {
+		/*
+		 * The new child has no data to resilver; the reflow is
+		 * started by vdev_raidz_attach_sync() in this txg.
+		 */
+		dtl_max_txg = txg;
+		tvd->vdev_rz_expanding = B_TRUE;
 
-	/*
-	 * Set newvd's DTL to [TXG_INITIAL, dtl_max_txg) so that we account
-	 * for any dmu_sync-ed blocks.  It will propagate upward when
-	 * spa_vdev_exit() calls vdev_dtl_reassess().
-	 */
-	dtl_max_txg = txg + TXG_CONCURRENT_STATES;
+		vdev_dirty_leaves(tvd, VDD_DTL, dtl_max_txg);
+		vdev_config_dirty(tvd);
 
-	vdev_dtl_dirty(newvd, DTL_MISSING, TXG_INITIAL,
-	    dtl_max_txg - TXG_INITIAL);
+		dmu_tx_t *tx = dmu_tx_create_assigned(spa->spa_dsl_pool,
+		    dtl_max_txg);
+		dsl_sync_task_nowait(spa->spa_dsl_pool, vdev_raidz_attach_sync,
+		    newvd, 0, ZFS_SPACE_CHECK_NONE, tx);
+		dmu_tx_commit(tx);
 
-	if (newvd->vdev_isspare) {
-		spa_spare_activate(newvd);
-		spa_event_notify(spa, newvd, NULL, ESC_ZFS_VDEV_SPARE);
-	}
+		char tvdname[32];
+		(void) snprintf(tvdname, sizeof (tvdname), "%s%llu-%llu",
+		    VDEV_TYPE_RAIDZ, (u_longlong_t)oldvd->vdev_nparity,
+		    (u_longlong_t)oldvd->vdev_id);
+		oldvdpath = spa_strdup(tvdname);
+		newvdpath = spa_strdup(newvd->vdev_path);
+		newvd_isspare = B_FALSE;
+	} else {
+		vdev_config_dirty(tvd);
 
-	oldvdpath = spa_strdup(oldvd->vdev_path);
-	newvdpath = spa_strdup(newvd->vdev_path);
-	newvd_isspare = newvd->vdev_isspare;
+		/*
+		 * Set newvd's DTL to [TXG_INITIAL, dtl_max_txg) so that we
+		 * account for any dmu_sync-ed blocks.  It will propagate
+		 * upward when spa_vdev_exit() calls vdev_dtl_reassess().
+		 */
+		dtl_max_txg = txg + TXG_CONCURRENT_STATES;
 
-	/*
-	 * Mark newvd's DTL dirty in this txg.
-	 */
-	vdev_dirty(tvd, VDD_DTL, newvd, txg);
+		vdev_dtl_dirty(newvd, DTL_MISSING, TXG_INITIAL,
+		    dtl_max_txg - TXG_INITIAL);
 
-	/*
-	 * Schedule the resilver to restart in the future. We do this to
-	 * ensure that dmu_sync-ed blocks have been stitched into the
-	 * respective datasets. We do not do this if resilvers have been
-	 * deferred.
-	 */
-	if (dsl_scan_resilvering(spa_get_dsl(spa)) &&
-	    spa_feature_is_enabled(spa, SPA_FEATURE_RESILVER_DEFER))
-		vdev_set_deferred_resilver(spa, newvd);
-	else
-		dsl_resilver_restart(spa->spa_dsl_pool, dtl_max_txg);
+		if (newvd->vdev_isspare) {
+			spa_spare_activate(newvd);
+			spa_event_notify(spa, newvd, NULL, ESC_ZFS_VDEV_SPARE);
+		}
+
+		oldvdpath = spa_strdup(oldvd->vdev_path);
+		newvdpath = spa_strdup(newvd->vdev_path);
+		newvd_isspare = newvd->vdev_isspare;
+
+		/*
+		 * Mark newvd's DTL dirty in this txg.
+		 */
+		vdev_dirty(tvd, VDD_DTL, newvd, txg);
+
+		/*
+		 * Schedule the resilver to restart in the future. We do this
+		 * to ensure that dmu_sync-ed blocks have been stitched into
+		 * the respective datasets. We do not do this if resilvers
+		 * have been deferred.  A rebuild is started instead by
+		 * spa_vdev_exit(), and waits for dtl_max_txg itself.
+		 */
+		if (!rebuild) {
+			if (dsl_scan_resilvering(spa_get_dsl(spa)) &&
+			    spa_feature_is_enabled(spa,
+			    SPA_FEATURE_RESILVER_DEFER))
+				vdev_set_deferred_resilver(spa, newvd);
+			else
+				dsl_resilver_restart(spa->spa_dsl_pool,
+				    dtl_max_txg);
+		}
+	}
 
 	if (spa->spa_bootfs)
 		spa_event_notify(spa, newvd, NULL, ESC_ZFS_BOOTFS_VDEV_ATTACH);
@@ -6295,10 +6467,11 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	(void) spa_vdev_exit(spa, newrootvd, dtl_max_txg, 0);
 
 	spa_history_log_internal(spa, "vdev attach", NULL,
-	    "%s vdev=%s %s vdev=%s",
+	    "%s vdev=%s %s vdev=%s%s",
 	    replacing && newvd_isspare ? "spare in" :
 	    replacing ? "replace" : "attach", newvdpath,
-	    replacing ? "for" : "to", oldvdpath);
+	    replacing ? "for" : "to", oldvdpath,
+	    rebuild ? " (rebuild)" : "");
 
 	spa_strfree(oldvdpath);
 	spa_strfree(newvdpath);
@@ -6598,7 +6771,7 @@ spa_vdev_initialize_impl(spa_t *spa, uint64_t guid, uint64_t cmd_type,
 	 */
 	if (cmd_type == POOL_INITIALIZE_START &&
 	    (vd->vdev_initialize_thread != NULL ||
-	    vd->vdev_top->vdev_removing)) {
+	    vd->vdev_top->vdev_removing || vd->vdev_top->vdev_rz_expanding)) {
 		mutex_exit(&vd->vdev_initialize_lock);
 		return (SET_ERROR(EBUSY));
 	} else if (cmd_type == POOL_INITIALIZE_CANCEL &&
@@ -6713,7 +6886,8 @@ spa_vdev_trim_impl(spa_t *spa, uint64_t guid, uint64_t cmd_type,
 	 * which has completed but the thread is not exited.
 	 */
 	if (cmd_type == POOL_TRIM_START &&
-	    (vd->vdev_trim_thread != NULL || vd->vdev_top->vdev_removing)) {
+	    (vd->vdev_trim_thread != NULL || vd->vdev_top->vdev_removing ||
+	    vd->vdev_top->vdev_rz_expanding)) {
 		mutex_exit(&vd->vdev_trim_lock);
 		return (SET_ERROR(EBUSY));
 	} else if (cmd_type == POOL_TRIM_CANCEL &&
@@ -7374,6 +7548,17 @@ spa_scan(spa_t *spa, pool_scan_func_t func)
 	return (dsl_scan(spa->spa_dsl_pool, func));
 }
 
+/*
+ * Scrub only the blocks born since the last completed scrub.
+ */
+int
+spa_scan_incremental(spa_t *spa)
+{
+	ASSERT(spa_config_held(spa, SCL_ALL, RW_WRITER) == 0);
+
+	return (dsl_scan_incremental(spa->spa_dsl_pool));
+}
+
 /*
  * ==========================================================================
  * SPA async task processing
@@ -7511,6 +7696,21 @@ spa_async_thread(void *arg)
 	if (tasks & SPA_ASYNC_RESILVER_DONE)
 		spa_vdev_resilver_done(spa);
 
+	/*
+	 * A sequential rebuild does not verify checksums, so once it is done
+	 * detach the replaced devices and scrub the pool.
+	 */
+	if (tasks & SPA_ASYNC_REBUILD_DONE) {
+		spa_vdev_resilver_done(spa);
+		if (zfs_rebuild_scrub_enabled && !spa_suspended(spa)) {
+			int error = dsl_scan(dp, POOL_SCAN_SCRUB);
+			if (error != 0) {
+				zfs_dbgmsg("not scrubbing %s after rebuild, "
+				    "error=%d", spa_name(spa), error);
+			}
+		}
+	}
+
 	/*
 	 * Kick off a resilver.
 	 */
@@ -7543,6 +7743,17 @@ spa_async_thread(void *arg)
 		mutex_exit(&spa_namespace_lock);
 	}
 
+	/*
+	 * Kick off L2ARC rebuild tasks.
+	 */
+	if (tasks & SPA_ASYNC_L2CACHE_REBUILD) {
+		mutex_enter(&spa_namespace_lock);
+		spa_config_enter(spa, SCL_L2ARC, FTAG, RW_READER);
+		l2arc_spa_rebuild_start(spa);
+		spa_config_exit(spa, SCL_L2ARC, FTAG);
+		mutex_exit(&spa_namespace_lock);
+	}
+
 	/*
 	 * Let the world know that we're done.
 	 */
@@ -7571,6 +7782,10 @@ spa_async_suspend(spa_t *spa)
 	zthr_t *discard_thread = spa->spa_checkpoint_discard_zthr;
 	if (discard_thread != NULL)
 		zthr_cancel(discard_thread);
+
+	zthr_t *raidz_expand_thread = spa->spa_raidz_expand_zthr;
+	if (raidz_expand_thread != NULL)
+		zthr_cancel(raidz_expand_thread);
 }
 
 void
@@ -7589,6 +7804,10 @@ spa_async_resume(spa_t *spa)
 	zthr_t *discard_thread = spa->spa_checkpoint_discard_zthr;
 	if (discard_thread != NULL)
 		zthr_resume(discard_thread);
+
+	zthr_t *raidz_expand_thread = spa->spa_raidz_expand_zthr;
+	if (raidz_expand_thread != NULL)
+		zthr_resume(raidz_expand_thread);
 }
 
 static boolean_t
@@ -8068,6 +8287,9 @@ spa_sync_props(void *arg, dmu_tx_t *tx)
 			case ZPOOL_PROP_MULTIHOST:
 				spa->spa_multihost = intval;
 				break;
+			case ZPOOL_PROP_DEDUP_TABLE_QUOTA:
+				spa->spa_dedup_table_quota = intval;
+				break;
 			default:
 				break;
 			}
@@ -8203,6 +8425,26 @@ spa_sync_adjust_vdev_max_queue_depth(spa_t *spa)
 	metaslab_class_t *special = spa_special_class(spa);
 	metaslab_class_t *dedup = spa_dedup_class(spa);
 
+	/*
+	 * Update each group's average write latency from the last txg and
+	 * find the fastest group of each class, which the adaptive throttle
+	 * scales the other groups' queue depths against.
+	 */
+	normal->mc_min_write_latency = 0;
+	special->mc_min_write_latency = 0;
+	dedup->mc_min_write_latency = 0;
+	for (int c = 0; c < rvd->vdev_children; c++) {
+		metaslab_group_t *mg = rvd->vdev_child[c]->vdev_mg;
+		if (mg == NULL || !metaslab_group_initialized(mg))
+			continue;
+
+		metaslab_class_t *mc = mg->mg_class;
+		if (mc != normal && mc != special && mc != dedup)
+			continue;
+
+		metaslab_group_write_latency_update(mg);
+	}
+
 	uint64_t slots_per_allocator = 0;
 	for (int c = 0; c < rvd->vdev_children; c++) {
 		vdev_t *tvd = rvd->vdev_child[c];
@@ -8223,13 +8465,14 @@ spa_sync_adjust_vdev_max_queue_depth(spa_t *spa)
 		for (int i = 0; i < spa->spa_alloc_count; i++)
 			ASSERT0(zfs_refcount_count(
 			    &(mg->mg_alloc_queue_depth[i])));
-		mg->mg_max_alloc_queue_depth = max_queue_depth;
+		mg->mg_max_alloc_queue_depth =
+		    metaslab_group_max_queue_depth(mg, max_queue_depth);
 
-		for (int i = 0; i < spa->spa_alloc_count; i++) {
-			mg->mg_cur_max_alloc_queue_depth[i] =
-			    zfs_vdev_def_queue_depth;
-		}
-		slots_per_allocator += zfs_vdev_def_queue_depth;
+		uint64_t cur_max = MIN(zfs_vdev_def_queue_depth,
+		    mg->mg_max_alloc_queue_depth);
+		for (int i = 0; i < spa->spa_alloc_count; i++)
+			mg->mg_cur_max_alloc_queue_depth[i] = cur_max;
+		slots_per_allocator += cur_max;
 	}
 
 	for (int i = 0; i < spa->spa_alloc_count; i++) {
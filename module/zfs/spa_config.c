@@ -27,6 +27,7 @@
  */
 
 #include <sys/spa.h>
+#include <sys/arc.h>
 #include <sys/fm/fs/zfs.h>
 #include <sys/spa_impl.h>
 #include <sys/nvpair.h>
@@ -539,6 +540,12 @@ spa_config_generate(spa_t *spa, vdev_t *vd, uint64_t txg, int getstats)
 		    ZPOOL_CONFIG_DDT_STATS,
 		    (uint64_t *)dds, sizeof (*dds) / sizeof (uint64_t));
 		kmem_free(dds, sizeof (ddt_stat_t));
+
+		/* The ARC is shared, so these are not specific to the pool. */
+		fnvlist_add_uint64(config, ZPOOL_CONFIG_DDT_ARC_SIZE,
+		    arc_ddt_size());
+		fnvlist_add_uint64(config, ZPOOL_CONFIG_DDT_ARC_RESERVE,
+		    arc_ddt_reserve());
 	}
 
 	if (locked)
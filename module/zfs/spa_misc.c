@@ -39,6 +39,7 @@
 #include <sys/zil.h>
 #include <sys/vdev_impl.h>
 #include <sys/vdev_initialize.h>
+#include <sys/vdev_rebuild.h>
 #include <sys/vdev_trim.h>
 #include <sys/vdev_file.h>
 #include <sys/vdev_raidz.h>
@@ -377,6 +378,25 @@ int spa_slop_shift = 5;
 uint64_t spa_min_slop = 128 * 1024 * 1024;
 int spa_allocators = 4;
 
+/*
+ * Each pool has spa_alloc_count allocators, and every allocator has its own
+ * primary metaslab in each metaslab group, so writes issued to different
+ * allocators do not contend on the same ms_lock.  spa_allocator_affinity
+ * controls how a write picks its allocator:
+ *
+ * SPA_ALLOCATOR_HASH - hash the block's objset, object, level and region.
+ * Logically adjacent blocks end up physically adjacent, but parallel
+ * writers to the same region of an object share an allocator.
+ *
+ * SPA_ALLOCATOR_CPU - use the allocator of the issuing CPU, so writers on
+ * different CPUs never share one when spa_allocators is at least the
+ * number of CPUs.
+ *
+ * SPA_ALLOCATOR_NUMA - the allocators are split evenly among the NUMA
+ * nodes and the block hash picks one of the issuing node's allocators.
+ */
+int spa_allocator_affinity = SPA_ALLOCATOR_HASH;
+
 
 /*PRINTFLIKE2*/
 void
@@ -685,7 +705,9 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 	if (altroot)
 		spa->spa_root = spa_strdup(altroot);
 
-	spa->spa_alloc_count = spa_allocators;
+	spa->spa_alloc_count = MAX(spa_allocators, 1);
+	if (spa_allocator_affinity == SPA_ALLOCATOR_NUMA)
+		spa->spa_alloc_count = MAX(spa->spa_alloc_count, nr_node_ids);
 	spa->spa_alloc_locks = kmem_zalloc(spa->spa_alloc_count *
 	    sizeof (kmutex_t), KM_SLEEP);
 	spa->spa_alloc_trees = kmem_zalloc(spa->spa_alloc_count *
@@ -737,6 +759,7 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 
 	/* Reset cached value */
 	spa->spa_dedup_dspace = ~0ULL;
+	spa->spa_dedup_dsize = ~0ULL;
 
 	/*
 	 * As a pool is being created, treat all features as disabled by
@@ -1151,6 +1174,7 @@ spa_vdev_enter(spa_t *spa)
 	mutex_enter(&spa_namespace_lock);
 
 	vdev_autotrim_stop_all(spa);
+	vdev_rebuild_stop_all(spa);
 
 	return (spa_vdev_config_enter(spa));
 }
@@ -1261,6 +1285,7 @@ int
 spa_vdev_exit(spa_t *spa, vdev_t *vd, uint64_t txg, int error)
 {
 	vdev_autotrim_restart(spa);
+	vdev_rebuild_restart(spa);
 
 	spa_vdev_config_exit(spa, vd, txg, error, FTAG);
 	mutex_exit(&spa_namespace_lock);
@@ -1905,6 +1930,33 @@ spa_preferred_class(spa_t *spa, uint64_t size, dmu_object_type_t objtype,
 	return (spa_normal_class(spa));
 }
 
+/*
+ * Pick the allocator for a write whose location hashes to the given value,
+ * according to spa_allocator_affinity.
+ */
+int
+spa_select_allocator(spa_t *spa, uint64_t hash)
+{
+	int count = spa->spa_alloc_count;
+
+	switch (spa_allocator_affinity) {
+	case SPA_ALLOCATOR_CPU:
+		return (CPU_SEQID % count);
+	case SPA_ALLOCATOR_NUMA: {
+		int nodes = MAX(nr_node_ids, 1);
+		int node = numa_node_id();
+		int per_node;
+
+		if (count < nodes)
+			return (node % count);
+		per_node = count / nodes;
+		return (node * per_node + hash % per_node);
+	}
+	default:
+		return (hash % count);
+	}
+}
+
 void
 spa_evicting_os_register(spa_t *spa, objset_t *os)
 {
@@ -2310,13 +2362,14 @@ spa_init(int mode)
 	fm_init();
 	zfs_refcount_init();
 	unique_init();
-	range_tree_init();
+	zfs_btree_init();
 	metaslab_alloc_trace_init();
 	ddt_init();
 	zio_init();
 	dmu_init();
 	zil_init();
 	vdev_cache_stat_init();
+	vdev_queue_stat_init();
 	vdev_mirror_stat_init();
 	vdev_raidz_math_init();
 	vdev_file_init();
@@ -2339,6 +2392,7 @@ spa_fini(void)
 
 	vdev_file_fini();
 	vdev_cache_stat_fini();
+	vdev_queue_stat_fini();
 	vdev_mirror_stat_fini();
 	vdev_raidz_math_fini();
 	zil_fini();
@@ -2346,7 +2400,7 @@ spa_fini(void)
 	zio_fini();
 	ddt_fini();
 	metaslab_alloc_trace_fini();
-	range_tree_fini();
+	zfs_btree_fini();
 	unique_fini();
 	zfs_refcount_fini();
 	fm_fini();
@@ -2928,6 +2982,13 @@ module_param_call(spa_slop_shift, param_set_slop_shift, param_get_int,
     &spa_slop_shift, 0644);
 MODULE_PARM_DESC(spa_slop_shift, "Reserved free space in pool");
 
+module_param(spa_allocators, int, 0644);
+MODULE_PARM_DESC(spa_allocators, "Number of allocators per pool");
+
+module_param(spa_allocator_affinity, int, 0644);
+MODULE_PARM_DESC(spa_allocator_affinity,
+	"Allocator selection (0=hash, 1=cpu, 2=numa node)");
+
 module_param(zfs_ddt_data_is_special, int, 0644);
 MODULE_PARM_DESC(zfs_ddt_data_is_special,
 	"Place DDT data into the special class");
@@ -212,6 +212,66 @@ int zfs_vdev_def_queue_depth = 32;
  */
 int zfs_vdev_aggregate_trim = 0;
 
+/*
+ * Latency-targeted scheduling.  When zfs_vdev_queue_latency_target_us is
+ * non-zero, each leaf vdev measures how long its sync reads and writes take
+ * from being queued to completing.  At the end of every
+ * zfs_vdev_queue_latency_window_ms window the max_active of all other
+ * (async) classes is adjusted:
+ *
+ *  - if more than 1% of the window's sync i/os exceeded the target, i.e.
+ *    their p99 latency is above it, the async depth is cut to 3/4;
+ *  - otherwise, or if there were no sync i/os, it is raised by
+ *    VDQ_LATENCY_SCALE_STEP percent of the static max_active, up to
+ *    zfs_vdev_queue_latency_max_scale percent.
+ *
+ * An async class is never limited below its min_active, and the total is
+ * still bounded by zfs_vdev_max_active.  The static min/max of the sync
+ * classes are left unchanged.
+ */
+/*
+ * Passthrough mode.  When zfs_vdev_queue_passthrough is set, i/os to
+ * non-rotational leaf vdevs skip the vdev queue: they are neither sorted nor
+ * aggregated and vq_lock is not taken, only the per-class count of active
+ * i/os is maintained (atomically).  Such devices usually have deep hardware
+ * queues of their own, and at high IOPS the queue lock becomes the
+ * bottleneck.  The min/max_active limits, the latency-targeted mode and the
+ * pool's I/O history kstat do not apply to these i/os.
+ */
+int zfs_vdev_queue_passthrough = 0;
+
+uint32_t zfs_vdev_queue_latency_target_us = 0;
+uint32_t zfs_vdev_queue_latency_window_ms = 100;
+uint32_t zfs_vdev_queue_latency_max_scale = 1000;
+
+#define	VDQ_LATENCY_SCALE_STEP	10
+
+typedef struct vdev_queue_stats {
+	kstat_named_t vdqs_sync_ios;
+	kstat_named_t vdqs_sync_ios_over_target;
+	kstat_named_t vdqs_windows;
+	kstat_named_t vdqs_windows_over_target;
+	kstat_named_t vdqs_async_scale_increases;
+	kstat_named_t vdqs_async_scale_decreases;
+	kstat_named_t vdqs_async_scale_last;
+} vdev_queue_stats_t;
+
+static vdev_queue_stats_t vdev_queue_stats = {
+	{ "sync_ios",			KSTAT_DATA_UINT64 },
+	{ "sync_ios_over_target",	KSTAT_DATA_UINT64 },
+	{ "windows",			KSTAT_DATA_UINT64 },
+	{ "windows_over_target",	KSTAT_DATA_UINT64 },
+	{ "async_scale_increases",	KSTAT_DATA_UINT64 },
+	{ "async_scale_decreases",	KSTAT_DATA_UINT64 },
+	{ "async_scale_last",		KSTAT_DATA_UINT64 },
+};
+
+#define	VDQSTAT(stat)		(vdev_queue_stats.stat.value.ui64)
+#define	VDQSTAT_INCR(stat, val)	atomic_add_64(&VDQSTAT(stat), val)
+#define	VDQSTAT_BUMP(stat)	VDQSTAT_INCR(stat, 1)
+
+static kstat_t *vdev_queue_ksp;
+
 int
 vdev_queue_offset_compare(const void *x1, const void *x2)
 {
@@ -333,7 +393,7 @@ vdev_queue_max_async_writes(spa_t *spa)
 }
 
 static int
-vdev_queue_class_max_active(spa_t *spa, zio_priority_t p)
+vdev_queue_class_static_max_active(spa_t *spa, zio_priority_t p)
 {
 	switch (p) {
 	case ZIO_PRIORITY_SYNC_READ:
@@ -358,6 +418,72 @@ vdev_queue_class_max_active(spa_t *spa, zio_priority_t p)
 	}
 }
 
+static boolean_t
+vdev_queue_class_is_sync(zio_priority_t p)
+{
+	return (p == ZIO_PRIORITY_SYNC_READ || p == ZIO_PRIORITY_SYNC_WRITE);
+}
+
+static int
+vdev_queue_class_max_active(vdev_queue_t *vq, zio_priority_t p)
+{
+	int max = vdev_queue_class_static_max_active(vq->vq_vdev->vdev_spa, p);
+
+	if (zfs_vdev_queue_latency_target_us == 0 ||
+	    vdev_queue_class_is_sync(p))
+		return (max);
+
+	return (MAX(vdev_queue_class_min_active(p),
+	    (uint64_t)max * vq->vq_async_scale / 100));
+}
+
+/*
+ * Account for a completed sync i/o and, once the current window has
+ * elapsed, grow or shrink the async classes' depth; see the comment above
+ * zfs_vdev_queue_latency_target_us.
+ */
+static void
+vdev_queue_latency_update(vdev_queue_t *vq, zio_t *zio, hrtime_t now)
+{
+	hrtime_t target = USEC2NSEC(zfs_vdev_queue_latency_target_us);
+
+	ASSERT(MUTEX_HELD(&vq->vq_lock));
+
+	if (target == 0)
+		return;
+
+	if (vdev_queue_class_is_sync(zio->io_priority)) {
+		vq->vq_lat_sync_ios++;
+		VDQSTAT_BUMP(vdqs_sync_ios);
+		if (zio->io_delta > target) {
+			vq->vq_lat_sync_over++;
+			VDQSTAT_BUMP(vdqs_sync_ios_over_target);
+		}
+	}
+
+	if (now - vq->vq_lat_window_start <
+	    MSEC2NSEC(zfs_vdev_queue_latency_window_ms))
+		return;
+
+	VDQSTAT_BUMP(vdqs_windows);
+	if (vq->vq_lat_sync_over * 100 > vq->vq_lat_sync_ios) {
+		VDQSTAT_BUMP(vdqs_windows_over_target);
+		if (vq->vq_async_scale > 0) {
+			vq->vq_async_scale = vq->vq_async_scale * 3 / 4;
+			VDQSTAT_BUMP(vdqs_async_scale_decreases);
+		}
+	} else if (vq->vq_async_scale < zfs_vdev_queue_latency_max_scale) {
+		vq->vq_async_scale = MIN(vq->vq_async_scale +
+		    VDQ_LATENCY_SCALE_STEP, zfs_vdev_queue_latency_max_scale);
+		VDQSTAT_BUMP(vdqs_async_scale_increases);
+	}
+	VDQSTAT(vdqs_async_scale_last) = vq->vq_async_scale;
+
+	vq->vq_lat_window_start = now;
+	vq->vq_lat_sync_ios = 0;
+	vq->vq_lat_sync_over = 0;
+}
+
 /*
  * Return the i/o class to issue from, or ZIO_PRIORITY_MAX_QUEUEABLE if
  * there is no eligible class.
@@ -365,7 +491,6 @@ vdev_queue_class_max_active(spa_t *spa, zio_priority_t p)
 static zio_priority_t
 vdev_queue_class_to_issue(vdev_queue_t *vq)
 {
-	spa_t *spa = vq->vq_vdev->vdev_spa;
 	zio_priority_t p;
 
 	if (avl_numnodes(&vq->vq_active_tree) >= zfs_vdev_max_active)
@@ -386,7 +511,7 @@ vdev_queue_class_to_issue(vdev_queue_t *vq)
 	for (p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
 		if (avl_numnodes(vdev_queue_class_tree(vq, p)) > 0 &&
 		    vq->vq_class[p].vqc_active <
-		    vdev_queue_class_max_active(spa, p))
+		    vdev_queue_class_max_active(vq, p))
 			return (p);
 	}
 
@@ -436,6 +561,8 @@ vdev_queue_init(vdev_t *vd)
 	}
 
 	vq->vq_last_offset = 0;
+	vq->vq_async_scale = 100;
+	vq->vq_lat_window_start = gethrtime();
 }
 
 void
@@ -838,6 +965,24 @@ vdev_queue_io(zio_t *zio)
 
 	zio->io_flags |= ZIO_FLAG_DONT_CACHE | ZIO_FLAG_DONT_QUEUE;
 
+	if (zfs_vdev_queue_passthrough && zio->io_vd->vdev_nonrot) {
+		/*
+		 * Optional i/os only exist to aid aggregation, which
+		 * does not happen here, so discard them right away.
+		 */
+		if (zio->io_flags & ZIO_FLAG_NODATA) {
+			zio_vdev_io_bypass(zio);
+			zio_execute(zio);
+			return (NULL);
+		}
+
+		zio->io_passthrough = B_TRUE;
+		zio->io_timestamp = gethrtime();
+		atomic_inc_32(&vq->vq_class[zio->io_priority].
+		    vqc_passthrough_active);
+		return (zio);
+	}
+
 	mutex_enter(&vq->vq_lock);
 	zio->io_timestamp = gethrtime();
 	vdev_queue_io_add(vq, zio);
@@ -861,6 +1006,13 @@ vdev_queue_io_done(zio_t *zio)
 	vdev_queue_t *vq = &zio->io_vd->vdev_queue;
 	zio_t *nio;
 
+	if (zio->io_passthrough) {
+		zio->io_delta = gethrtime() - zio->io_timestamp;
+		atomic_dec_32(&vq->vq_class[zio->io_priority].
+		    vqc_passthrough_active);
+		return;
+	}
+
 	mutex_enter(&vq->vq_lock);
 
 	vdev_queue_pending_remove(vq, zio);
@@ -868,6 +1020,7 @@ vdev_queue_io_done(zio_t *zio)
 	zio->io_delta = gethrtime() - zio->io_timestamp;
 	vq->vq_io_complete_ts = gethrtime();
 	vq->vq_io_delta_ts = vq->vq_io_complete_ts - zio->io_timestamp;
+	vdev_queue_latency_update(vq, zio, vq->vq_io_complete_ts);
 
 	while ((nio = vdev_queue_io_to_issue(vq)) != NULL) {
 		mutex_exit(&vq->vq_lock);
@@ -898,6 +1051,13 @@ vdev_queue_change_io_priority(zio_t *zio, zio_priority_t priority)
 	if (zio->io_priority == ZIO_PRIORITY_NOW)
 		return;
 
+	/*
+	 * A passthrough zio has already been issued, and its priority is
+	 * needed to find its class on completion.
+	 */
+	if (zio->io_passthrough)
+		return;
+
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 	ASSERT3U(priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 
@@ -940,10 +1100,37 @@ vdev_queue_change_io_priority(zio_t *zio, zio_priority_t priority)
  * vq_lock mutex use here, instead we prefer to keep it lock free for
  * performance.
  */
+void
+vdev_queue_stat_init(void)
+{
+	vdev_queue_ksp = kstat_create("zfs", 0, "vdev_queue_stats", "misc",
+	    KSTAT_TYPE_NAMED,
+	    sizeof (vdev_queue_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (vdev_queue_ksp != NULL) {
+		vdev_queue_ksp->ks_data = &vdev_queue_stats;
+		kstat_install(vdev_queue_ksp);
+	}
+}
+
+void
+vdev_queue_stat_fini(void)
+{
+	if (vdev_queue_ksp != NULL) {
+		kstat_delete(vdev_queue_ksp);
+		vdev_queue_ksp = NULL;
+	}
+}
+
 int
 vdev_queue_length(vdev_t *vd)
 {
-	return (avl_numnodes(&vd->vdev_queue.vq_active_tree));
+	int length = avl_numnodes(&vd->vdev_queue.vq_active_tree);
+
+	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++)
+		length += vd->vdev_queue.vq_class[p].vqc_passthrough_active;
+
+	return (length);
 }
 
 uint64_t
@@ -1047,4 +1234,20 @@ MODULE_PARM_DESC(zfs_vdev_trim_min_active,
 module_param(zfs_vdev_queue_depth_pct, int, 0644);
 MODULE_PARM_DESC(zfs_vdev_queue_depth_pct,
 	"Queue depth percentage for each top-level vdev");
+
+module_param(zfs_vdev_queue_passthrough, int, 0644);
+MODULE_PARM_DESC(zfs_vdev_queue_passthrough,
+	"Bypass the I/O queue of non-rotational vdevs");
+
+module_param(zfs_vdev_queue_latency_target_us, int, 0644);
+MODULE_PARM_DESC(zfs_vdev_queue_latency_target_us,
+	"Target p99 latency of sync I/Os, 0 disables latency scheduling");
+
+module_param(zfs_vdev_queue_latency_window_ms, int, 0644);
+MODULE_PARM_DESC(zfs_vdev_queue_latency_window_ms,
+	"Interval between async depth adjustments");
+
+module_param(zfs_vdev_queue_latency_max_scale, int, 0644);
+MODULE_PARM_DESC(zfs_vdev_queue_latency_max_scale,
+	"Max percentage the async max_active can be scaled to");
 #endif
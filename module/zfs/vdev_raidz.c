@@ -35,10 +35,17 @@
 #include <sys/fm/fs/zfs.h>
 #include <sys/vdev_raidz.h>
 #include <sys/vdev_raidz_impl.h>
-
-#ifdef ZFS_DEBUG
-#include <sys/vdev.h>	/* For vdev_xlate() in vdev_raidz_io_verify() */
-#endif
+#include <sys/vdev.h>
+#include <sys/dmu_tx.h>
+#include <sys/dsl_scan.h>
+#include <sys/dsl_synctask.h>
+#include <sys/metaslab_impl.h>
+#include <sys/mmp.h>
+#include <sys/spa_impl.h>
+#include <sys/uberblock_impl.h>
+#include <sys/zap.h>
+#include <sys/zfs_rlock.h>
+#include <sys/zthr.h>
 
 /*
  * Virtual device vector for RAID-Z.
@@ -134,25 +141,94 @@
 	VDEV_RAIDZ_64MUL_2((x), mask); \
 }
 
-void
-vdev_raidz_map_free(raidz_map_t *rm)
+/*
+ * Logical width of the blocks born in each txg range of an expanded raidz
+ * vdev.  Blocks born before the first node use vd_original_width.
+ */
+typedef struct reflow_node {
+	uint64_t re_txg;
+	uint64_t re_logical_width;
+	avl_node_t re_link;
+} reflow_node_t;
+
+/*
+ * The amount of reflow i/o which may be outstanding at once.
+ */
+static void vdev_raidz_generate_parity_row(raidz_map_t *, raidz_row_t *);
+
+unsigned long raidz_expand_max_copy_bytes = 10 * SPA_MAXBLOCKSIZE;
+
+/*
+ * For testing only: pause the reflow once this many bytes have been copied.
+ */
+unsigned long raidz_expand_max_reflow_bytes = 0;
+
+static int
+vdev_raidz_reflow_compare(const void *x1, const void *x2)
 {
-	int c;
+	const reflow_node_t *l = x1;
+	const reflow_node_t *r = x2;
+
+	return (AVL_CMP(l->re_txg, r->re_txg));
+}
+
+/*
+ * Return the number of columns that a block born in the given txg is
+ * striped across.
+ */
+static uint64_t
+vdev_raidz_get_logical_width(vdev_raidz_t *vdrz, uint64_t txg)
+{
+	reflow_node_t lookup = {
+		.re_txg = txg,
+	};
+	avl_index_t where;
+	uint64_t width;
+
+	mutex_enter(&vdrz->vd_expand_lock);
+	reflow_node_t *re = avl_find(&vdrz->vd_expand_txgs, &lookup, &where);
+	if (re == NULL) {
+		re = avl_nearest(&vdrz->vd_expand_txgs, where, AVL_BEFORE);
+	}
+	if (re != NULL)
+		width = re->re_logical_width;
+	else
+		width = vdrz->vd_original_width;
+	mutex_exit(&vdrz->vd_expand_lock);
 
-	for (c = 0; c < rm->rm_firstdatacol; c++) {
-		abd_free(rm->rm_col[c].rc_abd);
+	return (width);
+}
 
-		if (rm->rm_col[c].rc_gdata != NULL)
-			abd_free(rm->rm_col[c].rc_gdata);
+static void
+vdev_raidz_row_free(raidz_row_t *rr)
+{
+	for (int c = 0; c < rr->rr_cols; c++) {
+		raidz_col_t *rc = &rr->rr_col[c];
+
+		if (c < rr->rr_firstdatacol) {
+			abd_free(rc->rc_abd);
+			if (rc->rc_gdata != NULL)
+				abd_free(rc->rc_gdata);
+		} else if (rc->rc_abd != NULL) {
+			abd_put(rc->rc_abd);
+		}
+		if (rc->rc_orig_data != NULL)
+			abd_free(rc->rc_orig_data);
 	}
 
-	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++)
-		abd_put(rm->rm_col[c].rc_abd);
+	kmem_free(rr, offsetof(raidz_row_t, rr_col[rr->rr_scols]));
+}
+
+void
+vdev_raidz_map_free(raidz_map_t *rm)
+{
+	for (int i = 0; i < rm->rm_nrows; i++)
+		vdev_raidz_row_free(rm->rm_row[i]);
 
 	if (rm->rm_abd_copy != NULL)
 		abd_free(rm->rm_abd_copy);
 
-	kmem_free(rm, offsetof(raidz_map_t, rm_col[rm->rm_scols]));
+	kmem_free(rm, offsetof(raidz_map_t, rm_row[rm->rm_nrows]));
 }
 
 static void
@@ -183,80 +259,83 @@ static void
 vdev_raidz_cksum_finish(zio_cksum_report_t *zcr, const abd_t *good_data)
 {
 	raidz_map_t *rm = zcr->zcr_cbdata;
+	raidz_row_t *rr = rm->rm_row[0];
 	const size_t c = zcr->zcr_cbinfo;
 	size_t x, offset;
 
 	const abd_t *good = NULL;
-	const abd_t *bad = rm->rm_col[c].rc_abd;
+	const abd_t *bad = rr->rr_col[c].rc_abd;
+
+	ASSERT3U(rm->rm_nrows, ==, 1);
 
 	if (good_data == NULL) {
 		zfs_ereport_finish_checksum(zcr, NULL, NULL, B_FALSE);
 		return;
 	}
 
-	if (c < rm->rm_firstdatacol) {
+	if (c < rr->rr_firstdatacol) {
 		/*
 		 * The first time through, calculate the parity blocks for
 		 * the good data (this relies on the fact that the good
 		 * data never changes for a given logical ZIO)
 		 */
-		if (rm->rm_col[0].rc_gdata == NULL) {
+		if (rr->rr_col[0].rc_gdata == NULL) {
 			abd_t *bad_parity[VDEV_RAIDZ_MAXPARITY];
 
 			/*
-			 * Set up the rm_col[]s to generate the parity for
+			 * Set up the rr_col[]s to generate the parity for
 			 * good_data, first saving the parity bufs and
 			 * replacing them with buffers to hold the result.
 			 */
-			for (x = 0; x < rm->rm_firstdatacol; x++) {
-				bad_parity[x] = rm->rm_col[x].rc_abd;
-				rm->rm_col[x].rc_abd =
-				    rm->rm_col[x].rc_gdata =
-				    abd_alloc_sametype(rm->rm_col[x].rc_abd,
-				    rm->rm_col[x].rc_size);
+			for (x = 0; x < rr->rr_firstdatacol; x++) {
+				bad_parity[x] = rr->rr_col[x].rc_abd;
+				rr->rr_col[x].rc_abd =
+				    rr->rr_col[x].rc_gdata =
+				    abd_alloc_sametype(rr->rr_col[x].rc_abd,
+				    rr->rr_col[x].rc_size);
 			}
 
 			/* fill in the data columns from good_data */
 			offset = 0;
-			for (; x < rm->rm_cols; x++) {
-				abd_put(rm->rm_col[x].rc_abd);
+			for (; x < rr->rr_cols; x++) {
+				abd_put(rr->rr_col[x].rc_abd);
 
-				rm->rm_col[x].rc_abd =
+				rr->rr_col[x].rc_abd =
 				    abd_get_offset_size((abd_t *)good_data,
-				    offset, rm->rm_col[x].rc_size);
-				offset += rm->rm_col[x].rc_size;
+				    offset, rr->rr_col[x].rc_size);
+				offset += rr->rr_col[x].rc_size;
 			}
 
 			/*
 			 * Construct the parity from the good data.
 			 */
-			vdev_raidz_generate_parity(rm);
+			vdev_raidz_generate_parity_row(rm, rr);
 
 			/* restore everything back to its original state */
-			for (x = 0; x < rm->rm_firstdatacol; x++)
-				rm->rm_col[x].rc_abd = bad_parity[x];
+			for (x = 0; x < rr->rr_firstdatacol; x++)
+				rr->rr_col[x].rc_abd = bad_parity[x];
 
 			offset = 0;
-			for (x = rm->rm_firstdatacol; x < rm->rm_cols; x++) {
-				abd_put(rm->rm_col[x].rc_abd);
-				rm->rm_col[x].rc_abd = abd_get_offset_size(
+			for (x = rr->rr_firstdatacol; x < rr->rr_cols; x++) {
+				abd_put(rr->rr_col[x].rc_abd);
+				rr->rr_col[x].rc_abd = abd_get_offset_size(
 				    rm->rm_abd_copy, offset,
-				    rm->rm_col[x].rc_size);
-				offset += rm->rm_col[x].rc_size;
+				    rr->rr_col[x].rc_size);
+				offset += rr->rr_col[x].rc_size;
 			}
 		}
 
-		ASSERT3P(rm->rm_col[c].rc_gdata, !=, NULL);
-		good = abd_get_offset_size(rm->rm_col[c].rc_gdata, 0,
-		    rm->rm_col[c].rc_size);
+		ASSERT3P(rr->rr_col[c].rc_gdata, !=, NULL);
+		good = abd_get_offset_size(rr->rr_col[c].rc_gdata, 0,
+		    rr->rr_col[c].rc_size);
 	} else {
 		/* adjust good_data to point at the start of our column */
 		offset = 0;
-		for (x = rm->rm_firstdatacol; x < c; x++)
-			offset += rm->rm_col[x].rc_size;
+		for (x = rr->rr_firstdatacol; x < c; x++)
+			offset += rr->rr_col[x].rc_size;
 
 		good = abd_get_offset_size((abd_t *)good_data, offset,
-		    rm->rm_col[c].rc_size);
+		    rr->rr_col[c].rc_size);
 	}
 
 	/* we drop the ereport if it ends up that the data was good */
@@ -269,6 +348,10 @@ vdev_raidz_cksum_finish(zio_cksum_report_t *zcr, const abd_t *good_data)
  * below when our read operation fails completely.  The main point
  * is to keep a copy of everything we read from disk, so that at
  * vdev_raidz_cksum_finish() time we can compare it with the good data.
+ *
+ * Maps of blocks written before an expansion are made up of many
+ * single-sector rows; for those we fall back to reporting the whole
+ * block.
  */
 static void
 vdev_raidz_cksum_report(zio_t *zio, zio_cksum_report_t *zcr, void *arg)
@@ -277,8 +360,15 @@ vdev_raidz_cksum_report(zio_t *zio, zio_cksum_report_t *zcr, void *arg)
 	size_t offset;
 
 	raidz_map_t *rm = zio->io_vsd;
+	raidz_row_t *rr;
 	size_t size;
 
+	if (rm->rm_nrows != 1) {
+		zio_vsd_default_cksum_report(zio, zcr, arg);
+		return;
+	}
+	rr = rm->rm_row[0];
+
 	/* set up the report and bump the refcount  */
 	zcr->zcr_cbdata = rm;
 	zcr->zcr_cbinfo = c;
@@ -301,13 +391,13 @@ vdev_raidz_cksum_report(zio_t *zio, zio_cksum_report_t *zcr, void *arg)
 	 */
 
 	size = 0;
-	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++)
-		size += rm->rm_col[c].rc_size;
+	for (c = rr->rr_firstdatacol; c < rr->rr_cols; c++)
+		size += rr->rr_col[c].rc_size;
 
 	rm->rm_abd_copy = abd_alloc_for_io(size, B_FALSE);
 
-	for (offset = 0, c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-		raidz_col_t *col = &rm->rm_col[c];
+	for (offset = 0, c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+		raidz_col_t *col = &rr->rr_col[c];
 		abd_t *tmp = abd_get_offset_size(rm->rm_abd_copy, offset,
 		    col->rc_size);
 
@@ -326,6 +416,21 @@ static const zio_vsd_ops_t vdev_raidz_vsd_ops = {
 	.vsd_cksum_report = vdev_raidz_cksum_report
 };
 
+static raidz_row_t *
+vdev_raidz_row_alloc(int cols)
+{
+	raidz_row_t *rr =
+	    kmem_zalloc(offsetof(raidz_row_t, rr_col[cols]), KM_SLEEP);
+
+	rr->rr_cols = cols;
+	rr->rr_scols = cols;
+
+	for (int c = 0; c < cols; c++)
+		rr->rr_col[c].rc_shadow_devidx = UINT64_MAX;
+
+	return (rr);
+}
+
 /*
  * Divides the IO evenly across all child vdevs; usually, dcols is
  * the number of children in the target vdev.
@@ -338,6 +443,7 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t ashift, uint64_t dcols,
     uint64_t nparity)
 {
 	raidz_map_t *rm;
+	raidz_row_t *rr;
 	/* The starting RAIDZ (parent) vdev sector of the block. */
 	uint64_t b = zio->io_offset >> ashift;
 	/* The zio's size in units of the vdev's minimum sector size. */
@@ -383,45 +489,41 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t ashift, uint64_t dcols,
 
 	ASSERT3U(acols, <=, scols);
 
-	rm = kmem_alloc(offsetof(raidz_map_t, rm_col[scols]), KM_SLEEP);
+	rm = kmem_zalloc(offsetof(raidz_map_t, rm_row[1]), KM_SLEEP);
+	rm->rm_nrows = 1;
+	rm->rm_original_width = dcols;
 
-	rm->rm_cols = acols;
-	rm->rm_scols = scols;
-	rm->rm_bigcols = bc;
+	rr = vdev_raidz_row_alloc(scols);
+	rm->rm_row[0] = rr;
+
+	rr->rr_cols = acols;
+	rr->rr_physcols = dcols;
+	rr->rr_bigcols = bc;
+	rr->rr_firstdatacol = nparity;
 	rm->rm_skipstart = bc;
-	rm->rm_missingdata = 0;
-	rm->rm_missingparity = 0;
-	rm->rm_firstdatacol = nparity;
-	rm->rm_abd_copy = NULL;
-	rm->rm_reports = 0;
-	rm->rm_freed = 0;
-	rm->rm_ecksuminjected = 0;
 
 	asize = 0;
 
 	for (c = 0; c < scols; c++) {
+		raidz_col_t *rc = &rr->rr_col[c];
+
 		col = f + c;
 		coff = o;
 		if (col >= dcols) {
 			col -= dcols;
 			coff += 1ULL << ashift;
 		}
-		rm->rm_col[c].rc_devidx = col;
-		rm->rm_col[c].rc_offset = coff;
-		rm->rm_col[c].rc_abd = NULL;
-		rm->rm_col[c].rc_gdata = NULL;
-		rm->rm_col[c].rc_error = 0;
-		rm->rm_col[c].rc_tried = 0;
-		rm->rm_col[c].rc_skipped = 0;
+		rc->rc_devidx = col;
+		rc->rc_offset = coff;
 
 		if (c >= acols)
-			rm->rm_col[c].rc_size = 0;
+			rc->rc_size = 0;
 		else if (c < bc)
-			rm->rm_col[c].rc_size = (q + 1) << ashift;
+			rc->rc_size = (q + 1) << ashift;
 		else
-			rm->rm_col[c].rc_size = q << ashift;
+			rc->rc_size = q << ashift;
 
-		asize += rm->rm_col[c].rc_size;
+		asize += rc->rc_size;
 	}
 
 	ASSERT3U(asize, ==, tot << ashift);
@@ -430,18 +532,18 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t ashift, uint64_t dcols,
 	ASSERT3U(rm->rm_asize - asize, ==, rm->rm_nskip << ashift);
 	ASSERT3U(rm->rm_nskip, <=, nparity);
 
-	for (c = 0; c < rm->rm_firstdatacol; c++)
-		rm->rm_col[c].rc_abd =
-		    abd_alloc_linear(rm->rm_col[c].rc_size, B_FALSE);
+	for (c = 0; c < rr->rr_firstdatacol; c++)
+		rr->rr_col[c].rc_abd =
+		    abd_alloc_linear(rr->rr_col[c].rc_size, B_FALSE);
 
-	rm->rm_col[c].rc_abd = abd_get_offset_size(zio->io_abd, 0,
-	    rm->rm_col[c].rc_size);
-	off = rm->rm_col[c].rc_size;
+	rr->rr_col[c].rc_abd = abd_get_offset_size(zio->io_abd, 0,
+	    rr->rr_col[c].rc_size);
+	off = rr->rr_col[c].rc_size;
 
 	for (c = c + 1; c < acols; c++) {
-		rm->rm_col[c].rc_abd = abd_get_offset_size(zio->io_abd, off,
-		    rm->rm_col[c].rc_size);
-		off += rm->rm_col[c].rc_size;
+		rr->rr_col[c].rc_abd = abd_get_offset_size(zio->io_abd, off,
+		    rr->rr_col[c].rc_size);
+		off += rr->rr_col[c].rc_size;
 	}
 
 	/*
@@ -464,23 +566,204 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t ashift, uint64_t dcols,
 	 * skip the first column since at least one data and one parity
 	 * column must appear in each row.
 	 */
-	ASSERT(rm->rm_cols >= 2);
-	ASSERT(rm->rm_col[0].rc_size == rm->rm_col[1].rc_size);
+	ASSERT(rr->rr_cols >= 2);
+	ASSERT(rr->rr_col[0].rc_size == rr->rr_col[1].rc_size);
 
-	if (rm->rm_firstdatacol == 1 && (zio->io_offset & (1ULL << 20))) {
-		devidx = rm->rm_col[0].rc_devidx;
-		o = rm->rm_col[0].rc_offset;
-		rm->rm_col[0].rc_devidx = rm->rm_col[1].rc_devidx;
-		rm->rm_col[0].rc_offset = rm->rm_col[1].rc_offset;
-		rm->rm_col[1].rc_devidx = devidx;
-		rm->rm_col[1].rc_offset = o;
+	if (rr->rr_firstdatacol == 1 && (zio->io_offset & (1ULL << 20))) {
+		devidx = rr->rr_col[0].rc_devidx;
+		o = rr->rr_col[0].rc_offset;
+		rr->rr_col[0].rc_devidx = rr->rr_col[1].rc_devidx;
+		rr->rr_col[0].rc_offset = rr->rr_col[1].rc_offset;
+		rr->rr_col[1].rc_devidx = devidx;
+		rr->rr_col[1].rc_offset = o;
 
 		if (rm->rm_skipstart == 0)
 			rm->rm_skipstart = 1;
 	}
 
-	zio->io_vsd = rm;
-	zio->io_vsd_ops = &vdev_raidz_vsd_ops;
+	/* init RAIDZ parity ops */
+	rm->rm_ops = vdev_raidz_math_get_ops();
+
+	return (rm);
+}
+
+/*
+ * Build the map of a block whose logical width differs from the current
+ * number of children, i.e. a block written before the vdev was expanded,
+ * or any block while an expansion is still in progress.
+ *
+ * Expansion moves sectors without changing their order: the sector at
+ * parent offset b lives on child (b % width) at child offset (b / width),
+ * where width is the number of children when the sector was (re)written.
+ * The block is therefore split into rows of logical_cols one-sector
+ * columns, and each row is placed on either the old or the new layout
+ * depending on how far the reflow has progressed:
+ *
+ *  - rows entirely below reflow_offset_synced are known to be on disk at
+ *    their new location;
+ *  - all other rows are read from their old location, but sectors below
+ *    reflow_offset_next may already have been copied, so writes must
+ *    also update the new ("shadow") location.
+ *
+ * The last row may be short; its missing ("phantom") columns have no
+ * data and are treated as zero-filled when generating parity.
+ */
+static raidz_map_t *
+vdev_raidz_map_alloc_expanded(zio_t *zio, uint64_t ashift,
+    uint64_t physical_cols, uint64_t logical_cols, uint64_t nparity,
+    uint64_t reflow_offset_synced, uint64_t reflow_offset_next,
+    boolean_t use_scratch)
+{
+	uint64_t offset = zio->io_offset;
+
+	/* The zio's size in units of the vdev's minimum sector size. */
+	uint64_t s = zio->io_size >> ashift;
+
+	/* Full rows of data, and the data sectors in the partial row. */
+	uint64_t q = s / (logical_cols - nparity);
+	uint64_t r = s - q * (logical_cols - nparity);
+
+	/* The number of "big columns" - those which contain remainder data. */
+	uint64_t bc = (r == 0 ? 0 : r + nparity);
+
+	/*
+	 * The total number of data and parity sectors associated with
+	 * this I/O.
+	 */
+	uint64_t tot = s + nparity * (q + (r == 0 ? 0 : 1));
+
+	/* How many rows contain data (not skip) */
+	uint64_t rows = howmany(tot, logical_cols);
+	int cols = MIN(tot, logical_cols);
+	uint64_t asize = 0;
+
+	raidz_map_t *rm =
+	    kmem_zalloc(offsetof(raidz_map_t, rm_row[rows]), KM_SLEEP);
+	rm->rm_nrows = rows;
+	rm->rm_nskip = roundup(tot, nparity + 1) - tot;
+	rm->rm_skipstart = bc;
+	rm->rm_asize = roundup(tot, nparity + 1) << ashift;
+
+	for (uint64_t row = 0; row < rows; row++) {
+		raidz_row_t *rr = vdev_raidz_row_alloc(cols);
+		boolean_t row_use_scratch = B_FALSE;
+		rm->rm_row[row] = rr;
+
+		/* The starting RAIDZ (parent) vdev sector of the row. */
+		uint64_t b = (offset >> ashift) + row * logical_cols;
+
+		/*
+		 * Until the whole row has been copied and that progress is
+		 * on disk, the row is read from (and written to) its old
+		 * location.
+		 */
+		uint64_t row_phys_cols = physical_cols;
+		if (b + cols > reflow_offset_synced >> ashift)
+			row_phys_cols--;
+		else if (use_scratch)
+			row_use_scratch = B_TRUE;
+
+		/* starting child of this row */
+		uint64_t child_id = b % row_phys_cols;
+		/* The starting byte offset on each child vdev. */
+		uint64_t child_offset = (b / row_phys_cols) << ashift;
+
+		/*
+		 * Note, rr_cols is the entire width of the block, even if
+		 * this row is shorter.  Parity generation for Q and R needs
+		 * the full width, treating the phantom sectors as zeros.
+		 */
+		rr->rr_firstdatacol = nparity;
+		rr->rr_physcols = row_phys_cols;
+
+		for (int c = 0; c < rr->rr_cols; c++, child_id++) {
+			raidz_col_t *rc = &rr->rr_col[c];
+
+			if (child_id >= row_phys_cols) {
+				child_id -= row_phys_cols;
+				child_offset += 1ULL << ashift;
+			}
+			rc->rc_devidx = child_id;
+			rc->rc_offset = child_offset;
+
+			/*
+			 * The start of the vdev lives in the scratch (boot)
+			 * area until the pool is imported writeable after a
+			 * crash during the initial part of the reflow.
+			 */
+			if (row_use_scratch)
+				rc->rc_offset -= VDEV_BOOT_SIZE;
+
+			uint64_t dc = c - rr->rr_firstdatacol;
+			if (c < rr->rr_firstdatacol) {
+				rc->rc_size = 1ULL << ashift;
+				rc->rc_abd = abd_alloc_linear(rc->rc_size,
+				    B_FALSE);
+			} else if (row == rows - 1 && bc != 0 && c >= bc) {
+				/*
+				 * Past the end of the block; present only
+				 * so that we have full rows for parity.
+				 */
+				rc->rc_size = 0;
+				rc->rc_abd = NULL;
+			} else {
+				/* data sectors are laid out column-major */
+				uint64_t off;
+
+				if (c < bc || r == 0) {
+					off = dc * rows + row;
+				} else {
+					off = r * rows +
+					    (dc - r) * (rows - 1) + row;
+				}
+				rc->rc_size = 1ULL << ashift;
+				rc->rc_abd = abd_get_offset_size(zio->io_abd,
+				    off << ashift, rc->rc_size);
+			}
+
+			if (rc->rc_size == 0)
+				continue;
+
+			/*
+			 * If this sector may already have been copied to
+			 * its new location, writes must update both.
+			 */
+			if (row_phys_cols != physical_cols &&
+			    b + c < reflow_offset_next >> ashift) {
+				rc->rc_shadow_devidx = (b + c) % physical_cols;
+				rc->rc_shadow_offset =
+				    ((b + c) / physical_cols) << ashift;
+				if (row_use_scratch)
+					rc->rc_shadow_offset -= VDEV_BOOT_SIZE;
+			}
+
+			asize += rc->rc_size;
+		}
+
+		/*
+		 * See comment in vdev_raidz_map_alloc()
+		 */
+		if (rr->rr_firstdatacol == 1 && (offset & (1ULL << 20))) {
+			raidz_col_t *rc0 = &rr->rr_col[0];
+			raidz_col_t *rc1 = &rr->rr_col[1];
+			uint64_t devidx0 = rc0->rc_devidx;
+			uint64_t offset0 = rc0->rc_offset;
+			uint64_t shadow_devidx0 = rc0->rc_shadow_devidx;
+			uint64_t shadow_offset0 = rc0->rc_shadow_offset;
+
+			ASSERT3U(rc0->rc_size, ==, rc1->rc_size);
+
+			rc0->rc_devidx = rc1->rc_devidx;
+			rc0->rc_offset = rc1->rc_offset;
+			rc0->rc_shadow_devidx = rc1->rc_shadow_devidx;
+			rc0->rc_shadow_offset = rc1->rc_shadow_offset;
+			rc1->rc_devidx = devidx0;
+			rc1->rc_offset = offset0;
+			rc1->rc_shadow_devidx = shadow_devidx0;
+			rc1->rc_shadow_offset = shadow_offset0;
+		}
+	}
+	ASSERT3U(asize, ==, tot << ashift);
 
 	/* init RAIDZ parity ops */
 	rm->rm_ops = vdev_raidz_math_get_ops();
@@ -550,48 +833,48 @@ vdev_raidz_pqr_func(void *buf, size_t size, void *private)
 }
 
 static void
-vdev_raidz_generate_parity_p(raidz_map_t *rm)
+vdev_raidz_generate_parity_p(raidz_row_t *rr)
 {
 	uint64_t *p;
 	int c;
 	abd_t *src;
 
-	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-		src = rm->rm_col[c].rc_abd;
-		p = abd_to_buf(rm->rm_col[VDEV_RAIDZ_P].rc_abd);
+	for (c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+		src = rr->rr_col[c].rc_abd;
+		p = abd_to_buf(rr->rr_col[VDEV_RAIDZ_P].rc_abd);
 
-		if (c == rm->rm_firstdatacol) {
-			abd_copy_to_buf(p, src, rm->rm_col[c].rc_size);
+		if (c == rr->rr_firstdatacol) {
+			abd_copy_to_buf(p, src, rr->rr_col[c].rc_size);
 		} else {
 			struct pqr_struct pqr = { p, NULL, NULL };
-			(void) abd_iterate_func(src, 0, rm->rm_col[c].rc_size,
+			(void) abd_iterate_func(src, 0, rr->rr_col[c].rc_size,
 			    vdev_raidz_p_func, &pqr);
 		}
 	}
 }
 
 static void
-vdev_raidz_generate_parity_pq(raidz_map_t *rm)
+vdev_raidz_generate_parity_pq(raidz_row_t *rr)
 {
 	uint64_t *p, *q, pcnt, ccnt, mask, i;
 	int c;
 	abd_t *src;
 
-	pcnt = rm->rm_col[VDEV_RAIDZ_P].rc_size / sizeof (p[0]);
-	ASSERT(rm->rm_col[VDEV_RAIDZ_P].rc_size ==
-	    rm->rm_col[VDEV_RAIDZ_Q].rc_size);
+	pcnt = rr->rr_col[VDEV_RAIDZ_P].rc_size / sizeof (p[0]);
+	ASSERT(rr->rr_col[VDEV_RAIDZ_P].rc_size ==
+	    rr->rr_col[VDEV_RAIDZ_Q].rc_size);
 
-	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-		src = rm->rm_col[c].rc_abd;
-		p = abd_to_buf(rm->rm_col[VDEV_RAIDZ_P].rc_abd);
-		q = abd_to_buf(rm->rm_col[VDEV_RAIDZ_Q].rc_abd);
+	for (c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+		src = rr->rr_col[c].rc_abd;
+		p = abd_to_buf(rr->rr_col[VDEV_RAIDZ_P].rc_abd);
+		q = abd_to_buf(rr->rr_col[VDEV_RAIDZ_Q].rc_abd);
 
-		ccnt = rm->rm_col[c].rc_size / sizeof (p[0]);
+		ccnt = rr->rr_col[c].rc_size / sizeof (p[0]);
 
-		if (c == rm->rm_firstdatacol) {
+		if (c == rr->rr_firstdatacol) {
 			ASSERT(ccnt == pcnt || ccnt == 0);
-			abd_copy_to_buf(p, src, rm->rm_col[c].rc_size);
-			(void) memcpy(q, p, rm->rm_col[c].rc_size);
+			abd_copy_to_buf(p, src, rr->rr_col[c].rc_size);
+			(void) memcpy(q, p, rr->rr_col[c].rc_size);
 
 			for (i = ccnt; i < pcnt; i++) {
 				p[i] = 0;
@@ -601,7 +884,7 @@ vdev_raidz_generate_parity_pq(raidz_map_t *rm)
 			struct pqr_struct pqr = { p, q, NULL };
 
 			ASSERT(ccnt <= pcnt);
-			(void) abd_iterate_func(src, 0, rm->rm_col[c].rc_size,
+			(void) abd_iterate_func(src, 0, rr->rr_col[c].rc_size,
 			    vdev_raidz_pq_func, &pqr);
 
 			/*
@@ -616,31 +899,31 @@ vdev_raidz_generate_parity_pq(raidz_map_t *rm)
 }
 
 static void
-vdev_raidz_generate_parity_pqr(raidz_map_t *rm)
+vdev_raidz_generate_parity_pqr(raidz_row_t *rr)
 {
 	uint64_t *p, *q, *r, pcnt, ccnt, mask, i;
 	int c;
 	abd_t *src;
 
-	pcnt = rm->rm_col[VDEV_RAIDZ_P].rc_size / sizeof (p[0]);
-	ASSERT(rm->rm_col[VDEV_RAIDZ_P].rc_size ==
-	    rm->rm_col[VDEV_RAIDZ_Q].rc_size);
-	ASSERT(rm->rm_col[VDEV_RAIDZ_P].rc_size ==
-	    rm->rm_col[VDEV_RAIDZ_R].rc_size);
+	pcnt = rr->rr_col[VDEV_RAIDZ_P].rc_size / sizeof (p[0]);
+	ASSERT(rr->rr_col[VDEV_RAIDZ_P].rc_size ==
+	    rr->rr_col[VDEV_RAIDZ_Q].rc_size);
+	ASSERT(rr->rr_col[VDEV_RAIDZ_P].rc_size ==
+	    rr->rr_col[VDEV_RAIDZ_R].rc_size);
 
-	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-		src = rm->rm_col[c].rc_abd;
-		p = abd_to_buf(rm->rm_col[VDEV_RAIDZ_P].rc_abd);
-		q = abd_to_buf(rm->rm_col[VDEV_RAIDZ_Q].rc_abd);
-		r = abd_to_buf(rm->rm_col[VDEV_RAIDZ_R].rc_abd);
+	for (c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+		src = rr->rr_col[c].rc_abd;
+		p = abd_to_buf(rr->rr_col[VDEV_RAIDZ_P].rc_abd);
+		q = abd_to_buf(rr->rr_col[VDEV_RAIDZ_Q].rc_abd);
+		r = abd_to_buf(rr->rr_col[VDEV_RAIDZ_R].rc_abd);
 
-		ccnt = rm->rm_col[c].rc_size / sizeof (p[0]);
+		ccnt = rr->rr_col[c].rc_size / sizeof (p[0]);
 
-		if (c == rm->rm_firstdatacol) {
+		if (c == rr->rr_firstdatacol) {
 			ASSERT(ccnt == pcnt || ccnt == 0);
-			abd_copy_to_buf(p, src, rm->rm_col[c].rc_size);
-			(void) memcpy(q, p, rm->rm_col[c].rc_size);
-			(void) memcpy(r, p, rm->rm_col[c].rc_size);
+			abd_copy_to_buf(p, src, rr->rr_col[c].rc_size);
+			(void) memcpy(q, p, rr->rr_col[c].rc_size);
+			(void) memcpy(r, p, rr->rr_col[c].rc_size);
 
 			for (i = ccnt; i < pcnt; i++) {
 				p[i] = 0;
@@ -651,7 +934,7 @@ vdev_raidz_generate_parity_pqr(raidz_map_t *rm)
 			struct pqr_struct pqr = { p, q, r };
 
 			ASSERT(ccnt <= pcnt);
-			(void) abd_iterate_func(src, 0, rm->rm_col[c].rc_size,
+			(void) abd_iterate_func(src, 0, rr->rr_col[c].rc_size,
 			    vdev_raidz_pqr_func, &pqr);
 
 			/*
@@ -670,22 +953,22 @@ vdev_raidz_generate_parity_pqr(raidz_map_t *rm)
  * Generate RAID parity in the first virtual columns according to the number of
  * parity columns available.
  */
-void
-vdev_raidz_generate_parity(raidz_map_t *rm)
+static void
+vdev_raidz_generate_parity_row(raidz_map_t *rm, raidz_row_t *rr)
 {
 	/* Generate using the new math implementation */
-	if (vdev_raidz_math_generate(rm) != RAIDZ_ORIGINAL_IMPL)
+	if (vdev_raidz_math_generate(rm, rr) != RAIDZ_ORIGINAL_IMPL)
 		return;
 
-	switch (rm->rm_firstdatacol) {
+	switch (rr->rr_firstdatacol) {
 	case 1:
-		vdev_raidz_generate_parity_p(rm);
+		vdev_raidz_generate_parity_p(rr);
 		break;
 	case 2:
-		vdev_raidz_generate_parity_pq(rm);
+		vdev_raidz_generate_parity_pq(rr);
 		break;
 	case 3:
-		vdev_raidz_generate_parity_pqr(rm);
+		vdev_raidz_generate_parity_pqr(rr);
 		break;
 	default:
 		cmn_err(CE_PANIC, "invalid RAID-Z configuration");
@@ -809,30 +1092,30 @@ vdev_raidz_reconst_pq_tail_func(void *xbuf, size_t size, void *private)
 }
 
 static int
-vdev_raidz_reconstruct_p(raidz_map_t *rm, int *tgts, int ntgts)
+vdev_raidz_reconstruct_p(raidz_row_t *rr, int *tgts, int ntgts)
 {
 	int x = tgts[0];
 	int c;
 	abd_t *dst, *src;
 
 	ASSERT(ntgts == 1);
-	ASSERT(x >= rm->rm_firstdatacol);
-	ASSERT(x < rm->rm_cols);
+	ASSERT(x >= rr->rr_firstdatacol);
+	ASSERT(x < rr->rr_cols);
 
-	ASSERT(rm->rm_col[x].rc_size <= rm->rm_col[VDEV_RAIDZ_P].rc_size);
-	ASSERT(rm->rm_col[x].rc_size > 0);
+	ASSERT(rr->rr_col[x].rc_size <= rr->rr_col[VDEV_RAIDZ_P].rc_size);
+	ASSERT(rr->rr_col[x].rc_size > 0);
 
-	src = rm->rm_col[VDEV_RAIDZ_P].rc_abd;
-	dst = rm->rm_col[x].rc_abd;
+	src = rr->rr_col[VDEV_RAIDZ_P].rc_abd;
+	dst = rr->rr_col[x].rc_abd;
 
-	abd_copy_from_buf(dst, abd_to_buf(src), rm->rm_col[x].rc_size);
+	abd_copy_from_buf(dst, abd_to_buf(src), rr->rr_col[x].rc_size);
 
-	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-		uint64_t size = MIN(rm->rm_col[x].rc_size,
-		    rm->rm_col[c].rc_size);
+	for (c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+		uint64_t size = MIN(rr->rr_col[x].rc_size,
+		    rr->rr_col[c].rc_size);
 
-		src = rm->rm_col[c].rc_abd;
-		dst = rm->rm_col[x].rc_abd;
+		src = rr->rr_col[c].rc_abd;
+		dst = rr->rr_col[x].rc_abd;
 
 		if (c == x)
 			continue;
@@ -845,7 +1128,7 @@ vdev_raidz_reconstruct_p(raidz_map_t *rm, int *tgts, int ntgts)
 }
 
 static int
-vdev_raidz_reconstruct_q(raidz_map_t *rm, int *tgts, int ntgts)
+vdev_raidz_reconstruct_q(raidz_row_t *rr, int *tgts, int ntgts)
 {
 	int x = tgts[0];
 	int c, exp;
@@ -853,44 +1136,44 @@ vdev_raidz_reconstruct_q(raidz_map_t *rm, int *tgts, int ntgts)
 
 	ASSERT(ntgts == 1);
 
-	ASSERT(rm->rm_col[x].rc_size <= rm->rm_col[VDEV_RAIDZ_Q].rc_size);
+	ASSERT(rr->rr_col[x].rc_size <= rr->rr_col[VDEV_RAIDZ_Q].rc_size);
 
-	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-		uint64_t size = (c == x) ? 0 : MIN(rm->rm_col[x].rc_size,
-		    rm->rm_col[c].rc_size);
+	for (c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+		uint64_t size = (c == x) ? 0 : MIN(rr->rr_col[x].rc_size,
+		    rr->rr_col[c].rc_size);
 
-		src = rm->rm_col[c].rc_abd;
-		dst = rm->rm_col[x].rc_abd;
+		src = rr->rr_col[c].rc_abd;
+		dst = rr->rr_col[x].rc_abd;
 
-		if (c == rm->rm_firstdatacol) {
+		if (c == rr->rr_firstdatacol) {
 			abd_copy(dst, src, size);
-			if (rm->rm_col[x].rc_size > size)
+			if (rr->rr_col[x].rc_size > size)
 				abd_zero_off(dst, size,
-				    rm->rm_col[x].rc_size - size);
+				    rr->rr_col[x].rc_size - size);
 
 		} else {
-			ASSERT3U(size, <=, rm->rm_col[x].rc_size);
+			ASSERT3U(size, <=, rr->rr_col[x].rc_size);
 			(void) abd_iterate_func2(dst, src, 0, 0, size,
 			    vdev_raidz_reconst_q_pre_func, NULL);
 			(void) abd_iterate_func(dst,
-			    size, rm->rm_col[x].rc_size - size,
+			    size, rr->rr_col[x].rc_size - size,
 			    vdev_raidz_reconst_q_pre_tail_func, NULL);
 		}
 	}
 
-	src = rm->rm_col[VDEV_RAIDZ_Q].rc_abd;
-	dst = rm->rm_col[x].rc_abd;
-	exp = 255 - (rm->rm_cols - 1 - x);
+	src = rr->rr_col[VDEV_RAIDZ_Q].rc_abd;
+	dst = rr->rr_col[x].rc_abd;
+	exp = 255 - (rr->rr_cols - 1 - x);
 
 	struct reconst_q_struct rq = { abd_to_buf(src), exp };
-	(void) abd_iterate_func(dst, 0, rm->rm_col[x].rc_size,
+	(void) abd_iterate_func(dst, 0, rr->rr_col[x].rc_size,
 	    vdev_raidz_reconst_q_post_func, &rq);
 
 	return (1 << VDEV_RAIDZ_Q);
 }
 
 static int
-vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
+vdev_raidz_reconstruct_pq(raidz_row_t *rr, int *tgts, int ntgts)
 {
 	uint8_t *p, *q, *pxy, *qxy, tmp, a, b, aexp, bexp;
 	abd_t *pdata, *qdata;
@@ -901,10 +1184,10 @@ vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 
 	ASSERT(ntgts == 2);
 	ASSERT(x < y);
-	ASSERT(x >= rm->rm_firstdatacol);
-	ASSERT(y < rm->rm_cols);
+	ASSERT(x >= rr->rr_firstdatacol);
+	ASSERT(y < rr->rr_cols);
 
-	ASSERT(rm->rm_col[x].rc_size >= rm->rm_col[y].rc_size);
+	ASSERT(rr->rr_col[x].rc_size >= rr->rr_col[y].rc_size);
 
 	/*
 	 * Move the parity data aside -- we're going to compute parity as
@@ -913,29 +1196,29 @@ vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 	 * parity so we make those columns appear to be full of zeros by
 	 * setting their lengths to zero.
 	 */
-	pdata = rm->rm_col[VDEV_RAIDZ_P].rc_abd;
-	qdata = rm->rm_col[VDEV_RAIDZ_Q].rc_abd;
-	xsize = rm->rm_col[x].rc_size;
-	ysize = rm->rm_col[y].rc_size;
+	pdata = rr->rr_col[VDEV_RAIDZ_P].rc_abd;
+	qdata = rr->rr_col[VDEV_RAIDZ_Q].rc_abd;
+	xsize = rr->rr_col[x].rc_size;
+	ysize = rr->rr_col[y].rc_size;
 
-	rm->rm_col[VDEV_RAIDZ_P].rc_abd =
-	    abd_alloc_linear(rm->rm_col[VDEV_RAIDZ_P].rc_size, B_TRUE);
-	rm->rm_col[VDEV_RAIDZ_Q].rc_abd =
-	    abd_alloc_linear(rm->rm_col[VDEV_RAIDZ_Q].rc_size, B_TRUE);
-	rm->rm_col[x].rc_size = 0;
-	rm->rm_col[y].rc_size = 0;
+	rr->rr_col[VDEV_RAIDZ_P].rc_abd =
+	    abd_alloc_linear(rr->rr_col[VDEV_RAIDZ_P].rc_size, B_TRUE);
+	rr->rr_col[VDEV_RAIDZ_Q].rc_abd =
+	    abd_alloc_linear(rr->rr_col[VDEV_RAIDZ_Q].rc_size, B_TRUE);
+	rr->rr_col[x].rc_size = 0;
+	rr->rr_col[y].rc_size = 0;
 
-	vdev_raidz_generate_parity_pq(rm);
+	vdev_raidz_generate_parity_pq(rr);
 
-	rm->rm_col[x].rc_size = xsize;
-	rm->rm_col[y].rc_size = ysize;
+	rr->rr_col[x].rc_size = xsize;
+	rr->rr_col[y].rc_size = ysize;
 
 	p = abd_to_buf(pdata);
 	q = abd_to_buf(qdata);
-	pxy = abd_to_buf(rm->rm_col[VDEV_RAIDZ_P].rc_abd);
-	qxy = abd_to_buf(rm->rm_col[VDEV_RAIDZ_Q].rc_abd);
-	xd = rm->rm_col[x].rc_abd;
-	yd = rm->rm_col[y].rc_abd;
+	pxy = abd_to_buf(rr->rr_col[VDEV_RAIDZ_P].rc_abd);
+	qxy = abd_to_buf(rr->rr_col[VDEV_RAIDZ_Q].rc_abd);
+	xd = rr->rr_col[x].rc_abd;
+	yd = rr->rr_col[y].rc_abd;
 
 	/*
 	 * We now have:
@@ -953,7 +1236,7 @@ vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 	 */
 
 	a = vdev_raidz_pow2[255 + x - y];
-	b = vdev_raidz_pow2[255 - (rm->rm_cols - 1 - x)];
+	b = vdev_raidz_pow2[255 - (rr->rr_cols - 1 - x)];
 	tmp = 255 - vdev_raidz_log2[a ^ 1];
 
 	aexp = vdev_raidz_log2[vdev_raidz_exp2(a, tmp)];
@@ -967,14 +1250,14 @@ vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 	(void) abd_iterate_func(xd, ysize, xsize - ysize,
 	    vdev_raidz_reconst_pq_tail_func, &rpq);
 
-	abd_free(rm->rm_col[VDEV_RAIDZ_P].rc_abd);
-	abd_free(rm->rm_col[VDEV_RAIDZ_Q].rc_abd);
+	abd_free(rr->rr_col[VDEV_RAIDZ_P].rc_abd);
+	abd_free(rr->rr_col[VDEV_RAIDZ_Q].rc_abd);
 
 	/*
 	 * Restore the saved parity data.
 	 */
-	rm->rm_col[VDEV_RAIDZ_P].rc_abd = pdata;
-	rm->rm_col[VDEV_RAIDZ_Q].rc_abd = qdata;
+	rr->rr_col[VDEV_RAIDZ_P].rc_abd = pdata;
+	rr->rr_col[VDEV_RAIDZ_Q].rc_abd = qdata;
 
 	return ((1 << VDEV_RAIDZ_P) | (1 << VDEV_RAIDZ_Q));
 }
@@ -1134,13 +1417,13 @@ vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 /* END CSTYLED */
 
 static void
-vdev_raidz_matrix_init(raidz_map_t *rm, int n, int nmap, int *map,
+vdev_raidz_matrix_init(raidz_row_t *rr, int n, int nmap, int *map,
     uint8_t **rows)
 {
 	int i, j;
 	int pow;
 
-	ASSERT(n == rm->rm_cols - rm->rm_firstdatacol);
+	ASSERT(n == rr->rr_cols - rr->rr_firstdatacol);
 
 	/*
 	 * Fill in the missing rows of interest.
@@ -1164,7 +1447,7 @@ vdev_raidz_matrix_init(raidz_map_t *rm, int n, int nmap, int *map,
 }
 
 static void
-vdev_raidz_matrix_invert(raidz_map_t *rm, int n, int nmissing, int *missing,
+vdev_raidz_matrix_invert(raidz_row_t *rr, int n, int nmissing, int *missing,
     uint8_t **rows, uint8_t **invrows, const uint8_t *used)
 {
 	int i, j, ii, jj;
@@ -1176,10 +1459,10 @@ vdev_raidz_matrix_invert(raidz_map_t *rm, int n, int nmissing, int *missing,
 	 * correspond to data columns.
 	 */
 	for (i = 0; i < nmissing; i++) {
-		ASSERT3S(used[i], <, rm->rm_firstdatacol);
+		ASSERT3S(used[i], <, rr->rr_firstdatacol);
 	}
 	for (; i < n; i++) {
-		ASSERT3S(used[i], >=, rm->rm_firstdatacol);
+		ASSERT3S(used[i], >=, rr->rr_firstdatacol);
 	}
 
 	/*
@@ -1196,8 +1479,8 @@ vdev_raidz_matrix_invert(raidz_map_t *rm, int n, int nmissing, int *missing,
 	 */
 	for (i = 0; i < nmissing; i++) {
 		for (j = nmissing; j < n; j++) {
-			ASSERT3U(used[j], >=, rm->rm_firstdatacol);
-			jj = used[j] - rm->rm_firstdatacol;
+			ASSERT3U(used[j], >=, rr->rr_firstdatacol);
+			jj = used[j] - rr->rr_firstdatacol;
 			ASSERT3S(jj, <, n);
 			invrows[i][j] = rows[i][jj];
 			rows[i][jj] = 0;
@@ -1258,7 +1541,7 @@ vdev_raidz_matrix_invert(raidz_map_t *rm, int n, int nmissing, int *missing,
 }
 
 static void
-vdev_raidz_matrix_reconstruct(raidz_map_t *rm, int n, int nmissing,
+vdev_raidz_matrix_reconstruct(raidz_row_t *rr, int n, int nmissing,
     int *missing, uint8_t **invrows, const uint8_t *used)
 {
 	int i, j, x, cc, c;
@@ -1290,22 +1573,27 @@ vdev_raidz_matrix_reconstruct(raidz_map_t *rm, int n, int nmissing,
 
 	for (i = 0; i < n; i++) {
 		c = used[i];
-		ASSERT3U(c, <, rm->rm_cols);
+		ASSERT3U(c, <, rr->rr_cols);
 
-		src = abd_to_buf(rm->rm_col[c].rc_abd);
-		ccount = rm->rm_col[c].rc_size;
+		ccount = rr->rr_col[c].rc_size;
+		ASSERT(ccount >= rr->rr_col[missing[0]].rc_size || i > 0);
+		/*
+		 * Columns past the end of a short row hold no data; they
+		 * are never parity, so never the first column used.
+		 */
+		if (ccount == 0)
+			continue;
+		src = abd_to_buf(rr->rr_col[c].rc_abd);
 		for (j = 0; j < nmissing; j++) {
-			cc = missing[j] + rm->rm_firstdatacol;
-			ASSERT3U(cc, >=, rm->rm_firstdatacol);
-			ASSERT3U(cc, <, rm->rm_cols);
+			cc = missing[j] + rr->rr_firstdatacol;
+			ASSERT3U(cc, >=, rr->rr_firstdatacol);
+			ASSERT3U(cc, <, rr->rr_cols);
 			ASSERT3U(cc, !=, c);
 
-			dst[j] = abd_to_buf(rm->rm_col[cc].rc_abd);
-			dcount[j] = rm->rm_col[cc].rc_size;
+			dst[j] = abd_to_buf(rr->rr_col[cc].rc_abd);
+			dcount[j] = rr->rr_col[cc].rc_size;
 		}
 
-		ASSERT(ccount >= rm->rm_col[missing[0]].rc_size || i > 0);
-
 		for (x = 0; x < ccount; x++, src++) {
 			if (*src != 0)
 				log = vdev_raidz_log2[*src];
@@ -1334,7 +1622,7 @@ vdev_raidz_matrix_reconstruct(raidz_map_t *rm, int n, int nmissing,
 }
 
 static int
-vdev_raidz_reconstruct_general(raidz_map_t *rm, int *tgts, int ntgts)
+vdev_raidz_reconstruct_general(raidz_row_t *rr, int *tgts, int ntgts)
 {
 	int n, i, c, t, tt;
 	int nmissing_rows;
@@ -1356,28 +1644,31 @@ vdev_raidz_reconstruct_general(raidz_map_t *rm, int *tgts, int ntgts)
 	 * Matrix reconstruction can't use scatter ABDs yet, so we allocate
 	 * temporary linear ABDs.
 	 */
-	if (!abd_is_linear(rm->rm_col[rm->rm_firstdatacol].rc_abd)) {
-		bufs = kmem_alloc(rm->rm_cols * sizeof (abd_t *), KM_PUSHPAGE);
+	if (!abd_is_linear(rr->rr_col[rr->rr_firstdatacol].rc_abd)) {
+		bufs = kmem_alloc(rr->rr_cols * sizeof (abd_t *), KM_PUSHPAGE);
 
-		for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-			raidz_col_t *col = &rm->rm_col[c];
+		for (c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+			raidz_col_t *col = &rr->rr_col[c];
 
 			bufs[c] = col->rc_abd;
-			col->rc_abd = abd_alloc_linear(col->rc_size, B_TRUE);
-			abd_copy(col->rc_abd, bufs[c], col->rc_size);
+			if (bufs[c] != NULL) {
+				col->rc_abd = abd_alloc_linear(col->rc_size,
+				    B_TRUE);
+				abd_copy(col->rc_abd, bufs[c], col->rc_size);
+			}
 		}
 	}
 
-	n = rm->rm_cols - rm->rm_firstdatacol;
+	n = rr->rr_cols - rr->rr_firstdatacol;
 
 	/*
 	 * Figure out which data columns are missing.
 	 */
 	nmissing_rows = 0;
 	for (t = 0; t < ntgts; t++) {
-		if (tgts[t] >= rm->rm_firstdatacol) {
+		if (tgts[t] >= rr->rr_firstdatacol) {
 			missing_rows[nmissing_rows++] =
-			    tgts[t] - rm->rm_firstdatacol;
+			    tgts[t] - rr->rr_firstdatacol;
 		}
 	}
 
@@ -1387,7 +1678,7 @@ vdev_raidz_reconstruct_general(raidz_map_t *rm, int *tgts, int ntgts)
 	 */
 	for (tt = 0, c = 0, i = 0; i < nmissing_rows; c++) {
 		ASSERT(tt < ntgts);
-		ASSERT(c < rm->rm_firstdatacol);
+		ASSERT(c < rr->rr_firstdatacol);
 
 		/*
 		 * Skip any targeted parity columns.
@@ -1422,9 +1713,9 @@ vdev_raidz_reconstruct_general(raidz_map_t *rm, int *tgts, int ntgts)
 		used[i] = parity_map[i];
 	}
 
-	for (tt = 0, c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+	for (tt = 0, c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
 		if (tt < nmissing_rows &&
-		    c == missing_rows[tt] + rm->rm_firstdatacol) {
+		    c == missing_rows[tt] + rr->rr_firstdatacol) {
 			tt++;
 			continue;
 		}
@@ -1437,18 +1728,18 @@ vdev_raidz_reconstruct_general(raidz_map_t *rm, int *tgts, int ntgts)
 	/*
 	 * Initialize the interesting rows of the matrix.
 	 */
-	vdev_raidz_matrix_init(rm, n, nmissing_rows, parity_map, rows);
+	vdev_raidz_matrix_init(rr, n, nmissing_rows, parity_map, rows);
 
 	/*
 	 * Invert the matrix.
 	 */
-	vdev_raidz_matrix_invert(rm, n, nmissing_rows, missing_rows, rows,
+	vdev_raidz_matrix_invert(rr, n, nmissing_rows, missing_rows, rows,
 	    invrows, used);
 
 	/*
 	 * Reconstruct the missing data using the generated matrix.
 	 */
-	vdev_raidz_matrix_reconstruct(rm, n, nmissing_rows, missing_rows,
+	vdev_raidz_matrix_reconstruct(rr, n, nmissing_rows, missing_rows,
 	    invrows, used);
 
 	kmem_free(p, psize);
@@ -1457,26 +1748,28 @@ vdev_raidz_reconstruct_general(raidz_map_t *rm, int *tgts, int ntgts)
 	 * copy back from temporary linear abds and free them
 	 */
 	if (bufs) {
-		for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-			raidz_col_t *col = &rm->rm_col[c];
+		for (c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+			raidz_col_t *col = &rr->rr_col[c];
 
-			abd_copy(bufs[c], col->rc_abd, col->rc_size);
-			abd_free(col->rc_abd);
+			if (bufs[c] != NULL) {
+				abd_copy(bufs[c], col->rc_abd, col->rc_size);
+				abd_free(col->rc_abd);
+			}
 			col->rc_abd = bufs[c];
 		}
-		kmem_free(bufs, rm->rm_cols * sizeof (abd_t *));
+		kmem_free(bufs, rr->rr_cols * sizeof (abd_t *));
 	}
 
 	return (code);
 }
 
-int
-vdev_raidz_reconstruct(raidz_map_t *rm, const int *t, int nt)
+static void
+vdev_raidz_reconstruct_row(raidz_map_t *rm, raidz_row_t *rr,
+    const int *t, int nt)
 {
 	int tgts[VDEV_RAIDZ_MAXPARITY], *dt;
 	int ntgts;
 	int i, c, ret;
-	int code;
 	int nbadparity, nbaddata;
 	int parity_valid[VDEV_RAIDZ_MAXPARITY];
 
@@ -1487,19 +1780,19 @@ vdev_raidz_reconstruct(raidz_map_t *rm, const int *t, int nt)
 		ASSERT(t[i] > t[i - 1]);
 	}
 
-	nbadparity = rm->rm_firstdatacol;
-	nbaddata = rm->rm_cols - nbadparity;
+	nbadparity = rr->rr_firstdatacol;
+	nbaddata = rr->rr_cols - nbadparity;
 	ntgts = 0;
-	for (i = 0, c = 0; c < rm->rm_cols; c++) {
-		if (c < rm->rm_firstdatacol)
+	for (i = 0, c = 0; c < rr->rr_cols; c++) {
+		if (c < rr->rr_firstdatacol)
 			parity_valid[c] = B_FALSE;
 
 		if (i < nt && c == t[i]) {
 			tgts[ntgts++] = c;
 			i++;
-		} else if (rm->rm_col[c].rc_error != 0) {
+		} else if (rr->rr_col[c].rc_error != 0) {
 			tgts[ntgts++] = c;
-		} else if (c >= rm->rm_firstdatacol) {
+		} else if (c >= rr->rr_firstdatacol) {
 			nbaddata--;
 		} else {
 			parity_valid[c] = B_TRUE;
@@ -1514,42 +1807,59 @@ vdev_raidz_reconstruct(raidz_map_t *rm, const int *t, int nt)
 	dt = &tgts[nbadparity];
 
 	/* Reconstruct using the new math implementation */
-	ret = vdev_raidz_math_reconstruct(rm, parity_valid, dt, nbaddata);
+	ret = vdev_raidz_math_reconstruct(rm, rr, parity_valid, dt, nbaddata);
 	if (ret != RAIDZ_ORIGINAL_IMPL)
-		return (ret);
+		return;
 
 	/*
 	 * See if we can use any of our optimized reconstruction routines.
 	 */
 	switch (nbaddata) {
 	case 1:
-		if (parity_valid[VDEV_RAIDZ_P])
-			return (vdev_raidz_reconstruct_p(rm, dt, 1));
+		if (parity_valid[VDEV_RAIDZ_P]) {
+			(void) vdev_raidz_reconstruct_p(rr, dt, 1);
+			return;
+		}
 
-		ASSERT(rm->rm_firstdatacol > 1);
+		ASSERT(rr->rr_firstdatacol > 1);
 
-		if (parity_valid[VDEV_RAIDZ_Q])
-			return (vdev_raidz_reconstruct_q(rm, dt, 1));
+		if (parity_valid[VDEV_RAIDZ_Q]) {
+			(void) vdev_raidz_reconstruct_q(rr, dt, 1);
+			return;
+		}
 
-		ASSERT(rm->rm_firstdatacol > 2);
+		ASSERT(rr->rr_firstdatacol > 2);
 		break;
 
 	case 2:
-		ASSERT(rm->rm_firstdatacol > 1);
+		ASSERT(rr->rr_firstdatacol > 1);
 
 		if (parity_valid[VDEV_RAIDZ_P] &&
-		    parity_valid[VDEV_RAIDZ_Q])
-			return (vdev_raidz_reconstruct_pq(rm, dt, 2));
+		    parity_valid[VDEV_RAIDZ_Q]) {
+			(void) vdev_raidz_reconstruct_pq(rr, dt, 2);
+			return;
+		}
 
-		ASSERT(rm->rm_firstdatacol > 2);
+		ASSERT(rr->rr_firstdatacol > 2);
 
 		break;
 	}
 
-	code = vdev_raidz_reconstruct_general(rm, tgts, ntgts);
-	ASSERT(code < (1 << VDEV_RAIDZ_MAXPARITY));
-	ASSERT(code > 0);
-	return (code);
+	(void) vdev_raidz_reconstruct_general(rr, tgts, ntgts);
+}
+
+void
+vdev_raidz_generate_parity(raidz_map_t *rm)
+{
+	for (int i = 0; i < rm->rm_nrows; i++)
+		vdev_raidz_generate_parity_row(rm, rm->rm_row[i]);
+}
+
+void
+vdev_raidz_reconstruct(raidz_map_t *rm, const int *t, int nt)
+{
+	for (int i = 0; i < rm->rm_nrows; i++)
+		vdev_raidz_reconstruct_row(rm, rm->rm_row[i], t, nt);
 }
 
 static int
@@ -1558,6 +1868,7 @@ vdev_raidz_open(vdev_t *vd, uint64_t *asize, uint64_t *max_asize,
 {
 	vdev_t *cvd;
 	uint64_t nparity = vd->vdev_nparity;
+	uint64_t ndata;
 	int c;
 	int lasterror = 0;
 	int numerrors = 0;
@@ -1586,8 +1897,16 @@ vdev_raidz_open(vdev_t *vd, uint64_t *asize, uint64_t *max_asize,
 		*ashift = MAX(*ashift, cvd->vdev_ashift);
 	}
 
-	*asize *= vd->vdev_children;
-	*max_asize *= vd->vdev_children;
+	/*
+	 * The space of a child being added by an expansion isn't usable until
+	 * the reflow has completed.
+	 */
+	ndata = vd->vdev_children;
+	if (vd->vdev_rz_expanding)
+		ndata--;
+
+	*asize *= ndata;
+	*max_asize *= ndata;
 
 	if (numerrors > nparity) {
 		vd->vdev_stat.vs_aux = VDEV_AUX_NO_REPLICAS;
@@ -1606,12 +1925,17 @@ vdev_raidz_close(vdev_t *vd)
 		vdev_close(vd->vdev_child[c]);
 }
 
+/*
+ * The allocated size of a block depends on the width it was written with,
+ * which is determined by its birth txg (see vdev_raidz_get_logical_width()).
+ */
 static uint64_t
-vdev_raidz_asize(vdev_t *vd, uint64_t psize)
+vdev_raidz_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
 {
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
 	uint64_t asize;
 	uint64_t ashift = vd->vdev_top->vdev_ashift;
-	uint64_t cols = vd->vdev_children;
+	uint64_t cols = vdev_raidz_get_logical_width(vdrz, txg);
 	uint64_t nparity = vd->vdev_nparity;
 
 	asize = ((psize - 1) >> ashift) + 1;
@@ -1632,18 +1956,26 @@ vdev_raidz_child_done(zio_t *zio)
 }
 
 static void
-vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
+vdev_raidz_shadow_child_done(zio_t *zio)
+{
+	raidz_col_t *rc = zio->io_private;
+
+	rc->rc_shadow_error = zio->io_error;
+}
+
+static void
+vdev_raidz_io_verify(zio_t *zio, raidz_row_t *rr, int col, uint64_t txg)
 {
 #ifdef ZFS_DEBUG
 	vdev_t *vd = zio->io_vd;
 	vdev_t *tvd = vd->vdev_top;
 
-	range_seg_t logical_rs, physical_rs;
+	range_seg64_t logical_rs, physical_rs;
 	logical_rs.rs_start = zio->io_offset;
 	logical_rs.rs_end = logical_rs.rs_start +
-	    vdev_raidz_asize(zio->io_vd, zio->io_size);
+	    vdev_raidz_asize(zio->io_vd, zio->io_size, txg);
 
-	raidz_col_t *rc = &rm->rm_col[col];
+	raidz_col_t *rc = &rr->rr_col[col];
 	vdev_t *cvd = vd->vdev_child[rc->rc_devidx];
 
 	vdev_xlate(cvd, &logical_rs, &physical_rs);
@@ -1664,106 +1996,113 @@ vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
 #endif
 }
 
-/*
- * Start an IO operation on a RAIDZ VDev
- *
- * Outline:
- * - For write operations:
- *   1. Generate the parity data
- *   2. Create child zio write operations to each column's vdev, for both
- *      data and parity.
- *   3. If the column skips any sectors for padding, create optional dummy
- *      write zio children for those areas to improve aggregation continuity.
- * - For read operations:
- *   1. Create child zio read operations to each data column's vdev to read
- *      the range of data required for zio.
- *   2. If this is a scrub or resilver operation, or if any of the data
- *      vdevs have had errors, then create zio read operations to the parity
- *      columns' VDevs as well.
- */
 static void
-vdev_raidz_io_start(zio_t *zio)
+vdev_raidz_io_start_write(zio_t *zio, raidz_row_t *rr, boolean_t verify,
+    uint64_t txg)
 {
 	vdev_t *vd = zio->io_vd;
-	vdev_t *tvd = vd->vdev_top;
-	vdev_t *cvd;
-	raidz_map_t *rm;
-	raidz_col_t *rc;
-	int c, i;
-
-	rm = vdev_raidz_map_alloc(zio, tvd->vdev_ashift, vd->vdev_children,
-	    vd->vdev_nparity);
+	raidz_map_t *rm = zio->io_vsd;
 
-	ASSERT3U(rm->rm_asize, ==, vdev_psize_to_asize(vd, zio->io_size));
+	vdev_raidz_generate_parity_row(rm, rr);
 
-	if (zio->io_type == ZIO_TYPE_WRITE) {
-		vdev_raidz_generate_parity(rm);
+	for (int c = 0; c < rr->rr_cols; c++) {
+		raidz_col_t *rc = &rr->rr_col[c];
 
-		for (c = 0; c < rm->rm_cols; c++) {
-			rc = &rm->rm_col[c];
-			cvd = vd->vdev_child[rc->rc_devidx];
+		if (rc->rc_size == 0)
+			continue;
 
-			/*
-			 * Verify physical to logical translation.
-			 */
-			vdev_raidz_io_verify(zio, rm, c);
+		/*
+		 * Verify physical to logical translation.
+		 */
+		if (verify)
+			vdev_raidz_io_verify(zio, rr, c, txg);
 
-			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
-			    rc->rc_offset, rc->rc_abd, rc->rc_size,
-			    zio->io_type, zio->io_priority, 0,
-			    vdev_raidz_child_done, rc));
-		}
+		zio_nowait(zio_vdev_child_io(zio, NULL,
+		    vd->vdev_child[rc->rc_devidx], rc->rc_offset,
+		    rc->rc_abd, rc->rc_size, zio->io_type, zio->io_priority,
+		    0, vdev_raidz_child_done, rc));
 
 		/*
-		 * Generate optional I/Os for any skipped sectors to improve
-		 * aggregation contiguity.
+		 * The reflow may already have copied this sector to its new
+		 * location, in which case that copy must be kept up to date.
 		 */
-		for (c = rm->rm_skipstart, i = 0; i < rm->rm_nskip; c++, i++) {
-			ASSERT(c <= rm->rm_scols);
-			if (c == rm->rm_scols)
-				c = 0;
-			rc = &rm->rm_col[c];
-			cvd = vd->vdev_child[rc->rc_devidx];
-			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
-			    rc->rc_offset + rc->rc_size, NULL,
-			    1 << tvd->vdev_ashift,
-			    zio->io_type, zio->io_priority,
-			    ZIO_FLAG_NODATA | ZIO_FLAG_OPTIONAL, NULL, NULL));
+		if (rc->rc_shadow_devidx != UINT64_MAX) {
+			zio_nowait(zio_vdev_child_io(zio, NULL,
+			    vd->vdev_child[rc->rc_shadow_devidx],
+			    rc->rc_shadow_offset, rc->rc_abd, rc->rc_size,
+			    zio->io_type, zio->io_priority, 0,
+			    vdev_raidz_shadow_child_done, rc));
 		}
+	}
+}
 
-		zio_execute(zio);
-		return;
+/*
+ * Generate optional I/Os for any skipped sectors to improve aggregation
+ * contiguity.  Only blocks which are laid out in a single row have them.
+ */
+static void
+vdev_raidz_io_start_skip(zio_t *zio, raidz_map_t *rm)
+{
+	vdev_t *vd = zio->io_vd;
+	raidz_row_t *rr = rm->rm_row[0];
+	int c, i;
+
+	ASSERT3U(rm->rm_nrows, ==, 1);
+
+	for (c = rm->rm_skipstart, i = 0; i < rm->rm_nskip; c++, i++) {
+		ASSERT(c <= rr->rr_scols);
+		if (c == rr->rr_scols)
+			c = 0;
+		raidz_col_t *rc = &rr->rr_col[c];
+		vdev_t *cvd = vd->vdev_child[rc->rc_devidx];
+		zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
+		    rc->rc_offset + rc->rc_size, NULL,
+		    1 << vd->vdev_top->vdev_ashift,
+		    zio->io_type, zio->io_priority,
+		    ZIO_FLAG_NODATA | ZIO_FLAG_OPTIONAL, NULL, NULL));
 	}
+}
 
-	ASSERT(zio->io_type == ZIO_TYPE_READ);
+/*
+ * Iterate over the columns in reverse order so that we hit the parity
+ * last -- any errors along the way will force us to read the parity.
+ * Blocks made up of several rows always read the parity as well, since a
+ * checksum error can't be attributed to a particular row.
+ */
+static void
+vdev_raidz_io_start_read(zio_t *zio, raidz_row_t *rr, boolean_t forceparity)
+{
+	vdev_t *vd = zio->io_vd;
+
+	for (int c = rr->rr_cols - 1; c >= 0; c--) {
+		raidz_col_t *rc = &rr->rr_col[c];
+		vdev_t *cvd;
+
+		if (rc->rc_size == 0)
+			continue;
 
-	/*
-	 * Iterate over the columns in reverse order so that we hit the parity
-	 * last -- any errors along the way will force us to read the parity.
-	 */
-	for (c = rm->rm_cols - 1; c >= 0; c--) {
-		rc = &rm->rm_col[c];
 		cvd = vd->vdev_child[rc->rc_devidx];
 		if (!vdev_readable(cvd)) {
-			if (c >= rm->rm_firstdatacol)
-				rm->rm_missingdata++;
+			if (c >= rr->rr_firstdatacol)
+				rr->rr_missingdata++;
 			else
-				rm->rm_missingparity++;
+				rr->rr_missingparity++;
 			rc->rc_error = SET_ERROR(ENXIO);
 			rc->rc_tried = 1;	/* don't even try */
 			rc->rc_skipped = 1;
 			continue;
 		}
 		if (vdev_dtl_contains(cvd, DTL_MISSING, zio->io_txg, 1)) {
-			if (c >= rm->rm_firstdatacol)
-				rm->rm_missingdata++;
+			if (c >= rr->rr_firstdatacol)
+				rr->rr_missingdata++;
 			else
-				rm->rm_missingparity++;
+				rr->rr_missingparity++;
 			rc->rc_error = SET_ERROR(ESTALE);
 			rc->rc_skipped = 1;
 			continue;
 		}
-		if (c >= rm->rm_firstdatacol || rm->rm_missingdata > 0 ||
+		if (forceparity ||
+		    c >= rr->rr_firstdatacol || rr->rr_missingdata > 0 ||
 		    (zio->io_flags & (ZIO_FLAG_SCRUB | ZIO_FLAG_RESILVER))) {
 			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
 			    rc->rc_offset, rc->rc_abd, rc->rc_size,
@@ -1771,33 +2110,138 @@ vdev_raidz_io_start(zio_t *zio)
 			    vdev_raidz_child_done, rc));
 		}
 	}
-
-	zio_execute(zio);
 }
 
-
 /*
- * Report a checksum error for a child of a RAID-Z device.
+ * Start an IO operation on a RAIDZ VDev
+ *
+ * Outline:
+ * - For write operations:
+ *   1. Generate the parity data
+ *   2. Create child zio write operations to each column's vdev, for both
+ *      data and parity.  While the vdev is being expanded, columns which
+ *      may already have been copied are also written to their new location.
+ *   3. If the column skips any sectors for padding, create optional dummy
+ *      write zio children for those areas to improve aggregation continuity.
+ * - For read operations:
+ *   1. Create child zio read operations to each data column's vdev to read
+ *      the range of data required for zio.
+ *   2. If this is a scrub or resilver operation, or if any of the data
+ *      vdevs have had errors, then create zio read operations to the parity
+ *      columns' VDevs as well.
  */
 static void
-raidz_checksum_error(zio_t *zio, raidz_col_t *rc, abd_t *bad_data)
+vdev_raidz_io_start(zio_t *zio)
 {
-	vdev_t *vd = zio->io_vd->vdev_child[rc->rc_devidx];
-
-	if (!(zio->io_flags & ZIO_FLAG_SPECULATIVE)) {
-		zio_bad_cksum_t zbc;
-		raidz_map_t *rm = zio->io_vsd;
+	vdev_t *vd = zio->io_vd;
+	vdev_t *tvd = vd->vdev_top;
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+	spa_t *spa = zio->io_spa;
+	raidz_map_t *rm;
+	uint64_t txg = (zio->io_bp != NULL) ? BP_PHYSICAL_BIRTH(zio->io_bp) : 0;
+	uint64_t logical_width = vdev_raidz_get_logical_width(vdrz, txg);
+	uint64_t physical_width = vdrz->vd_physical_width;
+	boolean_t expanded = B_TRUE;
 
-		mutex_enter(&vd->vdev_stat_lock);
-		vd->vdev_stat.vs_checksum_errors++;
-		mutex_exit(&vd->vdev_stat_lock);
+	/*
+	 * Pairs with the membar_producer() in vdev_raidz_attach_sync(); if
+	 * we see the new width, we also see that the reflow is running.
+	 */
+	membar_consumer();
 
-		zbc.zbc_has_cksum = 0;
-		zbc.zbc_injected = rm->rm_ecksuminjected;
+	if (vre->vre_state == DSS_SCANNING) {
+		uint64_t synced, next;
 
-		zfs_ereport_post_checksum(zio->io_spa, vd,
-		    &zio->io_bookmark, zio, rc->rc_offset, rc->rc_size,
-		    rc->rc_abd, bad_data, &zbc);
+		/*
+		 * The new child is part of the layout as soon as the reflow
+		 * has started.  Lock the range so that it isn't reflowed
+		 * underneath us, then find out which rows have been moved.
+		 */
+		physical_width = vd->vdev_children;
+		locked_range_t *lr = rangelock_enter(&vre->vre_rangelock,
+		    zio->io_offset, vdev_raidz_asize(vd, zio->io_size, txg),
+		    RL_READER);
+
+		synced = vre->vre_synced_offset;
+		if (synced == UINT64_MAX)
+			synced = RRSS_GET_OFFSET(&spa->spa_ubsync);
+		next = vre->vre_offset;
+		if (next == UINT64_MAX)
+			next = synced;
+
+		rm = vdev_raidz_map_alloc_expanded(zio, tvd->vdev_ashift,
+		    physical_width, logical_width, vd->vdev_nparity,
+		    synced, next,
+		    RRSS_GET_STATE(&spa->spa_ubsync) == RRSS_SCRATCH_VALID);
+		rm->rm_lr = lr;
+	} else if (logical_width != physical_width) {
+		/*
+		 * A block written before the expansion; all of it has been
+		 * moved to the new layout.
+		 */
+		rm = vdev_raidz_map_alloc_expanded(zio, tvd->vdev_ashift,
+		    physical_width, logical_width, vd->vdev_nparity,
+		    UINT64_MAX, UINT64_MAX, B_FALSE);
+	} else {
+		rm = vdev_raidz_map_alloc(zio, tvd->vdev_ashift,
+		    logical_width, vd->vdev_nparity);
+		expanded = B_FALSE;
+	}
+	rm->rm_original_width = vdrz->vd_original_width;
+
+	zio->io_vsd = rm;
+	zio->io_vsd_ops = &vdev_raidz_vsd_ops;
+
+	ASSERT3U(rm->rm_asize, ==,
+	    vdev_psize_to_asize_txg(vd, zio->io_size, txg));
+
+	if (zio->io_type == ZIO_TYPE_WRITE) {
+		for (int i = 0; i < rm->rm_nrows; i++) {
+			vdev_raidz_io_start_write(zio, rm->rm_row[i],
+			    !expanded, txg);
+		}
+
+		if (!expanded)
+			vdev_raidz_io_start_skip(zio, rm);
+
+		zio_execute(zio);
+		return;
+	}
+
+	ASSERT(zio->io_type == ZIO_TYPE_READ);
+
+	for (int i = 0; i < rm->rm_nrows; i++) {
+		vdev_raidz_io_start_read(zio, rm->rm_row[i],
+		    rm->rm_nrows > 1);
+	}
+
+	zio_execute(zio);
+}
+
+
+/*
+ * Report a checksum error for a child of a RAID-Z device.
+ */
+static void
+raidz_checksum_error(zio_t *zio, raidz_col_t *rc, abd_t *bad_data)
+{
+	vdev_t *vd = zio->io_vd->vdev_child[rc->rc_devidx];
+
+	if (!(zio->io_flags & ZIO_FLAG_SPECULATIVE)) {
+		zio_bad_cksum_t zbc;
+		raidz_map_t *rm = zio->io_vsd;
+
+		mutex_enter(&vd->vdev_stat_lock);
+		vd->vdev_stat.vs_checksum_errors++;
+		mutex_exit(&vd->vdev_stat_lock);
+
+		zbc.zbc_has_cksum = 0;
+		zbc.zbc_injected = rm->rm_ecksuminjected;
+
+		zfs_ereport_post_checksum(zio->io_spa, vd,
+		    &zio->io_bookmark, zio, rc->rc_offset, rc->rc_size,
+		    rc->rc_abd, bad_data, &zbc);
 	}
 }
 
@@ -1827,10 +2271,11 @@ raidz_checksum_verify(zio_t *zio)
  * number such failures.
  */
 static int
-raidz_parity_verify(zio_t *zio, raidz_map_t *rm)
+raidz_parity_verify(zio_t *zio, raidz_row_t *rr)
 {
 	abd_t *orig[VDEV_RAIDZ_MAXPARITY];
 	int c, ret = 0;
+	raidz_map_t *rm = zio->io_vsd;
 	raidz_col_t *rc;
 
 	blkptr_t *bp = zio->io_bp;
@@ -1840,8 +2285,8 @@ raidz_parity_verify(zio_t *zio, raidz_map_t *rm)
 	if (checksum == ZIO_CHECKSUM_NOPARITY)
 		return (ret);
 
-	for (c = 0; c < rm->rm_firstdatacol; c++) {
-		rc = &rm->rm_col[c];
+	for (c = 0; c < rr->rr_firstdatacol; c++) {
+		rc = &rr->rr_col[c];
 		if (!rc->rc_tried || rc->rc_error != 0)
 			continue;
 
@@ -1849,10 +2294,10 @@ raidz_parity_verify(zio_t *zio, raidz_map_t *rm)
 		abd_copy(orig[c], rc->rc_abd, rc->rc_size);
 	}
 
-	vdev_raidz_generate_parity(rm);
+	vdev_raidz_generate_parity_row(rm, rr);
 
-	for (c = 0; c < rm->rm_firstdatacol; c++) {
-		rc = &rm->rm_col[c];
+	for (c = 0; c < rr->rr_firstdatacol; c++) {
+		rc = &rr->rr_col[c];
 		if (!rc->rc_tried || rc->rc_error != 0)
 			continue;
 		if (abd_cmp(orig[c], rc->rc_abd) != 0) {
@@ -1867,453 +2312,211 @@ raidz_parity_verify(zio_t *zio, raidz_map_t *rm)
 }
 
 static int
-vdev_raidz_worst_error(raidz_map_t *rm)
+vdev_raidz_worst_error(raidz_row_t *rr)
 {
 	int error = 0;
 
-	for (int c = 0; c < rm->rm_cols; c++)
-		error = zio_worst_error(error, rm->rm_col[c].rc_error);
+	for (int c = 0; c < rr->rr_cols; c++) {
+		error = zio_worst_error(error, rr->rr_col[c].rc_error);
+		error = zio_worst_error(error, rr->rr_col[c].rc_shadow_error);
+	}
 
 	return (error);
 }
 
-/*
- * Iterate over all combinations of bad data and attempt a reconstruction.
- * Note that the algorithm below is non-optimal because it doesn't take into
- * account how reconstruction is actually performed. For example, with
- * triple-parity RAID-Z the reconstruction procedure is the same if column 4
- * is targeted as invalid as if columns 1 and 4 are targeted since in both
- * cases we'd only use parity information in column 0.
- */
-static int
-vdev_raidz_combrec(zio_t *zio, int total_errors, int data_errors)
+static void
+vdev_raidz_io_done_write_impl(zio_t *zio, raidz_row_t *rr)
 {
-	raidz_map_t *rm = zio->io_vsd;
-	raidz_col_t *rc;
-	abd_t *orig[VDEV_RAIDZ_MAXPARITY];
-	int tstore[VDEV_RAIDZ_MAXPARITY + 2];
-	int *tgts = &tstore[1];
-	int curr, next, i, c, n;
-	int code, ret = 0;
-
-	ASSERT(total_errors < rm->rm_firstdatacol);
-
-	/*
-	 * This simplifies one edge condition.
-	 */
-	tgts[-1] = -1;
-
-	for (n = 1; n <= rm->rm_firstdatacol - total_errors; n++) {
-		/*
-		 * Initialize the targets array by finding the first n columns
-		 * that contain no error.
-		 *
-		 * If there were no data errors, we need to ensure that we're
-		 * always explicitly attempting to reconstruct at least one
-		 * data column. To do this, we simply push the highest target
-		 * up into the data columns.
-		 */
-		for (c = 0, i = 0; i < n; i++) {
-			if (i == n - 1 && data_errors == 0 &&
-			    c < rm->rm_firstdatacol) {
-				c = rm->rm_firstdatacol;
-			}
-
-			while (rm->rm_col[c].rc_error != 0) {
-				c++;
-				ASSERT3S(c, <, rm->rm_cols);
-			}
-
-			tgts[i] = c++;
-		}
-
-		/*
-		 * Setting tgts[n] simplifies the other edge condition.
-		 */
-		tgts[n] = rm->rm_cols;
-
-		/*
-		 * These buffers were allocated in previous iterations.
-		 */
-		for (i = 0; i < n - 1; i++) {
-			ASSERT(orig[i] != NULL);
-		}
-
-		orig[n - 1] = abd_alloc_sametype(rm->rm_col[0].rc_abd,
-		    rm->rm_col[0].rc_size);
-
-		curr = 0;
-		next = tgts[curr];
-
-		while (curr != n) {
-			tgts[curr] = next;
-			curr = 0;
-
-			/*
-			 * Save off the original data that we're going to
-			 * attempt to reconstruct.
-			 */
-			for (i = 0; i < n; i++) {
-				ASSERT(orig[i] != NULL);
-				c = tgts[i];
-				ASSERT3S(c, >=, 0);
-				ASSERT3S(c, <, rm->rm_cols);
-				rc = &rm->rm_col[c];
-				abd_copy(orig[i], rc->rc_abd, rc->rc_size);
-			}
-
-			/*
-			 * Attempt a reconstruction and exit the outer loop on
-			 * success.
-			 */
-			code = vdev_raidz_reconstruct(rm, tgts, n);
-			if (raidz_checksum_verify(zio) == 0) {
-
-				for (i = 0; i < n; i++) {
-					c = tgts[i];
-					rc = &rm->rm_col[c];
-					ASSERT(rc->rc_error == 0);
-					if (rc->rc_tried)
-						raidz_checksum_error(zio, rc,
-						    orig[i]);
-					rc->rc_error = SET_ERROR(ECKSUM);
-				}
-
-				ret = code;
-				goto done;
-			}
-
-			/*
-			 * Restore the original data.
-			 */
-			for (i = 0; i < n; i++) {
-				c = tgts[i];
-				rc = &rm->rm_col[c];
-				abd_copy(rc->rc_abd, orig[i], rc->rc_size);
-			}
-
-			do {
-				/*
-				 * Find the next valid column after the curr
-				 * position..
-				 */
-				for (next = tgts[curr] + 1;
-				    next < rm->rm_cols &&
-				    rm->rm_col[next].rc_error != 0; next++)
-					continue;
-
-				ASSERT(next <= tgts[curr + 1]);
-
-				/*
-				 * If that spot is available, we're done here.
-				 */
-				if (next != tgts[curr + 1])
-					break;
+	int total_errors = 0;
+	int shadow_errors = 0;
 
-				/*
-				 * Otherwise, find the next valid column after
-				 * the previous position.
-				 */
-				for (c = tgts[curr - 1] + 1;
-				    rm->rm_col[c].rc_error != 0; c++)
-					continue;
+	ASSERT3U(rr->rr_missingparity, <=, rr->rr_firstdatacol);
+	ASSERT3U(rr->rr_missingdata, <=, rr->rr_cols - rr->rr_firstdatacol);
+	ASSERT3U(zio->io_type, ==, ZIO_TYPE_WRITE);
 
-				tgts[curr] = c;
-				curr++;
+	for (int c = 0; c < rr->rr_cols; c++) {
+		raidz_col_t *rc = &rr->rr_col[c];
 
-			} while (curr != n);
+		if (rc->rc_error != 0) {
+			ASSERT(rc->rc_error != ECKSUM);	/* child has no bp */
+			total_errors++;
 		}
+		if (rc->rc_shadow_error != 0)
+			shadow_errors++;
 	}
-	n--;
-done:
-	for (i = 0; i < n; i++)
-		abd_free(orig[i]);
 
-	return (ret);
+	/*
+	 * XXX -- for now, treat partial writes as a success.
+	 * (If we couldn't write enough columns to reconstruct
+	 * the data, the I/O failed.  Otherwise, good enough.)
+	 *
+	 * Now that we support write reallocation, it would be better
+	 * to treat partial failure as real failure unless there are
+	 * no non-degraded top-level vdevs left, and not update DTLs
+	 * if we intend to reallocate.
+	 */
+	/* XXPOLICY */
+	if (total_errors > rr->rr_firstdatacol ||
+	    shadow_errors > rr->rr_firstdatacol) {
+		zio->io_error = zio_worst_error(zio->io_error,
+		    vdev_raidz_worst_error(rr));
+	}
 }
 
 /*
- * Complete an IO operation on a RAIDZ VDev
- *
- * Outline:
- * - For write operations:
- *   1. Check for errors on the child IOs.
- *   2. Return, setting an error code if too few child VDevs were written
- *      to reconstruct the data later.  Note that partial writes are
- *      considered successful if they can be reconstructed at all.
- * - For read operations:
- *   1. Check for errors on the child IOs.
- *   2. If data errors occurred:
- *      a. Try to reassemble the data from the parity available.
- *      b. If we haven't yet read the parity drives, read them now.
- *      c. If all parity drives have been read but the data still doesn't
- *         reassemble with a correct checksum, then try combinatorial
- *         reconstruction.
- *      d. If that doesn't work, return an error.
- *   3. If there were unexpected errors or this is a resilver operation,
- *      rewrite the vdevs that had errors.
+ * If the number of errors we saw was correctable -- less than or equal
+ * to the number of parity disks read -- reconstruct the data columns
+ * that are known to be missing.
  */
 static void
-vdev_raidz_io_done(zio_t *zio)
+vdev_raidz_io_done_reconstruct_known_missing(zio_t *zio, raidz_map_t *rm,
+    raidz_row_t *rr)
 {
-	vdev_t *vd = zio->io_vd;
-	vdev_t *cvd;
-	raidz_map_t *rm = zio->io_vsd;
-	raidz_col_t *rc = NULL;
-	int unexpected_errors = 0;
 	int parity_errors = 0;
 	int parity_untried = 0;
 	int data_errors = 0;
 	int total_errors = 0;
-	int n, c;
-	int tgts[VDEV_RAIDZ_MAXPARITY];
-	int code;
-
-	ASSERT(zio->io_bp != NULL);  /* XXX need to add code to enforce this */
 
-	ASSERT(rm->rm_missingparity <= rm->rm_firstdatacol);
-	ASSERT(rm->rm_missingdata <= rm->rm_cols - rm->rm_firstdatacol);
+	ASSERT3U(rr->rr_missingparity, <=, rr->rr_firstdatacol);
+	ASSERT3U(rr->rr_missingdata, <=, rr->rr_cols - rr->rr_firstdatacol);
 
-	for (c = 0; c < rm->rm_cols; c++) {
-		rc = &rm->rm_col[c];
+	for (int c = 0; c < rr->rr_cols; c++) {
+		raidz_col_t *rc = &rr->rr_col[c];
 
 		if (rc->rc_error) {
 			ASSERT(rc->rc_error != ECKSUM);	/* child has no bp */
 
-			if (c < rm->rm_firstdatacol)
+			if (c < rr->rr_firstdatacol)
 				parity_errors++;
 			else
 				data_errors++;
 
-			if (!rc->rc_skipped)
-				unexpected_errors++;
-
 			total_errors++;
-		} else if (c < rm->rm_firstdatacol && !rc->rc_tried) {
+		} else if (c < rr->rr_firstdatacol && !rc->rc_tried) {
 			parity_untried++;
 		}
 	}
 
-	if (zio->io_type == ZIO_TYPE_WRITE) {
-		/*
-		 * XXX -- for now, treat partial writes as a success.
-		 * (If we couldn't write enough columns to reconstruct
-		 * the data, the I/O failed.  Otherwise, good enough.)
-		 *
-		 * Now that we support write reallocation, it would be better
-		 * to treat partial failure as real failure unless there are
-		 * no non-degraded top-level vdevs left, and not update DTLs
-		 * if we intend to reallocate.
-		 */
-		/* XXPOLICY */
-		if (total_errors > rm->rm_firstdatacol)
-			zio->io_error = vdev_raidz_worst_error(rm);
-
+	if (data_errors == 0 ||
+	    total_errors > rr->rr_firstdatacol - parity_untried)
 		return;
-	}
 
-	ASSERT(zio->io_type == ZIO_TYPE_READ);
 	/*
-	 * There are three potential phases for a read:
-	 *	1. produce valid data from the columns read
-	 *	2. read all disks and try again
-	 *	3. perform combinatorial reconstruction
-	 *
-	 * Each phase is progressively both more expensive and less likely to
-	 * occur. If we encounter more errors than we can repair or all phases
-	 * fail, we have no choice but to return an error.
+	 * We either attempt to read all the parity columns or none of
+	 * them.  If we didn't try to read parity, we wouldn't be here in
+	 * the correctable case.  There must also have been fewer parity
+	 * errors than parity columns or, again, we wouldn't be in this
+	 * code path.
 	 */
+	ASSERT(parity_untried == 0);
+	ASSERT(parity_errors < rr->rr_firstdatacol);
 
 	/*
-	 * If the number of errors we saw was correctable -- less than or equal
-	 * to the number of parity disks read -- attempt to produce data that
-	 * has a valid checksum. Naturally, this case applies in the absence of
-	 * any errors.
+	 * Identify the data columns that reported an error.
 	 */
-	if (total_errors <= rm->rm_firstdatacol - parity_untried) {
-		if (data_errors == 0) {
-			if (raidz_checksum_verify(zio) == 0) {
-				/*
-				 * If we read parity information (unnecessarily
-				 * as it happens since no reconstruction was
-				 * needed) regenerate and verify the parity.
-				 * We also regenerate parity when resilvering
-				 * so we can write it out to the failed device
-				 * later.
-				 */
-				if (parity_errors + parity_untried <
-				    rm->rm_firstdatacol ||
-				    (zio->io_flags & ZIO_FLAG_RESILVER)) {
-					n = raidz_parity_verify(zio, rm);
-					unexpected_errors += n;
-					ASSERT(parity_errors + n <=
-					    rm->rm_firstdatacol);
-				}
-				goto done;
-			}
-		} else {
-			/*
-			 * We either attempt to read all the parity columns or
-			 * none of them. If we didn't try to read parity, we
-			 * wouldn't be here in the correctable case. There must
-			 * also have been fewer parity errors than parity
-			 * columns or, again, we wouldn't be in this code path.
-			 */
-			ASSERT(parity_untried == 0);
-			ASSERT(parity_errors < rm->rm_firstdatacol);
+	int n = 0;
+	int tgts[VDEV_RAIDZ_MAXPARITY];
+	for (int c = rr->rr_firstdatacol; c < rr->rr_cols; c++) {
+		raidz_col_t *rc = &rr->rr_col[c];
+		if (rc->rc_error != 0) {
+			ASSERT(n < VDEV_RAIDZ_MAXPARITY);
+			tgts[n++] = c;
+		}
+	}
 
-			/*
-			 * Identify the data columns that reported an error.
-			 */
-			n = 0;
-			for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-				rc = &rm->rm_col[c];
-				if (rc->rc_error != 0) {
-					ASSERT(n < VDEV_RAIDZ_MAXPARITY);
-					tgts[n++] = c;
-				}
-			}
+	ASSERT(rr->rr_firstdatacol >= n);
+
+	vdev_raidz_reconstruct_row(rm, rr, tgts, n);
+}
+
+/*
+ * The data of the block has been verified by its checksum.  If we read
+ * more parity than was needed, confirm that it is correct, and use the
+ * good data to repair any children that returned errors.
+ */
+static void
+vdev_raidz_io_done_verified(zio_t *zio, raidz_row_t *rr)
+{
+	vdev_t *vd = zio->io_vd;
+	int unexpected_errors = 0;
+	int parity_errors = 0;
+	int parity_untried = 0;
+	int data_errors = 0;
 
-			ASSERT(rm->rm_firstdatacol >= n);
+	ASSERT3U(zio->io_type, ==, ZIO_TYPE_READ);
 
-			code = vdev_raidz_reconstruct(rm, tgts, n);
+	for (int c = 0; c < rr->rr_cols; c++) {
+		raidz_col_t *rc = &rr->rr_col[c];
 
-			if (raidz_checksum_verify(zio) == 0) {
-				/*
-				 * If we read more parity disks than were used
-				 * for reconstruction, confirm that the other
-				 * parity disks produced correct data. This
-				 * routine is suboptimal in that it regenerates
-				 * the parity that we already used in addition
-				 * to the parity that we're attempting to
-				 * verify, but this should be a relatively
-				 * uncommon case, and can be optimized if it
-				 * becomes a problem. Note that we regenerate
-				 * parity when resilvering so we can write it
-				 * out to failed devices later.
-				 */
-				if (parity_errors < rm->rm_firstdatacol - n ||
-				    (zio->io_flags & ZIO_FLAG_RESILVER)) {
-					n = raidz_parity_verify(zio, rm);
-					unexpected_errors += n;
-					ASSERT(parity_errors + n <=
-					    rm->rm_firstdatacol);
-				}
+		if (rc->rc_error) {
+			if (c < rr->rr_firstdatacol)
+				parity_errors++;
+			else
+				data_errors++;
 
-				goto done;
-			}
+			if (!rc->rc_skipped)
+				unexpected_errors++;
+		} else if (c < rr->rr_firstdatacol && !rc->rc_tried) {
+			parity_untried++;
 		}
 	}
 
 	/*
-	 * This isn't a typical situation -- either we got a read error or
-	 * a child silently returned bad data. Read every block so we can
-	 * try again with as much data and parity as we can track down. If
-	 * we've already been through once before, all children will be marked
-	 * as tried so we'll proceed to combinatorial reconstruction.
+	 * If we read more parity disks than were used for reconstruction,
+	 * confirm that the other parity disks produced correct data.  This
+	 * routine is suboptimal in that it regenerates the parity that we
+	 * already used in addition to the parity that we're attempting to
+	 * verify, but this should be a relatively uncommon case, and can be
+	 * optimized if it becomes a problem.  Note that we regenerate parity
+	 * when resilvering so we can write it out to failed devices later.
 	 */
-	unexpected_errors = 1;
-	rm->rm_missingdata = 0;
-	rm->rm_missingparity = 0;
+	if (parity_errors + parity_untried <
+	    rr->rr_firstdatacol - data_errors ||
+	    (zio->io_flags & ZIO_FLAG_RESILVER)) {
+		int n = raidz_parity_verify(zio, rr);
+		unexpected_errors += n;
+		ASSERT3U(parity_errors + n, <=, rr->rr_firstdatacol);
+	}
 
-	for (c = 0; c < rm->rm_cols; c++) {
-		if (rm->rm_col[c].rc_tried)
-			continue;
+	if (zio->io_error != 0 || !spa_writeable(zio->io_spa))
+		return;
 
-		zio_vdev_io_redone(zio);
-		do {
-			rc = &rm->rm_col[c];
-			if (rc->rc_tried)
+	if (unexpected_errors > 0 || (zio->io_flags & ZIO_FLAG_RESILVER)) {
+		/*
+		 * Use the good data we have in hand to repair damaged
+		 * children.
+		 */
+		for (int c = 0; c < rr->rr_cols; c++) {
+			raidz_col_t *rc = &rr->rr_col[c];
+
+			if (rc->rc_error == 0 || rc->rc_size == 0)
 				continue;
+
 			zio_nowait(zio_vdev_child_io(zio, NULL,
 			    vd->vdev_child[rc->rc_devidx],
 			    rc->rc_offset, rc->rc_abd, rc->rc_size,
-			    zio->io_type, zio->io_priority, 0,
-			    vdev_raidz_child_done, rc));
-		} while (++c < rm->rm_cols);
-
-		return;
+			    ZIO_TYPE_WRITE, ZIO_PRIORITY_ASYNC_WRITE,
+			    ZIO_FLAG_IO_REPAIR | (unexpected_errors ?
+			    ZIO_FLAG_SELF_HEAL : 0), NULL, NULL));
+		}
 	}
 
 	/*
-	 * At this point we've attempted to reconstruct the data given the
-	 * errors we detected, and we've attempted to read all columns. There
-	 * must, therefore, be one or more additional problems -- silent errors
-	 * resulting in invalid data rather than explicit I/O errors resulting
-	 * in absent data. We check if there is enough additional data to
-	 * possibly reconstruct the data and then perform combinatorial
-	 * reconstruction over all possible combinations. If that fails,
-	 * we're cooked.
+	 * Scrub and resilver also rewrite the new location of any sector
+	 * which the reflow may already have copied, so that a damaged copy
+	 * is corrected too.
 	 */
-	if (total_errors > rm->rm_firstdatacol) {
-		zio->io_error = vdev_raidz_worst_error(rm);
-
-	} else if (total_errors < rm->rm_firstdatacol &&
-	    (code = vdev_raidz_combrec(zio, total_errors, data_errors)) != 0) {
-		/*
-		 * If we didn't use all the available parity for the
-		 * combinatorial reconstruction, verify that the remaining
-		 * parity is correct.
-		 */
-		if (code != (1 << rm->rm_firstdatacol) - 1)
-			(void) raidz_parity_verify(zio, rm);
-	} else {
-		/*
-		 * We're here because either:
-		 *
-		 *	total_errors == rm_first_datacol, or
-		 *	vdev_raidz_combrec() failed
-		 *
-		 * In either case, there is enough bad data to prevent
-		 * reconstruction.
-		 *
-		 * Start checksum ereports for all children which haven't
-		 * failed, and the IO wasn't speculative.
-		 */
-		zio->io_error = SET_ERROR(ECKSUM);
-
-		if (!(zio->io_flags & ZIO_FLAG_SPECULATIVE)) {
-			for (c = 0; c < rm->rm_cols; c++) {
-				vdev_t *cvd;
-				rc = &rm->rm_col[c];
-				cvd = vd->vdev_child[rc->rc_devidx];
-				if (rc->rc_error == 0) {
-					zio_bad_cksum_t zbc;
-					zbc.zbc_has_cksum = 0;
-					zbc.zbc_injected =
-					    rm->rm_ecksuminjected;
-
-					mutex_enter(&cvd->vdev_stat_lock);
-					cvd->vdev_stat.vs_checksum_errors++;
-					mutex_exit(&cvd->vdev_stat_lock);
-
-					zfs_ereport_start_checksum(
-					    zio->io_spa, cvd,
-					    &zio->io_bookmark, zio,
-					    rc->rc_offset, rc->rc_size,
-					    (void *)(uintptr_t)c, &zbc);
-				}
-			}
-		}
-	}
-
-done:
-	zio_checksum_verified(zio);
+	if (zio->io_flags & (ZIO_FLAG_SCRUB | ZIO_FLAG_RESILVER)) {
+		for (int c = 0; c < rr->rr_cols; c++) {
+			raidz_col_t *rc = &rr->rr_col[c];
 
-	if (zio->io_error == 0 && spa_writeable(zio->io_spa) &&
-	    (unexpected_errors || (zio->io_flags & ZIO_FLAG_RESILVER))) {
-		/*
-		 * Use the good data we have in hand to repair damaged children.
-		 */
-		for (c = 0; c < rm->rm_cols; c++) {
-			rc = &rm->rm_col[c];
-			cvd = vd->vdev_child[rc->rc_devidx];
-
-			if (rc->rc_error == 0)
+			if (rc->rc_shadow_devidx == UINT64_MAX ||
+			    rc->rc_size == 0)
 				continue;
 
-			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
-			    rc->rc_offset, rc->rc_abd, rc->rc_size,
+			zio_nowait(zio_vdev_child_io(zio, NULL,
+			    vd->vdev_child[rc->rc_shadow_devidx],
+			    rc->rc_shadow_offset, rc->rc_abd, rc->rc_size,
 			    ZIO_TYPE_WRITE, ZIO_PRIORITY_ASYNC_WRITE,
 			    ZIO_FLAG_IO_REPAIR | (unexpected_errors ?
 			    ZIO_FLAG_SELF_HEAL : 0), NULL, NULL));
@@ -2321,37 +2524,430 @@ done:
 	}
 }
 
-static void
-vdev_raidz_state_change(vdev_t *vd, int faulted, int degraded)
+/*
+ * Read every column which hasn't been read yet.  Returns the number of
+ * reads issued.
+ */
+static int
+vdev_raidz_read_all(zio_t *zio, raidz_row_t *rr)
 {
-	if (faulted > vd->vdev_nparity)
-		vdev_set_state(vd, B_FALSE, VDEV_STATE_CANT_OPEN,
-		    VDEV_AUX_NO_REPLICAS);
-	else if (degraded + faulted != 0)
-		vdev_set_state(vd, B_FALSE, VDEV_STATE_DEGRADED, VDEV_AUX_NONE);
-	else
-		vdev_set_state(vd, B_FALSE, VDEV_STATE_HEALTHY, VDEV_AUX_NONE);
+	vdev_t *vd = zio->io_vd;
+	int nread = 0;
+
+	rr->rr_missingdata = 0;
+	rr->rr_missingparity = 0;
+
+	for (int c = 0; c < rr->rr_cols; c++) {
+		raidz_col_t *rc = &rr->rr_col[c];
+
+		if (rc->rc_tried || rc->rc_size == 0)
+			continue;
+
+		zio_nowait(zio_vdev_child_io(zio, NULL,
+		    vd->vdev_child[rc->rc_devidx],
+		    rc->rc_offset, rc->rc_abd, rc->rc_size,
+		    zio->io_type, zio->io_priority, 0,
+		    vdev_raidz_child_done, rc));
+		nread++;
+	}
+
+	return (nread);
 }
 
 /*
- * Determine if any portion of the provided block resides on a child vdev
- * with a dirty DTL and therefore needs to be resilvered.  The function
- * assumes that at least one DTL is dirty which imples that full stripe
- * width blocks must be resilvered.
+ * Combinatorial reconstruction simulates the failure of "logical" children.
+ * When the vdev has never been expanded these are simply its children.  An
+ * expanded vdev may have placed a sector on any disk at any of the widths
+ * it has had, so each width from the physical width down to the original
+ * width contributes its own set of logical children: logical child i of
+ * width w covers the sectors whose id (offset in sectors times width, plus
+ * device) is i modulo w.
  */
 static boolean_t
-vdev_raidz_need_resilver(vdev_t *vd, uint64_t offset, size_t psize)
+raidz_simulate_failure(vdev_raidz_t *vdrz, int ashift, int i,
+    raidz_row_t *rr, raidz_col_t *rc)
 {
-	uint64_t dcols = vd->vdev_children;
-	uint64_t nparity = vd->vdev_nparity;
-	uint64_t ashift = vd->vdev_top->vdev_ashift;
-	/* The starting RAIDZ (parent) vdev sector of the block. */
-	uint64_t b = offset >> ashift;
-	/* The zio's size in units of the vdev's minimum sector size. */
-	uint64_t s = ((psize - 1) >> ashift) + 1;
-	/* The first column for this stripe. */
-	uint64_t f = b % dcols;
-
+	uint64_t sector_id =
+	    rr->rr_physcols * (rc->rc_offset >> ashift) + rc->rc_devidx;
+
+	for (int w = vdrz->vd_physical_width;
+	    w >= vdrz->vd_original_width; w--) {
+		if (i < w)
+			return (sector_id % w == i);
+		i -= w;
+	}
+	ASSERT(!"invalid logical child id");
+	return (B_FALSE);
+}
+
+static void
+raidz_restore_orig_data(raidz_map_t *rm)
+{
+	for (int i = 0; i < rm->rm_nrows; i++) {
+		raidz_row_t *rr = rm->rm_row[i];
+
+		for (int c = 0; c < rr->rr_cols; c++) {
+			raidz_col_t *rc = &rr->rr_col[c];
+
+			if (rc->rc_need_orig_restore) {
+				abd_copy(rc->rc_abd, rc->rc_orig_data,
+				    rc->rc_size);
+				rc->rc_need_orig_restore = B_FALSE;
+			}
+		}
+	}
+}
+
+/*
+ * Try to reconstruct the block assuming that the given logical children
+ * returned bad data.  Returns 0 on success, EINVAL if too many columns of
+ * some row would be missing, or ECKSUM if the result still doesn't match
+ * the checksum.
+ */
+static int
+raidz_reconstruct(zio_t *zio, int *ltgts, int ntgts, int nparity)
+{
+	raidz_map_t *rm = zio->io_vsd;
+	vdev_raidz_t *vdrz = zio->io_vd->vdev_tsd;
+	int ashift = zio->io_vd->vdev_top->vdev_ashift;
+
+	for (int r = 0; r < rm->rm_nrows; r++) {
+		raidz_row_t *rr = rm->rm_row[r];
+		int my_tgts[VDEV_RAIDZ_MAXPARITY];
+		int t = 0;
+		int dead = 0;
+		int dead_data = 0;
+
+		for (int c = 0; c < rr->rr_cols; c++) {
+			raidz_col_t *rc = &rr->rr_col[c];
+
+			ASSERT0(rc->rc_need_orig_restore);
+			if (rc->rc_error != 0) {
+				dead++;
+				if (c >= nparity)
+					dead_data++;
+				continue;
+			}
+			if (rc->rc_size == 0)
+				continue;
+
+			for (int lt = 0; lt < ntgts; lt++) {
+				if (!raidz_simulate_failure(vdrz, ashift,
+				    ltgts[lt], rr, rc))
+					continue;
+
+				if (rc->rc_orig_data == NULL) {
+					rc->rc_orig_data = abd_alloc_linear(
+					    rc->rc_size, B_TRUE);
+					abd_copy(rc->rc_orig_data,
+					    rc->rc_abd, rc->rc_size);
+				}
+				rc->rc_need_orig_restore = B_TRUE;
+
+				dead++;
+				if (c >= nparity)
+					dead_data++;
+				my_tgts[t++] = c;
+				break;
+			}
+		}
+
+		if (dead > nparity) {
+			/* reconstruction not possible */
+			raidz_restore_orig_data(rm);
+			return (SET_ERROR(EINVAL));
+		}
+		if (dead_data > 0)
+			vdev_raidz_reconstruct_row(rm, rr, my_tgts, t);
+	}
+
+	if (raidz_checksum_verify(zio) != 0) {
+		raidz_restore_orig_data(rm);
+		return (SET_ERROR(ECKSUM));
+	}
+
+	/*
+	 * Reconstruction succeeded; report the data columns which were bad.
+	 * Parity columns are left to vdev_raidz_io_done_verified(), which
+	 * checks (and repairs) any which weren't used.
+	 */
+	for (int r = 0; r < rm->rm_nrows; r++) {
+		raidz_row_t *rr = rm->rm_row[r];
+
+		for (int c = 0; c < rr->rr_cols; c++) {
+			raidz_col_t *rc = &rr->rr_col[c];
+
+			if (!rc->rc_need_orig_restore)
+				continue;
+
+			if (rc->rc_error == 0 && c >= rr->rr_firstdatacol) {
+				raidz_checksum_error(zio, rc, rc->rc_orig_data);
+				rc->rc_error = SET_ERROR(ECKSUM);
+			}
+			rc->rc_need_orig_restore = B_FALSE;
+		}
+
+		vdev_raidz_io_done_verified(zio, rr);
+	}
+
+	zio_checksum_verified(zio);
+
+	return (0);
+}
+
+/*
+ * Iterate over all combinations of bad data and attempt a reconstruction.
+ * Note that the algorithm below is non-optimal because it doesn't take into
+ * account how reconstruction is actually performed. For example, with
+ * triple-parity RAID-Z the reconstruction procedure is the same if column 4
+ * is targeted as invalid as if columns 1 and 4 are targeted since in both
+ * cases we'd only use parity information in column 0.
+ */
+static int
+vdev_raidz_combrec(zio_t *zio)
+{
+	vdev_raidz_t *vdrz = zio->io_vd->vdev_tsd;
+	int nparity = zio->io_vd->vdev_nparity;
+	raidz_map_t *rm = zio->io_vsd;
+
+	for (int i = 0; i < rm->rm_nrows; i++) {
+		raidz_row_t *rr = rm->rm_row[i];
+		int total_errors = 0;
+
+		for (int c = 0; c < rr->rr_cols; c++) {
+			if (rr->rr_col[c].rc_error)
+				total_errors++;
+		}
+
+		if (total_errors > nparity)
+			return (vdev_raidz_worst_error(rr));
+	}
+
+	/*
+	 * The number of logical children; see raidz_simulate_failure().
+	 */
+	int n = 0;
+	for (int w = vdrz->vd_physical_width;
+	    w >= vdrz->vd_original_width; w--)
+		n += w;
+
+	for (int num_failures = 1; num_failures <= nparity; num_failures++) {
+		int tstore[VDEV_RAIDZ_MAXPARITY + 2];
+		int *ltgts = &tstore[1];	/* value is logical child id */
+
+		ASSERT3U(num_failures, <=, VDEV_RAIDZ_MAXPARITY);
+
+		/* Handle corner cases in the iteration below */
+		ltgts[-1] = -1;
+		for (int i = 0; i < num_failures; i++)
+			ltgts[i] = i;
+		ltgts[num_failures] = n;
+
+		for (;;) {
+			if (raidz_reconstruct(zio, ltgts, num_failures,
+			    nparity) == 0)
+				return (0);
+
+			/* Compute the next combination of targets to try */
+			int t;
+			for (t = 0; ; t++) {
+				ASSERT3U(t, <, num_failures);
+				ltgts[t]++;
+				if (ltgts[t] == n) {
+					ASSERT3U(t, ==, num_failures - 1);
+					break;
+				}
+
+				ASSERT3U(ltgts[t], <, n);
+				ASSERT3U(ltgts[t], <=, ltgts[t + 1]);
+
+				/*
+				 * If that spot is available, we're done here.
+				 */
+				if (ltgts[t] != ltgts[t + 1])
+					break;
+
+				/*
+				 * Otherwise, reset this target to the minimum,
+				 * and move on to the next one.
+				 */
+				ltgts[t] = ltgts[t - 1] + 1;
+				ASSERT3U(ltgts[t], ==, t);
+			}
+
+			/* Out of combinations; try more failures. */
+			if (ltgts[num_failures - 1] == n)
+				break;
+		}
+	}
+
+	return (SET_ERROR(ECKSUM));
+}
+
+/*
+ * Start checksum ereports for all children which haven't failed.
+ */
+static void
+vdev_raidz_io_done_unrecoverable(zio_t *zio)
+{
+	raidz_map_t *rm = zio->io_vsd;
+
+	for (int i = 0; i < rm->rm_nrows; i++) {
+		raidz_row_t *rr = rm->rm_row[i];
+
+		for (int c = 0; c < rr->rr_cols; c++) {
+			raidz_col_t *rc = &rr->rr_col[c];
+			vdev_t *cvd = zio->io_vd->vdev_child[rc->rc_devidx];
+			zio_bad_cksum_t zbc;
+
+			if (rc->rc_error != 0 || rc->rc_size == 0)
+				continue;
+
+			zbc.zbc_has_cksum = 0;
+			zbc.zbc_injected = rm->rm_ecksuminjected;
+
+			mutex_enter(&cvd->vdev_stat_lock);
+			cvd->vdev_stat.vs_checksum_errors++;
+			mutex_exit(&cvd->vdev_stat_lock);
+
+			zfs_ereport_start_checksum(zio->io_spa, cvd,
+			    &zio->io_bookmark, zio, rc->rc_offset, rc->rc_size,
+			    (void *)(uintptr_t)c, &zbc);
+		}
+	}
+}
+
+/*
+ * Complete an IO operation on a RAIDZ VDev
+ *
+ * Outline:
+ * - For write operations:
+ *   1. Check for errors on the child IOs.
+ *   2. Return, setting an error code if too few child VDevs were written
+ *      to reconstruct the data later.  Note that partial writes are
+ *      considered successful if they can be reconstructed at all.
+ * - For read operations:
+ *   1. Check for errors on the child IOs.
+ *   2. If data errors occurred:
+ *      a. Try to reassemble the data from the parity available.
+ *      b. If we haven't yet read the parity drives, read them now.
+ *      c. If all parity drives have been read but the data still doesn't
+ *         reassemble with a correct checksum, then try combinatorial
+ *         reconstruction.
+ *      d. If that doesn't work, return an error.
+ *   3. If there were unexpected errors or this is a resilver operation,
+ *      rewrite the vdevs that had errors.
+ */
+static void
+vdev_raidz_io_done(zio_t *zio)
+{
+	raidz_map_t *rm = zio->io_vsd;
+
+	if (zio->io_type == ZIO_TYPE_WRITE) {
+		for (int i = 0; i < rm->rm_nrows; i++)
+			vdev_raidz_io_done_write_impl(zio, rm->rm_row[i]);
+	} else {
+		ASSERT(zio->io_bp != NULL);
+
+		for (int i = 0; i < rm->rm_nrows; i++) {
+			vdev_raidz_io_done_reconstruct_known_missing(zio, rm,
+			    rm->rm_row[i]);
+		}
+
+		if (raidz_checksum_verify(zio) == 0) {
+			for (int i = 0; i < rm->rm_nrows; i++)
+				vdev_raidz_io_done_verified(zio, rm->rm_row[i]);
+			zio_checksum_verified(zio);
+		} else {
+			/*
+			 * This isn't a typical situation -- either we got a
+			 * read error or a child silently returned bad data.
+			 * Read every block so we can try again with as much
+			 * data and parity as we can track down.  If we've
+			 * already been through once before, all children will
+			 * be marked as tried so we'll proceed to combinatorial
+			 * reconstruction.
+			 */
+			int nread = 0;
+			for (int i = 0; i < rm->rm_nrows; i++) {
+				nread += vdev_raidz_read_all(zio,
+				    rm->rm_row[i]);
+			}
+			if (nread != 0) {
+				/*
+				 * Normally our stage is VDEV_IO_DONE, but if
+				 * we've already called redone(), it will have
+				 * changed to VDEV_IO_START, in which case we
+				 * don't want to call redone() again.
+				 */
+				if (zio->io_stage != ZIO_STAGE_VDEV_IO_START)
+					zio_vdev_io_redone(zio);
+				return;
+			}
+
+			/*
+			 * At this point we've attempted to reconstruct the
+			 * data given the errors we detected, and we've
+			 * attempted to read all columns.  There must,
+			 * therefore, be one or more additional problems --
+			 * silent errors resulting in invalid data rather than
+			 * explicit I/O errors resulting in absent data.  If
+			 * combinatorial reconstruction fails too, we're
+			 * cooked.
+			 */
+			zio->io_error = vdev_raidz_combrec(zio);
+			if (zio->io_error == ECKSUM &&
+			    !(zio->io_flags & ZIO_FLAG_SPECULATIVE))
+				vdev_raidz_io_done_unrecoverable(zio);
+		}
+	}
+
+	if (rm->rm_lr != NULL) {
+		rangelock_exit(rm->rm_lr);
+		rm->rm_lr = NULL;
+	}
+}
+
+static void
+vdev_raidz_state_change(vdev_t *vd, int faulted, int degraded)
+{
+	if (faulted > vd->vdev_nparity)
+		vdev_set_state(vd, B_FALSE, VDEV_STATE_CANT_OPEN,
+		    VDEV_AUX_NO_REPLICAS);
+	else if (degraded + faulted != 0)
+		vdev_set_state(vd, B_FALSE, VDEV_STATE_DEGRADED, VDEV_AUX_NONE);
+	else
+		vdev_set_state(vd, B_FALSE, VDEV_STATE_HEALTHY, VDEV_AUX_NONE);
+}
+
+/*
+ * Determine if any portion of the provided block resides on a child vdev
+ * with a dirty DTL and therefore needs to be resilvered.  The function
+ * assumes that at least one DTL is dirty which imples that full stripe
+ * width blocks must be resilvered.
+ */
+static boolean_t
+vdev_raidz_need_resilver(vdev_t *vd, uint64_t offset, size_t psize)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	uint64_t dcols = vdrz->vd_physical_width;
+	uint64_t nparity = vd->vdev_nparity;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	/* The starting RAIDZ (parent) vdev sector of the block. */
+	uint64_t b = offset >> ashift;
+	/* The zio's size in units of the vdev's minimum sector size. */
+	uint64_t s = ((psize - 1) >> ashift) + 1;
+	/* The first column for this stripe. */
+	uint64_t f = b % dcols;
+
+	/*
+	 * The layout of a block isn't known here while the vdev is being
+	 * expanded, nor for blocks written before an expansion.
+	 */
+	if (vdrz->vn_vre.vre_state == DSS_SCANNING ||
+	    vdrz->vd_original_width != dcols)
+		return (B_TRUE);
+
 	if (s + nparity >= dcols)
 		return (B_TRUE);
 
@@ -2372,12 +2968,13 @@ vdev_raidz_need_resilver(vdev_t *vd, uint64_t offset, size_t psize)
 }
 
 static void
-vdev_raidz_xlate(vdev_t *cvd, const range_seg_t *in, range_seg_t *res)
+vdev_raidz_xlate(vdev_t *cvd, const range_seg64_t *in, range_seg64_t *res)
 {
 	vdev_t *raidvd = cvd->vdev_parent;
 	ASSERT(raidvd->vdev_ops == &vdev_raidz_ops);
+	vdev_raidz_t *vdrz = raidvd->vdev_tsd;
 
-	uint64_t width = raidvd->vdev_children;
+	uint64_t width = vdrz->vd_physical_width;
 	uint64_t tgt_col = cvd->vdev_id;
 	uint64_t ashift = raidvd->vdev_top->vdev_ashift;
 
@@ -2402,18 +2999,1370 @@ vdev_raidz_xlate(vdev_t *cvd, const range_seg_t *in, range_seg_t *res)
 	ASSERT3U(res->rs_end - res->rs_start, <=, in->rs_end - in->rs_start);
 }
 
-vdev_ops_t vdev_raidz_ops = {
-	.vdev_op_open = vdev_raidz_open,
-	.vdev_op_close = vdev_raidz_close,
-	.vdev_op_asize = vdev_raidz_asize,
-	.vdev_op_io_start = vdev_raidz_io_start,
-	.vdev_op_io_done = vdev_raidz_io_done,
-	.vdev_op_state_change = vdev_raidz_state_change,
-	.vdev_op_need_resilver = vdev_raidz_need_resilver,
-	.vdev_op_hold = NULL,
-	.vdev_op_rele = NULL,
-	.vdev_op_remap = NULL,
-	.vdev_op_xlate = vdev_raidz_xlate,
-	.vdev_op_type = VDEV_TYPE_RAIDZ,	/* name of this vdev type */
-	.vdev_op_leaf = B_FALSE			/* not a leaf vdev */
-};
+/*
+ * RAID-Z expansion
+ *
+ * A raidz vdev is expanded by attaching a new child to it.  The existing
+ * data is then reflowed: every allocated sector is copied, in order, from
+ * its location in the old (narrower) layout to its location in the new
+ * layout, by spa_raidz_expand_thread().  Blocks keep their logical width
+ * (and therefore their parity ratio); only blocks born after the expansion
+ * completes use the new width.
+ *
+ * The progress of the reflow is recorded in the uberblock
+ * (ub_raidz_reflow_info) every txg.  Everything below the recorded offset
+ * is at its new location.  Because the new location of a sector overlaps
+ * the old location of an earlier sector, the copying may not get ahead of
+ * the progress which is on disk by more than the copy would overwrite;
+ * otherwise a crash would leave us unable to find the data.  At the very
+ * start of the vdev the new locations overlap the old ones of the same
+ * sectors, so the first few rows are copied through a scratch area (the
+ * boot area of the children), see raidz_reflow_scratch_sync().
+ *
+ * While the reflow is running, normal i/o takes a reader lock on
+ * vre_rangelock over the range it accesses, so that it doesn't race with
+ * the copying; see vdev_raidz_map_alloc_expanded() for how rows are placed.
+ */
+
+boolean_t
+vdev_raidz_expanding(vdev_t *vd)
+{
+	return (vd->vdev_top->vdev_rz_expanding);
+}
+
+vdev_raidz_t *
+vdev_raidz_init(vdev_t *vd, nvlist_t *nv)
+{
+	vdev_raidz_t *vdrz = kmem_zalloc(sizeof (*vdrz), KM_SLEEP);
+	vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+	nvlist_t **child;
+	uint_t children = 0;
+	uint64_t *txgs;
+	uint_t txgs_size = 0;
+
+	mutex_init(&vdrz->vd_expand_lock, NULL, MUTEX_DEFAULT, NULL);
+	avl_create(&vdrz->vd_expand_txgs, vdev_raidz_reflow_compare,
+	    sizeof (reflow_node_t), offsetof(reflow_node_t, re_link));
+
+	mutex_init(&vre->vre_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vre->vre_cv, NULL, CV_DEFAULT, NULL);
+	rangelock_init(&vre->vre_rangelock, NULL, NULL);
+	vre->vre_vdev_id = vd->vdev_id;
+	vre->vre_offset = UINT64_MAX;
+	vre->vre_synced_offset = UINT64_MAX;
+	vre->vre_failed_offset = UINT64_MAX;
+
+	(void) nvlist_lookup_nvlist_array(nv, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children);
+	vdrz->vd_physical_width = children;
+
+	/*
+	 * Each completed expansion added one child; the widths of the
+	 * blocks born after each of them follow from the current width.
+	 */
+	if (nvlist_lookup_uint64_array(nv, ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS,
+	    &txgs, &txgs_size) == 0) {
+		for (int i = 0; i < txgs_size; i++) {
+			reflow_node_t *re = kmem_zalloc(sizeof (*re), KM_SLEEP);
+			re->re_txg = txgs[txgs_size - i - 1];
+			re->re_logical_width = vdrz->vd_physical_width - i;
+			if (vd->vdev_rz_expanding)
+				re->re_logical_width--;
+			avl_add(&vdrz->vd_expand_txgs, re);
+		}
+	}
+	vdrz->vd_original_width = vdrz->vd_physical_width - txgs_size;
+	if (vd->vdev_rz_expanding)
+		vdrz->vd_original_width--;
+
+	if (vd->vdev_rz_expanding) {
+		vre->vre_state = DSS_SCANNING;
+		vd->vdev_spa->spa_raidz_expand = vre;
+	}
+
+	return (vdrz);
+}
+
+void
+vdev_raidz_fini(vdev_t *vd)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+	reflow_node_t *re;
+	void *cookie = NULL;
+
+	if (vd->vdev_spa->spa_raidz_expand == vre)
+		vd->vdev_spa->spa_raidz_expand = NULL;
+
+	while ((re = avl_destroy_nodes(&vdrz->vd_expand_txgs, &cookie)) != NULL)
+		kmem_free(re, sizeof (*re));
+	avl_destroy(&vdrz->vd_expand_txgs);
+	mutex_destroy(&vdrz->vd_expand_lock);
+
+	rangelock_fini(&vre->vre_rangelock);
+	cv_destroy(&vre->vre_cv);
+	mutex_destroy(&vre->vre_lock);
+
+	kmem_free(vdrz, sizeof (*vdrz));
+	vd->vdev_tsd = NULL;
+}
+
+/*
+ * Add the expansion state to the vdev's config.
+ */
+void
+vdev_raidz_config_generate(vdev_t *vd, nvlist_t *nv)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_raidz_ops);
+
+	if (vd->vdev_rz_expanding)
+		fnvlist_add_boolean(nv, ZPOOL_CONFIG_RAIDZ_EXPANDING);
+
+	mutex_enter(&vdrz->vd_expand_lock);
+	if (!avl_is_empty(&vdrz->vd_expand_txgs)) {
+		uint64_t count = avl_numnodes(&vdrz->vd_expand_txgs);
+		uint64_t *txgs = kmem_alloc(sizeof (uint64_t) * count,
+		    KM_SLEEP);
+		uint64_t i = 0;
+
+		for (reflow_node_t *re = avl_first(&vdrz->vd_expand_txgs);
+		    re != NULL; re = AVL_NEXT(&vdrz->vd_expand_txgs, re)) {
+			txgs[i++] = re->re_txg;
+		}
+
+		fnvlist_add_uint64_array(nv, ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS,
+		    txgs, count);
+
+		kmem_free(txgs, sizeof (uint64_t) * count);
+	}
+	mutex_exit(&vdrz->vd_expand_lock);
+}
+
+/*
+ * Load the expansion state from the vdev's top-level ZAP.
+ */
+int
+vdev_raidz_load(vdev_t *vd)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+	objset_t *mos = vd->vdev_spa->spa_meta_objset;
+	uint64_t state = DSS_NONE;
+	uint64_t start_time = 0;
+	uint64_t end_time = 0;
+	uint64_t bytes_copied = 0;
+	int err;
+
+	if (vd->vdev_top_zap != 0) {
+		err = zap_lookup(mos, vd->vdev_top_zap,
+		    VDEV_TOP_ZAP_RAIDZ_EXPAND_STATE,
+		    sizeof (state), 1, &state);
+		if (err != 0 && err != ENOENT)
+			return (err);
+
+		err = zap_lookup(mos, vd->vdev_top_zap,
+		    VDEV_TOP_ZAP_RAIDZ_EXPAND_START_TIME,
+		    sizeof (start_time), 1, &start_time);
+		if (err != 0 && err != ENOENT)
+			return (err);
+
+		err = zap_lookup(mos, vd->vdev_top_zap,
+		    VDEV_TOP_ZAP_RAIDZ_EXPAND_END_TIME,
+		    sizeof (end_time), 1, &end_time);
+		if (err != 0 && err != ENOENT)
+			return (err);
+
+		err = zap_lookup(mos, vd->vdev_top_zap,
+		    VDEV_TOP_ZAP_RAIDZ_EXPAND_BYTES_COPIED,
+		    sizeof (bytes_copied), 1, &bytes_copied);
+		if (err != 0 && err != ENOENT)
+			return (err);
+	}
+
+	/*
+	 * If we are in the middle of an expansion, vre_state has already
+	 * been set by vdev_raidz_init().
+	 */
+	if ((vre->vre_state == DSS_SCANNING) != (state == DSS_SCANNING))
+		return (SET_ERROR(EINVAL));
+
+	vre->vre_vdev_id = vd->vdev_id;
+	vre->vre_state = (dsl_scan_state_t)state;
+	vre->vre_start_time = start_time;
+	vre->vre_end_time = end_time;
+	vre->vre_bytes_copied = bytes_copied;
+
+	return (0);
+}
+
+int
+spa_raidz_expand_get_stats(spa_t *spa, pool_raidz_expand_stat_t *pres)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	if (vre == NULL) {
+		/* no expansion in progress; find the most recent completed */
+		vdev_t *rvd = spa->spa_root_vdev;
+
+		for (int c = 0; c < rvd->vdev_children; c++) {
+			vdev_t *vd = rvd->vdev_child[c];
+			vdev_raidz_t *vdrz;
+
+			if (vd->vdev_ops != &vdev_raidz_ops)
+				continue;
+
+			vdrz = vd->vdev_tsd;
+			if (vdrz->vn_vre.vre_end_time != 0 && (vre == NULL ||
+			    vdrz->vn_vre.vre_end_time > vre->vre_end_time))
+				vre = &vdrz->vn_vre;
+		}
+	}
+
+	if (vre == NULL)
+		return (SET_ERROR(ENOENT));
+
+	pres->pres_state = vre->vre_state;
+	pres->pres_expanding_vdev = vre->vre_vdev_id;
+
+	vdev_t *vd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	pres->pres_to_reflow = vd->vdev_stat.vs_alloc;
+
+	mutex_enter(&vre->vre_lock);
+	pres->pres_reflowed = vre->vre_bytes_copied;
+	for (int i = 0; i < TXG_SIZE; i++)
+		pres->pres_reflowed += vre->vre_bytes_copied_pertxg[i];
+	pres->pres_waiting_for_resilver = vre->vre_waiting_for_resilver;
+	mutex_exit(&vre->vre_lock);
+
+	pres->pres_start_time = vre->vre_start_time;
+	pres->pres_end_time = vre->vre_end_time;
+
+	return (0);
+}
+
+/*
+ * Sync task run every txg in which the reflow made progress: record that
+ * progress in the uberblock which will be written at the end of this txg,
+ * and let normal i/o use the new location of everything which was on disk
+ * as of the last txg.
+ */
+static void
+raidz_reflow_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = arg;
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	uint64_t synced = RRSS_GET_OFFSET(&spa->spa_ubsync);
+	uint64_t pertxg = vre->vre_offset_pertxg[txgoff];
+	uint64_t new_offset;
+	locked_range_t *lr = NULL;
+
+	ASSERT3U(pertxg, >=, vre->vre_synced_offset);
+	ASSERT3U(synced, >=, vre->vre_synced_offset);
+
+	/*
+	 * Wait for the copies of this txg to complete (so that any failure
+	 * has been noted), and for normal i/o to the rows which are moving
+	 * to their new location to drain.
+	 */
+	if (pertxg > vre->vre_synced_offset) {
+		lr = rangelock_enter(&vre->vre_rangelock,
+		    vre->vre_synced_offset, pertxg - vre->vre_synced_offset,
+		    RL_WRITER);
+	}
+	vre->vre_synced_offset = synced;
+
+	mutex_enter(&vre->vre_lock);
+	new_offset = MIN(pertxg, vre->vre_failed_offset);
+	/*
+	 * We should not have committed anything that failed.
+	 */
+	VERIFY3U(vre->vre_failed_offset, >=, synced);
+	mutex_exit(&vre->vre_lock);
+
+	/*
+	 * Update the uberblock that will be written when this txg completes.
+	 */
+	RAIDZ_REFLOW_SET(&spa->spa_uberblock,
+	    RRSS_SCRATCH_INVALID_SYNCED_REFLOW, new_offset);
+	vre->vre_offset_pertxg[txgoff] = 0;
+
+	if (lr != NULL)
+		rangelock_exit(lr);
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_bytes_copied += vre->vre_bytes_copied_pertxg[txgoff];
+	vre->vre_bytes_copied_pertxg[txgoff] = 0;
+	mutex_exit(&vre->vre_lock);
+
+	vdev_t *vd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    vd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_BYTES_COPIED,
+	    sizeof (vre->vre_bytes_copied), 1, &vre->vre_bytes_copied, tx));
+}
+
+/*
+ * Note that everything below the given offset is being copied in this txg.
+ */
+static void
+raidz_reflow_record_progress(vdev_raidz_expand_t *vre, uint64_t offset,
+    dmu_tx_t *tx)
+{
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+
+	if (offset == 0)
+		return;
+
+	mutex_enter(&vre->vre_lock);
+	ASSERT3U(vre->vre_offset, <=, offset);
+	vre->vre_offset = offset;
+	mutex_exit(&vre->vre_lock);
+
+	if (vre->vre_offset_pertxg[txgoff] == 0) {
+		dsl_sync_task_nowait(dmu_tx_pool(tx), raidz_reflow_sync,
+		    spa, 0, ZFS_SPACE_CHECK_NONE, tx);
+	}
+	vre->vre_offset_pertxg[txgoff] = offset;
+}
+
+/*
+ * State of one copy issued by raidz_reflow_impl().  The sectors are read
+ * from the old children into rra_rbuf[] and rearranged into rra_wbuf[]
+ * for the new children.
+ */
+typedef struct raidz_reflow_arg {
+	vdev_raidz_expand_t *rra_vre;
+	locked_range_t *rra_lr;
+	uint64_t rra_txg;
+	uint64_t rra_blocks;		/* number of sectors copied */
+	uint64_t rra_old_children;
+	uint64_t rra_new_children;
+	uint64_t rra_nreads;
+	uint64_t rra_nwrites;
+	uint32_t rra_reads_left;	/* protected by vre_lock */
+	uint32_t rra_writes_left;	/* protected by vre_lock */
+	int rra_ashift;
+	abd_t **rra_rbuf;
+	abd_t **rra_wbuf;
+	zio_t **rra_wzio;
+} raidz_reflow_arg_t;
+
+static void
+raidz_reflow_arg_free(raidz_reflow_arg_t *rra)
+{
+	for (int i = 0; i < rra->rra_nreads; i++)
+		abd_free(rra->rra_rbuf[i]);
+	for (int i = 0; i < rra->rra_nwrites; i++)
+		abd_free(rra->rra_wbuf[i]);
+	kmem_free(rra->rra_rbuf, rra->rra_nreads * sizeof (abd_t *));
+	kmem_free(rra->rra_wbuf, rra->rra_nwrites * sizeof (abd_t *));
+	kmem_free(rra->rra_wzio, rra->rra_nwrites * sizeof (zio_t *));
+	kmem_free(rra, sizeof (*rra));
+}
+
+/*
+ * Drop a reference on rra_writes_left (one per write, plus one held while
+ * the writes are being issued), and clean up after the last.
+ */
+static void
+raidz_reflow_write_rele(spa_t *spa, raidz_reflow_arg_t *rra)
+{
+	vdev_raidz_expand_t *vre = rra->rra_vre;
+	boolean_t done;
+
+	mutex_enter(&vre->vre_lock);
+	done = (--rra->rra_writes_left == 0);
+	mutex_exit(&vre->vre_lock);
+
+	if (!done)
+		return;
+
+	spa_config_exit(spa, SCL_STATE, rra);
+	rangelock_exit(rra->rra_lr);
+	raidz_reflow_arg_free(rra);
+}
+
+static void
+raidz_reflow_write_done(zio_t *zio)
+{
+	raidz_reflow_arg_t *rra = zio->io_private;
+	vdev_raidz_expand_t *vre = rra->rra_vre;
+
+	mutex_enter(&vre->vre_lock);
+	if (zio->io_error != 0) {
+		/* Force a reflow pause on errors */
+		vre->vre_failed_offset =
+		    MIN(vre->vre_failed_offset, rra->rra_lr->lr_offset);
+	}
+	ASSERT3U(vre->vre_outstanding_bytes, >=, zio->io_size);
+	vre->vre_outstanding_bytes -= zio->io_size;
+	if (rra->rra_lr->lr_offset + rra->rra_lr->lr_length <
+	    vre->vre_failed_offset) {
+		vre->vre_bytes_copied_pertxg[rra->rra_txg & TXG_MASK] +=
+		    zio->io_size;
+	}
+	cv_signal(&vre->vre_cv);
+	mutex_exit(&vre->vre_lock);
+
+	raidz_reflow_write_rele(zio->io_spa, rra);
+}
+
+static void
+raidz_reflow_read_done(zio_t *zio)
+{
+	raidz_reflow_arg_t *rra = zio->io_private;
+	vdev_raidz_expand_t *vre = rra->rra_vre;
+	boolean_t done;
+
+	/*
+	 * If the read failed, or if it was done on a vdev that is not fully
+	 * healthy (e.g. a child that has a resilver in progress), we may not
+	 * have the correct data.  Note that it's OK if the write proceeds.
+	 * It may write garbage but the location is otherwise unused and we
+	 * will retry later due to vre_failed_offset.
+	 */
+	mutex_enter(&vre->vre_lock);
+	if (zio->io_error != 0 || !vdev_dtl_empty(zio->io_vd, DTL_MISSING)) {
+		zfs_dbgmsg("reflow read failed off=%llu size=%llu txg=%llu "
+		    "err=%u partial_dtl_empty=%u missing_dtl_empty=%u",
+		    (long long)rra->rra_lr->lr_offset,
+		    (long long)rra->rra_lr->lr_length,
+		    (long long)rra->rra_txg,
+		    zio->io_error,
+		    vdev_dtl_empty(zio->io_vd, DTL_PARTIAL),
+		    vdev_dtl_empty(zio->io_vd, DTL_MISSING));
+		vre->vre_failed_offset =
+		    MIN(vre->vre_failed_offset, rra->rra_lr->lr_offset);
+	}
+	done = (--rra->rra_reads_left == 0);
+	mutex_exit(&vre->vre_lock);
+
+	if (!done)
+		return;
+
+	/*
+	 * Sector k of the copy is at index k / old_width of read buffer
+	 * k % old_width, and goes to index k / new_width of write buffer
+	 * k % new_width.
+	 */
+	uint64_t old_children = rra->rra_old_children;
+	uint64_t new_children = rra->rra_new_children;
+	int ashift = rra->rra_ashift;
+
+	for (uint64_t k = 0; k < rra->rra_blocks; k++) {
+		abd_copy_off(rra->rra_wbuf[k % new_children],
+		    rra->rra_rbuf[k % old_children],
+		    (k / new_children) << ashift,
+		    (k / old_children) << ashift, 1ULL << ashift);
+	}
+
+	for (int i = 0; i < rra->rra_nwrites; i++)
+		zio_nowait(rra->rra_wzio[i]);
+
+	raidz_reflow_write_rele(zio->io_spa, rra);
+}
+
+/*
+ * Copy the first range in rt which can safely be copied.  Returns B_TRUE
+ * if the caller should wait for the txg to sync before more can be copied.
+ */
+static boolean_t
+raidz_reflow_impl(vdev_t *vd, vdev_raidz_expand_t *vre, range_tree_t *rt,
+    dmu_tx_t *tx)
+{
+	spa_t *spa = vd->vdev_spa;
+	int ashift = vd->vdev_top->vdev_ashift;
+	uint64_t old_children = vd->vdev_children - 1;
+	uint64_t new_children = vd->vdev_children;
+	uint64_t offset, size;
+
+	range_seg_t *rs = range_tree_first(rt);
+	ASSERT(rs != NULL);
+	offset = rs_get_start(rs, rt);
+	size = rs_get_end(rs, rt) - offset;
+	ASSERT3U(offset, >=, vre->vre_offset);
+	ASSERT(IS_P2ALIGNED(offset, 1 << ashift));
+	ASSERT(IS_P2ALIGNED(size, 1 << ashift));
+
+	uint64_t blkid = offset >> ashift;
+
+	/*
+	 * We can only copy up to the point where the new locations would
+	 * overwrite the old location of a sector whose copy isn't on disk
+	 * yet.  Since rows which are only partially on disk are still read
+	 * from their old location, stop one row early.
+	 */
+	uint64_t synced_row = (vre->vre_synced_offset >> ashift) /
+	    old_children;
+	uint64_t next_overwrite_blkid = 0;
+	if (synced_row > 1)
+		next_overwrite_blkid = (synced_row - 1) * new_children;
+
+	/*
+	 * Everything below next_overwrite_blkid which is still in rt is
+	 * free, so we can claim to have copied up to there even if there
+	 * is nothing to copy.  Otherwise a stretch of free space past the
+	 * next overwrite would prevent the synced offset from advancing.
+	 */
+	if (blkid >= next_overwrite_blkid) {
+		raidz_reflow_record_progress(vre,
+		    MAX(vre->vre_offset, next_overwrite_blkid << ashift), tx);
+		return (B_TRUE);
+	}
+
+	size = MIN(size, raidz_expand_max_copy_bytes);
+	size = MIN(size, (next_overwrite_blkid - blkid) << ashift);
+	uint64_t blocks = size >> ashift;
+
+	range_tree_remove(rt, offset, size);
+
+	raidz_reflow_arg_t *rra = kmem_zalloc(sizeof (*rra), KM_SLEEP);
+	rra->rra_vre = vre;
+	rra->rra_lr = rangelock_enter(&vre->vre_rangelock,
+	    offset, size, RL_WRITER);
+	rra->rra_txg = dmu_tx_get_txg(tx);
+	rra->rra_blocks = blocks;
+	rra->rra_old_children = old_children;
+	rra->rra_new_children = new_children;
+	rra->rra_ashift = ashift;
+	rra->rra_nreads = MIN(blocks, old_children);
+	rra->rra_nwrites = MIN(blocks, new_children);
+	rra->rra_reads_left = rra->rra_nreads;
+	rra->rra_writes_left = rra->rra_nwrites + 1;
+	rra->rra_rbuf = kmem_zalloc(rra->rra_nreads * sizeof (abd_t *),
+	    KM_SLEEP);
+	rra->rra_wbuf = kmem_zalloc(rra->rra_nwrites * sizeof (abd_t *),
+	    KM_SLEEP);
+	rra->rra_wzio = kmem_zalloc(rra->rra_nwrites * sizeof (zio_t *),
+	    KM_SLEEP);
+
+	raidz_reflow_record_progress(vre, offset + size, tx);
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_outstanding_bytes += size;
+	mutex_exit(&vre->vre_lock);
+
+	/*
+	 * The writes are children of this txg's root zio, so that the
+	 * progress recorded for this txg isn't written out until they are
+	 * on disk.
+	 */
+	spa_config_enter(spa, SCL_STATE, rra, RW_READER);
+	zio_t *pio = spa->spa_txg_zio[rra->rra_txg & TXG_MASK];
+
+	for (int i = 0; i < rra->rra_nwrites; i++) {
+		uint64_t n = howmany(blocks - i, new_children);
+
+		rra->rra_wbuf[i] = abd_alloc_for_io(n << ashift, B_FALSE);
+		rra->rra_wzio[i] = zio_vdev_child_io(pio, NULL,
+		    vd->vdev_child[(blkid + i) % new_children],
+		    ((blkid + i) / new_children) << ashift,
+		    rra->rra_wbuf[i], n << ashift, ZIO_TYPE_WRITE,
+		    ZIO_PRIORITY_REMOVAL, ZIO_FLAG_CANFAIL,
+		    raidz_reflow_write_done, rra);
+	}
+
+	/*
+	 * The reads are children of the first write, which is held back
+	 * until the last read has completed and the data is rearranged.
+	 */
+	for (int i = 0; i < rra->rra_nreads; i++) {
+		uint64_t n = howmany(blocks - i, old_children);
+
+		rra->rra_rbuf[i] = abd_alloc_for_io(n << ashift, B_FALSE);
+		zio_nowait(zio_vdev_child_io(rra->rra_wzio[0], NULL,
+		    vd->vdev_child[(blkid + i) % old_children],
+		    ((blkid + i) / old_children) << ashift,
+		    rra->rra_rbuf[i], n << ashift, ZIO_TYPE_READ,
+		    ZIO_PRIORITY_REMOVAL, ZIO_FLAG_CANFAIL,
+		    raidz_reflow_read_done, rra));
+	}
+
+	return (B_FALSE);
+}
+
+static void
+raidz_scratch_child_done(zio_t *zio)
+{
+	zio_t *pio = zio->io_private;
+
+	mutex_enter(&pio->io_lock);
+	pio->io_error = zio_worst_error(pio->io_error, zio->io_error);
+	mutex_exit(&pio->io_lock);
+}
+
+/*
+ * Write the given uberblock (spa_ubsync) to all labels, out of band of the
+ * normal txg sync.  Its timestamp is bumped so that it is preferred over
+ * the copy written at the end of the last txg.
+ */
+static void
+raidz_reflow_write_uberblock(spa_t *spa)
+{
+	spa->spa_ubsync.ub_timestamp++;
+	VERIFY0(vdev_uberblock_sync_list(&spa->spa_root_vdev, 1,
+	    &spa->spa_ubsync, ZIO_FLAG_CONFIG_WRITER));
+	if (spa_multihost(spa))
+		mmp_update_uberblock(spa, &spa->spa_ubsync);
+}
+
+/*
+ * Reflow the start of the vdev, whose new location overlaps its own old
+ * location, by way of the scratch area:
+ *
+ *  1. Read the first rows of the old layout and rearrange them in memory.
+ *  2. Write the new layout to the scratch area of each child and record
+ *     that in the uberblock (RRSS_SCRATCH_VALID).  From here on, a pool
+ *     which is imported after a crash reads this range from the scratch
+ *     area, and copies it into place (vdev_raidz_reflow_copy_scratch()).
+ *  3. Write the new layout to its real location and record that the
+ *     scratch area is no longer needed (RRSS_SCRATCH_INVALID_SYNCED).
+ */
+static void
+raidz_reflow_scratch_sync(void *arg, dmu_tx_t *tx)
+{
+	vdev_raidz_expand_t *vre = arg;
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+	zio_t *pio;
+	int error;
+
+	spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	int ashift = raidvd->vdev_ashift;
+	uint64_t write_size = P2ALIGN(VDEV_BOOT_SIZE, 1ULL << ashift);
+	uint64_t logical_size = write_size * raidvd->vdev_children;
+	uint64_t read_size =
+	    P2ROUNDUP(DIV_ROUND_UP(logical_size, (raidvd->vdev_children - 1)),
+	    1ULL << ashift);
+
+	/*
+	 * The scratch space must be large enough to get us to the point
+	 * that one row does not overlap itself when moved.  This is checked
+	 * by spa_vdev_attach().
+	 */
+	VERIFY3U(write_size, >=, raidvd->vdev_children << ashift);
+	VERIFY3U(write_size, <=, VDEV_BOOT_SIZE);
+	VERIFY3U(write_size, <=, read_size);
+
+	locked_range_t *lr = rangelock_enter(&vre->vre_rangelock,
+	    0, logical_size, RL_WRITER);
+
+	abd_t **abds = kmem_alloc(raidvd->vdev_children * sizeof (abd_t *),
+	    KM_SLEEP);
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abds[i] = abd_alloc_linear(read_size, B_FALSE);
+
+	/*
+	 * If we have already written the scratch area then we must read from
+	 * there, since new writes were redirected there while we were paused
+	 * or the original location may have been partially overwritten with
+	 * reflowed data.
+	 */
+	if (RRSS_GET_STATE(&spa->spa_ubsync) == RRSS_SCRATCH_VALID) {
+		VERIFY3U(RRSS_GET_OFFSET(&spa->spa_ubsync), ==, logical_size);
+
+		/*
+		 * Note: zio_vdev_child_io() adds VDEV_LABEL_START_SIZE to the
+		 * offset to calculate the physical offset to read from, so
+		 * this offset wraps around to the boot area.
+		 */
+		pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+		for (int i = 0; i < raidvd->vdev_children; i++) {
+			zio_nowait(zio_vdev_child_io(pio, NULL,
+			    raidvd->vdev_child[i],
+			    VDEV_BOOT_OFFSET - VDEV_LABEL_START_SIZE, abds[i],
+			    write_size, ZIO_TYPE_READ, ZIO_PRIORITY_ASYNC_READ,
+			    ZIO_FLAG_CANFAIL, raidz_scratch_child_done, pio));
+		}
+		error = zio_wait(pio);
+		if (error != 0) {
+			zfs_dbgmsg("reflow: error %d reading scratch location",
+			    error);
+			goto io_error_exit;
+		}
+		goto overwrite;
+	}
+
+	/*
+	 * Read from the original location.
+	 */
+	pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < raidvd->vdev_children - 1; i++) {
+		ASSERT0(vdev_is_dead(raidvd->vdev_child[i]));
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    0, abds[i], read_size, ZIO_TYPE_READ,
+		    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL,
+		    raidz_scratch_child_done, pio));
+	}
+	error = zio_wait(pio);
+	if (error != 0) {
+		zfs_dbgmsg("reflow: error %d reading original location",
+		    error);
+		goto io_error_exit;
+	}
+
+	/*
+	 * Reflow in memory.  The first row doesn't move, and every other
+	 * sector moves to a location which has already been vacated.
+	 */
+	uint64_t logical_sectors = logical_size >> ashift;
+	for (uint64_t i = raidvd->vdev_children - 1; i < logical_sectors;
+	    i++) {
+		int oldchild = i % (raidvd->vdev_children - 1);
+		uint64_t oldoff = (i / (raidvd->vdev_children - 1)) << ashift;
+
+		int newchild = i % raidvd->vdev_children;
+		uint64_t newoff = (i / raidvd->vdev_children) << ashift;
+
+		/* a single sector should not be copying over itself */
+		ASSERT(!(newchild == oldchild && newoff == oldoff));
+
+		abd_copy_off(abds[newchild], abds[oldchild],
+		    newoff, oldoff, 1ULL << ashift);
+	}
+
+	/*
+	 * Verify that we filled in everything we intended to (write_size on
+	 * each child).
+	 */
+	VERIFY0(logical_sectors % raidvd->vdev_children);
+	VERIFY3U(write_size, ==,
+	    (logical_sectors / raidvd->vdev_children) << ashift);
+
+	/*
+	 * Write to the scratch location (boot area).
+	 */
+	pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    VDEV_BOOT_OFFSET - VDEV_LABEL_START_SIZE, abds[i],
+		    write_size, ZIO_TYPE_WRITE, ZIO_PRIORITY_ASYNC_WRITE,
+		    ZIO_FLAG_CANFAIL, raidz_scratch_child_done, pio));
+	}
+	error = zio_wait(pio);
+	if (error != 0) {
+		zfs_dbgmsg("reflow: error %d writing scratch location", error);
+		goto io_error_exit;
+	}
+	pio = zio_root(spa, NULL, NULL, 0);
+	zio_flush(pio, raidvd);
+	zio_wait(pio);
+
+	zfs_dbgmsg("reflow: wrote %llu bytes (logical) to scratch area",
+	    (long long)logical_size);
+
+	/*
+	 * Update the uberblock to indicate that the scratch space is valid.
+	 * This is needed because after this point, the real location may be
+	 * overwritten.  If we crash, we need to get the data from the
+	 * scratch space, rather than the real location.
+	 */
+	RAIDZ_REFLOW_SET(&spa->spa_ubsync, RRSS_SCRATCH_VALID, logical_size);
+	raidz_reflow_write_uberblock(spa);
+
+	zfs_dbgmsg("reflow: uberblock updated "
+	    "(txg %llu, SCRATCH_VALID, size %llu, ts %llu)",
+	    (long long)spa->spa_ubsync.ub_txg,
+	    (long long)logical_size,
+	    (long long)spa->spa_ubsync.ub_timestamp);
+
+	/*
+	 * Overwrite the real location with the reflowed data.
+	 */
+overwrite:
+	pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    0, abds[i], write_size, ZIO_TYPE_WRITE,
+		    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL,
+		    raidz_scratch_child_done, pio));
+	}
+	error = zio_wait(pio);
+	if (error != 0) {
+		/*
+		 * When we exit early here and drop the range lock, new
+		 * writes will go into the scratch area so we'll need to
+		 * read from there when we return after pausing.
+		 */
+		zfs_dbgmsg("reflow: error %d writing real location", error);
+		/*
+		 * Update the uberblock that is written when this txg
+		 * completes.
+		 */
+		RAIDZ_REFLOW_SET(&spa->spa_uberblock, RRSS_SCRATCH_VALID,
+		    logical_size);
+		vre->vre_synced_offset = logical_size;
+		goto io_error_exit;
+	}
+	pio = zio_root(spa, NULL, NULL, 0);
+	zio_flush(pio, raidvd);
+	zio_wait(pio);
+
+	zfs_dbgmsg("reflow: overwrote %llu bytes (logical) to real location",
+	    (long long)logical_size);
+
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abd_free(abds[i]);
+	kmem_free(abds, raidvd->vdev_children * sizeof (abd_t *));
+
+	/*
+	 * Update the uberblock to indicate that the initial part has been
+	 * reflowed.  This is needed because after this point (when we exit
+	 * the rangelock), we allow regular writes to this region, which will
+	 * be written to the new location only.  If we crashed and re-copied
+	 * from the scratch space, we would lose the regular writes.
+	 */
+	RAIDZ_REFLOW_SET(&spa->spa_ubsync, RRSS_SCRATCH_INVALID_SYNCED,
+	    logical_size);
+	raidz_reflow_write_uberblock(spa);
+
+	zfs_dbgmsg("reflow: uberblock updated "
+	    "(txg %llu, SCRATCH_NOT_IN_USE, size %llu, ts %llu)",
+	    (long long)spa->spa_ubsync.ub_txg,
+	    (long long)logical_size,
+	    (long long)spa->spa_ubsync.ub_timestamp);
+
+	/*
+	 * Update progress.
+	 */
+	vre->vre_offset = logical_size;
+	vre->vre_synced_offset = logical_size;
+	rangelock_exit(lr);
+	spa_config_exit(spa, SCL_STATE, FTAG);
+
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	vre->vre_offset_pertxg[txgoff] = vre->vre_offset;
+
+	/*
+	 * raidz_reflow_sync() will update the uberblock state to
+	 * RRSS_SCRATCH_INVALID_SYNCED_REFLOW.
+	 */
+	raidz_reflow_sync(spa, tx);
+	return;
+
+io_error_exit:
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abd_free(abds[i]);
+	kmem_free(abds, raidvd->vdev_children * sizeof (abd_t *));
+	rangelock_exit(lr);
+	spa_config_exit(spa, SCL_STATE, FTAG);
+}
+
+/*
+ * We crashed in the middle of raidz_reflow_scratch_sync(), after the
+ * scratch area had been written; complete the copy of its contents to the
+ * real location.  Called while importing the pool, before anything else
+ * can write to it.
+ */
+void
+vdev_raidz_reflow_copy_scratch(spa_t *spa)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	uint64_t logical_size = RRSS_GET_OFFSET(&spa->spa_uberblock);
+	ASSERT3U(RRSS_GET_STATE(&spa->spa_uberblock), ==, RRSS_SCRATCH_VALID);
+
+	spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	ASSERT0(logical_size % raidvd->vdev_children);
+	uint64_t write_size = logical_size / raidvd->vdev_children;
+
+	zio_t *pio;
+
+	/*
+	 * Read from the scratch space.
+	 */
+	abd_t **abds = kmem_alloc(raidvd->vdev_children * sizeof (abd_t *),
+	    KM_SLEEP);
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abds[i] = abd_alloc_linear(write_size, B_FALSE);
+
+	pio = zio_root(spa, NULL, NULL, 0);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		/*
+		 * Note: zio_vdev_child_io() adds VDEV_LABEL_START_SIZE to
+		 * the offset to calculate the physical offset to read from.
+		 */
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    VDEV_BOOT_OFFSET - VDEV_LABEL_START_SIZE, abds[i],
+		    write_size, ZIO_TYPE_READ, ZIO_PRIORITY_ASYNC_READ, 0,
+		    raidz_scratch_child_done, pio));
+	}
+	zio_wait(pio);
+
+	/*
+	 * Overwrite the real location with the reflowed data.
+	 */
+	pio = zio_root(spa, NULL, NULL, 0);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    0, abds[i], write_size, ZIO_TYPE_WRITE,
+		    ZIO_PRIORITY_ASYNC_WRITE, 0,
+		    raidz_scratch_child_done, pio));
+	}
+	zio_wait(pio);
+	pio = zio_root(spa, NULL, NULL, 0);
+	zio_flush(pio, raidvd);
+	zio_wait(pio);
+
+	zfs_dbgmsg("reflow recovery: overwrote %llu bytes (logical) "
+	    "to real location", (long long)logical_size);
+
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abd_free(abds[i]);
+	kmem_free(abds, raidvd->vdev_children * sizeof (abd_t *));
+
+	/*
+	 * Update the uberblock.
+	 */
+	RAIDZ_REFLOW_SET(&spa->spa_ubsync,
+	    RRSS_SCRATCH_INVALID_SYNCED_ON_IMPORT, logical_size);
+	raidz_reflow_write_uberblock(spa);
+	RAIDZ_REFLOW_SET(&spa->spa_uberblock,
+	    RRSS_SCRATCH_INVALID_SYNCED_ON_IMPORT, logical_size);
+
+	zfs_dbgmsg("reflow recovery: uberblock updated "
+	    "(txg %llu, SCRATCH_NOT_IN_USE, size %llu, ts %llu)",
+	    (long long)spa->spa_ubsync.ub_txg,
+	    (long long)logical_size,
+	    (long long)spa->spa_ubsync.ub_timestamp);
+
+	spa_config_exit(spa, SCL_STATE, FTAG);
+}
+
+/*
+ * Sync task run once everything has been copied.
+ */
+static void
+raidz_reflow_complete_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	vdev_raidz_t *vdrz = raidvd->vdev_tsd;
+
+	/*
+	 * Make sure no normal i/o is in flight while we switch it over to
+	 * the new layout.
+	 */
+	locked_range_t *lr = rangelock_enter(&vre->vre_rangelock,
+	    0, UINT64_MAX, RL_WRITER);
+
+	for (int i = 0; i < TXG_SIZE; i++)
+		VERIFY0(vre->vre_offset_pertxg[i]);
+
+	VERIFY3U(RRSS_GET_OFFSET(&spa->spa_ubsync), ==,
+	    raidvd->vdev_ms_count << raidvd->vdev_ms_shift);
+
+	/*
+	 * Blocks born from this txg on (allowing for the txgs which may
+	 * already have allocated space) use the new width.
+	 */
+	reflow_node_t *re = kmem_zalloc(sizeof (*re), KM_SLEEP);
+	re->re_txg = tx->tx_txg + TXG_CONCURRENT_STATES;
+	re->re_logical_width = vdrz->vd_physical_width;
+	mutex_enter(&vdrz->vd_expand_lock);
+	avl_add(&vdrz->vd_expand_txgs, re);
+	mutex_exit(&vdrz->vd_expand_lock);
+
+	vdev_config_dirty(raidvd);
+
+	/*
+	 * before we change vre_state, the on-disk state must reflect that we
+	 * have completed all copying, so that vdev_raidz_io_start() can use
+	 * vre_state to determine if the reflow is in progress.  See also the
+	 * end of spa_raidz_expand_thread().
+	 */
+	vre->vre_synced_offset = RRSS_GET_OFFSET(&spa->spa_ubsync);
+	vre->vre_end_time = gethrestime_sec();
+	vre->vre_state = DSS_FINISHED;
+
+	uint64_t state = vre->vre_state;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_STATE,
+	    sizeof (state), 1, &state, tx));
+
+	uint64_t end_time = vre->vre_end_time;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_END_TIME,
+	    sizeof (end_time), 1, &end_time, tx));
+
+	spa->spa_uberblock.ub_raidz_reflow_info = 0;
+
+	spa_history_log_internal(spa, "raidz vdev expansion completed", tx,
+	    "%s vdev %llu new width %llu", spa_name(spa),
+	    (unsigned long long)raidvd->vdev_id,
+	    (unsigned long long)raidvd->vdev_children);
+
+	spa->spa_raidz_expand = NULL;
+	raidvd->vdev_rz_expanding = B_FALSE;
+
+	spa_async_request(spa, SPA_ASYNC_INITIALIZE_RESTART);
+	spa_async_request(spa, SPA_ASYNC_TRIM_RESTART);
+	spa_async_request(spa, SPA_ASYNC_AUTOTRIM_RESTART);
+
+	rangelock_exit(lr);
+}
+
+/*
+ * Sync task of spa_vdev_attach() for a raidz vdev; the new child has been
+ * added to the vdev.  Start the reflow.
+ */
+void
+vdev_raidz_attach_sync(void *arg, dmu_tx_t *tx)
+{
+	vdev_t *new_child = arg;
+	spa_t *spa = new_child->vdev_spa;
+	vdev_t *raidvd = new_child->vdev_parent;
+	vdev_raidz_t *vdrz = raidvd->vdev_tsd;
+	vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+
+	ASSERT3P(raidvd->vdev_ops, ==, &vdev_raidz_ops);
+	ASSERT3P(raidvd->vdev_top, ==, raidvd);
+	ASSERT3U(raidvd->vdev_children, >, vdrz->vd_original_width);
+	ASSERT3U(raidvd->vdev_children, ==, vdrz->vd_physical_width + 1);
+	ASSERT3P(raidvd->vdev_child[raidvd->vdev_children - 1], ==,
+	    new_child);
+
+	spa_feature_incr(spa, SPA_FEATURE_RAIDZ_EXPANSION, tx);
+
+	vre->vre_vdev_id = raidvd->vdev_id;
+	vre->vre_offset = 0;
+	vre->vre_synced_offset = 0;
+	vre->vre_failed_offset = UINT64_MAX;
+	vre->vre_waiting_for_resilver = B_FALSE;
+	vre->vre_start_time = gethrestime_sec();
+	vre->vre_end_time = 0;
+	vre->vre_bytes_copied = 0;
+	vre->vre_state = DSS_SCANNING;
+	spa->spa_raidz_expand = vre;
+
+	/*
+	 * Pairs with the membar_consumer() in vdev_raidz_io_start().
+	 */
+	membar_producer();
+	vdrz->vd_physical_width++;
+
+	vdev_config_dirty(raidvd);
+
+	uint64_t state = vre->vre_state;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_STATE,
+	    sizeof (state), 1, &state, tx));
+
+	uint64_t start_time = vre->vre_start_time;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_START_TIME,
+	    sizeof (start_time), 1, &start_time, tx));
+
+	(void) zap_remove(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_END_TIME, tx);
+	(void) zap_remove(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_BYTES_COPIED, tx);
+
+	spa_history_log_internal(spa, "raidz vdev expansion started", tx,
+	    "%s vdev %llu new width %llu", spa_name(spa),
+	    (unsigned long long)raidvd->vdev_id,
+	    (unsigned long long)raidvd->vdev_children);
+
+	zthr_wakeup(spa->spa_raidz_expand_zthr);
+}
+
+/*
+ * Copy every allocated sector of the vdev being expanded to its new
+ * location, one metaslab at a time.
+ */
+/* ARGSUSED */
+static void
+spa_raidz_expand_thread(void *arg, zthr_t *zthr)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	/*
+	 * If the scratch area is still in use we restart from the
+	 * beginning, reading the start of the vdev from it.
+	 */
+	vre->vre_synced_offset = RRSS_GET_OFFSET(&spa->spa_ubsync);
+	if (RRSS_GET_STATE(&spa->spa_ubsync) == RRSS_SCRATCH_VALID)
+		vre->vre_offset = 0;
+	else
+		vre->vre_offset = RRSS_GET_OFFSET(&spa->spa_ubsync);
+
+	/* Reflow the begining portion using the scratch area */
+	if (vre->vre_offset == 0) {
+		VERIFY0(dsl_sync_task(spa_name(spa),
+		    NULL, raidz_reflow_scratch_sync,
+		    vre, 0, ZFS_SPACE_CHECK_NONE));
+
+		/* if we encountered errors then pause */
+		if (vre->vre_offset == 0) {
+			mutex_enter(&vre->vre_lock);
+			vre->vre_waiting_for_resilver = B_TRUE;
+			mutex_exit(&vre->vre_lock);
+			return;
+		}
+	}
+
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+
+	uint64_t guid = raidvd->vdev_guid;
+
+	for (uint64_t i = vre->vre_offset >> raidvd->vdev_ms_shift;
+	    i < raidvd->vdev_ms_count &&
+	    !zthr_iscancelled(zthr) &&
+	    vre->vre_failed_offset == UINT64_MAX; i++) {
+		metaslab_t *msp = raidvd->vdev_ms[i];
+
+		/*
+		 * Disabling the metaslab keeps new allocations out of it
+		 * while we find (and copy) what is allocated.
+		 */
+		metaslab_disable(msp);
+		mutex_enter(&msp->ms_lock);
+
+		/*
+		 * The metaslab may be newly created (for the expanded
+		 * space), in which case its trees won't exist yet,
+		 * so we need to bail out early.
+		 */
+		if (msp->ms_new) {
+			mutex_exit(&msp->ms_lock);
+			metaslab_enable(msp, B_FALSE);
+			continue;
+		}
+
+		VERIFY0(metaslab_load(msp));
+
+		/*
+		 * We want to copy everything except the free (allocatable)
+		 * space.  Note that there may be a little bit more free
+		 * space (e.g. in ms_defer), and it's fine to copy that too.
+		 */
+		range_tree_t *rt = range_tree_create(NULL, RANGE_SEG64,
+		    NULL, 0, 0);
+		range_tree_add(rt, msp->ms_start, msp->ms_size);
+		range_tree_walk(msp->ms_allocatable, range_tree_remove, rt);
+		mutex_exit(&msp->ms_lock);
+
+		/*
+		 * Force the last sector of each metaslab to be copied.  This
+		 * ensures that we advance the on-disk progress to the end of
+		 * this metaslab while the metaslab is disabled.  Otherwise, we
+		 * could move past this metaslab without advancing the on-disk
+		 * progress, and then an allocation to this metaslab would not
+		 * be copied.
+		 */
+		int sectorsz = 1 << raidvd->vdev_ashift;
+		uint64_t ms_last_offset = msp->ms_start +
+		    msp->ms_size - sectorsz;
+		if (!range_tree_contains(rt, ms_last_offset, sectorsz))
+			range_tree_add(rt, ms_last_offset, sectorsz);
+
+		/*
+		 * When we are resuming from a paused expansion (i.e.
+		 * when importing a pool with a expansion in progress),
+		 * discard any state that we have already processed.
+		 */
+		range_tree_clear(rt, 0, vre->vre_offset);
+
+		while (!zthr_iscancelled(zthr) &&
+		    !range_tree_is_empty(rt) &&
+		    vre->vre_failed_offset == UINT64_MAX) {
+
+			/*
+			 * We need to periodically drop the config lock so that
+			 * writers can get in.  Additionally, we can't wait
+			 * for a txg to sync while holding a config lock
+			 * (since a waiting writer could cause a 3-way wait
+			 * with the sync thread, which also gets a config
+			 * lock for reader).  So we can't hold the config lock
+			 * while calling dmu_tx_assign().
+			 */
+			spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+			/*
+			 * This pause is only used during testing or debugging.
+			 */
+			while (raidz_expand_max_reflow_bytes != 0 &&
+			    raidz_expand_max_reflow_bytes <=
+			    vre->vre_bytes_copied && !zthr_iscancelled(zthr)) {
+				delay(hz);
+			}
+
+			mutex_enter(&vre->vre_lock);
+			while (vre->vre_outstanding_bytes >
+			    raidz_expand_max_copy_bytes) {
+				cv_wait(&vre->vre_cv, &vre->vre_lock);
+			}
+			mutex_exit(&vre->vre_lock);
+
+			dmu_tx_t *tx =
+			    dmu_tx_create_dd(spa_get_dsl(spa)->dp_mos_dir);
+
+			VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+			uint64_t txg = dmu_tx_get_txg(tx);
+
+			/*
+			 * Reacquire the vdev_config lock.  Theoretically, the
+			 * vdev_t that we're expanding may have changed.
+			 */
+			spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+			raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+
+			boolean_t needsync =
+			    raidz_reflow_impl(raidvd, vre, rt, tx);
+
+			dmu_tx_commit(tx);
+
+			if (needsync) {
+				spa_config_exit(spa, SCL_CONFIG, FTAG);
+				txg_wait_synced(spa->spa_dsl_pool, txg);
+				spa_config_enter(spa, SCL_CONFIG, FTAG,
+				    RW_READER);
+			}
+		}
+
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+		metaslab_enable(msp, B_FALSE);
+		range_tree_vacate(rt, NULL, NULL);
+		range_tree_destroy(rt);
+
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+		raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	}
+
+	uint64_t end = raidvd->vdev_ms_count << raidvd->vdev_ms_shift;
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+	/*
+	 * The txg_wait_synced() here ensures that all reflow zio's have
+	 * completed, and vre_failed_offset has been set if necessary.  It
+	 * also ensures that the progress of the last raidz_reflow_sync() is
+	 * written to disk before raidz_reflow_complete_sync() changes the
+	 * in-memory vre_state.  vdev_raidz_io_start() uses vre_state to
+	 * determine if a reflow is in progress, in which case we may need to
+	 * write to both old and new locations.  Therefore we can only change
+	 * vre_state once this is not necessary, which is once the on-disk
+	 * progress (in spa_ubsync) has been set past any possible writes (to
+	 * the end of the last metaslab).
+	 */
+	txg_wait_synced(spa->spa_dsl_pool, 0);
+
+	if (!zthr_iscancelled(zthr) && vre->vre_offset == end &&
+	    vre->vre_failed_offset == UINT64_MAX) {
+		/*
+		 * We are not being canceled or paused, so the reflow must be
+		 * complete.  In that case also mark it as completed on disk.
+		 */
+		VERIFY0(dsl_sync_task(spa_name(spa), NULL,
+		    raidz_reflow_complete_sync, spa,
+		    0, ZFS_SPACE_CHECK_NONE));
+
+		/*
+		 * Reopen the vdev so that it picks up the space of the new
+		 * child, and let the async thread add the new metaslabs.
+		 */
+		spa_vdev_state_enter(spa, SCL_NONE);
+		raidvd = spa_lookup_by_guid(spa, guid, B_FALSE);
+		if (raidvd != NULL) {
+			raidvd->vdev_expanding = B_TRUE;
+			vdev_reopen(raidvd);
+			raidvd->vdev_expanding = B_FALSE;
+		}
+		(void) spa_vdev_state_exit(spa, NULL, 0);
+		spa_async_request(spa, SPA_ASYNC_CONFIG_UPDATE);
+	} else {
+		/*
+		 * Wait for all copy zio's to complete and for all the
+		 * raidz_reflow_sync() synctasks to be run.
+		 */
+		spa_history_log_internal(spa, "reflow pause",
+		    NULL, "offset=%llu failed_offset=%lld",
+		    (long long)vre->vre_offset,
+		    (long long)vre->vre_failed_offset);
+		mutex_enter(&vre->vre_lock);
+		if (vre->vre_failed_offset != UINT64_MAX) {
+			/*
+			 * Reset progress so that we will retry everything
+			 * after the point that something failed.
+			 */
+			vre->vre_offset = vre->vre_failed_offset;
+			vre->vre_failed_offset = UINT64_MAX;
+			vre->vre_waiting_for_resilver = B_TRUE;
+		}
+		mutex_exit(&vre->vre_lock);
+	}
+}
+
+/* ARGSUSED */
+static boolean_t
+spa_raidz_expand_thread_check(void *arg, zthr_t *zthr)
+{
+	spa_t *spa = arg;
+
+	return (spa->spa_raidz_expand != NULL &&
+	    !spa->spa_raidz_expand->vre_waiting_for_resilver);
+}
+
+void
+spa_start_raidz_expansion_thread(spa_t *spa)
+{
+	ASSERT3P(spa->spa_raidz_expand_zthr, ==, NULL);
+	spa->spa_raidz_expand_zthr = zthr_create(
+	    spa_raidz_expand_thread_check, spa_raidz_expand_thread, spa);
+}
+
+/*
+ * A failed copy paused the reflow; resume it once the vdev's children
+ * no longer have missing data (e.g. after a resilver or "zpool clear").
+ */
+void
+vdev_raidz_expand_resume(spa_t *spa)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	if (vre == NULL || !vre->vre_waiting_for_resilver)
+		return;
+
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	if (raidvd == NULL || !vdev_dtl_empty(raidvd, DTL_MISSING))
+		return;
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_waiting_for_resilver = B_FALSE;
+	mutex_exit(&vre->vre_lock);
+	zthr_wakeup(spa->spa_raidz_expand_zthr);
+}
+
+vdev_ops_t vdev_raidz_ops = {
+	.vdev_op_open = vdev_raidz_open,
+	.vdev_op_close = vdev_raidz_close,
+	.vdev_op_asize = vdev_raidz_asize,
+	.vdev_op_io_start = vdev_raidz_io_start,
+	.vdev_op_io_done = vdev_raidz_io_done,
+	.vdev_op_state_change = vdev_raidz_state_change,
+	.vdev_op_need_resilver = vdev_raidz_need_resilver,
+	.vdev_op_hold = NULL,
+	.vdev_op_rele = NULL,
+	.vdev_op_remap = NULL,
+	.vdev_op_xlate = vdev_raidz_xlate,
+	.vdev_op_type = VDEV_TYPE_RAIDZ,	/* name of this vdev type */
+	.vdev_op_leaf = B_FALSE			/* not a leaf vdev */
+};
+
+#if defined(_KERNEL)
+/* BEGIN CSTYLED */
+module_param(raidz_expand_max_copy_bytes, ulong, 0644);
+MODULE_PARM_DESC(raidz_expand_max_copy_bytes,
+	"Max amount of concurrent i/o for RAIDZ expansion");
+
+module_param(raidz_expand_max_reflow_bytes, ulong, 0644);
+MODULE_PARM_DESC(raidz_expand_max_reflow_bytes,
+	"For testing, pause RAIDZ expansion after reflowing this many bytes");
+/* END CSTYLED */
+#endif
@@ -0,0 +1,485 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/txg.h>
+#include <sys/vdev_impl.h>
+#include <sys/vdev_rebuild.h>
+#include <sys/metaslab_impl.h>
+#include <sys/space_map.h>
+#include <sys/dsl_pool.h>
+#include <sys/dsl_synctask.h>
+#include <sys/dmu_tx.h>
+#include <sys/zio.h>
+
+/*
+ * Sequential rebuild
+ *
+ * A regular resilver (see dsl_scan.c) traverses the block tree, which
+ * results in mostly random i/o even with sorted scan queues.  For mirrors
+ * every allocated sector of a healthy child is a valid copy of the data, so
+ * a new child can instead be populated by copying the allocated ranges of
+ * each metaslab, as recorded in its space map, in LBA order.  This runs at
+ * the sequential bandwidth of the devices, at the cost of not verifying
+ * block checksums; a scrub is started once the rebuild completes to do
+ * that (see zfs_rebuild_scrub_enabled).
+ *
+ * A rebuild is requested with "zpool attach -s" or "zpool replace -s".  The
+ * new leaf is marked with vdev_rebuild_txg and one thread per top-level
+ * vdev copies each metaslab by issuing resilver reads for its allocated
+ * ranges; vdev_mirror_io_done() writes the data to every child whose DTL
+ * says it is missing.  Once all metaslabs have been copied without errors,
+ * the DTLs of the rebuilt leaves are excised, which lets a replacing or
+ * spare vdev detach the old device as it would after a resilver.
+ *
+ * The rebuild progress is kept in memory only.  Like autotrim, the threads
+ * are stopped by spa_vdev_enter() and restarted by spa_vdev_exit(); the
+ * pass resumes where it left off unless the change added missing data that
+ * the pass does not cover.  If the pool is exported or the rebuild fails,
+ * the leaves are left with their DTLs and a regular resilver takes over.
+ */
+
+/* maximum size of a single rebuild read */
+int zfs_rebuild_max_segment = 1024 * 1024;
+
+/* maximum number of rebuild reads outstanding per top-level vdev */
+int zfs_rebuild_queue_limit = 20;
+
+/* start a scrub to verify the checksums once a rebuild completes */
+int zfs_rebuild_scrub_enabled = 1;
+
+static boolean_t
+vdev_rebuild_should_stop(vdev_t *tvd)
+{
+	return (tvd->vdev_rebuild_exit_wanted || tvd->vdev_removing ||
+	    !vdev_readable(tvd) || !spa_writeable(tvd->vdev_spa));
+}
+
+/*
+ * Returns the end of the missing range of the leaves below vd that were
+ * attached for a rebuild, or 0 if none of them is missing anything.
+ */
+static uint64_t
+vdev_rebuild_dtl_max(vdev_t *vd)
+{
+	uint64_t max_txg = 0;
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++) {
+		max_txg = MAX(max_txg,
+		    vdev_rebuild_dtl_max(vd->vdev_child[c]));
+	}
+
+	if (vd->vdev_ops->vdev_op_leaf && vd->vdev_rebuild_txg != 0) {
+		mutex_enter(&vd->vdev_dtl_lock);
+		max_txg = MAX(max_txg,
+		    range_tree_max(vd->vdev_dtl[DTL_MISSING]));
+		mutex_exit(&vd->vdev_dtl_lock);
+	}
+
+	return (max_txg);
+}
+
+/*
+ * Excise the DTLs of the rebuilt leaves below vd.  A leaf is only
+ * considered rebuilt if every read of the pass succeeded, no write to it
+ * failed, and it is not missing anything the pass did not cover.  The
+ * remaining leaves are handed over to a regular resilver.  Returns B_TRUE
+ * if all leaves were rebuilt.
+ */
+static boolean_t
+vdev_rebuild_excise(vdev_t *vd, uint64_t max_txg, boolean_t clean)
+{
+	boolean_t rebuilt = B_TRUE;
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++) {
+		if (!vdev_rebuild_excise(vd->vdev_child[c], max_txg, clean))
+			rebuilt = B_FALSE;
+	}
+
+	if (!vd->vdev_ops->vdev_op_leaf || vd->vdev_rebuild_txg == 0)
+		return (rebuilt);
+
+	mutex_enter(&vd->vdev_dtl_lock);
+	if (clean && vdev_writeable(vd) &&
+	    vd->vdev_stat.vs_write_errors == 0 &&
+	    range_tree_max(vd->vdev_dtl[DTL_MISSING]) <= max_txg) {
+		range_tree_vacate(vd->vdev_dtl[DTL_MISSING], NULL, NULL);
+	} else {
+		rebuilt = B_FALSE;
+	}
+	vd->vdev_rebuild_txg = 0;
+	mutex_exit(&vd->vdev_dtl_lock);
+
+	return (rebuilt);
+}
+
+static void
+vdev_rebuild_complete_sync(void *arg, dmu_tx_t *tx)
+{
+	vdev_t *tvd = arg;
+	spa_t *spa = tvd->vdev_spa;
+
+	mutex_enter(&tvd->vdev_rebuild_lock);
+	boolean_t rebuilt = vdev_rebuild_excise(tvd,
+	    tvd->vdev_rebuild_max_txg, tvd->vdev_rebuild_errors == 0);
+
+	spa_history_log_internal(spa, "rebuild", tx,
+	    "vdev_id=%llu copied=%llu errors=%llu %s",
+	    (u_longlong_t)tvd->vdev_id,
+	    (u_longlong_t)tvd->vdev_rebuild_bytes_done,
+	    (u_longlong_t)tvd->vdev_rebuild_errors,
+	    rebuilt ? "complete" : "incomplete, resilvering");
+
+	tvd->vdev_rebuild_max_txg = 0;
+	tvd->vdev_rebuild_ms = 0;
+	tvd->vdev_rebuild_errors = 0;
+	tvd->vdev_rebuild_bytes_done = 0;
+	mutex_exit(&tvd->vdev_rebuild_lock);
+
+	vdev_dtl_reassess(tvd, dmu_tx_get_txg(tx), 0, B_FALSE);
+
+	spa_async_request(spa, rebuilt ? SPA_ASYNC_REBUILD_DONE :
+	    SPA_ASYNC_RESILVER);
+}
+
+static void
+vdev_rebuild_cb(zio_t *zio)
+{
+	vdev_t *tvd = zio->io_private;
+
+	mutex_enter(&tvd->vdev_rebuild_io_lock);
+	if (zio->io_error != 0)
+		tvd->vdev_rebuild_errors++;
+	else
+		tvd->vdev_rebuild_bytes_done += zio->io_size;
+
+	ASSERT3U(tvd->vdev_rebuild_inflight, >, 0);
+	tvd->vdev_rebuild_inflight--;
+	cv_broadcast(&tvd->vdev_rebuild_io_cv);
+	mutex_exit(&tvd->vdev_rebuild_io_lock);
+
+	abd_free(zio->io_abd);
+}
+
+/*
+ * Read the given range of the top-level vdev with ZIO_FLAG_RESILVER, so
+ * that the mirror repairs the children that are missing it.  Only the DVA
+ * of the block pointer is used; the birth txg is set so that it falls in
+ * the DTL of the newly attached leaves.
+ */
+static int
+vdev_rebuild_range(vdev_t *tvd, uint64_t start, uint64_t size)
+{
+	spa_t *spa = tvd->vdev_spa;
+	blkptr_t blk, *bp = &blk;
+
+	mutex_enter(&tvd->vdev_rebuild_io_lock);
+	while (tvd->vdev_rebuild_inflight >= zfs_rebuild_queue_limit)
+		cv_wait(&tvd->vdev_rebuild_io_cv, &tvd->vdev_rebuild_io_lock);
+	if (vdev_rebuild_should_stop(tvd)) {
+		mutex_exit(&tvd->vdev_rebuild_io_lock);
+		return (SET_ERROR(EINTR));
+	}
+	tvd->vdev_rebuild_inflight++;
+	mutex_exit(&tvd->vdev_rebuild_io_lock);
+
+	BP_ZERO(bp);
+	DVA_SET_VDEV(&bp->blk_dva[0], tvd->vdev_id);
+	DVA_SET_OFFSET(&bp->blk_dva[0], start);
+	DVA_SET_GANG(&bp->blk_dva[0], 0);
+	DVA_SET_ASIZE(&bp->blk_dva[0], size);
+	BP_SET_BIRTH(bp, TXG_INITIAL, TXG_INITIAL);
+	BP_SET_LSIZE(bp, size);
+	BP_SET_PSIZE(bp, size);
+	BP_SET_COMPRESS(bp, ZIO_COMPRESS_OFF);
+	BP_SET_CHECKSUM(bp, ZIO_CHECKSUM_OFF);
+	BP_SET_TYPE(bp, DMU_OT_NONE);
+	BP_SET_LEVEL(bp, 0);
+	BP_SET_DEDUP(bp, 0);
+	BP_SET_BYTEORDER(bp, ZFS_HOST_BYTEORDER);
+
+	zio_nowait(zio_read(NULL, spa, bp, abd_alloc(size, B_FALSE), size,
+	    vdev_rebuild_cb, tvd, ZIO_PRIORITY_SCRUB,
+	    ZIO_FLAG_RAW | ZIO_FLAG_CANFAIL | ZIO_FLAG_RESILVER, NULL));
+
+	return (0);
+}
+
+static int
+vdev_rebuild_ranges(vdev_t *tvd, range_tree_t *rt)
+{
+	zfs_btree_t *bt = &rt->rt_root;
+	zfs_btree_index_t where;
+
+	for (range_seg_t *rs = zfs_btree_first(bt, &where); rs != NULL;
+	    rs = zfs_btree_next(bt, &where, &where)) {
+		uint64_t start = rs_get_start(rs, rt);
+		uint64_t end = rs_get_end(rs, rt);
+
+		/* Split range into legally-sized chunks */
+		while (start < end) {
+			uint64_t size = MIN(end - start,
+			    zfs_rebuild_max_segment);
+			int error = vdev_rebuild_range(tvd, start, size);
+			if (error != 0)
+				return (error);
+			start += size;
+		}
+	}
+	return (0);
+}
+
+/*
+ * Load the allocated ranges of a disabled metaslab into rt.  Allocations
+ * which have not been synced yet may not be on disk, so wait for them
+ * first; the metaslab is disabled, so no new ones can be made.
+ */
+static void
+vdev_rebuild_ms_load(metaslab_t *msp, range_tree_t *rt)
+{
+	dsl_pool_t *dp = spa_get_dsl(msp->ms_group->mg_vd->vdev_spa);
+
+	mutex_enter(&msp->ms_sync_lock);
+	mutex_enter(&msp->ms_lock);
+
+	for (int t = 0; t < TXG_SIZE; t++) {
+		if (!range_tree_is_empty(msp->ms_allocating[t])) {
+			mutex_exit(&msp->ms_lock);
+			mutex_exit(&msp->ms_sync_lock);
+			txg_wait_synced(dp, 0);
+			mutex_enter(&msp->ms_sync_lock);
+			mutex_enter(&msp->ms_lock);
+			break;
+		}
+	}
+	mutex_exit(&msp->ms_lock);
+
+	/*
+	 * The space map and the unflushed changes are only modified in
+	 * syncing context while holding ms_sync_lock, so the space map can
+	 * be read without holding ms_lock (see metaslab_load_impl()).
+	 */
+	if (msp->ms_sm != NULL) {
+		VERIFY0(space_map_load(msp->ms_sm, rt, SM_ALLOC));
+
+		mutex_enter(&msp->ms_lock);
+		range_tree_walk(msp->ms_unflushed_allocs, range_tree_add, rt);
+		range_tree_walk(msp->ms_unflushed_frees, range_tree_remove,
+		    rt);
+		mutex_exit(&msp->ms_lock);
+	}
+
+	mutex_exit(&msp->ms_sync_lock);
+}
+
+static void
+vdev_rebuild_thread(void *arg)
+{
+	vdev_t *tvd = arg;
+	spa_t *spa = tvd->vdev_spa;
+	dsl_pool_t *dp = spa_get_dsl(spa);
+	range_tree_t *rt;
+	int error = 0;
+
+	/*
+	 * Everything the new leaves are missing must have been synced to
+	 * the healthy children before it can be copied.
+	 */
+	txg_wait_synced(dp, tvd->vdev_rebuild_max_txg);
+
+	rt = range_tree_create(NULL, RANGE_SEG64, NULL, 0, 0);
+
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+	while (tvd->vdev_rebuild_ms < tvd->vdev_ms_count) {
+		metaslab_t *msp = tvd->vdev_ms[tvd->vdev_rebuild_ms];
+
+		if (vdev_rebuild_should_stop(tvd)) {
+			error = SET_ERROR(EINTR);
+			break;
+		}
+
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+		metaslab_disable(msp);
+		vdev_rebuild_ms_load(msp, rt);
+		error = vdev_rebuild_ranges(tvd, rt);
+		range_tree_vacate(rt, NULL, NULL);
+
+		/* Let the copies of this metaslab land before moving on. */
+		mutex_enter(&tvd->vdev_rebuild_io_lock);
+		while (tvd->vdev_rebuild_inflight > 0) {
+			cv_wait(&tvd->vdev_rebuild_io_cv,
+			    &tvd->vdev_rebuild_io_lock);
+		}
+		mutex_exit(&tvd->vdev_rebuild_io_lock);
+
+		metaslab_enable(msp, B_FALSE);
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+
+		if (error != 0)
+			break;
+		tvd->vdev_rebuild_ms++;
+	}
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+	range_tree_destroy(rt);
+
+	if (error == 0) {
+		zfs_dbgmsg("rebuild of vdev %llu complete, %llu bytes copied",
+		    (u_longlong_t)tvd->vdev_id,
+		    (u_longlong_t)tvd->vdev_rebuild_bytes_done);
+
+		dmu_tx_t *tx = dmu_tx_create_dd(dp->dp_mos_dir);
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		dsl_sync_task_nowait(dp, vdev_rebuild_complete_sync, tvd,
+		    0, ZFS_SPACE_CHECK_NONE, tx);
+		dmu_tx_commit(tx);
+		txg_wait_synced(dp, dmu_tx_get_txg(tx));
+	}
+
+	mutex_enter(&tvd->vdev_rebuild_lock);
+	tvd->vdev_rebuild_thread = NULL;
+	cv_broadcast(&tvd->vdev_rebuild_cv);
+	mutex_exit(&tvd->vdev_rebuild_lock);
+}
+
+/*
+ * Start (or resume) rebuilding the leaves of a top-level vdev which were
+ * attached for a rebuild, if any of them is missing data.
+ */
+void
+vdev_rebuild(vdev_t *tvd)
+{
+	spa_t *spa = tvd->vdev_spa;
+
+	ASSERT(MUTEX_HELD(&spa_namespace_lock));
+	ASSERT3P(tvd, ==, tvd->vdev_top);
+
+	if (!vdev_is_concrete(tvd) || tvd->vdev_removing ||
+	    !spa_writeable(spa))
+		return;
+
+	mutex_enter(&tvd->vdev_rebuild_lock);
+	if (tvd->vdev_rebuild_thread != NULL) {
+		mutex_exit(&tvd->vdev_rebuild_lock);
+		return;
+	}
+
+	uint64_t max_txg = vdev_rebuild_dtl_max(tvd);
+	if (max_txg == 0) {
+		mutex_exit(&tvd->vdev_rebuild_lock);
+		return;
+	}
+
+	/*
+	 * If the leaves are now missing data born after the pass started,
+	 * the metaslabs copied so far are stale and we start over.
+	 */
+	if (max_txg > tvd->vdev_rebuild_max_txg) {
+		tvd->vdev_rebuild_max_txg = max_txg;
+		tvd->vdev_rebuild_ms = 0;
+		tvd->vdev_rebuild_errors = 0;
+		tvd->vdev_rebuild_bytes_done = 0;
+		zfs_dbgmsg("rebuild of vdev %llu started, max_txg=%llu",
+		    (u_longlong_t)tvd->vdev_id, (u_longlong_t)max_txg);
+	}
+
+	tvd->vdev_rebuild_exit_wanted = B_FALSE;
+	tvd->vdev_rebuild_thread = thread_create(NULL, 0,
+	    vdev_rebuild_thread, tvd, 0, &p0, TS_RUN, maxclsyspri);
+	mutex_exit(&tvd->vdev_rebuild_lock);
+}
+
+/*
+ * Stop the rebuild of a top-level vdev and wait for its thread to exit.
+ * The progress is kept so that vdev_rebuild() can resume it.  Returns
+ * B_TRUE if a rebuild was running.
+ */
+boolean_t
+vdev_rebuild_stop_wait(vdev_t *tvd)
+{
+	boolean_t stopped = B_FALSE;
+
+	mutex_enter(&tvd->vdev_rebuild_lock);
+	if (tvd->vdev_rebuild_thread != NULL) {
+		tvd->vdev_rebuild_exit_wanted = B_TRUE;
+		mutex_enter(&tvd->vdev_rebuild_io_lock);
+		cv_broadcast(&tvd->vdev_rebuild_io_cv);
+		mutex_exit(&tvd->vdev_rebuild_io_lock);
+
+		while (tvd->vdev_rebuild_thread != NULL)
+			cv_wait(&tvd->vdev_rebuild_cv, &tvd->vdev_rebuild_lock);
+		tvd->vdev_rebuild_exit_wanted = B_FALSE;
+		stopped = B_TRUE;
+	}
+	mutex_exit(&tvd->vdev_rebuild_lock);
+
+	return (stopped);
+}
+
+/*
+ * Stop all rebuilds of the pool.  The caller must not hold the config
+ * lock, since the rebuild threads enter it as readers.
+ */
+void
+vdev_rebuild_stop_all(spa_t *spa)
+{
+	vdev_t *rvd = spa->spa_root_vdev;
+
+	for (uint64_t c = 0; c < rvd->vdev_children; c++)
+		(void) vdev_rebuild_stop_wait(rvd->vdev_child[c]);
+}
+
+/*
+ * Resume the rebuilds stopped by vdev_rebuild_stop_all(), and start the
+ * ones requested since.
+ */
+void
+vdev_rebuild_restart(spa_t *spa)
+{
+	vdev_t *rvd = spa->spa_root_vdev;
+
+	ASSERT(MUTEX_HELD(&spa_namespace_lock));
+
+	for (uint64_t c = 0; c < rvd->vdev_children; c++)
+		vdev_rebuild(rvd->vdev_child[c]);
+}
+
+#if defined(_KERNEL)
+EXPORT_SYMBOL(vdev_rebuild);
+EXPORT_SYMBOL(vdev_rebuild_stop_wait);
+EXPORT_SYMBOL(vdev_rebuild_stop_all);
+EXPORT_SYMBOL(vdev_rebuild_restart);
+
+/* BEGIN CSTYLED */
+module_param(zfs_rebuild_max_segment, int, 0644);
+MODULE_PARM_DESC(zfs_rebuild_max_segment,
+	"Max segment size in bytes of rebuild reads");
+
+module_param(zfs_rebuild_queue_limit, int, 0644);
+MODULE_PARM_DESC(zfs_rebuild_queue_limit,
+	"Max rebuild reads outstanding per top-level vdev");
+
+module_param(zfs_rebuild_scrub_enabled, int, 0644);
+MODULE_PARM_DESC(zfs_rebuild_scrub_enabled,
+	"Scrub the pool once a sequential rebuild completes");
+/* END CSTYLED */
+#endif
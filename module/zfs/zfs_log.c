@@ -508,7 +508,10 @@ zfs_log_write(zilog_t *zilog, dmu_tx_t *tx, int txtype,
 		return;
 	}
 
-	if (zilog->zl_logbias == ZFS_LOGBIAS_THROUGHPUT)
+	/*
+	 * Direct I/O writes are already on disk; log their block pointers.
+	 */
+	if (zilog->zl_logbias == ZFS_LOGBIAS_THROUGHPUT || (ioflag & O_DIRECT))
 		write_state = WR_INDIRECT;
 	else if (!spa_has_slogs(zilog->zl_spa) &&
 	    resid >= zfs_immediate_write_sz)
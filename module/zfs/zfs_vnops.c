@@ -69,6 +69,7 @@
 #include <sys/zpl.h>
 #include <sys/zil.h>
 #include <sys/sa_impl.h>
+#include <sys/abd.h>
 
 /*
  * Programming rules.
@@ -417,6 +418,55 @@ mappedread(struct inode *ip, int nbytes, uio_t *uio)
 unsigned long zfs_read_chunk_size = 1024 * 1024; /* Tunable */
 unsigned long zfs_delete_blocks = DMU_MAX_DELETEBLKCNT;
 
+/*
+ * Direct I/O.  When enabled, suitably aligned O_DIRECT reads and writes
+ * are performed straight between the caller's (pinned) pages and disk,
+ * without passing through the ARC.  Everything else falls back to the
+ * normal buffered path.
+ */
+int zfs_dio_enabled = 1;
+
+typedef struct zfs_dio {
+	struct page	**zd_pages;
+	uint_t		zd_maxpages;
+	uint_t		zd_npages;
+	abd_t		*zd_abd;
+} zfs_dio_t;
+
+/*
+ * Pin the user pages backing the next n bytes of the uio and wrap them in
+ * an ABD.  Fails if the uio's buffers are not page aligned.
+ */
+static int
+zfs_dio_pin(zfs_dio_t *dio, uio_t *uio, size_t n, enum uio_rw rw)
+{
+	int error;
+
+	dio->zd_maxpages = P2ROUNDUP(n, PAGESIZE) >> PAGE_SHIFT;
+	dio->zd_pages = vmem_alloc(dio->zd_maxpages * sizeof (struct page *),
+	    KM_SLEEP);
+
+	error = uio_get_user_pages(uio, n, rw, dio->zd_pages, &dio->zd_npages);
+	if (error != 0) {
+		vmem_free(dio->zd_pages,
+		    dio->zd_maxpages * sizeof (struct page *));
+		return (error);
+	}
+	ASSERT3U(dio->zd_npages, ==, dio->zd_maxpages);
+
+	dio->zd_abd = abd_get_from_pages(dio->zd_pages, dio->zd_npages, n);
+
+	return (0);
+}
+
+static void
+zfs_dio_unpin(zfs_dio_t *dio, boolean_t dirty)
+{
+	abd_put(dio->zd_abd);
+	uio_put_user_pages(dio->zd_pages, dio->zd_npages, dirty);
+	vmem_free(dio->zd_pages, dio->zd_maxpages * sizeof (struct page *));
+}
+
 /*
  * Read bytes from specified file into supplied buffer.
  *
@@ -536,8 +586,23 @@ zfs_read(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 	while (n > 0) {
 		ssize_t nbytes = MIN(n, zfs_read_chunk_size -
 		    P2PHASE(uio->uio_loffset, zfs_read_chunk_size));
-
-		if (zp->z_is_mapped && !(ioflag & O_DIRECT)) {
+		zfs_dio_t dio;
+
+		if ((ioflag & O_DIRECT) && zfs_dio_enabled &&
+		    !zp->z_is_mapped &&
+		    P2PHASE(uio->uio_loffset, PAGESIZE) == 0 &&
+		    zfs_dio_pin(&dio, uio, nbytes, UIO_READ) == 0) {
+			dmu_buf_impl_t *db =
+			    (dmu_buf_impl_t *)sa_get_db(zp->z_sa_hdl);
+
+			DB_DNODE_ENTER(db);
+			error = dmu_read_abd(DB_DNODE(db), uio->uio_loffset,
+			    nbytes, dio.zd_abd);
+			DB_DNODE_EXIT(db);
+			zfs_dio_unpin(&dio, error == 0);
+			if (error == 0)
+				uioskip(uio, nbytes);
+		} else if (zp->z_is_mapped && !(ioflag & O_DIRECT)) {
 			error = mappedread(ip, nbytes, uio);
 		} else {
 			error = dmu_read_uio_dbuf(sa_get_db(zp->z_sa_hdl),
@@ -734,6 +799,9 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 
 		arc_buf_t *abuf = NULL;
 		const iovec_t *aiov = NULL;
+		ssize_t dio_bytes = P2ALIGN(MIN(n, SPA_MAXBLOCKSIZE), max_blksz);
+		boolean_t dio = B_FALSE;
+		zfs_dio_t zd;
 		if (xuio) {
 #ifdef HAVE_UIO_ZEROCOPY
 			ASSERT(i_iov < iovcnt);
@@ -746,6 +814,17 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 			    aiov->iov_len == arc_buf_size(abuf)));
 			i_iov++;
 #endif
+		} else if ((ioflag & O_DIRECT) && zfs_dio_enabled &&
+		    !zp->z_is_mapped && dio_bytes > 0 &&
+		    P2PHASE(woff, max_blksz) == 0 &&
+		    zp->z_blksz == max_blksz && lr->lr_length != UINT64_MAX &&
+		    zfs_dio_pin(&zd, uio, dio_bytes, UIO_WRITE) == 0) {
+			/*
+			 * Whole, aligned blocks are written by Direct I/O
+			 * straight from the caller's pages, which are pinned
+			 * now so that we cannot fault with the tx open.
+			 */
+			dio = B_TRUE;
 		} else if (n >= max_blksz && woff >= zp->z_size &&
 		    P2PHASE(woff, max_blksz) == 0 &&
 		    zp->z_blksz == max_blksz) {
@@ -778,7 +857,7 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 		dmu_buf_impl_t *db = (dmu_buf_impl_t *)sa_get_db(zp->z_sa_hdl);
 		DB_DNODE_ENTER(db);
 		dmu_tx_hold_write_by_dnode(tx, DB_DNODE(db), woff,
-		    MIN(n, max_blksz));
+		    dio ? dio_bytes : MIN(n, max_blksz));
 		DB_DNODE_EXIT(db);
 		zfs_sa_upgrade_txholds(tx, zp);
 		error = dmu_tx_assign(tx, TXG_WAIT);
@@ -786,6 +865,8 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 			dmu_tx_abort(tx);
 			if (abuf != NULL)
 				dmu_return_arcbuf(abuf);
+			if (dio)
+				zfs_dio_unpin(&zd, B_FALSE);
 			break;
 		}
 
@@ -821,7 +902,19 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 		ssize_t nbytes = MIN(n, max_blksz - P2PHASE(woff, max_blksz));
 
 		ssize_t tx_bytes;
-		if (abuf == NULL) {
+		if (dio) {
+			DB_DNODE_ENTER(db);
+			error = dmu_write_abd(DB_DNODE(db), woff, dio_bytes,
+			    zd.zd_abd, tx);
+			DB_DNODE_EXIT(db);
+			zfs_dio_unpin(&zd, B_FALSE);
+			if (error != 0) {
+				dmu_tx_commit(tx);
+				break;
+			}
+			tx_bytes = nbytes = dio_bytes;
+			uioskip(uio, tx_bytes);
+		} else if (abuf == NULL) {
 			tx_bytes = uio->uio_resid;
 			uio->uio_fault_disable = B_TRUE;
 			error = dmu_write_uio_dbuf(sa_get_db(zp->z_sa_hdl),
@@ -932,8 +1025,8 @@ zfs_write(struct inode *ip, uio_t *uio, int ioflag, cred_t *cr)
 
 		error = sa_bulk_update(zp->z_sa_hdl, bulk, count, tx);
 
-		zfs_log_write(zilog, tx, TX_WRITE, zp, woff, tx_bytes, ioflag,
-		    NULL, NULL);
+		zfs_log_write(zilog, tx, TX_WRITE, zp, woff, tx_bytes,
+		    dio ? ioflag : ioflag & ~O_DIRECT, NULL, NULL);
 		dmu_tx_commit(tx);
 
 		if (error != 0)
@@ -5269,6 +5362,9 @@ module_param(zfs_delete_blocks, ulong, 0644);
 MODULE_PARM_DESC(zfs_delete_blocks, "Delete files larger than N blocks async");
 module_param(zfs_read_chunk_size, ulong, 0644);
 MODULE_PARM_DESC(zfs_read_chunk_size, "Bytes to read per chunk");
+
+module_param(zfs_dio_enabled, int, 0644);
+MODULE_PARM_DESC(zfs_dio_enabled, "Bypass the ARC for aligned O_DIRECT I/O");
 /* END CSTYLED */
 
 #endif
@@ -1431,11 +1431,13 @@ uint64_t zil_block_buckets[] = {
 int zil_maxblocksize = SPA_OLD_MAXBLOCKSIZE;
 
 /*
- * Start a log block write and advance to the next log block.
- * Calls are serialized.
+ * Finish a log block and advance to the next log block.  Calls are
+ * serialized by the zl_issuer_lock.  The lwb is added to "ilwbs" and its
+ * zios are not started until zil_lwb_write_start() is called on that
+ * list, which callers do after dropping the zl_issuer_lock.
  */
 static lwb_t *
-zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
+zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb, list_t *ilwbs)
 {
 	lwb_t *nlwb = NULL;
 	zil_chain_t *zilc;
@@ -1554,11 +1556,8 @@ zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
 	spa_config_enter(zilog->zl_spa, SCL_STATE, lwb, RW_READER);
 
 	zil_lwb_add_block(lwb, &lwb->lwb_blk);
-	lwb->lwb_issued_timestamp = gethrtime();
 	lwb->lwb_state = LWB_STATE_ISSUED;
-
-	zio_nowait(lwb->lwb_root_zio);
-	zio_nowait(lwb->lwb_write_zio);
+	list_insert_tail(ilwbs, lwb);
 
 	/*
 	 * If there was an allocation failure then nlwb will be null which
@@ -1567,6 +1566,26 @@ zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
 	return (nlwb);
 }
 
+/*
+ * Start the zios of the lwbs queued by zil_lwb_write_issue().  The
+ * ordering of lwb completions was already established by the zio
+ * dependencies set up in zil_lwb_set_zio_dependency(), so the lwbs may be
+ * started without holding the zl_issuer_lock, concurrently with other
+ * threads issuing later lwbs of the same log.
+ */
+static void
+zil_lwb_write_start(list_t *ilwbs)
+{
+	lwb_t *lwb;
+
+	while ((lwb = list_remove_head(ilwbs)) != NULL) {
+		ASSERT3S(lwb->lwb_state, ==, LWB_STATE_ISSUED);
+		lwb->lwb_issued_timestamp = gethrtime();
+		zio_nowait(lwb->lwb_root_zio);
+		zio_nowait(lwb->lwb_write_zio);
+	}
+}
+
 /*
  * Maximum amount of write data that can be put into single log block.
  */
@@ -1602,7 +1621,7 @@ zil_max_copied_data(zilog_t *zilog)
 }
 
 static lwb_t *
-zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
+zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb, list_t *ilwbs)
 {
 	lr_t *lrcb, *lrc;
 	lr_write_t *lrwb, *lrw;
@@ -1661,7 +1680,7 @@ cont:
 	    lwb_sp < zil_max_waste_space(zilog) &&
 	    (dlen % max_log_data == 0 ||
 	    lwb_sp < reclen + dlen % max_log_data))) {
-		lwb = zil_lwb_write_issue(zilog, lwb);
+		lwb = zil_lwb_write_issue(zilog, lwb, ilwbs);
 		if (lwb == NULL)
 			return (NULL);
 		zil_lwb_write_open(zilog, lwb);
@@ -2234,7 +2253,7 @@ zil_commit_writer_stall(zilog_t *zilog)
  * lwb will be issued to the zio layer to be written to disk.
  */
 static void
-zil_process_commit_list(zilog_t *zilog)
+zil_process_commit_list(zilog_t *zilog, list_t *ilwbs)
 {
 	spa_t *spa = zilog->zl_spa;
 	list_t nolwb_itxs;
@@ -2329,7 +2348,7 @@ zil_process_commit_list(zilog_t *zilog)
 		 */
 		if (frozen || !synced || lrc->lrc_txtype == TX_COMMIT) {
 			if (lwb != NULL) {
-				lwb = zil_lwb_commit(zilog, itx, lwb);
+				lwb = zil_lwb_commit(zilog, itx, lwb, ilwbs);
 
 				if (lwb == NULL)
 					list_insert_tail(&nolwb_itxs, itx);
@@ -2355,7 +2374,11 @@ zil_process_commit_list(zilog_t *zilog)
 		 * "next" lwb on-disk. When this happens, we must stall
 		 * the ZIL write pipeline; see the comment within
 		 * zil_commit_writer_stall() for more details.
+		 *
+		 * The lwbs issued so far must be started first, as
+		 * the txg cannot sync until their writes complete.
 		 */
+		zil_lwb_write_start(ilwbs);
 		zil_commit_writer_stall(zilog);
 
 		/*
@@ -2449,13 +2472,23 @@ zil_process_commit_list(zilog_t *zilog)
  * have been issued by the time this function completes. If the lwb is
  * not issued, we rely on future calls to zil_commit_writer() to issue
  * the lwb, or the timeout mechanism found in zil_commit_waiter().
+ *
+ * Any lwbs that fill up while processing the queue are issued under the
+ * "zl_issuer_lock", but their zios are only started once the lock has
+ * been dropped. With many threads committing to the same zilog, this
+ * lets the next writer fill and issue the following lwb while this
+ * thread is still checksumming and submitting the previous ones, which
+ * keeps several lwb writes in flight to the log devices.
  */
 static void
 zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
 {
+	list_t ilwbs;
+
 	ASSERT(!MUTEX_HELD(&zilog->zl_lock));
 	ASSERT(spa_writeable(zilog->zl_spa));
 
+	list_create(&ilwbs, sizeof (lwb_t), offsetof(lwb_t, lwb_issue_node));
 	mutex_enter(&zilog->zl_issuer_lock);
 
 	if (zcw->zcw_lwb != NULL || zcw->zcw_done) {
@@ -2482,15 +2515,19 @@ zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
 
 	zil_get_commit_list(zilog);
 	zil_prune_commit_list(zilog);
-	zil_process_commit_list(zilog);
+	zil_process_commit_list(zilog, &ilwbs);
 
 out:
 	mutex_exit(&zilog->zl_issuer_lock);
+	zil_lwb_write_start(&ilwbs);
+	list_destroy(&ilwbs);
 }
 
 static void
 zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
 {
+	list_t ilwbs;
+
 	ASSERT(!MUTEX_HELD(&zilog->zl_issuer_lock));
 	ASSERT(MUTEX_HELD(&zcw->zcw_lock));
 	ASSERT3B(zcw->zcw_done, ==, B_FALSE);
@@ -2518,6 +2555,7 @@ zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
 	 * and those two locks are acquired in the opposite order
 	 * elsewhere.
 	 */
+	list_create(&ilwbs, sizeof (lwb_t), offsetof(lwb_t, lwb_issue_node));
 	mutex_exit(&zcw->zcw_lock);
 	mutex_enter(&zilog->zl_issuer_lock);
 	mutex_enter(&zcw->zcw_lock);
@@ -2568,7 +2606,7 @@ zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
 	 * since we've reached the commit waiter's timeout and it still
 	 * hasn't been issued.
 	 */
-	lwb_t *nlwb = zil_lwb_write_issue(zilog, lwb);
+	lwb_t *nlwb = zil_lwb_write_issue(zilog, lwb, &ilwbs);
 
 	IMPLY(nlwb != NULL, lwb->lwb_state != LWB_STATE_OPENED);
 
@@ -2610,12 +2648,15 @@ zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
 		 *   lock, which occurs prior to calling dmu_tx_commit()
 		 */
 		mutex_exit(&zcw->zcw_lock);
+		zil_lwb_write_start(&ilwbs);
 		zil_commit_writer_stall(zilog);
 		mutex_enter(&zcw->zcw_lock);
 	}
 
 out:
 	mutex_exit(&zilog->zl_issuer_lock);
+	zil_lwb_write_start(&ilwbs);
+	list_destroy(&ilwbs);
 	ASSERT(MUTEX_HELD(&zcw->zcw_lock));
 }
 
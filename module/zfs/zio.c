@@ -63,6 +63,7 @@ const char *zio_type_name[ZIO_TYPES] = {
 };
 
 int zio_dva_throttle_enabled = B_TRUE;
+int zio_dva_throttle_adaptive = B_FALSE;
 int zio_deadman_log_all = B_FALSE;
 
 /*
@@ -218,6 +219,7 @@ zio_init(void)
 	zio_inject_init();
 
 	lz4_init();
+	zstd_init();
 }
 
 void
@@ -262,6 +264,7 @@ zio_fini(void)
 	zio_inject_fini();
 
 	lz4_fini();
+	zstd_fini();
 }
 
 /*
@@ -2139,7 +2142,7 @@ zio_nowait(zio_t *zio)
 	ASSERT3P(zio->io_executor, ==, NULL);
 
 	if (zio->io_child_type == ZIO_CHILD_LOGICAL &&
-	    zio_unique_parent(zio) == NULL) {
+	    list_is_empty(&zio->io_parent_list)) {
 		zio_t *pio;
 
 		/*
@@ -3137,6 +3140,22 @@ zio_ddt_child_write_done(zio_t *zio)
 	ddt_exit(ddt);
 }
 
+/*
+ * Returns true if the entry neither references a block on disk nor has a
+ * write in flight, i.e. it was just created by ddt_lookup().
+ */
+static boolean_t
+zio_ddt_entry_unused(const ddt_entry_t *dde)
+{
+	for (int p = 0; p < DDT_PHYS_TYPES; p++) {
+		if (dde->dde_phys[p].ddp_phys_birth != 0 ||
+		    dde->dde_lead_zio[p] != NULL)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
 static zio_t *
 zio_ddt_write(zio_t *zio)
 {
@@ -3182,6 +3201,20 @@ zio_ddt_write(zio_t *zio)
 		return (zio);
 	}
 
+	/*
+	 * Once the dedup table has reached its quota no new entries are
+	 * added to it; the block is written as an ordinary one instead.
+	 * Blocks which match an existing entry are still deduplicated.
+	 */
+	if (zio->io_bp_override == NULL && ddt_over_quota(spa) &&
+	    zio_ddt_entry_unused(dde)) {
+		zp->zp_dedup = B_FALSE;
+		BP_SET_DEDUP(bp, B_FALSE);
+		zio->io_pipeline = ZIO_WRITE_PIPELINE;
+		ddt_exit(ddt);
+		return (zio);
+	}
+
 	if (ddp->ddp_phys_birth != 0 || dde->dde_lead_zio[p] != NULL) {
 		if (ddp->ddp_phys_birth != 0)
 			ddt_bp_fill(ddp, bp, txg);
@@ -3222,7 +3255,7 @@ zio_ddt_free(zio_t *zio)
 	blkptr_t *bp = zio->io_bp;
 	ddt_t *ddt = ddt_select(spa, bp);
 	ddt_entry_t *dde;
-	ddt_phys_t *ddp;
+	ddt_phys_t *ddp = NULL;
 
 	ASSERT(BP_GET_DEDUP(bp));
 	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
@@ -3236,6 +3269,13 @@ zio_ddt_free(zio_t *zio)
 	}
 	ddt_exit(ddt);
 
+	/*
+	 * The entry of this block may have been pruned from the DDT, in
+	 * which case nothing else references it and it is freed directly.
+	 */
+	if (ddp == NULL && spa_feature_is_active(spa, SPA_FEATURE_DDT_PRUNE))
+		zio->io_pipeline |= ZIO_STAGE_DVA_FREE;
+
 	return (zio);
 }
 
@@ -3285,28 +3325,37 @@ zio_dva_throttle(zio_t *zio)
 	mc = spa_preferred_class(spa, zio->io_size, zio->io_prop.zp_type,
 	    zio->io_prop.zp_level, zio->io_prop.zp_zpl_smallblk);
 
-	if (zio->io_priority == ZIO_PRIORITY_SYNC_WRITE ||
-	    !mc->mc_alloc_throttle_enabled ||
-	    zio->io_child_type == ZIO_CHILD_GANG ||
+	if (zio->io_child_type == ZIO_CHILD_GANG ||
 	    zio->io_flags & ZIO_FLAG_NODATA) {
 		return (zio);
 	}
 
-	ASSERT(zio->io_child_type > ZIO_CHILD_GANG);
-
-	ASSERT3U(zio->io_queued_timestamp, >, 0);
-	ASSERT(zio->io_stage == ZIO_STAGE_DVA_THROTTLE);
-
 	zbookmark_phys_t *bm = &zio->io_bookmark;
 	/*
 	 * We want to try to use as many allocators as possible to help improve
 	 * performance, but we also want logically adjacent IOs to be physically
 	 * adjacent to improve sequential read performance. We chunk each object
 	 * into 2^20 block regions, and then hash based on the objset, object,
-	 * level, and region to accomplish both of these goals.
+	 * level, and region to accomplish both of these goals.  Depending on
+	 * spa_allocator_affinity the issuing CPU or NUMA node may take
+	 * precedence over the hash.
 	 */
-	zio->io_allocator = cityhash4(bm->zb_objset, bm->zb_object,
-	    bm->zb_level, bm->zb_blkid >> 20) % spa->spa_alloc_count;
+	zio->io_allocator = spa_select_allocator(spa, cityhash4(bm->zb_objset,
+	    bm->zb_object, bm->zb_level, bm->zb_blkid >> 20));
+
+	/*
+	 * Writes that are not throttled still use the allocator chosen
+	 * above, so that they do not all pile up on allocator 0.
+	 */
+	if (zio->io_priority == ZIO_PRIORITY_SYNC_WRITE ||
+	    !mc->mc_alloc_throttle_enabled)
+		return (zio);
+
+	ASSERT(zio->io_child_type > ZIO_CHILD_GANG);
+
+	ASSERT3U(zio->io_queued_timestamp, >, 0);
+	ASSERT(zio->io_stage == ZIO_STAGE_DVA_THROTTLE);
+
 	mutex_enter(&spa->spa_alloc_locks[zio->io_allocator]);
 	ASSERT(zio->io_type == ZIO_TYPE_WRITE);
 	zio->io_metaslab_class = mc;
@@ -3486,17 +3535,16 @@ zio_alloc_zil(spa_t *spa, objset_t *os, uint64_t txg, blkptr_t *new_bp,
 	 * of, so we just hash the objset ID to pick the allocator to get
 	 * some parallelism.
 	 */
+	int allocator = spa_select_allocator(spa,
+	    cityhash4(0, 0, 0, os->os_dsl_dataset->ds_object));
 	error = metaslab_alloc(spa, spa_log_class(spa), size, new_bp, 1,
-	    txg, NULL, METASLAB_FASTWRITE, &io_alloc_list, NULL,
-	    cityhash4(0, 0, 0, os->os_dsl_dataset->ds_object) %
-	    spa->spa_alloc_count);
+	    txg, NULL, METASLAB_FASTWRITE, &io_alloc_list, NULL, allocator);
 	if (error == 0) {
 		*slog = TRUE;
 	} else {
 		error = metaslab_alloc(spa, spa_normal_class(spa), size,
 		    new_bp, 1, txg, NULL, METASLAB_FASTWRITE,
-		    &io_alloc_list, NULL, cityhash4(0, 0, 0,
-		    os->os_dsl_dataset->ds_object) % spa->spa_alloc_count);
+		    &io_alloc_list, NULL, allocator);
 		if (error == 0)
 			*slog = FALSE;
 	}
@@ -4295,6 +4343,9 @@ zio_dva_throttle_done(zio_t *zio)
 	    pio->io_allocator, B_TRUE);
 	mutex_exit(&pio->io_lock);
 
+	metaslab_group_write_latency_add(vd->vdev_mg,
+	    gethrtime() - zio->io_queued_timestamp);
+
 	metaslab_class_throttle_unreserve(zio->io_metaslab_class, 1,
 	    pio->io_allocator, pio);
 
@@ -4866,6 +4917,10 @@ module_param(zio_dva_throttle_enabled, int, 0644);
 MODULE_PARM_DESC(zio_dva_throttle_enabled,
 	"Throttle block allocations in the ZIO pipeline");
 
+module_param(zio_dva_throttle_adaptive, int, 0644);
+MODULE_PARM_DESC(zio_dva_throttle_adaptive,
+	"Size each vdev's allocation queue depth from its write latency");
+
 module_param(zio_deadman_log_all, int, 0644);
 MODULE_PARM_DESC(zio_deadman_log_all,
 	"Log all slow ZIOs, not just those with vdevs");
@@ -0,0 +1,341 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * zstd compression for ZFS.
+ *
+ * Like gzip, the zstd implementation itself is not part of ZFS.  In the
+ * kernel the zstd library shipped with Linux (4.14 and newer) is used,
+ * in user space the system libzstd is used.  Both produce and consume the
+ * standard zstd frame format so blocks written by one are readable by
+ * the other.
+ *
+ * The on-disk layout of a zstd compressed block is:
+ *
+ *	+-----------------------+-------------------------------+
+ *	| compressed size (BE32)|  zstd frame			|
+ *	+-----------------------+-------------------------------+
+ *
+ * The exact frame size must be recorded because the allocated size of
+ * the block is rounded up to a multiple of 1<<ashift, and zstd refuses
+ * to decode a frame followed by trailing padding.  This mirrors the
+ * header used by lz4_compress_zfs().
+ *
+ * The compression level is encoded in the block pointer's compression
+ * function (zstd-1 .. zstd-19 and zstd-fast-N) the same way gzip-1 ..
+ * gzip-9 are, so no level needs to be stored alongside the data.
+ * Negative levels select the zstd "fast" strategies which trade ratio
+ * for speed; the decoder does not need to know which level was used.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zio_compress.h>
+
+#ifdef _KERNEL
+
+#ifdef HAVE_KERNEL_ZSTD
+#include <linux/zstd.h>
+
+/*
+ * The in-kernel zstd requires the caller to provide all working memory.
+ * Allocating a multi-megabyte workspace for every block is expensive, so
+ * a small pool of workspaces is kept and reused.  When every workspace is
+ * busy a temporary one is allocated and freed after use.
+ */
+typedef struct zstd_workspace {
+	kmutex_t	zw_lock;
+	void		*zw_mem;
+	size_t		zw_size;
+} zstd_workspace_t;
+
+static zstd_workspace_t *zstd_cwork;
+static zstd_workspace_t *zstd_dwork;
+static int zstd_nwork;
+
+static zstd_workspace_t *
+zstd_workspace_get(zstd_workspace_t *pool, size_t size, void **mem)
+{
+	for (int i = 0; i < zstd_nwork; i++) {
+		zstd_workspace_t *zw = &pool[i];
+
+		if (!mutex_tryenter(&zw->zw_lock))
+			continue;
+
+		if (zw->zw_size < size) {
+			if (zw->zw_mem != NULL)
+				vmem_free(zw->zw_mem, zw->zw_size);
+			zw->zw_mem = vmem_alloc(size, KM_SLEEP);
+			zw->zw_size = size;
+		}
+
+		*mem = zw->zw_mem;
+		return (zw);
+	}
+
+	*mem = vmem_alloc(size, KM_SLEEP);
+	return (NULL);
+}
+
+static void
+zstd_workspace_put(zstd_workspace_t *zw, void *mem, size_t size)
+{
+	if (zw == NULL)
+		vmem_free(mem, size);
+	else
+		mutex_exit(&zw->zw_lock);
+}
+
+static void
+zstd_workspace_destroy(zstd_workspace_t *pool)
+{
+	for (int i = 0; i < zstd_nwork; i++) {
+		zstd_workspace_t *zw = &pool[i];
+
+		if (zw->zw_mem != NULL)
+			vmem_free(zw->zw_mem, zw->zw_size);
+		mutex_destroy(&zw->zw_lock);
+	}
+	kmem_free(pool, sizeof (zstd_workspace_t) * zstd_nwork);
+}
+
+static size_t
+zstd_compress_buf(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int level)
+{
+	ZSTD_parameters params;
+	ZSTD_CCtx *cctx;
+	zstd_workspace_t *zw;
+	size_t wsize, c_len;
+	void *mem;
+
+	/*
+	 * The kernel's zstd predates the negative "fast" levels.  Those
+	 * are purely an encoder setting, so use the fastest level it does
+	 * support; the resulting frames are identical in format.
+	 */
+	level = MIN(MAX(level, 1), ZSTD_maxCLevel());
+
+	params = ZSTD_getParams(level, s_len, 0);
+	wsize = ZSTD_CCtxWorkspaceBound(params.cParams);
+	zw = zstd_workspace_get(zstd_cwork, wsize, &mem);
+
+	cctx = ZSTD_initCCtx(mem, wsize);
+	if (cctx == NULL)
+		c_len = (size_t)-1;
+	else
+		c_len = ZSTD_compressCCtx(cctx, d_start, d_len, s_start,
+		    s_len, params);
+
+	zstd_workspace_put(zw, mem, wsize);
+
+	if (cctx == NULL || ZSTD_isError(c_len))
+		return (0);
+
+	return (c_len);
+}
+
+static int
+zstd_decompress_buf(void *s_start, void *d_start, size_t s_len, size_t d_len)
+{
+	ZSTD_DCtx *dctx;
+	zstd_workspace_t *zw;
+	size_t wsize, len;
+	void *mem;
+
+	wsize = ZSTD_DCtxWorkspaceBound();
+	zw = zstd_workspace_get(zstd_dwork, wsize, &mem);
+
+	dctx = ZSTD_initDCtx(mem, wsize);
+	if (dctx == NULL)
+		len = (size_t)-1;
+	else
+		len = ZSTD_decompressDCtx(dctx, d_start, d_len, s_start, s_len);
+
+	zstd_workspace_put(zw, mem, wsize);
+
+	if (dctx == NULL || ZSTD_isError(len) || len != d_len)
+		return (-1);
+
+	return (0);
+}
+
+void
+zstd_init(void)
+{
+	zstd_nwork = MAX(boot_ncpus, 1);
+	zstd_cwork = kmem_zalloc(sizeof (zstd_workspace_t) * zstd_nwork,
+	    KM_SLEEP);
+	zstd_dwork = kmem_zalloc(sizeof (zstd_workspace_t) * zstd_nwork,
+	    KM_SLEEP);
+
+	for (int i = 0; i < zstd_nwork; i++) {
+		mutex_init(&zstd_cwork[i].zw_lock, NULL, MUTEX_DEFAULT, NULL);
+		mutex_init(&zstd_dwork[i].zw_lock, NULL, MUTEX_DEFAULT, NULL);
+	}
+}
+
+void
+zstd_fini(void)
+{
+	zstd_workspace_destroy(zstd_cwork);
+	zstd_workspace_destroy(zstd_dwork);
+	zstd_cwork = zstd_dwork = NULL;
+	zstd_nwork = 0;
+}
+
+boolean_t
+zstd_available(void)
+{
+	return (B_TRUE);
+}
+
+#else /* HAVE_KERNEL_ZSTD */
+
+/*
+ * Built against a kernel without zstd.  Setting compression=zstd is
+ * refused by zfs_check_settable() and existing zstd blocks can not be
+ * decompressed.
+ */
+
+/*ARGSUSED*/
+static size_t
+zstd_compress_buf(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int level)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+static int
+zstd_decompress_buf(void *s_start, void *d_start, size_t s_len, size_t d_len)
+{
+	return (-1);
+}
+
+void
+zstd_init(void)
+{
+}
+
+void
+zstd_fini(void)
+{
+}
+
+boolean_t
+zstd_available(void)
+{
+	return (B_FALSE);
+}
+
+#endif /* HAVE_KERNEL_ZSTD */
+
+#else /* _KERNEL */
+
+#include <zstd.h>
+
+static size_t
+zstd_compress_buf(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int level)
+{
+	size_t c_len;
+
+	c_len = ZSTD_compress(d_start, d_len, s_start, s_len, level);
+	if (ZSTD_isError(c_len))
+		return (0);
+
+	return (c_len);
+}
+
+static int
+zstd_decompress_buf(void *s_start, void *d_start, size_t s_len, size_t d_len)
+{
+	size_t len;
+
+	len = ZSTD_decompress(d_start, d_len, s_start, s_len);
+	if (ZSTD_isError(len) || len != d_len)
+		return (-1);
+
+	return (0);
+}
+
+void
+zstd_init(void)
+{
+}
+
+void
+zstd_fini(void)
+{
+}
+
+boolean_t
+zstd_available(void)
+{
+	return (B_TRUE);
+}
+
+#endif /* _KERNEL */
+
+size_t
+zstd_compress(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int level)
+{
+	uint32_t bufsiz;
+	char *dest = d_start;
+
+	ASSERT(d_len <= s_len);
+
+	if (d_len <= sizeof (bufsiz))
+		return (s_len);
+
+	bufsiz = zstd_compress_buf(s_start, &dest[sizeof (bufsiz)], s_len,
+	    d_len - sizeof (bufsiz), level);
+
+	/* Signal an error if the compression routine returned zero. */
+	if (bufsiz == 0)
+		return (s_len);
+
+	*(uint32_t *)dest = BE_32(bufsiz);
+
+	return (bufsiz + sizeof (bufsiz));
+}
+
+/*ARGSUSED*/
+int
+zstd_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int level)
+{
+	const char *src = s_start;
+	uint32_t bufsiz;
+
+	if (s_len < sizeof (bufsiz))
+		return (-1);
+
+	bufsiz = BE_IN32(src);
+
+	/* Invalid compressed buffer size encoded at start */
+	if (bufsiz + sizeof (bufsiz) > s_len)
+		return (-1);
+
+	return (zstd_decompress_buf((void *)&src[sizeof (bufsiz)], d_start,
+	    bufsiz, d_len));
+}
@@ -296,6 +296,19 @@ test_pool_discard_checkpoint(const char *pool)
 		    NULL, 0);
 }
 
+static void
+test_ddt_prune(const char *pool)
+{
+	nvlist_t *required = fnvlist_alloc();
+
+	fnvlist_add_uint64(required, DDT_PRUNE_UNIT, ZPOOL_DDT_PRUNE_AGE);
+	fnvlist_add_uint64(required, DDT_PRUNE_AMOUNT, 365);
+
+	IOC_INPUT_TEST(ZFS_IOC_DDT_PRUNE, pool, required, NULL, 0);
+
+	nvlist_free(required);
+}
+
 static void
 test_log_history(const char *pool)
 {
@@ -765,6 +778,7 @@ zfs_ioc_input_tests(const char *pool)
 	test_pool_reopen(pool);
 	test_pool_checkpoint(pool);
 	test_pool_discard_checkpoint(pool);
+	test_ddt_prune(pool);
 	test_log_history(pool);
 
 	test_create(dataset);
@@ -946,6 +960,7 @@ validate_ioc_values(void)
 	    ZFS_IOC_BASE + 80 == ZFS_IOC_POOL_TRIM &&
 	    ZFS_IOC_BASE + 81 == ZFS_IOC_REDACT &&
 	    ZFS_IOC_BASE + 82 == ZFS_IOC_GET_BOOKMARK_PROPS &&
+	    ZFS_IOC_BASE + 83 == ZFS_IOC_DDT_PRUNE &&
 	    LINUX_IOC_BASE + 1 == ZFS_IOC_EVENTS_NEXT &&
 	    LINUX_IOC_BASE + 2 == ZFS_IOC_EVENTS_CLEAR &&
 	    LINUX_IOC_BASE + 3 == ZFS_IOC_EVENTS_SEEK);
@@ -0,0 +1,345 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * This is just to keep the compiler happy about sys/time.h not declaring
+ * gettimeofday due to -D_KERNEL (we can do this since we're actually
+ * running in userspace, but we need -D_KERNEL for the remaining BLAKE3 code).
+ */
+#ifdef	_KERNEL
+#undef	_KERNEL
+#endif
+
+#include <sys/blake3.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <stdio.h>
+#include <sys/time.h>
+#define	NOTE(x)
+
+typedef	enum boolean { B_FALSE, B_TRUE } boolean_t;
+typedef	unsigned long long	u_longlong_t;
+
+/*
+ * BLAKE3 test suite using a subset of the official test vectors found at:
+ * https://github.com/BLAKE3-team/BLAKE3/blob/master/test_vectors
+ *
+ * Each input consists of the repeating byte sequence 0, 1, ..., 250 of the
+ * given length.  The lengths exercise partial blocks, partial and whole
+ * chunks, and inputs large enough to be split across several batches of
+ * chunks handed to the SIMD implementations.
+ */
+const size_t	test_lens[] = {
+	0, 1, 63, 64, 65, 1023, 1024, 1025, 2049, 3073, 8193, 31744, 102400
+};
+
+#define	TEST_COUNT	(sizeof (test_lens) / sizeof (test_lens[0]))
+#define	TEST_MAX_LEN	102400
+
+const uint8_t	test_key[BLAKE3_KEY_LEN] = "whats the Elvish word for friend";
+
+const uint8_t	blake3_test_digests[][BLAKE3_OUT_LEN] = {
+	{
+		/* 0 bytes */
+		0xAF, 0x13, 0x49, 0xB9, 0xF5, 0xF9, 0xA1, 0xA6,
+		0xA0, 0x40, 0x4D, 0xEA, 0x36, 0xDC, 0xC9, 0x49,
+		0x9B, 0xCB, 0x25, 0xC9, 0xAD, 0xC1, 0x12, 0xB7,
+		0xCC, 0x9A, 0x93, 0xCA, 0xE4, 0x1F, 0x32, 0x62
+	},
+	{
+		/* 1 bytes */
+		0x2D, 0x3A, 0xDE, 0xDF, 0xF1, 0x1B, 0x61, 0xF1,
+		0x4C, 0x88, 0x6E, 0x35, 0xAF, 0xA0, 0x36, 0x73,
+		0x6D, 0xCD, 0x87, 0xA7, 0x4D, 0x27, 0xB5, 0xC1,
+		0x51, 0x02, 0x25, 0xD0, 0xF5, 0x92, 0xE2, 0x13
+	},
+	{
+		/* 63 bytes */
+		0xE9, 0xBC, 0x37, 0xA5, 0x94, 0xDA, 0xAD, 0x83,
+		0xBE, 0x94, 0x70, 0xDF, 0x7F, 0x7B, 0x37, 0x98,
+		0x29, 0x7C, 0x3D, 0x83, 0x4C, 0xE8, 0x0B, 0xA8,
+		0x5D, 0x6E, 0x20, 0x76, 0x27, 0xB7, 0xDB, 0x7B
+	},
+	{
+		/* 64 bytes */
+		0x4E, 0xED, 0x71, 0x41, 0xEA, 0x4A, 0x5C, 0xD4,
+		0xB7, 0x88, 0x60, 0x6B, 0xD2, 0x3F, 0x46, 0xE2,
+		0x12, 0xAF, 0x9C, 0xAC, 0xEB, 0xAC, 0xDC, 0x7D,
+		0x1F, 0x4C, 0x6D, 0xC7, 0xF2, 0x51, 0x1B, 0x98
+	},
+	{
+		/* 65 bytes */
+		0xDE, 0x1E, 0x5F, 0xA0, 0xBE, 0x70, 0xDF, 0x6D,
+		0x2B, 0xE8, 0xFF, 0xFD, 0x0E, 0x99, 0xCE, 0xAA,
+		0x8E, 0xB6, 0xE8, 0xC9, 0x3A, 0x63, 0xF2, 0xD8,
+		0xD1, 0xC3, 0x0E, 0xCB, 0x6B, 0x26, 0x3D, 0xEE
+	},
+	{
+		/* 1023 bytes */
+		0x10, 0x10, 0x89, 0x70, 0xEE, 0xDA, 0x3E, 0xB9,
+		0x32, 0xBA, 0xAC, 0x14, 0x28, 0xC7, 0xA2, 0x16,
+		0x3B, 0x0E, 0x92, 0x4C, 0x9A, 0x9E, 0x25, 0xB3,
+		0x5B, 0xBA, 0x72, 0xB2, 0x8F, 0x70, 0xBD, 0x11
+	},
+	{
+		/* 1024 bytes */
+		0x42, 0x21, 0x47, 0x39, 0xF0, 0x95, 0xA4, 0x06,
+		0xF3, 0xFC, 0x83, 0xDE, 0xB8, 0x89, 0x74, 0x4A,
+		0xC0, 0x0D, 0xF8, 0x31, 0xC1, 0x0D, 0xAA, 0x55,
+		0x18, 0x9B, 0x5D, 0x12, 0x1C, 0x85, 0x5A, 0xF7
+	},
+	{
+		/* 1025 bytes */
+		0xD0, 0x02, 0x78, 0xAE, 0x47, 0xEB, 0x27, 0xB3,
+		0x4F, 0xAE, 0xCF, 0x67, 0xB4, 0xFE, 0x26, 0x3F,
+		0x82, 0xD5, 0x41, 0x29, 0x16, 0xC1, 0xFF, 0xD9,
+		0x7C, 0x8C, 0xB7, 0xFB, 0x81, 0x4B, 0x84, 0x44
+	},
+	{
+		/* 2049 bytes */
+		0x5F, 0x4D, 0x72, 0xF4, 0x0D, 0x7A, 0x5F, 0x82,
+		0xB1, 0x5C, 0xA2, 0xB2, 0xE4, 0x4B, 0x1D, 0xE3,
+		0xC2, 0xEF, 0x86, 0xC4, 0x26, 0xC9, 0x5C, 0x1A,
+		0xF0, 0xB6, 0x87, 0x95, 0x22, 0x56, 0x30, 0x30
+	},
+	{
+		/* 3073 bytes */
+		0x71, 0x24, 0xB4, 0x95, 0x01, 0x01, 0x2F, 0x81,
+		0xCC, 0x7F, 0x11, 0xCA, 0x06, 0x9E, 0xC9, 0x22,
+		0x6C, 0xEC, 0xB8, 0xA2, 0xC8, 0x50, 0xCF, 0xE6,
+		0x44, 0xE3, 0x27, 0xD2, 0x2D, 0x3E, 0x1C, 0xD3
+	},
+	{
+		/* 8193 bytes */
+		0xBA, 0xB6, 0xC0, 0x9C, 0xB8, 0xCE, 0x8C, 0xF4,
+		0x59, 0x26, 0x13, 0x98, 0xD2, 0xE7, 0xAE, 0xF3,
+		0x57, 0x00, 0xBF, 0x48, 0x81, 0x16, 0xCE, 0xB9,
+		0x4A, 0x36, 0xD0, 0xF5, 0xF1, 0xB7, 0xBC, 0x3B
+	},
+	{
+		/* 31744 bytes */
+		0x62, 0xB6, 0x96, 0x0E, 0x1A, 0x44, 0xBC, 0xC1,
+		0xEB, 0x1A, 0x61, 0x1A, 0x8D, 0x62, 0x35, 0xB6,
+		0xB4, 0xB7, 0x8F, 0x32, 0xE7, 0xAB, 0xC4, 0xFB,
+		0x4C, 0x6C, 0xDC, 0xCE, 0x94, 0x89, 0x5C, 0x47
+	},
+	{
+		/* 102400 bytes */
+		0xBC, 0x3E, 0x3D, 0x41, 0xA1, 0x14, 0x6B, 0x06,
+		0x9A, 0xBF, 0xFA, 0xD3, 0xC0, 0xD4, 0x48, 0x60,
+		0xCF, 0x66, 0x43, 0x90, 0xAF, 0xCE, 0x4D, 0x96,
+		0x61, 0xF7, 0x90, 0x2E, 0x79, 0x43, 0xE0, 0x85
+	}
+};
+
+const uint8_t	blake3_keyed_test_digests[][BLAKE3_OUT_LEN] = {
+	{
+		/* 0 bytes */
+		0x92, 0xB2, 0xB7, 0x56, 0x04, 0xED, 0x3C, 0x76,
+		0x1F, 0x9D, 0x6F, 0x62, 0x39, 0x2C, 0x8A, 0x92,
+		0x27, 0xAD, 0x0E, 0xA3, 0xF0, 0x95, 0x73, 0xE7,
+		0x83, 0xF1, 0x49, 0x8A, 0x4E, 0xD6, 0x0D, 0x26
+	},
+	{
+		/* 1 bytes */
+		0x6D, 0x78, 0x78, 0xDF, 0xFF, 0x2F, 0x48, 0x56,
+		0x35, 0xD3, 0x90, 0x13, 0x27, 0x8A, 0xE1, 0x4F,
+		0x14, 0x54, 0xB8, 0xC0, 0xA3, 0xA2, 0xD3, 0x4B,
+		0xC1, 0xAB, 0x38, 0x22, 0x8A, 0x80, 0xC9, 0x5B
+	},
+	{
+		/* 63 bytes */
+		0xBB, 0x1E, 0xB5, 0xD4, 0xAF, 0xA7, 0x93, 0xC1,
+		0xEB, 0xDD, 0x9F, 0xB0, 0x8D, 0xEF, 0x6C, 0x36,
+		0xD1, 0x00, 0x96, 0x98, 0x6A, 0xE0, 0xCF, 0xE1,
+		0x48, 0xCD, 0x10, 0x11, 0x70, 0xCE, 0x37, 0xAE
+	},
+	{
+		/* 64 bytes */
+		0xBA, 0x8C, 0xED, 0x36, 0xF3, 0x27, 0x70, 0x0D,
+		0x21, 0x3F, 0x12, 0x0B, 0x1A, 0x20, 0x7A, 0x3B,
+		0x8C, 0x04, 0x33, 0x05, 0x28, 0x58, 0x6F, 0x41,
+		0x4D, 0x09, 0xF2, 0xF7, 0xD9, 0xCC, 0xB7, 0xE6
+	},
+	{
+		/* 65 bytes */
+		0xC0, 0xA4, 0xED, 0xEF, 0xA2, 0xD2, 0xAC, 0xCB,
+		0x92, 0x77, 0xC3, 0x71, 0xAC, 0x12, 0xFC, 0xDB,
+		0xB5, 0x29, 0x88, 0xA8, 0x6E, 0xDC, 0x54, 0xF0,
+		0x71, 0x6E, 0x15, 0x91, 0xB4, 0x32, 0x6E, 0x72
+	},
+	{
+		/* 1023 bytes */
+		0xC9, 0x51, 0xEC, 0xDF, 0x03, 0x28, 0x8D, 0x0F,
+		0xCC, 0x96, 0xEE, 0x34, 0x13, 0x56, 0x3D, 0x8A,
+		0x6D, 0x35, 0x89, 0x54, 0x7F, 0x2C, 0x2F, 0xB3,
+		0x6D, 0x97, 0x86, 0x47, 0x0F, 0x1B, 0x9D, 0x6E
+	},
+	{
+		/* 1024 bytes */
+		0x75, 0xC4, 0x6F, 0x6F, 0x3D, 0x9E, 0xB4, 0xF5,
+		0x5E, 0xCA, 0xAE, 0xE4, 0x80, 0xDB, 0x73, 0x2E,
+		0x6C, 0x21, 0x05, 0x54, 0x6F, 0x1E, 0x67, 0x50,
+		0x03, 0x68, 0x7C, 0x31, 0x71, 0x9C, 0x7B, 0xA4
+	},
+	{
+		/* 1025 bytes */
+		0x35, 0x7D, 0xC5, 0x5D, 0xE0, 0xC7, 0xE3, 0x82,
+		0xC9, 0x00, 0xFD, 0x6E, 0x32, 0x0A, 0xCC, 0x04,
+		0x14, 0x6B, 0xE0, 0x1D, 0xB6, 0xA8, 0xCE, 0x72,
+		0x10, 0xB7, 0x18, 0x9B, 0xD6, 0x64, 0xEA, 0x69
+	},
+	{
+		/* 2049 bytes */
+		0x9F, 0x29, 0x70, 0x09, 0x02, 0xF7, 0xC8, 0x6E,
+		0x51, 0x4D, 0xDC, 0x4D, 0xF1, 0xE3, 0x04, 0x9F,
+		0x25, 0x8B, 0x24, 0x72, 0xB6, 0xDD, 0x52, 0x67,
+		0xF6, 0x1B, 0xF1, 0x39, 0x83, 0xB7, 0x8D, 0xD5
+	},
+	{
+		/* 3073 bytes */
+		0x68, 0xDE, 0xDE, 0x9B, 0xEF, 0x00, 0xBA, 0x89,
+		0xE4, 0x3F, 0x31, 0xA6, 0x82, 0x5F, 0x4C, 0xF4,
+		0x33, 0x38, 0x9F, 0xED, 0xAE, 0x75, 0xC0, 0x4E,
+		0xE9, 0xF0, 0xCF, 0x16, 0xA4, 0x27, 0xC9, 0x5A
+	},
+	{
+		/* 8193 bytes */
+		0x95, 0x4A, 0x2A, 0x75, 0x42, 0x0C, 0x8D, 0x65,
+		0x47, 0xE3, 0xBA, 0x5B, 0x98, 0xD9, 0x63, 0xE6,
+		0xFA, 0x64, 0x91, 0xAD, 0xDC, 0x8C, 0x02, 0x31,
+		0x89, 0xCC, 0x51, 0x98, 0x21, 0xB4, 0xA1, 0xF5
+	},
+	{
+		/* 31744 bytes */
+		0xEF, 0xA5, 0x3B, 0x38, 0x9A, 0xB6, 0x7C, 0x59,
+		0x3D, 0xBA, 0x62, 0x4D, 0x89, 0x8D, 0x0F, 0x73,
+		0x53, 0xAB, 0x99, 0xE4, 0xAC, 0x9D, 0x42, 0x30,
+		0x2E, 0xE6, 0x4C, 0xBF, 0x99, 0x39, 0xA4, 0x19
+	},
+	{
+		/* 102400 bytes */
+		0x1C, 0x35, 0xD1, 0xA5, 0x81, 0x10, 0x83, 0xFD,
+		0x71, 0x19, 0xF5, 0xD5, 0xD1, 0xBA, 0x02, 0x7B,
+		0x4D, 0x01, 0xC0, 0xC6, 0xC4, 0x9F, 0xB6, 0xFF,
+		0x2C, 0xF7, 0x53, 0x93, 0xEA, 0x5D, 0xB4, 0xA7
+	}
+};
+/*
+ * Implementations to test, unsupported ones are skipped.
+ */
+const char	*test_impls[] = {
+	"generic", "sse41", "avx2", "avx512"
+};
+
+int
+main(int argc, char *argv[])
+{
+	boolean_t	failed = B_FALSE;
+	uint64_t	cpu_mhz = 0;
+	uint8_t		*msg;
+	int		i, j;
+
+	if (argc == 2)
+		cpu_mhz = atoi(argv[1]);
+
+	msg = malloc(TEST_MAX_LEN);
+	if (msg == NULL)
+		return (1);
+	for (i = 0; i < TEST_MAX_LEN; i++)
+		msg[i] = i % 251;
+
+	blake3_impl_init();
+
+#define	BLAKE3_ALGO_TEST(impl, keyed, len, testdigest)			\
+	do {								\
+		BLAKE3_CTX	ctx;					\
+		uint8_t		digest[BLAKE3_OUT_LEN];			\
+		if (keyed)						\
+			Blake3_InitKeyed(&ctx, test_key);		\
+		else							\
+			Blake3_Init(&ctx);				\
+		Blake3_Update(&ctx, msg, len);				\
+		Blake3_Final(&ctx, digest);				\
+		(void) printf("BLAKE3 %-8s%s\tMessage: %6zu bytes"	\
+		    "\tResult: ", impl, keyed ? " keyed" : "",		\
+		    (size_t)len);					\
+		if (bcmp(digest, testdigest, BLAKE3_OUT_LEN) == 0) {	\
+			(void) printf("OK\n");				\
+		} else {						\
+			(void) printf("FAILED!\n");			\
+			failed = B_TRUE;				\
+		}							\
+		NOTE(CONSTCOND)						\
+	} while (0)
+
+#define	BLAKE3_PERF_TEST(impl)						\
+	do {								\
+		BLAKE3_CTX	ctx;					\
+		uint8_t		digest[BLAKE3_OUT_LEN];			\
+		uint8_t		block[131072];				\
+		uint64_t	delta;					\
+		double		cpb = 0;				\
+		int		n;					\
+		struct timeval	start, end;				\
+		bzero(block, sizeof (block));				\
+		(void) gettimeofday(&start, NULL);			\
+		Blake3_Init(&ctx);					\
+		for (n = 0; n < 8192; n++)				\
+			Blake3_Update(&ctx, block, sizeof (block));	\
+		Blake3_Final(&ctx, digest);				\
+		(void) gettimeofday(&end, NULL);			\
+		delta = (end.tv_sec * 1000000llu + end.tv_usec) -	\
+		    (start.tv_sec * 1000000llu + start.tv_usec);	\
+		if (cpu_mhz != 0) {					\
+			cpb = (cpu_mhz * 1e6 * ((double)delta /		\
+			    1000000)) / (8192 * 128 * 1024);		\
+		}							\
+		(void) printf("BLAKE3 %-8s\t%llu us (%.02f CPB)\n",	\
+		    impl, (u_longlong_t)delta, cpb);			\
+		NOTE(CONSTCOND)						\
+	} while (0)
+
+	(void) printf("Running algorithm correctness tests:\n");
+	for (i = 0; i < sizeof (test_impls) / sizeof (test_impls[0]); i++) {
+		if (blake3_impl_set(test_impls[i]) != 0)
+			continue;
+		for (j = 0; j < TEST_COUNT; j++) {
+			BLAKE3_ALGO_TEST(test_impls[i], B_FALSE,
+			    test_lens[j], blake3_test_digests[j]);
+			BLAKE3_ALGO_TEST(test_impls[i], B_TRUE,
+			    test_lens[j], blake3_keyed_test_digests[j]);
+		}
+	}
+	free(msg);
+	if (failed)
+		return (1);
+
+	(void) printf("Running performance tests (hashing 1024 MiB of "
+	    "data):\n");
+	for (i = 0; i < sizeof (test_impls) / sizeof (test_impls[0]); i++) {
+		if (blake3_impl_set(test_impls[i]) != 0)
+			continue;
+		BLAKE3_PERF_TEST(test_impls[i]);
+	}
+
+	return (0);
+}